@@ -0,0 +1,218 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <benchmark/benchmark.h>
+#include <spio/spio.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Global operator new and delete are replaced to count every allocation.
+// Built as a separate executable, so the other benchmarks don't pay
+// for the counting.
+#include "counting_new.h"
+
+namespace {
+    // Counts the allocations made during a benchmark.
+    // Every iteration is expected to perform ops operations.
+    class alloc_counter {
+    public:
+        alloc_counter(benchmark::State& state, std::int64_t ops = 1)
+            : m_state(state),
+              m_ops(ops),
+              m_count(counting_new::allocations()),
+              m_bytes(counting_new::allocated_bytes())
+        {
+        }
+
+        alloc_counter(const alloc_counter&) = delete;
+        alloc_counter& operator=(const alloc_counter&) = delete;
+
+        ~alloc_counter()
+        {
+            const auto ops = static_cast<double>(m_state.iterations()) *
+                             static_cast<double>(m_ops);
+            if (ops == 0) {
+                return;
+            }
+            m_state.counters["Allocs/op"] = static_cast<double>(
+                counting_new::allocations() - m_count) / ops;
+            m_state.counters["AllocBytes/op"] = static_cast<double>(
+                counting_new::allocated_bytes() - m_bytes) / ops;
+        }
+
+    private:
+        benchmark::State& m_state;
+        std::int64_t m_ops;
+        std::uint64_t m_count;
+        std::uint64_t m_bytes;
+    };
+
+    using vector_stream = spio::stream<spio::vector_sink,
+                                       spio::encoding<char>,
+                                       spio::sink_filter_chain>;
+
+    // Unbuffered, like the streams in bench_print.cpp
+    class vector_outstream : public vector_stream {
+    public:
+        explicit vector_outstream(std::vector<spio::byte>& buf)
+            : vector_stream(spio::vector_sink(buf),
+                            input_base{},
+                            output_base{},
+                            chain_type{}),
+              m_buf(std::addressof(buf))
+        {
+            sink_storage() = sink_type(device(), spio::buffer_mode::none);
+        }
+
+        // Empties the output, keeping its capacity
+        void clear()
+        {
+            m_buf->clear();
+            device() = spio::vector_sink(*m_buf);
+        }
+
+    private:
+        std::vector<spio::byte>* m_buf;
+    };
+
+    // Operations are performed in batches, so that the output vector
+    // only needs to be cleared between them
+    const std::int64_t ops_per_iteration = 64;
+}  // namespace
+
+static void alloc_print_stream(benchmark::State& state)
+{
+    std::vector<spio::byte> str;
+    vector_outstream s(str);
+    const std::string text = "text";
+
+    alloc_counter counter(state, ops_per_iteration);
+    for (auto _ : state) {
+        s.clear();
+        for (std::int64_t i = 0; i < ops_per_iteration; ++i) {
+            spio::print(s, "{} {}\n", i, text);
+        }
+        benchmark::DoNotOptimize(str);
+    }
+}
+static void alloc_print_stream_ref(benchmark::State& state)
+{
+    std::vector<spio::byte> str;
+    vector_outstream s(str);
+    spio::basic_stream_ref<spio::encoding<char>, spio::writable_tag> ref(s);
+    const std::string text = "text";
+
+    alloc_counter counter(state, ops_per_iteration);
+    for (auto _ : state) {
+        s.clear();
+        for (std::int64_t i = 0; i < ops_per_iteration; ++i) {
+            spio::print(ref, "{} {}\n", i, text);
+        }
+        benchmark::DoNotOptimize(str);
+    }
+}
+
+static void alloc_write_filtered(benchmark::State& state)
+{
+    std::vector<spio::byte> str;
+    vector_outstream s(str);
+    s.chain().push<spio::null_output_filter>();
+    const std::vector<spio::byte> data(64, static_cast<spio::byte>('a'));
+
+    alloc_counter counter(state, ops_per_iteration);
+    for (auto _ : state) {
+        s.clear();
+        for (std::int64_t i = 0; i < ops_per_iteration; ++i) {
+            spio::write(s, spio::make_span(data));
+        }
+        benchmark::DoNotOptimize(str);
+    }
+}
+
+static void alloc_scan_int(benchmark::State& state)
+{
+    const std::string data = "123456789";
+    spio::memory_instream s(spio::as_bytes(spio::make_span(
+        data.data(), static_cast<std::ptrdiff_t>(data.size()))));
+
+    alloc_counter counter(state);
+    for (auto _ : state) {
+        int value{};
+        spio::scan_at(s, 0, "{}", value);
+        benchmark::DoNotOptimize(value);
+    }
+}
+static void alloc_scan_string(benchmark::State& state)
+{
+    const std::string data = "text";
+    spio::memory_instream s(spio::as_bytes(spio::make_span(
+        data.data(), static_cast<std::ptrdiff_t>(data.size()))));
+    std::array<char, 4> value{};
+
+    alloc_counter counter(state);
+    for (auto _ : state) {
+        auto sp = spio::span<char>(value);
+        spio::scan_at(s, 0, "{}", sp);
+        benchmark::DoNotOptimize(value);
+    }
+}
+
+static void alloc_construct_memory_instream(benchmark::State& state)
+{
+    const std::string data = "text";
+    const auto bytes = spio::as_bytes(spio::make_span(
+        data.data(), static_cast<std::ptrdiff_t>(data.size())));
+
+    alloc_counter counter(state);
+    for (auto _ : state) {
+        spio::memory_instream s(bytes);
+        benchmark::DoNotOptimize(s);
+    }
+}
+static void alloc_construct_vector_outstream(benchmark::State& state)
+{
+    std::vector<spio::byte> str;
+
+    alloc_counter counter(state);
+    for (auto _ : state) {
+        vector_outstream s(str);
+        benchmark::DoNotOptimize(s);
+    }
+}
+static void alloc_construct_stream_ref(benchmark::State& state)
+{
+    std::vector<spio::byte> str;
+    vector_outstream s(str);
+
+    alloc_counter counter(state);
+    for (auto _ : state) {
+        spio::basic_stream_ref<spio::encoding<char>, spio::writable_tag> ref(
+            s);
+        benchmark::DoNotOptimize(ref);
+    }
+}
+
+BENCHMARK(alloc_print_stream);
+BENCHMARK(alloc_print_stream_ref);
+BENCHMARK(alloc_write_filtered);
+BENCHMARK(alloc_scan_int);
+BENCHMARK(alloc_scan_string);
+BENCHMARK(alloc_construct_memory_instream);
+BENCHMARK(alloc_construct_vector_outstream);
+BENCHMARK(alloc_construct_stream_ref);
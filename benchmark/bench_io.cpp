@@ -0,0 +1,515 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <benchmark/benchmark.h>
+#include <spio/spio.h>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if SPIO_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Every benchmark reads or writes the same pre-generated text,
+// in chunks of io_chunk bytes
+static const std::ptrdiff_t io_chunk = 64;
+
+static const std::vector<spio::byte>& corpus()
+{
+    static const auto data = [] {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> dist(' ', '~');
+        std::vector<spio::byte> d(4 << 20);
+        for (std::size_t i = 0; i < d.size(); ++i) {
+            // Lines of 80 characters, for buffer_mode::line
+            d[i] = static_cast<spio::byte>(i % 81 == 80 ? '\n' : dist(rng));
+        }
+        return d;
+    }();
+    return data;
+}
+
+static void set_bytes_counter(benchmark::State& state)
+{
+    state.counters["Bytes"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) *
+            static_cast<double>(corpus().size()),
+        benchmark::Counter::kIsRate, benchmark::Counter::OneK::kIs1024);
+}
+
+// Sequential reads and writes on top of a random-access device
+template <typename Device>
+class sequential_device {
+public:
+    explicit sequential_device(Device& d) : m_dev(std::addressof(d)) {}
+
+    spio::result write(spio::span<const spio::byte> s)
+    {
+        auto r = m_dev->write_at(s, m_pos);
+        m_pos += r.value();
+        return r;
+    }
+    spio::result read(spio::span<spio::byte> s, bool& eof)
+    {
+        auto r = m_dev->read_at(s, m_pos, eof);
+        m_pos += r.value();
+        return r;
+    }
+
+    void rewind()
+    {
+        m_pos = 0;
+    }
+
+private:
+    Device* m_dev;
+    spio::streamoff m_pos{0};
+};
+
+// Targets hand out a device positioned at the start of their contents
+struct vector_target {
+    using writable_type = spio::vector_sink;
+    using readable_type = spio::vector_source;
+
+    bool open()
+    {
+        return true;
+    }
+    writable_type& begin_write()
+    {
+        data.clear();
+        sink = writable_type(data);
+        return sink;
+    }
+    void fill(const std::vector<spio::byte>& d)
+    {
+        data = d;
+    }
+    readable_type& begin_read()
+    {
+        source = readable_type(data);
+        return source;
+    }
+
+    std::vector<spio::byte> data{};
+    writable_type sink{};
+    readable_type source{};
+};
+
+struct chunked_target {
+    using writable_type = spio::chunked_sink;
+    using readable_type = spio::chunked_source;
+
+    bool open()
+    {
+        return true;
+    }
+    writable_type& begin_write()
+    {
+        data.clear();
+        sink = writable_type(data);
+        return sink;
+    }
+    void fill(const std::vector<spio::byte>& d)
+    {
+        data.clear();
+        data.append(d);
+    }
+    readable_type& begin_read()
+    {
+        source = readable_type(data);
+        return source;
+    }
+
+    spio::chunked_buffer data{};
+    writable_type sink{};
+    readable_type source{};
+};
+
+struct memory_target {
+    using writable_type = sequential_device<spio::memory_device>;
+    using readable_type = writable_type;
+
+    bool open()
+    {
+        return true;
+    }
+    writable_type& begin_write()
+    {
+        seq.rewind();
+        return seq;
+    }
+    void fill(const std::vector<spio::byte>& d)
+    {
+        std::copy(d.begin(), d.end(), storage.begin());
+    }
+    readable_type& begin_read()
+    {
+        seq.rewind();
+        return seq;
+    }
+
+    std::vector<spio::byte> storage = std::vector<spio::byte>(corpus().size());
+    spio::memory_device dev{spio::make_span(storage)};
+    writable_type seq{dev};
+};
+
+#if SPIO_POSIX
+// Temporary file, in memory if possible
+static int open_temp_fd()
+{
+    char shm_path[] = "/dev/shm/spio-bench-XXXXXX";
+    char tmp_path[] = "/tmp/spio-bench-XXXXXX";
+    char* path = shm_path;
+    auto fd = ::mkstemp(path);
+    if (fd == -1) {
+        path = tmp_path;
+        fd = ::mkstemp(path);
+    }
+    if (fd != -1) {
+        ::unlink(path);
+    }
+    return fd;
+}
+
+struct fd_file_target {
+    using writable_type = spio::fd_file_device;
+    using readable_type = spio::fd_file_device;
+
+    fd_file_target() = default;
+    fd_file_target(const fd_file_target&) = delete;
+    fd_file_target& operator=(const fd_file_target&) = delete;
+    ~fd_file_target()
+    {
+        if (dev.is_open()) {
+            dev.close();
+        }
+    }
+
+    bool open()
+    {
+        dev = spio::fd_file_device(open_temp_fd());
+        return dev.is_open();
+    }
+    writable_type& begin_write()
+    {
+        dev.seek(0);
+        return dev;
+    }
+    void fill(const std::vector<spio::byte>& d)
+    {
+        begin_write().write(spio::make_span(d));
+    }
+    readable_type& begin_read()
+    {
+        return begin_write();
+    }
+
+    spio::fd_file_device dev{};
+};
+
+// stdio_device can only read a byte at a time,
+// so only buffered writes are measured
+struct stdio_target {
+    using writable_type = spio::stdio_device;
+
+    stdio_target() = default;
+    stdio_target(const stdio_target&) = delete;
+    stdio_target& operator=(const stdio_target&) = delete;
+    ~stdio_target()
+    {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    bool open()
+    {
+        const auto fd = open_temp_fd();
+        if (fd == -1) {
+            return false;
+        }
+        file = ::fdopen(fd, "w+b");
+        if (!file) {
+            ::close(fd);
+            return false;
+        }
+        // Only measure the buffering done by spio
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        dev = spio::stdio_device(file);
+        return true;
+    }
+    writable_type& begin_write()
+    {
+        dev.seek(0, spio::seekdir::beg);
+        return dev;
+    }
+
+    std::FILE* file{nullptr};
+    spio::stdio_device dev{};
+};
+#endif
+
+#if SPIO_USE_LLFIO
+class llfio_sequential_device {
+public:
+    explicit llfio_sequential_device(spio::llfio_file_device& d)
+        : m_dev(std::addressof(d))
+    {
+    }
+
+    spio::result write(spio::span<const spio::byte> s)
+    {
+        spio::span<const spio::byte> bufs[] = {s};
+        auto r = m_dev->vwrite(bufs, m_pos);
+        if (!r) {
+            return spio::make_result(0, r.error());
+        }
+        return _advance(*r);
+    }
+    spio::result read(spio::span<spio::byte> s, bool& eof)
+    {
+        spio::span<spio::byte> bufs[] = {s};
+        auto r = m_dev->vread(bufs, m_pos);
+        if (!r) {
+            return spio::make_result(0, r.error());
+        }
+        auto n = _advance(*r);
+        if (n < s.size()) {
+            eof = true;
+        }
+        return n;
+    }
+
+    void rewind()
+    {
+        m_pos = 0;
+    }
+
+private:
+    template <typename Buffers>
+    spio::streamsize _advance(const Buffers& bufs)
+    {
+        spio::streamsize n = 0;
+        for (auto& b : bufs) {
+            n += b.size();
+        }
+        m_pos += n;
+        return n;
+    }
+
+    spio::llfio_file_device* m_dev;
+    spio::streamoff m_pos{0};
+};
+
+struct llfio_target {
+    using writable_type = llfio_sequential_device;
+    using readable_type = llfio_sequential_device;
+
+    bool open()
+    {
+        auto h = llfio::file_handle::temp_inode();
+        if (!h) {
+            return false;
+        }
+        handle = std::move(h).value();
+        return true;
+    }
+    writable_type& begin_write()
+    {
+        seq.rewind();
+        return seq;
+    }
+    void fill(const std::vector<spio::byte>& d)
+    {
+        begin_write().write(spio::make_span(d));
+    }
+    readable_type& begin_read()
+    {
+        return begin_write();
+    }
+
+    llfio::file_handle handle{};
+    spio::llfio_file_device dev{handle};
+    writable_type seq{dev};
+};
+#endif
+
+template <typename Writable>
+static bool write_chunks(benchmark::State& state, Writable& w)
+{
+    auto data = spio::make_span(corpus());
+    while (!data.empty()) {
+        auto chunk = data.first(std::min(io_chunk, data.size()));
+        // Line buffering stops at newlines
+        while (!chunk.empty()) {
+            auto r = w.write(chunk);
+            if (r.has_error()) {
+                state.SkipWithError(r.error().what());
+                return false;
+            }
+            chunk = chunk.subspan(r.value());
+            data = data.subspan(r.value());
+        }
+    }
+    return true;
+}
+
+template <typename Target>
+static void write_buffered(benchmark::State& state, spio::buffer_mode mode)
+{
+    Target t;
+    if (!t.open()) {
+        state.SkipWithError("Failed to open the target");
+        return;
+    }
+    for (auto _ : state) {
+        spio::basic_buffered_writable<typename Target::writable_type> buf(
+            t.begin_write(), mode, state.range(0));
+        if (!write_chunks(state, buf)) {
+            return;
+        }
+        buf.flush();
+    }
+    set_bytes_counter(state);
+}
+template <typename Target>
+static void write_full(benchmark::State& state)
+{
+    write_buffered<Target>(state, spio::buffer_mode::full);
+}
+template <typename Target>
+static void write_line(benchmark::State& state)
+{
+    write_buffered<Target>(state, spio::buffer_mode::line);
+}
+template <typename Target>
+static void write_unbuffered(benchmark::State& state)
+{
+    Target t;
+    if (!t.open()) {
+        state.SkipWithError("Failed to open the target");
+        return;
+    }
+    for (auto _ : state) {
+        if (!write_chunks(state, t.begin_write())) {
+            return;
+        }
+    }
+    set_bytes_counter(state);
+}
+
+template <typename Readable>
+static bool read_chunks(benchmark::State& state, Readable& r)
+{
+    std::array<spio::byte, io_chunk> buf{};
+    spio::streamsize total = 0;
+    bool eof = false;
+    while (!eof) {
+        auto ret = r.read(spio::make_span(buf), eof);
+        if (ret.has_error() && !eof) {
+            state.SkipWithError(ret.error().what());
+            return false;
+        }
+        benchmark::DoNotOptimize(buf);
+        total += ret.value();
+        if (ret.value() == 0 && !eof) {
+            break;
+        }
+    }
+    if (total != static_cast<spio::streamsize>(corpus().size())) {
+        state.SkipWithError("Short read");
+        return false;
+    }
+    return true;
+}
+
+template <typename Target>
+static void read_buffered(benchmark::State& state)
+{
+    Target t;
+    if (!t.open()) {
+        state.SkipWithError("Failed to open the target");
+        return;
+    }
+    t.fill(corpus());
+    for (auto _ : state) {
+        spio::basic_buffered_readable<typename Target::readable_type> buf(
+            t.begin_read(), state.range(0), state.range(1));
+        if (!read_chunks(state, buf)) {
+            return;
+        }
+    }
+    set_bytes_counter(state);
+}
+template <typename Target>
+static void read_unbuffered(benchmark::State& state)
+{
+    Target t;
+    if (!t.open()) {
+        state.SkipWithError("Failed to open the target");
+        return;
+    }
+    t.fill(corpus());
+    for (auto _ : state) {
+        if (!read_chunks(state, t.begin_read())) {
+            return;
+        }
+    }
+    set_bytes_counter(state);
+}
+
+// Buffer sizes, and read sizes from a quarter of the buffer to all of it
+static void read_args(benchmark::internal::Benchmark* b)
+{
+    for (int64_t size = 4 << 10; size <= 1 << 20; size *= 4) {
+        for (int64_t rs = size / 4; rs <= size; rs *= 2) {
+            b->Args({size, rs});
+        }
+    }
+}
+
+#define SPIO_BENCH_WRITE(target)                                            \
+    BENCHMARK_TEMPLATE(write_full, target)                                  \
+        ->RangeMultiplier(4)                                                \
+        ->Range(1 << 10, 1 << 20);                                          \
+    BENCHMARK_TEMPLATE(write_line, target)                                  \
+        ->RangeMultiplier(4)                                                \
+        ->Range(1 << 10, 1 << 20);                                          \
+    BENCHMARK_TEMPLATE(write_unbuffered, target)
+#define SPIO_BENCH_READ(target)                                             \
+    BENCHMARK_TEMPLATE(read_buffered, target)->Apply(read_args);            \
+    BENCHMARK_TEMPLATE(read_unbuffered, target)
+
+SPIO_BENCH_WRITE(vector_target);
+SPIO_BENCH_WRITE(memory_target);
+SPIO_BENCH_WRITE(chunked_target);
+SPIO_BENCH_READ(vector_target);
+SPIO_BENCH_READ(memory_target);
+SPIO_BENCH_READ(chunked_target);
+#if SPIO_POSIX
+SPIO_BENCH_WRITE(fd_file_target);
+SPIO_BENCH_WRITE(stdio_target);
+SPIO_BENCH_READ(fd_file_target);
+#endif
+#if SPIO_USE_LLFIO
+SPIO_BENCH_WRITE(llfio_target);
+SPIO_BENCH_READ(llfio_target);
+#endif
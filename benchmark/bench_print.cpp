@@ -33,7 +33,8 @@ static std::vector<std::string> generate_data(size_t len)
         'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',  'k',  'l',
         'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',  'w',  'x',
         'y', 'z', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '\n', '\n', '\t'};
-    std::default_random_engine rng(std::random_device{}());
+    // Fixed seed, so that every run measures the same data
+    std::default_random_engine rng(42);
     std::uniform_int_distribution<> dist(0, static_cast<int>(chars.size() - 1));
 
     std::vector<std::string> data;
@@ -52,10 +53,10 @@ static std::vector<std::string> generate_data(size_t len)
 
 static void print_spio_write_device(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<spio::byte> str;
         spio::vector_sink sink{str};
         state.ResumeTiming();
@@ -74,10 +75,10 @@ static void print_spio_write_device(benchmark::State& state)
 }
 static void print_spio_write_stream(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<spio::byte> str;
 
         spio::vector_sink sink{str};
@@ -86,8 +87,8 @@ static void print_spio_write_stream(benchmark::State& state)
                          spio::sink_filter_chain>;
         stream_type s(sink, stream_type::input_base{},
                       stream_type::output_base{}, stream_type::chain_type{});
-        s.sink_storage() = nonstd::make_optional(
-            stream_type::sink_type(sink, spio::buffer_mode::none));
+        s.sink_storage() =
+            stream_type::sink_type(sink, spio::buffer_mode::none);
         spio::basic_stream_ref<spio::encoding<char>, spio::writable_tag> ref(s);
         state.ResumeTiming();
 
@@ -106,10 +107,10 @@ static void print_spio_write_stream(benchmark::State& state)
 }
 static void print_spio_write_stream_ref(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<spio::byte> str;
 
         spio::vector_sink sink{str};
@@ -118,8 +119,8 @@ static void print_spio_write_stream_ref(benchmark::State& state)
                          spio::sink_filter_chain>;
         stream_type s(sink, stream_type::input_base{},
                       stream_type::output_base{}, stream_type::chain_type{});
-        s.sink_storage() = nonstd::make_optional(
-            stream_type::sink_type(sink, spio::buffer_mode::none));
+        s.sink_storage() =
+            stream_type::sink_type(sink, spio::buffer_mode::none);
         spio::basic_stream_ref<spio::encoding<char>, spio::writable_tag> ref(s);
         state.ResumeTiming();
 
@@ -138,10 +139,10 @@ static void print_spio_write_stream_ref(benchmark::State& state)
 }
 static void print_spio_stream(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<spio::byte> str;
 
         spio::vector_sink sink{str};
@@ -150,8 +151,8 @@ static void print_spio_stream(benchmark::State& state)
                          spio::sink_filter_chain>;
         stream_type s(sink, stream_type::input_base{},
                       stream_type::output_base{}, stream_type::chain_type{});
-        s.sink_storage() = nonstd::make_optional(
-            stream_type::sink_type(sink, spio::buffer_mode::none));
+        s.sink_storage() =
+            stream_type::sink_type(sink, spio::buffer_mode::none);
         state.ResumeTiming();
 
         for (auto& n : data) {
@@ -168,10 +169,10 @@ static void print_spio_stream(benchmark::State& state)
 }
 static void print_spio_stream_ref(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<spio::byte> str;
 
         spio::vector_sink sink{str};
@@ -180,8 +181,8 @@ static void print_spio_stream_ref(benchmark::State& state)
                          spio::sink_filter_chain>;
         stream_type s(sink, stream_type::input_base{},
                       stream_type::output_base{}, stream_type::chain_type{});
-        s.sink_storage() = nonstd::make_optional(
-            stream_type::sink_type(sink, spio::buffer_mode::none));
+        s.sink_storage() =
+            stream_type::sink_type(sink, spio::buffer_mode::none);
         spio::basic_stream_ref<spio::encoding<char>, spio::writable_tag> ref(s);
         state.ResumeTiming();
 
@@ -199,10 +200,10 @@ static void print_spio_stream_ref(benchmark::State& state)
 }
 static void print_fmt(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<char> str;
         state.ResumeTiming();
 
@@ -218,10 +219,10 @@ static void print_fmt(benchmark::State& state)
 }
 static void print_insert(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::vector<char> str;
         state.ResumeTiming();
 
@@ -237,10 +238,10 @@ static void print_insert(benchmark::State& state)
 }
 static void print_stringstream(benchmark::State& state)
 {
+    const auto data = generate_data(static_cast<size_t>(state.range(0)));
     size_t bytes = 0;
     for (auto _ : state) {
         state.PauseTiming();
-        auto data = generate_data(static_cast<size_t>(state.range(0)));
         std::ostringstream ss;
         state.ResumeTiming();
 
@@ -0,0 +1,602 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <benchmark/benchmark.h>
+#include <spio/spio.h>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every benchmark scans the same pre-generated records.
+// Records are fixed-width and space-padded, so that they can be scanned
+// with scan_at() at known offsets.
+// Sequential scanning uses the same values separated by single spaces,
+// see squeeze().
+struct corpus {
+    std::string data;
+    std::ptrdiff_t width;
+};
+
+static const std::size_t max_records = 4096;
+
+template <typename Generator>
+static corpus make_corpus(std::ptrdiff_t width, Generator gen)
+{
+    std::mt19937 rng(42);
+    corpus c{{}, width};
+    c.data.reserve(max_records * static_cast<std::size_t>(width));
+    for (std::size_t i = 0; i < max_records; ++i) {
+        auto rec = gen(rng);
+        rec.resize(static_cast<std::size_t>(width), ' ');
+        c.data += rec;
+    }
+    return c;
+}
+
+// The first records of c without their padding, each followed by a space
+static std::string squeeze(const corpus& c, std::ptrdiff_t records)
+{
+    std::string str;
+    for (std::ptrdiff_t i = 0; i < records; ++i) {
+        auto rec = c.data.substr(static_cast<std::size_t>(i * c.width),
+                                 static_cast<std::size_t>(c.width));
+        rec.erase(rec.find_last_not_of(' ') + 1);
+        str += rec;
+        str += ' ';
+    }
+    return str;
+}
+
+struct int_field {
+    using value_type = int;
+
+    static const corpus& data()
+    {
+        static const auto c = make_corpus(16, [](std::mt19937& rng) {
+            std::uniform_int_distribution<int> dist(-1000000, 1000000);
+            return std::to_string(dist(rng));
+        });
+        return c;
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan(Stream& s,
+                                                    spio::streampos pos,
+                                                    value_type& v)
+    {
+        return spio::scan_at(s, pos, "{}", v);
+    }
+    // Consumes the space after the value
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan_next(Stream& s,
+                                                         value_type& v)
+    {
+        return spio::scan(s, "{}", v);
+    }
+    static bool scanf(const char* p, value_type& v)
+    {
+        return std::sscanf(p, "%d", &v) == 1;
+    }
+    static bool strto(const char* p, value_type& v)
+    {
+        char* end;
+        v = static_cast<int>(std::strtol(p, &end, 10));
+        return end != p;
+    }
+    static bool istream(std::istream& is, value_type& v)
+    {
+        return static_cast<bool>(is >> v);
+    }
+};
+
+struct float_field {
+    using value_type = double;
+
+    static const corpus& data()
+    {
+        static const auto c = make_corpus(16, [](std::mt19937& rng) {
+            std::uniform_real_distribution<double> dist(0.0, 10000.0);
+            std::array<char, 32> buf{};
+            std::snprintf(buf.data(), buf.size(), "%.4f", dist(rng));
+            return std::string(buf.data());
+        });
+        return c;
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan(Stream& s,
+                                                    spio::streampos pos,
+                                                    value_type& v)
+    {
+        return spio::scan_at(s, pos, "{}", v);
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan_next(Stream& s,
+                                                         value_type& v)
+    {
+        char sep{};
+        return spio::scan(s, "{}{}", v, sep);
+    }
+    static bool scanf(const char* p, value_type& v)
+    {
+        return std::sscanf(p, "%lf", &v) == 1;
+    }
+    static bool strto(const char* p, value_type& v)
+    {
+        char* end;
+        v = std::strtod(p, &end);
+        return end != p;
+    }
+    static bool istream(std::istream& is, value_type& v)
+    {
+        return static_cast<bool>(is >> v);
+    }
+};
+
+struct bool_field {
+    using value_type = bool;
+
+    static const corpus& data()
+    {
+        static const auto c = make_corpus(8, [](std::mt19937& rng) {
+            return std::string(rng() % 2 == 0 ? "true" : "false");
+        });
+        return c;
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan(Stream& s,
+                                                    spio::streampos pos,
+                                                    value_type& v)
+    {
+        return spio::scan_at(s, pos, "{}", v);
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan_next(Stream& s,
+                                                         value_type& v)
+    {
+        char sep{};
+        return spio::scan(s, "{}{}", v, sep);
+    }
+    static bool scanf(const char* p, value_type& v)
+    {
+        std::array<char, 6> buf{};
+        if (std::sscanf(p, "%5s", buf.data()) != 1) {
+            return false;
+        }
+        v = std::strcmp(buf.data(), "true") == 0;
+        return v || std::strcmp(buf.data(), "false") == 0;
+    }
+    static bool strto(const char* p, value_type& v)
+    {
+        if (std::strncmp(p, "true", 4) == 0) {
+            v = true;
+            return true;
+        }
+        v = false;
+        return std::strncmp(p, "false", 5) == 0;
+    }
+    static bool istream(std::istream& is, value_type& v)
+    {
+        return static_cast<bool>(is >> std::boolalpha >> v);
+    }
+};
+
+struct string_field {
+    using value_type = std::array<char, 8>;
+
+    static const corpus& data()
+    {
+        static const auto c = make_corpus(12, [](std::mt19937& rng) {
+            std::uniform_int_distribution<int> dist('a', 'z');
+            std::string str(8, ' ');
+            for (auto& ch : str) {
+                ch = static_cast<char>(dist(rng));
+            }
+            return str;
+        });
+        return c;
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan(Stream& s,
+                                                    spio::streampos pos,
+                                                    value_type& v)
+    {
+        auto sp = spio::span<char>(v);
+        return spio::scan_at(s, pos, "{}", sp);
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan_next(Stream& s,
+                                                         value_type& v)
+    {
+        auto sp = spio::span<char>(v);
+        char sep{};
+        return spio::scan(s, "{}{}", sp, sep);
+    }
+    static bool scanf(const char* p, value_type& v)
+    {
+        return std::sscanf(p, "%8c", v.data()) == 1;
+    }
+    static bool strto(const char* p, value_type& v)
+    {
+        std::memcpy(v.data(), p, v.size());
+        return true;
+    }
+    static bool istream(std::istream& is, value_type& v)
+    {
+        return static_cast<bool>(is.read(v.data(), 8) >> std::ws);
+    }
+};
+
+// Two integers and a floating-point value
+struct mixed_field {
+    struct value_type {
+        int a;
+        int b;
+        double c;
+    };
+
+    static const corpus& data()
+    {
+        static const auto c = make_corpus(32, [](std::mt19937& rng) {
+            std::uniform_int_distribution<int> idist(-100000, 100000);
+            std::uniform_real_distribution<double> fdist(0.0, 1000.0);
+            std::array<char, 64> buf{};
+            std::snprintf(buf.data(), buf.size(), "%d %d %.3f", idist(rng),
+                          idist(rng), fdist(rng));
+            return std::string(buf.data());
+        });
+        return c;
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan(Stream& s,
+                                                    spio::streampos pos,
+                                                    value_type& v)
+    {
+        // Integers consume the whitespace after them
+        return spio::scan_at(s, pos, "{}{}{}", v.a, v.b, v.c);
+    }
+    template <typename Stream>
+    static spio::expected<void, spio::failure> scan_next(Stream& s,
+                                                         value_type& v)
+    {
+        char sep{};
+        return spio::scan(s, "{}{}{}{}", v.a, v.b, v.c, sep);
+    }
+    static bool scanf(const char* p, value_type& v)
+    {
+        return std::sscanf(p, "%d %d %lf", &v.a, &v.b, &v.c) == 3;
+    }
+    static bool strto(const char* p, value_type& v)
+    {
+        char* end;
+        v.a = static_cast<int>(std::strtol(p, &end, 10));
+        v.b = static_cast<int>(std::strtol(end, &end, 10));
+        v.c = std::strtod(end, &end);
+        return end != p;
+    }
+    static bool istream(std::istream& is, value_type& v)
+    {
+        return static_cast<bool>(is >> v.a >> v.b >> v.c);
+    }
+};
+
+// Records/sec is comparable between the fixed-width and the squeezed
+// input, Bytes/sec isn't
+static void set_counters(benchmark::State& state,
+                         std::size_t bytes,
+                         std::ptrdiff_t records)
+{
+    const auto iterations = static_cast<double>(state.iterations());
+    state.counters["Bytes"] = benchmark::Counter(
+        iterations * static_cast<double>(bytes),
+        benchmark::Counter::kIsRate, benchmark::Counter::OneK::kIs1024);
+    state.counters["Records"] =
+        benchmark::Counter(iterations * static_cast<double>(records),
+                           benchmark::Counter::kIsRate);
+}
+static void set_counters(benchmark::State& state,
+                         const corpus& c,
+                         std::ptrdiff_t records)
+{
+    set_counters(state, static_cast<std::size_t>(records * c.width), records);
+}
+
+static std::vector<spio::byte> to_bytes(const std::string& str)
+{
+    std::vector<spio::byte> bytes(str.size());
+    std::memcpy(bytes.data(), str.data(), str.size());
+    return bytes;
+}
+#if SPIO_POSIX
+static std::FILE* make_temp_file(const std::string& str)
+{
+    auto f = std::tmpfile();
+    if (f) {
+        std::fwrite(str.data(), 1, str.size(), f);
+        std::fflush(f);
+    }
+    return f;
+}
+#endif
+
+template <typename Field, typename Stream>
+static void scan_records(benchmark::State& state,
+                         Stream& s,
+                         const corpus& c,
+                         std::ptrdiff_t records)
+{
+    typename Field::value_type v{};
+    for (auto _ : state) {
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            auto ret = Field::scan(s, i * c.width, v);
+            if (!ret) {
+                state.SkipWithError(ret.error().what());
+                return;
+            }
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    set_counters(state, c, records);
+}
+
+template <typename Field>
+static void scan_spio_memory(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    spio::memory_instream s(spio::as_bytes(spio::make_span(
+        c.data.data(), static_cast<std::ptrdiff_t>(c.data.size()))));
+    scan_records<Field>(state, s, c, state.range(0));
+}
+template <typename Field>
+static void scan_spio_stream_ref(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    spio::memory_instream s(spio::as_bytes(spio::make_span(
+        c.data.data(), static_cast<std::ptrdiff_t>(c.data.size()))));
+    spio::basic_stream_ref<spio::encoding<char>,
+                           spio::random_access_readable_tag>
+        ref(s);
+    scan_records<Field>(state, ref, c, state.range(0));
+}
+#if SPIO_POSIX
+// stdio_instream only supports scan_at() where it has read_at()
+template <typename Field>
+static void scan_spio_stdio(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    auto f = make_temp_file(c.data);
+    if (!f) {
+        state.SkipWithError("Failed to create a temporary file");
+        return;
+    }
+    {
+        spio::basic_stdio_handle_instream<spio::encoding<char>> s(f);
+        scan_records<Field>(state, s, c, state.range(0));
+    }
+    std::fclose(f);
+}
+#endif
+
+// Sequential scan() and read() go through the stream buffer:
+// basic_buffered_readable in memory, the FILE buffer with stdio.
+// The stream is recreated for every pass over the input.
+using memory_seq_instream = spio::stream<spio::vector_source,
+                                         spio::encoding<char>,
+                                         spio::source_filter_chain>;
+
+template <typename Field, typename Stream>
+static bool scan_sequential(benchmark::State& state,
+                            Stream& s,
+                            std::ptrdiff_t records)
+{
+    typename Field::value_type v{};
+    for (std::ptrdiff_t i = 0; i < records; ++i) {
+        auto ret = Field::scan_next(s, v);
+        if (!ret) {
+            state.SkipWithError(ret.error().what());
+            return false;
+        }
+        benchmark::DoNotOptimize(v);
+    }
+    return true;
+}
+
+template <typename Field>
+static void scan_spio_memory_sequential(benchmark::State& state)
+{
+    const auto records = state.range(0);
+    auto data = to_bytes(squeeze(Field::data(), records));
+    for (auto _ : state) {
+        memory_seq_instream s(
+            spio::vector_source(data), memory_seq_instream::input_base{},
+            memory_seq_instream::output_base{},
+            memory_seq_instream::chain_type{});
+        s.source_storage() =
+            memory_seq_instream::input_base::source_type(s.device());
+        if (!scan_sequential<Field>(state, s, records)) {
+            return;
+        }
+    }
+    set_counters(state, data.size(), records);
+}
+template <typename Field>
+static void read_spio_memory(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    const auto records = state.range(0);
+    auto data = to_bytes(
+        c.data.substr(0, static_cast<std::size_t>(records * c.width)));
+    std::array<spio::byte, 64> rec{};
+    const auto width = spio::make_span(rec).first(c.width);
+    for (auto _ : state) {
+        memory_seq_instream s(
+            spio::vector_source(data), memory_seq_instream::input_base{},
+            memory_seq_instream::output_base{},
+            memory_seq_instream::chain_type{});
+        s.source_storage() =
+            memory_seq_instream::input_base::source_type(s.device());
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            auto ret = spio::read(s, width);
+            if (ret.value() != c.width) {
+                state.SkipWithError("read failed");
+                return;
+            }
+            benchmark::DoNotOptimize(rec);
+        }
+    }
+    set_counters(state, c, records);
+}
+#if SPIO_POSIX
+template <typename Field>
+static void scan_spio_stdio_sequential(benchmark::State& state)
+{
+    const auto records = state.range(0);
+    const auto data = squeeze(Field::data(), records);
+    auto f = make_temp_file(data);
+    if (!f) {
+        state.SkipWithError("Failed to create a temporary file");
+        return;
+    }
+    for (auto _ : state) {
+        std::rewind(f);
+        spio::stdio_handle_instream s(f);
+        if (!scan_sequential<Field>(state, s, records)) {
+            break;
+        }
+    }
+    std::fclose(f);
+    set_counters(state, data.size(), records);
+}
+// Byte-readable streams read a span with get()
+template <typename Field>
+static void read_spio_stdio(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    const auto records = state.range(0);
+    auto f = make_temp_file(c.data);
+    if (!f) {
+        state.SkipWithError("Failed to create a temporary file");
+        return;
+    }
+    std::array<spio::byte, 64> rec{};
+    const auto width = spio::make_span(rec).first(c.width);
+    for (auto _ : state) {
+        std::rewind(f);
+        spio::stdio_handle_instream s(f);
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            auto ret = spio::get(s, width);
+            if (ret.value() != c.width) {
+                state.SkipWithError("get failed");
+                break;
+            }
+            benchmark::DoNotOptimize(rec);
+        }
+    }
+    std::fclose(f);
+    set_counters(state, c, records);
+}
+#endif
+
+template <typename Field>
+static void scan_scanf(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    const auto records = state.range(0);
+    typename Field::value_type v{};
+    // sscanf() calls strlen() on its input, so give it one record at a time
+    std::array<char, 64> rec{};
+    for (auto _ : state) {
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            std::memcpy(rec.data(), c.data.data() + i * c.width,
+                        static_cast<std::size_t>(c.width));
+            if (!Field::scanf(rec.data(), v)) {
+                state.SkipWithError("sscanf failed");
+                return;
+            }
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    set_counters(state, c, records);
+}
+template <typename Field>
+static void scan_strto(benchmark::State& state)
+{
+    const auto& c = Field::data();
+    const auto records = state.range(0);
+    typename Field::value_type v{};
+    for (auto _ : state) {
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            if (!Field::strto(c.data.data() + i * c.width, v)) {
+                state.SkipWithError("strto failed");
+                return;
+            }
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    set_counters(state, c, records);
+}
+// Scans the same input as scan_spio_*_sequential
+template <typename Field>
+static void scan_istringstream(benchmark::State& state)
+{
+    const auto records = state.range(0);
+    const auto data = squeeze(Field::data(), records);
+    std::istringstream is(data);
+    typename Field::value_type v{};
+    for (auto _ : state) {
+        is.clear();
+        is.seekg(0);
+        for (std::ptrdiff_t i = 0; i < records; ++i) {
+            if (!Field::istream(is, v)) {
+                state.SkipWithError("istream failed");
+                return;
+            }
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    set_counters(state, data.size(), records);
+}
+
+#if SPIO_POSIX
+#define SPIO_BENCH_SCAN_STDIO(field)                                       \
+    BENCHMARK_TEMPLATE(scan_spio_stdio, field)->Range(64, 64 << 6);        \
+    BENCHMARK_TEMPLATE(scan_spio_stdio_sequential, field)                  \
+        ->Range(64, 64 << 6);                                              \
+    BENCHMARK_TEMPLATE(read_spio_stdio, field)->Range(64, 64 << 6);
+#else
+#define SPIO_BENCH_SCAN_STDIO(field)
+#endif
+
+#define SPIO_BENCH_SCAN(field)                                             \
+    BENCHMARK_TEMPLATE(scan_spio_memory, field)->Range(64, 64 << 6);       \
+    BENCHMARK_TEMPLATE(scan_spio_stream_ref, field)->Range(64, 64 << 6);   \
+    BENCHMARK_TEMPLATE(scan_spio_memory_sequential, field)                 \
+        ->Range(64, 64 << 6);                                              \
+    BENCHMARK_TEMPLATE(read_spio_memory, field)->Range(64, 64 << 6);       \
+    SPIO_BENCH_SCAN_STDIO(field)                                           \
+    BENCHMARK_TEMPLATE(scan_scanf, field)->Range(64, 64 << 6);             \
+    BENCHMARK_TEMPLATE(scan_strto, field)->Range(64, 64 << 6);             \
+    BENCHMARK_TEMPLATE(scan_istringstream, field)->Range(64, 64 << 6)
+
+SPIO_BENCH_SCAN(int_field);
+SPIO_BENCH_SCAN(float_field);
+SPIO_BENCH_SCAN(bool_field);
+SPIO_BENCH_SCAN(string_field);
+SPIO_BENCH_SCAN(mixed_field);
@@ -0,0 +1,94 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_ADAPTIVE_SIZING_H
+#define SPIO_ADAPTIVE_SIZING_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include "third_party/gsl.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+// Bounds for buffers resizing themselves to how they're used.
+// A buffer that fills up before it's flushed doubles in size, and one
+// that is flushed while less than a quarter full shrink_after times in
+// a row is halved, so interactive streams stay small and bulk transfers
+// get large buffers.
+// Only the fill level at each flush is considered: device latency and
+// how often the buffer is flushed don't affect the size.
+struct adaptive_sizing {
+    std::ptrdiff_t min_size{512};
+    std::ptrdiff_t max_size{std::ptrdiff_t{1} << 20};
+    int shrink_after{8};
+};
+
+namespace detail {
+    class size_adapter {
+    public:
+        using size_type = std::ptrdiff_t;
+
+        size_adapter() = default;
+        size_adapter(adaptive_sizing s) : m_bounds(s), m_enabled(true)
+        {
+            Expects(s.min_size > 0 && s.min_size <= s.max_size);
+            Expects(s.shrink_after > 0);
+        }
+
+        SPIO_CONSTEXPR bool enabled() const noexcept
+        {
+            return m_enabled;
+        }
+        SPIO_CONSTEXPR const adaptive_sizing& bounds() const noexcept
+        {
+            return m_bounds;
+        }
+
+        // used bytes of a buffer of size current were consumed,
+        // returns the size to use from now on.
+        // Decides on the fill level alone, without timing the device.
+        size_type observe(size_type used, size_type current) noexcept
+        {
+            if (used >= current) {
+                m_small = 0;
+                return std::min(current * 2, m_bounds.max_size);
+            }
+            if (used < current / 4) {
+                if (++m_small >= m_bounds.shrink_after) {
+                    m_small = 0;
+                    return std::max(current / 2, m_bounds.min_size);
+                }
+                return current;
+            }
+            m_small = 0;
+            return current;
+        }
+
+    private:
+        adaptive_sizing m_bounds{};
+        int m_small{0};
+        bool m_enabled{false};
+    };
+}  // namespace detail
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_ADAPTIVE_SIZING_H
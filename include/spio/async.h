@@ -0,0 +1,888 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_ASYNC_H
+#define SPIO_ASYNC_H
+
+#include "config.h"
+
+#if SPIO_HAS_COROUTINES
+
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "deadline.h"
+#include "device.h"
+#include "device_stream.h"
+#include "formatter.h"
+#include "result.h"
+#include "scanner.h"
+#include "stream.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+template <typename T = void>
+class task;
+
+namespace detail {
+    struct task_promise_base {
+        struct final_awaiter {
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<Promise> h) noexcept
+            {
+                return h.promise().continuation;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+        final_awaiter final_suspend() const noexcept
+        {
+            return {};
+        }
+        void unhandled_exception() noexcept
+        {
+            exception = std::current_exception();
+        }
+
+        std::coroutine_handle<> continuation{std::noop_coroutine()};
+        std::exception_ptr exception{};
+    };
+
+    template <typename T>
+    struct task_promise : task_promise_base {
+        task<T> get_return_object() noexcept;
+
+        template <typename U>
+        void return_value(U&& v)
+        {
+            value.emplace(std::forward<U>(v));
+        }
+
+        T get()
+        {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            Expects(value.has_value());
+            return std::move(*value);
+        }
+
+        std::optional<T> value{};
+    };
+    template <>
+    struct task_promise<void> : task_promise_base {
+        task<void> get_return_object() noexcept;
+
+        void return_void() const noexcept {}
+
+        void get()
+        {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+
+    // Coroutine nobody waits for: it starts right away,
+    // and cleans up after itself when it's done
+    struct detached_task {
+        struct promise_type {
+            detached_task get_return_object() const noexcept
+            {
+                return {};
+            }
+            std::suspend_never initial_suspend() const noexcept
+            {
+                return {};
+            }
+            std::suspend_never final_suspend() const noexcept
+            {
+                return {};
+            }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+}  // namespace detail
+
+// Lazily started coroutine, which runs when it's co_awaited.
+// Exceptions thrown by it are rethrown to the awaiter.
+template <typename T>
+class task {
+public:
+    using promise_type = detail::task_promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() = default;
+    explicit task(handle_type h) noexcept : m_handle(h) {}
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    task(task&& o) noexcept : m_handle(std::exchange(o.m_handle, {})) {}
+    task& operator=(task&& o) noexcept
+    {
+        if (this != &o) {
+            _destroy();
+            m_handle = std::exchange(o.m_handle, {});
+        }
+        return *this;
+    }
+
+    ~task() noexcept
+    {
+        _destroy();
+    }
+
+    bool valid() const noexcept
+    {
+        return static_cast<bool>(m_handle);
+    }
+    bool done() const noexcept
+    {
+        Expects(valid());
+        return m_handle.done();
+    }
+
+    auto operator co_await() noexcept
+    {
+        struct awaiter {
+            bool await_ready() const noexcept
+            {
+                return handle.done();
+            }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<> cont) noexcept
+            {
+                handle.promise().continuation = cont;
+                return handle;
+            }
+            T await_resume()
+            {
+                return handle.promise().get();
+            }
+
+            handle_type handle;
+        };
+        Expects(valid());
+        return awaiter{m_handle};
+    }
+
+private:
+    void _destroy() noexcept
+    {
+        if (m_handle) {
+            m_handle.destroy();
+            m_handle = {};
+        }
+    }
+
+    handle_type m_handle{};
+};
+
+namespace detail {
+    template <typename T>
+    task<T> task_promise<T>::get_return_object() noexcept
+    {
+        return task<T>{task<T>::handle_type::from_promise(*this)};
+    }
+    inline task<void> task_promise<void>::get_return_object() noexcept
+    {
+        return task<void>{task<void>::handle_type::from_promise(*this)};
+    }
+}  // namespace detail
+
+// Minimal single-threaded executor.
+// Coroutines are queued with schedule() and resumed by run(), in order.
+// Timers are fired from run() too, which sleeps while only timers are
+// pending, or waits on the attached I/O poller.
+class run_loop {
+public:
+    using clock = deadline::clock;
+    using time_point = deadline::time_point;
+
+    struct schedule_awaiter {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop->post(h);
+        }
+        void await_resume() const noexcept {}
+
+        run_loop* loop;
+    };
+    struct timer_awaiter {
+        bool await_ready() const
+        {
+            return clock::now() >= when;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop->_add_timer(when, h);
+        }
+        void await_resume() const noexcept {}
+
+        run_loop* loop;
+        time_point when;
+    };
+
+    run_loop() = default;
+
+    run_loop(const run_loop&) = delete;
+    run_loop& operator=(const run_loop&) = delete;
+    run_loop(run_loop&&) = delete;
+    run_loop& operator=(run_loop&&) = delete;
+
+    ~run_loop() = default;
+
+    void post(std::coroutine_handle<> h)
+    {
+        m_ready.push_back(h);
+    }
+
+    // Resumes the awaiting coroutine from run()
+    schedule_awaiter schedule() noexcept
+    {
+        return {this};
+    }
+    timer_awaiter sleep_until(time_point t) noexcept
+    {
+        return {this, t};
+    }
+    template <typename Rep, typename Period>
+    timer_awaiter sleep_for(std::chrono::duration<Rep, Period> d)
+    {
+        return sleep_until(clock::now() +
+                           std::chrono::duration_cast<clock::duration>(d));
+    }
+
+    // Starts t without waiting for it.
+    // An exception escaping t terminates the program.
+    void spawn(task<void> t)
+    {
+        _spawn(*this, std::move(t));
+    }
+
+    // Lets run() wait for I/O on p, like an epoll_reactor.
+    // p.pending() is the number of I/O waits, and p.poll(deadline) blocks
+    // until one of them completes or the deadline expires.
+    template <typename Poller>
+    void attach(Poller& p) noexcept
+    {
+        m_poller = std::addressof(p);
+        m_poller_pending = [](void* q) {
+            return static_cast<Poller*>(q)->pending() != 0;
+        };
+        m_poller_poll = [](void* q, deadline d) {
+            static_cast<void>(static_cast<Poller*>(q)->poll(d));
+        };
+    }
+    void detach() noexcept
+    {
+        m_poller = nullptr;
+    }
+
+    // Runs until there's nothing left to do
+    void run()
+    {
+        while (true) {
+            _fire_timers();
+            const bool io = _io_pending();
+            if (m_ready.empty()) {
+                if (io) {
+                    m_poller_poll(m_poller, m_timers.empty()
+                                                ? deadline{}
+                                                : m_timers.top().when);
+                    continue;
+                }
+                if (m_timers.empty()) {
+                    return;
+                }
+                std::this_thread::sleep_until(m_timers.top().when);
+                continue;
+            }
+            if (io) {
+                // Don't starve I/O while there's work queued
+                m_poller_poll(m_poller, deadline{clock::now()});
+            }
+
+            // Only resume what was queued before this round,
+            // so timers get to fire between rounds
+            for (auto n = m_ready.size(); n != 0; --n) {
+                auto h = m_ready.front();
+                m_ready.pop_front();
+                h.resume();
+            }
+        }
+    }
+
+    bool empty() const noexcept
+    {
+        return m_ready.empty() && m_timers.empty() && !_io_pending();
+    }
+
+private:
+    struct timer {
+        bool operator>(const timer& o) const noexcept
+        {
+            return when > o.when || (when == o.when && seq > o.seq);
+        }
+
+        time_point when;
+        std::uint64_t seq;
+        std::coroutine_handle<> handle;
+    };
+
+    bool _io_pending() const
+    {
+        return m_poller && m_poller_pending(m_poller);
+    }
+
+    void _add_timer(time_point t, std::coroutine_handle<> h)
+    {
+        m_timers.push(timer{t, m_timer_seq++, h});
+    }
+    void _fire_timers()
+    {
+        if (m_timers.empty()) {
+            return;
+        }
+        const auto now = clock::now();
+        while (!m_timers.empty() && m_timers.top().when <= now) {
+            m_ready.push_back(m_timers.top().handle);
+            m_timers.pop();
+        }
+    }
+
+    static detail::detached_task _spawn(run_loop& loop, task<void> t)
+    {
+        co_await loop.schedule();
+        co_await t;
+    }
+
+    std::deque<std::coroutine_handle<>> m_ready{};
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>>
+        m_timers{};
+    std::uint64_t m_timer_seq{0};
+
+    void* m_poller{nullptr};
+    bool (*m_poller_pending)(void*){nullptr};
+    void (*m_poller_poll)(void*, deadline){nullptr};
+};
+
+namespace detail {
+    template <typename T>
+    struct sync_wait_state {
+        T get()
+        {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            Expects(value.has_value());
+            return std::move(*value);
+        }
+
+        std::optional<T> value{};
+        std::exception_ptr exception{};
+    };
+    template <>
+    struct sync_wait_state<void> {
+        void get()
+        {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            Expects(done);
+        }
+
+        bool done{false};
+        std::exception_ptr exception{};
+    };
+
+    template <typename T>
+    detached_task sync_wait_impl(run_loop& loop,
+                                 task<T> t,
+                                 sync_wait_state<T>& state)
+    {
+        co_await loop.schedule();
+        try {
+            if constexpr (std::is_void<T>::value) {
+                co_await t;
+                state.done = true;
+            }
+            else {
+                state.value.emplace(co_await t);
+            }
+        }
+        catch (...) {
+            state.exception = std::current_exception();
+        }
+    }
+}  // namespace detail
+
+// Runs loop until t has completed, and returns its result
+template <typename T>
+T sync_wait(run_loop& loop, task<T> t)
+{
+    detail::sync_wait_state<T> state;
+    detail::sync_wait_impl(loop, std::move(t), state);
+    loop.run();
+    return state.get();
+}
+
+template <typename Device>
+using async_writable_op = decltype(
+    std::declval<Device>().async_write(std::declval<span<const byte>>(),
+                                       std::declval<deadline>()));
+template <typename Device>
+using is_async_writable = is_detected<async_writable_op, Device>;
+
+template <typename Device>
+using async_ra_writable_op = decltype(
+    std::declval<Device>().async_write_at(std::declval<span<const byte>>(),
+                                          std::declval<streampos>(),
+                                          std::declval<deadline>()));
+template <typename Device>
+using is_async_random_access_writable =
+    is_detected<async_ra_writable_op, Device>;
+
+template <typename Device>
+using async_readable_op =
+    decltype(std::declval<Device>().async_read(std::declval<span<byte>>(),
+                                               std::declval<bool&>(),
+                                               std::declval<deadline>()));
+template <typename Device>
+using is_async_readable = is_detected<async_readable_op, Device>;
+
+template <typename Device>
+using async_ra_readable_op =
+    decltype(std::declval<Device>().async_read_at(std::declval<span<byte>>(),
+                                                  std::declval<streampos>(),
+                                                  std::declval<bool&>(),
+                                                  std::declval<deadline>()));
+template <typename Device>
+using is_async_random_access_readable =
+    is_detected<async_ra_readable_op, Device>;
+
+// Runs the operations of a synchronous Device on a run_loop.
+// Every operation first yields to the loop, so concurrent operations are
+// interleaved, and fails with std::errc::timed_out if its deadline has
+// expired by the time it gets to run.
+// The Device call itself still blocks the loop, so this is meant for
+// in-memory devices and testing.
+template <typename Device>
+class basic_async_device {
+public:
+    using device_type = Device;
+
+    basic_async_device(run_loop& l, device_type d)
+        : m_loop(std::addressof(l)), m_device(std::move(d))
+    {
+    }
+
+    SPIO_CONSTEXPR14 device_type& device() noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR const device_type& device() const noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR run_loop& loop() const noexcept
+    {
+        return *m_loop;
+    }
+
+    bool is_open() const
+    {
+        return m_device.is_open();
+    }
+    expected<void, failure> close()
+    {
+        return m_device.close();
+    }
+
+    template <typename D = Device>
+    auto async_write(span<const byte> s, deadline d = {}) ->
+        typename std::enable_if<is_writable<D>::value, task<result>>::type
+    {
+        co_await m_loop->schedule();
+        if (d.expired()) {
+            co_return make_result(0, timed_out_error());
+        }
+        co_return m_device.write(s);
+    }
+    template <typename D = Device>
+    auto async_write_at(span<const byte> s, streampos pos, deadline d = {})
+        -> typename std::enable_if<is_random_access_writable<D>::value,
+                                   task<result>>::type
+    {
+        co_await m_loop->schedule();
+        if (d.expired()) {
+            co_return make_result(0, timed_out_error());
+        }
+        co_return m_device.write_at(s, pos);
+    }
+
+    template <typename D = Device>
+    auto async_read(span<byte> s, bool& eof, deadline d = {}) ->
+        typename std::enable_if<is_readable<D>::value, task<result>>::type
+    {
+        co_await m_loop->schedule();
+        if (d.expired()) {
+            co_return make_result(0, timed_out_error());
+        }
+        co_return m_device.read(s, eof);
+    }
+    template <typename D = Device>
+    auto async_read_at(span<byte> s,
+                       streampos pos,
+                       bool& eof,
+                       deadline d = {}) ->
+        typename std::enable_if<is_random_access_readable<D>::value,
+                                task<result>>::type
+    {
+        co_await m_loop->schedule();
+        if (d.expired()) {
+            co_return make_result(0, timed_out_error());
+        }
+        co_return m_device.read_at(s, pos, eof);
+    }
+
+private:
+    run_loop* m_loop;
+    device_type m_device;
+};
+
+// Writes all of data to s, unless an error occurs
+template <typename Stream>
+auto async_write(Stream& s, span<const byte> data, deadline d = {}) ->
+    typename std::enable_if<
+        is_async_writable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    auto sentry = typename Stream::output_sentry(s);
+    if (!sentry) {
+        co_return make_result(0, sentry.error());
+    }
+    byte_buffer buf{aligned_allocator<byte>(new_delete_resource())};
+    if (!s.chain().output_empty()) {
+        buf.assign(data.begin(), data.end());
+        auto r = s.chain().write(buf);
+        if (r.has_error()) {
+            co_return r;
+        }
+        data = make_span(buf);
+    }
+
+    streamsize written = 0;
+    while (!data.empty()) {
+        auto r = co_await s.device().async_write(data, d);
+        written += r.value();
+        if (r.has_error()) {
+            co_return make_result(written, r.error());
+        }
+        if (r.value() == 0) {
+            break;
+        }
+        data = data.subspan(r.value());
+    }
+    co_return written;
+}
+template <typename Stream>
+auto async_write_at(Stream& s,
+                    span<const byte> data,
+                    streampos pos,
+                    deadline d = {}) ->
+    typename std::enable_if<
+        is_async_random_access_writable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    auto sentry = typename Stream::output_sentry(s);
+    if (!sentry) {
+        co_return make_result(0, sentry.error());
+    }
+    byte_buffer buf{aligned_allocator<byte>(new_delete_resource())};
+    if (!s.chain().output_empty()) {
+        buf.assign(data.begin(), data.end());
+        auto r = s.chain().write(buf);
+        if (r.has_error()) {
+            co_return r;
+        }
+        data = make_span(buf);
+    }
+
+    auto device_pos = Stream::encoding_type::to_device(pos);
+    streamsize written = 0;
+    while (!data.empty()) {
+        auto r = co_await s.device().async_write_at(data, device_pos, d);
+        written += r.value();
+        if (r.has_error()) {
+            co_return make_result(written, r.error());
+        }
+        if (r.value() == 0) {
+            break;
+        }
+        data = data.subspan(r.value());
+        device_pos += r.value();
+    }
+    co_return written;
+}
+
+namespace detail {
+    // Reads what's already buffered in the source of s, if it has one,
+    // without touching the device
+    template <typename Stream>
+    auto _read_buffered(Stream& s, span<byte> data, int)
+        -> decltype(s.source_storage(), streamsize())
+    {
+        auto& src = s.source_storage();
+        if (!src || src->in_use() == 0) {
+            return 0;
+        }
+        bool eof = false;
+        return src->read(data.first(std::min(data.size(), src->in_use())),
+                         eof)
+            .value();
+    }
+    template <typename Stream>
+    streamsize _read_buffered(Stream&, span<byte>, long)
+    {
+        return 0;
+    }
+}  // namespace detail
+
+// Bytes put back into s, and bytes buffered in its source by synchronous
+// reads, are returned first, without waiting on the device
+template <typename Stream>
+auto async_read(Stream& s, span<byte> data, deadline d = {}) ->
+    typename std::enable_if<
+        is_async_readable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    auto sentry = typename Stream::input_sentry(s);
+    if (!sentry) {
+        co_return make_result(0, sentry.error());
+    }
+    if (!s.putback_storage().empty()) {
+        // Already filtered
+        co_return s.putback_storage().read(data);
+    }
+    bool eof = false;
+    auto r = result(detail::_read_buffered(s, data, 0));
+    if (r.value() == 0) {
+        r = co_await s.device().async_read(data, eof, d);
+    }
+    if (eof) {
+        s.set_eof();
+    }
+    if (r.has_error() || s.chain().input_empty()) {
+        co_return r;
+    }
+    if (eof) {
+        co_return s.chain().read_final(data, r.value());
+    }
+    data = data.first(r.value());
+    co_return s.chain().read(data);
+}
+template <typename Stream>
+auto async_read_at(Stream& s, span<byte> data, streampos pos, deadline d = {})
+    -> typename std::enable_if<
+        is_async_random_access_readable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    auto sentry = typename Stream::input_sentry(s);
+    if (!sentry) {
+        co_return make_result(0, sentry.error());
+    }
+    bool eof = false;
+    auto r = co_await s.device().async_read_at(
+        data, Stream::encoding_type::to_device(pos), eof, d);
+    if (eof) {
+        s.set_eof();
+    }
+    if (r.has_error() || s.chain().input_empty()) {
+        co_return r;
+    }
+    data = data.first(r.value());
+    co_return s.chain().read(data);
+}
+
+namespace detail {
+    template <typename Stream>
+    task<result> async_write_owned(Stream& s,
+                                   std::vector<byte> buf,
+                                   deadline d)
+    {
+        co_return co_await async_write(s, span<const byte>(buf), d);
+    }
+}  // namespace detail
+
+// The arguments are formatted right away,
+// so they don't need to outlive the call
+template <typename Stream, typename... Args>
+auto async_print(Stream& s,
+                 deadline d,
+                 basic_string_view<typename Stream::char_type> f,
+                 const Args&... a) ->
+    typename std::enable_if<
+        is_async_writable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    std::vector<byte> buf;
+    buf.reserve(f.size());
+    using iterator = memcpy_back_insert_iterator<std::vector<byte>,
+                                                 typename Stream::char_type>;
+    basic_formatter<typename Stream::encoding_type>{}(
+        iterator(buf), f,
+        fmt::make_format_args<typename fmt::format_context_t<
+            iterator, typename Stream::char_type>::type>(a...));
+    return detail::async_write_owned(s, std::move(buf), d);
+}
+template <typename Stream, typename... Args>
+auto async_print(Stream& s,
+                 basic_string_view<typename Stream::char_type> f,
+                 const Args&... a) ->
+    typename std::enable_if<
+        is_async_writable<typename Stream::device_type>::value,
+        task<result>>::type
+{
+    return async_print(s, deadline{}, f, a...);
+}
+
+namespace detail {
+    // Size of the chunks async_scan() reads
+    constexpr std::ptrdiff_t async_scan_chunk = 256;
+
+    // data has been read with async_read(), so it's put back after the
+    // filters, in front of whatever is buffered in the source
+    template <typename Stream>
+    void _async_putback(Stream& s, span<const byte> data)
+    {
+        if (!data.empty()) {
+            s.putback_storage().putback(data);
+            s.clear_eof();
+        }
+    }
+}  // namespace detail
+
+// Reads a line from s, and scans it with f.
+// The line is read in chunks, and whatever follows the newline
+// is put back into the stream for the next read.
+// A read returning nothing before the end of the input fails with
+// would_block, with the partial line put back.
+// a must outlive the returned task.
+template <typename Stream, typename... Args>
+auto async_scan(Stream& s,
+                deadline d,
+                basic_string_view<typename Stream::char_type> f,
+                Args&... a) ->
+    typename std::enable_if<
+        is_async_readable<typename Stream::device_type>::value,
+        task<expected<void, failure>>>::type
+{
+    using char_type = typename Stream::char_type;
+    const auto char_size = static_cast<std::ptrdiff_t>(sizeof(char_type));
+
+    std::vector<byte> line;
+    // Bytes of line already searched for the newline
+    std::ptrdiff_t searched = 0;
+    bool found = false;
+    while (!found && !s.eof()) {
+        std::array<byte, detail::async_scan_chunk> chunk{};
+        auto r = co_await async_read(s, make_span(chunk), d);
+        if (r.has_error()) {
+            detail::_async_putback(s, span<const byte>(line));
+            co_return make_unexpected(r.error());
+        }
+        if (r.value() == 0 && !s.eof()) {
+            detail::_async_putback(s, span<const byte>(line));
+            co_return make_unexpected(failure{would_block});
+        }
+        line.insert(line.end(), chunk.begin(), chunk.begin() + r.value());
+
+        const auto size = static_cast<std::ptrdiff_t>(line.size());
+        for (; searched + char_size <= size; searched += char_size) {
+            char_type c{};
+            std::memcpy(&c, line.data() + searched, sizeof(char_type));
+            if (c == char_type('\n')) {
+                searched += char_size;
+                found = true;
+                break;
+            }
+        }
+    }
+    if (found) {
+        detail::_async_putback(s, span<const byte>(line).subspan(searched));
+        line.resize(static_cast<std::size_t>(searched));
+    }
+    else {
+        // A partial character at the end of the input is dropped
+        line.resize(line.size() - line.size() % sizeof(char_type));
+    }
+    if (line.empty()) {
+        co_return make_unexpected(failure{end_of_file});
+    }
+
+    basic_memory_instream<typename Stream::encoding_type> input{
+        span<const byte>(line)};
+    co_return scan_at(input, 0, f, a...);
+}
+template <typename Stream, typename... Args>
+auto async_scan(Stream& s,
+                basic_string_view<typename Stream::char_type> f,
+                Args&... a) ->
+    typename std::enable_if<
+        is_async_readable<typename Stream::device_type>::value,
+        task<expected<void, failure>>>::type
+{
+    return async_scan(s, deadline{}, f, a...);
+}
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_HAS_COROUTINES
+
+#endif  // SPIO_ASYNC_H
@@ -0,0 +1,304 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_BUFFER_POOL_H
+#define SPIO_BUFFER_POOL_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "memory_resource.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    inline std::uint64_t next_pool_generation() noexcept
+    {
+        static std::atomic<std::uint64_t> generation{0};
+        return ++generation;
+    }
+}  // namespace detail
+
+// Memory resource recycling buffers between sinks.
+// Allocations are rounded up to a power of two, starting from min_size,
+// and freed buffers are kept for the next allocation of the same size.
+// Every thread first uses a small cache of its own, which doesn't need a
+// lock, and falls back to lists shared by every thread.
+// When a thread exits, the buffers in its cache go back to the shared
+// lists the next time a thread starts using the pool, or on trim().
+// Allocations larger than max_size go straight to the upstream resource.
+//
+// Memory is only returned to the upstream resource by trim() and
+// the destructor, so the pool must outlive every buffer allocated from it.
+class buffer_pool : public memory_resource {
+public:
+    using size_type = std::ptrdiff_t;
+
+    static SPIO_CONSTEXPR_DECL const size_type min_size = 256;
+
+    explicit buffer_pool(size_type max_size = size_type{1} << 20,
+                         size_type thread_cache_size = 4,
+                         memory_resource* upstream = new_delete_resource())
+        : m_upstream(upstream),
+          m_thread_cache_size(thread_cache_size),
+          m_generation(detail::next_pool_generation())
+    {
+        Expects(max_size >= min_size);
+        Expects(thread_cache_size >= 0);
+        Expects(upstream != nullptr);
+        m_classes = _class_of(max_size) + 1;
+        m_shared.resize(static_cast<std::size_t>(m_classes));
+    }
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    buffer_pool(buffer_pool&&) = delete;
+    buffer_pool& operator=(buffer_pool&&) = delete;
+
+    ~buffer_pool() override
+    {
+        trim();
+        for (auto& cache : m_caches) {
+            _free_lists(cache->lists);
+        }
+    }
+
+    // Frees the buffers in the shared lists,
+    // and in the caches of exited threads.
+    // The caches of running threads are kept.
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        _drain_exited();
+        _free_lists(m_shared);
+    }
+
+    size_type max_buffer_size() const noexcept
+    {
+        return min_size << (m_classes - 1);
+    }
+    // Size of the buffers in the shared lists
+    size_type shared_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_type total = 0;
+        for (size_type c = 0; c < m_classes; ++c) {
+            total += _class_size(c) *
+                     static_cast<size_type>(
+                         m_shared[static_cast<std::size_t>(c)].size());
+        }
+        return total;
+    }
+    // Size of the buffers allocated from upstream and not freed by trim()
+    size_type allocated_bytes() const noexcept
+    {
+        return m_allocated.load(std::memory_order_relaxed);
+    }
+
+private:
+    using free_list = std::vector<void*>;
+
+    struct thread_cache {
+        std::vector<free_list> lists;
+        // Set when the thread using the cache exits
+        std::atomic<bool> exited{false};
+    };
+
+    // The caches of a thread, one for every pool it has used.
+    // Marks them when the thread exits; a cache outlives its thread
+    // until the pool has taken its buffers back.
+    struct thread_caches {
+        struct entry {
+            std::uint64_t generation;
+            // Valid while the pool of the same generation is alive
+            thread_cache* cache;
+            std::weak_ptr<thread_cache> owner;
+        };
+
+        ~thread_caches()
+        {
+            for (auto& e : entries) {
+                if (auto c = e.owner.lock()) {
+                    c->exited.store(true, std::memory_order_release);
+                }
+            }
+        }
+
+        std::vector<entry> entries{};
+    };
+
+    static SPIO_CONSTEXPR size_type _class_size(size_type c) noexcept
+    {
+        return min_size << c;
+    }
+    static size_type _class_of(size_type bytes) noexcept
+    {
+        size_type c = 0;
+        while (_class_size(c) < bytes) {
+            ++c;
+        }
+        return c;
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        Expects(alignment <= alignof(std::max_align_t));
+        const auto c = _class_of(static_cast<size_type>(bytes));
+        if (c >= m_classes) {
+            return m_upstream->allocate(bytes, alignment);
+        }
+        const auto i = static_cast<std::size_t>(c);
+
+        auto& cached = _local_cache().lists[i];
+        if (!cached.empty()) {
+            auto p = cached.back();
+            cached.pop_back();
+            return p;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& shared = m_shared[i];
+            if (shared.empty()) {
+                _drain_exited();
+            }
+            if (!shared.empty()) {
+                auto p = shared.back();
+                shared.pop_back();
+                return p;
+            }
+        }
+        auto p = m_upstream->allocate(static_cast<std::size_t>(_class_size(c)),
+                                      alignof(std::max_align_t));
+        m_allocated.fetch_add(_class_size(c), std::memory_order_relaxed);
+        return p;
+    }
+    void do_deallocate(void* p,
+                       std::size_t bytes,
+                       std::size_t alignment) override
+    {
+        const auto c = _class_of(static_cast<size_type>(bytes));
+        if (c >= m_classes) {
+            m_upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        const auto i = static_cast<std::size_t>(c);
+
+        auto& cached = _local_cache().lists[i];
+        if (static_cast<size_type>(cached.size()) < m_thread_cache_size) {
+            cached.push_back(p);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shared[i].push_back(p);
+    }
+    bool do_is_equal(const memory_resource& o) const noexcept override
+    {
+        return this == &o;
+    }
+
+    thread_cache& _local_cache()
+    {
+        static thread_local thread_caches caches;
+        // A thread only uses a few pools
+        for (auto& e : caches.entries) {
+            if (SPIO_LIKELY(e.generation == m_generation)) {
+                return *e.cache;
+            }
+        }
+        return _add_local_cache(caches);
+    }
+    thread_cache& _add_local_cache(thread_caches& caches)
+    {
+        // Forget the caches of destroyed pools
+        caches.entries.erase(
+            std::remove_if(caches.entries.begin(), caches.entries.end(),
+                           [](const thread_caches::entry& e) {
+                               return e.owner.expired();
+                           }),
+            caches.entries.end());
+
+        auto cache = std::make_shared<thread_cache>();
+        cache->lists.resize(static_cast<std::size_t>(m_classes));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            _drain_exited();
+            m_caches.push_back(cache);
+        }
+        caches.entries.push_back({m_generation, cache.get(), cache});
+        return *cache;
+    }
+
+    // Moves the buffers cached by exited threads to the shared lists.
+    // m_mutex must be locked.
+    void _drain_exited()
+    {
+        m_caches.erase(
+            std::remove_if(
+                m_caches.begin(), m_caches.end(),
+                [&](const std::shared_ptr<thread_cache>& c) {
+                    if (!c->exited.load(std::memory_order_acquire)) {
+                        return false;
+                    }
+                    for (std::size_t i = 0; i < c->lists.size(); ++i) {
+                        m_shared[i].insert(m_shared[i].end(),
+                                           c->lists[i].begin(),
+                                           c->lists[i].end());
+                    }
+                    return true;
+                }),
+            m_caches.end());
+    }
+
+    // m_mutex must be locked, or the pool not used by other threads
+    void _free_lists(std::vector<free_list>& lists) noexcept
+    {
+        for (size_type c = 0; c < static_cast<size_type>(lists.size()); ++c) {
+            const auto size = _class_size(c);
+            for (auto p : lists[static_cast<std::size_t>(c)]) {
+                m_upstream->deallocate(p, static_cast<std::size_t>(size),
+                                       alignof(std::max_align_t));
+                m_allocated.fetch_sub(size, std::memory_order_relaxed);
+            }
+            lists[static_cast<std::size_t>(c)].clear();
+        }
+    }
+
+    memory_resource* m_upstream;
+    size_type m_thread_cache_size;
+    size_type m_classes{0};
+    std::uint64_t m_generation;
+    std::atomic<size_type> m_allocated{0};
+
+    mutable std::mutex m_mutex{};
+    std::vector<free_list> m_shared{};
+    std::vector<std::shared_ptr<thread_cache>> m_caches{};
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_BUFFER_POOL_H
@@ -0,0 +1,329 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_CHUNKED_DEVICE_H
+#define SPIO_CHUNKED_DEVICE_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "device.h"
+#include "error.h"
+#include "result.h"
+#include "sink.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+// Byte buffer made of separately allocated chunks.
+// Appending never moves the data already in the buffer: when the last
+// chunk is full, a new one is allocated, twice the size of the previous
+// one up to max_chunk, or large enough for the rest of the appended data.
+// With first_chunk == max_chunk, every chunk has at least the same size.
+class chunked_buffer {
+public:
+    using size_type = std::ptrdiff_t;
+
+    explicit chunked_buffer(size_type first_chunk = 4096,
+                            size_type max_chunk = 1 << 20)
+        : m_first_chunk(first_chunk), m_max_chunk(max_chunk)
+    {
+        Expects(first_chunk > 0 && first_chunk <= max_chunk);
+    }
+
+    void append(span<const byte> s)
+    {
+        while (!s.empty()) {
+            if (m_chunks.empty() || _last().full()) {
+                _add_chunk(s.size());
+            }
+            auto& c = _last();
+            const auto n = std::min(s.size(), c.capacity - c.size);
+            std::copy(s.begin(), s.begin() + n, c.data.get() + c.size);
+            c.size += n;
+            m_size += n;
+            s = s.subspan(n);
+        }
+    }
+
+    // Copies the bytes starting from pos into s.
+    // Returns the number of bytes copied.
+    size_type copy_to(span<byte> s, size_type pos) const noexcept
+    {
+        Expects(pos >= 0);
+        if (pos >= m_size) {
+            return 0;
+        }
+        // The first chunk starting after pos, minus one
+        auto it = std::upper_bound(
+            m_chunks.begin(), m_chunks.end(), pos,
+            [](size_type p, const chunk& c) { return p < c.offset; });
+        --it;
+        size_type copied = 0;
+        for (; it != m_chunks.end() && copied < s.size(); ++it) {
+            const auto begin = pos + copied - it->offset;
+            const auto n = std::min(s.size() - copied, it->size - begin);
+            std::copy(it->data.get() + begin, it->data.get() + begin + n,
+                      s.begin() + copied);
+            copied += n;
+        }
+        return copied;
+    }
+
+    // The contents of the buffer, one span per chunk,
+    // e.g. for vwrite()
+    std::vector<span<const byte>> buffers() const
+    {
+        std::vector<span<const byte>> bufs;
+        bufs.reserve(m_chunks.size());
+        for (auto& c : m_chunks) {
+            if (c.size != 0) {
+                bufs.emplace_back(c.data.get(), c.size);
+            }
+        }
+        return bufs;
+    }
+
+    // Moves the contents into a single chunk, if they aren't already
+    span<const byte> linearize()
+    {
+        if (m_chunks.size() > 1) {
+            chunk c(m_size, 0);
+            copy_to(make_span(c.data.get(), m_size), 0);
+            c.size = m_size;
+            m_chunks.clear();
+            m_chunks.push_back(std::move(c));
+        }
+        if (m_chunks.empty()) {
+            return {};
+        }
+        return {m_chunks.front().data.get(), m_size};
+    }
+
+    // Keeps the first chunk, so that the buffer can be reused
+    void clear() noexcept
+    {
+        if (m_chunks.size() > 1) {
+            m_chunks.erase(m_chunks.begin() + 1, m_chunks.end());
+        }
+        if (!m_chunks.empty()) {
+            m_chunks.front().size = 0;
+        }
+        m_size = 0;
+    }
+
+    size_type size() const noexcept
+    {
+        return m_size;
+    }
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+    size_type chunk_count() const noexcept
+    {
+        return static_cast<size_type>(m_chunks.size());
+    }
+
+private:
+    struct chunk {
+        chunk(size_type cap, size_type off)
+            : data(new byte[static_cast<std::size_t>(cap)]),
+              capacity(cap),
+              offset(off)
+        {
+        }
+
+        bool full() const noexcept
+        {
+            return size == capacity;
+        }
+
+        std::unique_ptr<byte[]> data;
+        size_type capacity;
+        size_type size{0};
+        // Of the first byte of the chunk in the buffer
+        size_type offset;
+    };
+
+    chunk& _last() noexcept
+    {
+        return m_chunks.back();
+    }
+    void _add_chunk(size_type needed)
+    {
+        auto cap = m_chunks.empty()
+                       ? m_first_chunk
+                       : std::min(_last().capacity * 2, m_max_chunk);
+        // Larger writes get a chunk of their own,
+        // instead of being split into many small ones
+        if (!m_chunks.empty() && needed > cap) {
+            cap = needed;
+        }
+        // A full chunk is always at the end, so the new one starts at size
+        m_chunks.emplace_back(cap, m_size);
+    }
+
+    std::vector<chunk> m_chunks{};
+    size_type m_size{0};
+    size_type m_first_chunk;
+    size_type m_max_chunk;
+};
+
+// Writes every chunk of b to w.
+// Stops at the first chunk w doesn't accept completely.
+template <typename Writable>
+result write_chunks(Writable& w, const chunked_buffer& b)
+{
+    streamsize written = 0;
+    for (auto& s : b.buffers()) {
+        auto r = write_all(w, s);
+        written += r.value();
+        if (r.has_error()) {
+            return make_result(written, r.error());
+        }
+        // The rest would leave a gap in the output
+        if (r.value() != s.size()) {
+            return written;
+        }
+    }
+    return written;
+}
+
+namespace detail {
+    class chunked_device_impl {
+    public:
+        chunked_device_impl() = default;
+        chunked_device_impl(chunked_buffer& b) : m_buf(std::addressof(b)) {}
+
+        SPIO_CONSTEXPR14 chunked_buffer* buffer() noexcept
+        {
+            return m_buf;
+        }
+        SPIO_CONSTEXPR const chunked_buffer* buffer() const noexcept
+        {
+            return m_buf;
+        }
+
+        SPIO_CONSTEXPR bool is_open() const noexcept
+        {
+            return m_buf != nullptr;
+        }
+        expected<void, failure> close() noexcept
+        {
+            Expects(m_buf != nullptr);
+            m_buf = nullptr;
+            return {};
+        }
+
+        result read(span<byte> s, bool& eof) noexcept
+        {
+            Expects(is_open());
+
+            if (SPIO_UNLIKELY(m_pos == m_buf->size() && s.size() != 0)) {
+                return make_result(0, end_of_file);
+            }
+            const auto n = m_buf->copy_to(s, m_pos);
+            m_pos += n;
+            if (m_pos == m_buf->size()) {
+                eof = true;
+            }
+            return n;
+        }
+        result read_at(span<byte> s, streampos pos, bool& eof) noexcept
+        {
+            Expects(is_open());
+
+            if (streamoff(pos) >= m_buf->size()) {
+                return make_result(0, out_of_range);
+            }
+            const auto n = m_buf->copy_to(s, streamoff(pos));
+            if (streamoff(pos) + n == m_buf->size()) {
+                eof = true;
+            }
+            return n;
+        }
+
+        // Always appends to the buffer
+        result write(span<const byte> s)
+        {
+            Expects(is_open());
+            m_buf->append(s);
+            return s.size();
+        }
+
+        expected<streamsize, failure> extent() const noexcept
+        {
+            Expects(is_open());
+            return m_buf->size();
+        }
+
+    private:
+        chunked_buffer* m_buf{nullptr};
+        streamoff m_pos{0};
+    };
+}  // namespace detail
+
+// Device over a chunked_buffer.
+// Writes append to the buffer, and reads start from the beginning.
+class chunked_device : private detail::chunked_device_impl {
+    using base = detail::chunked_device_impl;
+
+public:
+    using base::base;
+    using base::buffer;
+    using base::close;
+    using base::extent;
+    using base::is_open;
+    using base::read;
+    using base::read_at;
+    using base::write;
+};
+
+class chunked_sink : private detail::chunked_device_impl {
+    using base = detail::chunked_device_impl;
+
+public:
+    using base::base;
+    using base::buffer;
+    using base::close;
+    using base::is_open;
+    using base::write;
+};
+
+class chunked_source : private detail::chunked_device_impl {
+    using base = detail::chunked_device_impl;
+
+public:
+    using base::base;
+    using base::buffer;
+    using base::close;
+    using base::extent;
+    using base::is_open;
+    using base::read;
+    using base::read_at;
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_CHUNKED_DEVICE_H
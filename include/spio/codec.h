@@ -0,0 +1,962 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_CODEC_H
+#define SPIO_CODEC_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "error.h"
+#include "filter.h"
+#include "result.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+#if SPIO_HAS_SSE2
+#include <emmintrin.h>
+#endif
+#if SPIO_HAS_SSSE3
+#include <tmmintrin.h>
+#endif
+#if SPIO_HAS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+// Codecs operate on raw byte ranges, and are used by the filters below.
+//
+// encode_blocks() and decode_blocks() only process complete blocks,
+// and return early on anything they can't handle.
+// encode_final() and decode_final() handle the last, possibly partial or
+// padded block of the data.
+//
+// Decoding may be done in place (dst == src), otherwise dst must have
+// room for n bytes.
+
+struct base64_alphabet {
+    static const char* chars() noexcept
+    {
+        return "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+               "abcdefghijklmnopqrstuvwxyz"
+               "0123456789+/";
+    }
+    static SPIO_CONSTEXPR bool padding() noexcept
+    {
+        return true;
+    }
+};
+struct base64url_alphabet {
+    static const char* chars() noexcept
+    {
+        return "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+               "abcdefghijklmnopqrstuvwxyz"
+               "0123456789-_";
+    }
+    static SPIO_CONSTEXPR bool padding() noexcept
+    {
+        return false;
+    }
+};
+
+namespace detail {
+    inline unsigned char byte_value(byte b) noexcept
+    {
+        return static_cast<unsigned char>(b);
+    }
+    inline byte char_byte(char c) noexcept
+    {
+        return static_cast<byte>(static_cast<unsigned char>(c));
+    }
+
+    template <typename Alphabet>
+    const std::array<signed char, 256>& base64_decode_table()
+    {
+        static const auto table = [] {
+            std::array<signed char, 256> t;
+            t.fill(-1);
+            const auto chars = Alphabet::chars();
+            for (int i = 0; i < 64; ++i) {
+                t[static_cast<unsigned char>(chars[i])] =
+                    static_cast<signed char>(i);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+#if SPIO_HAS_SSSE3
+    inline __m128i base64_encode_lookup(__m128i indices, char c62, char c63)
+    {
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+        const char digit = '0' - 52;
+        const __m128i shift = _mm_setr_epi8(
+            'a' - 26, digit, digit, digit, digit, digit, digit, digit, digit,
+            digit, digit, static_cast<char>(c62 - 62),
+            static_cast<char>(c63 - 63), 'A', 0, 0);
+        result = _mm_shuffle_epi8(shift, result);
+        return _mm_add_epi8(result, indices);
+    }
+    inline __m128i base64_encode_split(__m128i input)
+    {
+        input = _mm_shuffle_epi8(input, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                                     4, 5, 3, 4, 1, 2, 0, 1));
+        const __m128i t0 = _mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00));
+        const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        const __m128i t2 = _mm_and_si128(input, _mm_set1_epi32(0x003f03f0));
+        const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t1, t3);
+    }
+
+    inline __m128i base64_in_range(__m128i v, char lo, char hi)
+    {
+        return _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+            _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+    }
+    // Returns false if any of the characters is not in the alphabet
+    inline bool base64_decode_lookup(__m128i input,
+                                     char c62,
+                                     char c63,
+                                     __m128i& values)
+    {
+        const __m128i upper = base64_in_range(input, 'A', 'Z');
+        const __m128i lower = base64_in_range(input, 'a', 'z');
+        const __m128i digit = base64_in_range(input, '0', '9');
+        const __m128i e62 = _mm_cmpeq_epi8(input, _mm_set1_epi8(c62));
+        const __m128i e63 = _mm_cmpeq_epi8(input, _mm_set1_epi8(c63));
+
+        const __m128i valid = _mm_or_si128(
+            _mm_or_si128(upper, lower),
+            _mm_or_si128(digit, _mm_or_si128(e62, e63)));
+        if (_mm_movemask_epi8(valid) != 0xffff) {
+            return false;
+        }
+
+        __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+        shift = _mm_or_si128(
+            shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+        shift = _mm_or_si128(
+            shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+        shift = _mm_or_si128(
+            shift,
+            _mm_and_si128(e62, _mm_set1_epi8(static_cast<char>(62 - c62))));
+        shift = _mm_or_si128(
+            shift,
+            _mm_and_si128(e63, _mm_set1_epi8(static_cast<char>(63 - c63))));
+        values = _mm_add_epi8(input, shift);
+        return true;
+    }
+    inline __m128i base64_decode_pack(__m128i values)
+    {
+        const __m128i merged =
+            _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        const __m128i packed =
+            _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        return _mm_shuffle_epi8(
+            packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1,
+                                  -1, -1, -1));
+    }
+#endif
+
+#if SPIO_HAS_AVX2
+    inline __m256i base64_encode_lookup(__m256i indices, char c62, char c63)
+    {
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result,
+                                 _mm256_and_si256(less, _mm256_set1_epi8(13)));
+
+        const char digit = '0' - 52;
+        const __m256i shift = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            'a' - 26, digit, digit, digit, digit, digit, digit, digit, digit,
+            digit, digit, static_cast<char>(c62 - 62),
+            static_cast<char>(c63 - 63), 'A', 0, 0));
+        result = _mm256_shuffle_epi8(shift, result);
+        return _mm256_add_epi8(result, indices);
+    }
+    inline __m256i base64_encode_split(__m256i input)
+    {
+        input = _mm256_shuffle_epi8(
+            input, _mm256_broadcastsi128_si256(_mm_set_epi8(
+                    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1)));
+        const __m256i t0 =
+            _mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 =
+            _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 =
+            _mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 =
+            _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        return _mm256_or_si256(t1, t3);
+    }
+
+    inline __m256i base64_in_range(__m256i v, char lo, char hi)
+    {
+        return _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v));
+    }
+    inline bool base64_decode_lookup(__m256i input,
+                                     char c62,
+                                     char c63,
+                                     __m256i& values)
+    {
+        const __m256i upper = base64_in_range(input, 'A', 'Z');
+        const __m256i lower = base64_in_range(input, 'a', 'z');
+        const __m256i digit = base64_in_range(input, '0', '9');
+        const __m256i e62 = _mm256_cmpeq_epi8(input, _mm256_set1_epi8(c62));
+        const __m256i e63 = _mm256_cmpeq_epi8(input, _mm256_set1_epi8(c63));
+
+        const __m256i valid = _mm256_or_si256(
+            _mm256_or_si256(upper, lower),
+            _mm256_or_si256(digit, _mm256_or_si256(e62, e63)));
+        if (_mm256_movemask_epi8(valid) != -1) {
+            return false;
+        }
+
+        __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+        shift = _mm256_or_si256(
+            shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+        shift = _mm256_or_si256(
+            shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+        shift = _mm256_or_si256(
+            shift, _mm256_and_si256(
+                       e62, _mm256_set1_epi8(static_cast<char>(62 - c62))));
+        shift = _mm256_or_si256(
+            shift, _mm256_and_si256(
+                       e63, _mm256_set1_epi8(static_cast<char>(63 - c63))));
+        values = _mm256_add_epi8(input, shift);
+        return true;
+    }
+    inline __m256i base64_decode_pack(__m256i values)
+    {
+        const __m256i merged =
+            _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i packed =
+            _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(
+            packed, _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+        return _mm256_permutevar8x32_epi32(
+            packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    }
+#endif
+
+#if SPIO_HAS_SSE2
+    inline __m128i hex_encode_nibbles(__m128i n)
+    {
+        const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)),
+                                            _mm_set1_epi8('a' - '0' - 10));
+        return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), alpha);
+    }
+    // Returns false if any of the characters is not a hex digit
+    inline bool hex_decode_nibbles(__m128i input, __m128i& values)
+    {
+        const __m128i d = _mm_sub_epi8(input, _mm_set1_epi8('0'));
+        const __m128i dv = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)),
+                                         _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+        const __m128i l = _mm_sub_epi8(_mm_or_si128(input, _mm_set1_epi8(0x20)),
+                                       _mm_set1_epi8('a'));
+        const __m128i lv = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)),
+                                         _mm_cmplt_epi8(l, _mm_set1_epi8(6)));
+        if (_mm_movemask_epi8(_mm_or_si128(dv, lv)) != 0xffff) {
+            return false;
+        }
+        values = _mm_or_si128(
+            _mm_and_si128(dv, d),
+            _mm_and_si128(lv, _mm_add_epi8(l, _mm_set1_epi8(10))));
+        return true;
+    }
+    inline __m128i hex_decode_pack(__m128i values)
+    {
+        const __m128i hi = _mm_and_si128(values, _mm_set1_epi16(0x00ff));
+        const __m128i lo = _mm_srli_epi16(values, 8);
+        return _mm_or_si128(_mm_slli_epi16(hi, 4), lo);
+    }
+#endif
+
+#if SPIO_HAS_AVX2
+    inline __m256i hex_encode_nibbles(__m256i n)
+    {
+        const __m256i alpha =
+            _mm256_and_si256(_mm256_cmpgt_epi8(n, _mm256_set1_epi8(9)),
+                             _mm256_set1_epi8('a' - '0' - 10));
+        return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')),
+                               alpha);
+    }
+    inline bool hex_decode_nibbles(__m256i input, __m256i& values)
+    {
+        const __m256i d = _mm256_sub_epi8(input, _mm256_set1_epi8('0'));
+        const __m256i dv =
+            _mm256_and_si256(_mm256_cmpgt_epi8(d, _mm256_set1_epi8(-1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8(10), d));
+        const __m256i l =
+            _mm256_sub_epi8(_mm256_or_si256(input, _mm256_set1_epi8(0x20)),
+                            _mm256_set1_epi8('a'));
+        const __m256i lv =
+            _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8(-1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8(6), l));
+        if (_mm256_movemask_epi8(_mm256_or_si256(dv, lv)) != -1) {
+            return false;
+        }
+        values = _mm256_or_si256(
+            _mm256_and_si256(dv, d),
+            _mm256_and_si256(lv, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+        return true;
+    }
+    inline __m256i hex_decode_pack(__m256i values)
+    {
+        const __m256i hi = _mm256_and_si256(values, _mm256_set1_epi16(0x00ff));
+        const __m256i lo = _mm256_srli_epi16(values, 8);
+        return _mm256_or_si256(_mm256_slli_epi16(hi, 4), lo);
+    }
+#endif
+}  // namespace detail
+
+template <typename Alphabet>
+struct base64_codec {
+    using alphabet_type = Alphabet;
+    using size_type = std::ptrdiff_t;
+
+    static SPIO_CONSTEXPR size_type decoded_block_size() noexcept
+    {
+        return 3;
+    }
+    static SPIO_CONSTEXPR size_type encoded_block_size() noexcept
+    {
+        return 4;
+    }
+
+    static size_type encode_blocks(const byte* src, size_type n, byte* dst)
+    {
+        const auto chars = Alphabet::chars();
+        size_type i = 0;
+#if SPIO_HAS_AVX2
+        for (; i + 28 <= n; i += 24, dst += 32) {
+            const __m256i input = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12)),
+                1);
+            _mm256_storeu_si256(
+                reinterpret_cast<__m256i*>(dst),
+                detail::base64_encode_lookup(detail::base64_encode_split(input),
+                                             chars[62], chars[63]));
+        }
+#endif
+#if SPIO_HAS_SSSE3
+        for (; i + 16 <= n; i += 12, dst += 16) {
+            const __m128i input =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(dst),
+                detail::base64_encode_lookup(detail::base64_encode_split(input),
+                                             chars[62], chars[63]));
+        }
+#endif
+        for (; i + 3 <= n; i += 3, dst += 4) {
+            const auto a = detail::byte_value(src[i]);
+            const auto b = detail::byte_value(src[i + 1]);
+            const auto c = detail::byte_value(src[i + 2]);
+            dst[0] = detail::char_byte(chars[a >> 2]);
+            dst[1] = detail::char_byte(chars[((a & 0x03) << 4) | (b >> 4)]);
+            dst[2] = detail::char_byte(chars[((b & 0x0f) << 2) | (c >> 6)]);
+            dst[3] = detail::char_byte(chars[c & 0x3f]);
+        }
+        return i;
+    }
+    static size_type encode_final(const byte* src, size_type n, byte* dst)
+    {
+        Expects(n < decoded_block_size());
+        if (n == 0) {
+            return 0;
+        }
+        const auto chars = Alphabet::chars();
+        const auto a = detail::byte_value(src[0]);
+        const auto b = n == 2 ? detail::byte_value(src[1]) : 0u;
+        dst[0] = detail::char_byte(chars[a >> 2]);
+        dst[1] = detail::char_byte(chars[((a & 0x03) << 4) | (b >> 4)]);
+        if (n == 2) {
+            dst[2] = detail::char_byte(chars[(b & 0x0f) << 2]);
+        }
+        if (!Alphabet::padding()) {
+            return n + 1;
+        }
+        if (n == 1) {
+            dst[2] = detail::char_byte('=');
+        }
+        dst[3] = detail::char_byte('=');
+        return 4;
+    }
+
+    static size_type decode_blocks(const byte* src,
+                                   size_type n,
+                                   byte* dst,
+                                   size_type& consumed)
+    {
+        size_type i = 0;
+        auto pos = dst;
+        // The vector stores write 32 or 16 bytes, of which only 24 or 12
+        // are decoded: stop while the whole store still fits in the
+        // n / 4 * 3 bytes of dst, and let the scalar loop finish
+#if SPIO_HAS_AVX2
+        {
+            const auto chars = Alphabet::chars();
+            for (; i + 44 <= n; i += 32, pos += 24) {
+                __m256i values;
+                if (!detail::base64_decode_lookup(
+                        _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>(src + i)),
+                        chars[62], chars[63], values)) {
+                    break;
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pos),
+                                    detail::base64_decode_pack(values));
+            }
+        }
+#endif
+#if SPIO_HAS_SSSE3
+        {
+            const auto chars = Alphabet::chars();
+            for (; i + 24 <= n; i += 16, pos += 12) {
+                __m128i values;
+                if (!detail::base64_decode_lookup(
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(src + i)),
+                        chars[62], chars[63], values)) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pos),
+                                 detail::base64_decode_pack(values));
+            }
+        }
+#endif
+        const auto& table = detail::base64_decode_table<Alphabet>();
+        for (; i + 4 <= n; i += 4, pos += 3) {
+            const auto a = table[detail::byte_value(src[i])];
+            const auto b = table[detail::byte_value(src[i + 1])];
+            const auto c = table[detail::byte_value(src[i + 2])];
+            const auto d = table[detail::byte_value(src[i + 3])];
+            if ((a | b | c | d) < 0) {
+                break;
+            }
+            const auto v = static_cast<std::uint32_t>(a << 18 | b << 12 |
+                                                      c << 6 | d);
+            pos[0] = static_cast<byte>(v >> 16);
+            pos[1] = static_cast<byte>((v >> 8) & 0xff);
+            pos[2] = static_cast<byte>(v & 0xff);
+        }
+        consumed = i;
+        return pos - dst;
+    }
+    // Returns -1 if the block is invalid
+    static size_type decode_final(const byte* src, size_type n, byte* dst)
+    {
+        Expects(n <= encoded_block_size());
+        auto len = n;
+        while (len > 0 && n - len < 2 &&
+               src[len - 1] == detail::char_byte('=')) {
+            --len;
+        }
+        if (len < 2) {
+            return -1;
+        }
+
+        const auto& table = detail::base64_decode_table<Alphabet>();
+        std::uint32_t v = 0;
+        for (size_type i = 0; i < len; ++i) {
+            const auto c = table[detail::byte_value(src[i])];
+            if (c < 0) {
+                return -1;
+            }
+            v |= static_cast<std::uint32_t>(c) << (18 - 6 * i);
+        }
+        for (size_type i = 0; i < len - 1; ++i) {
+            dst[i] = static_cast<byte>((v >> (16 - 8 * i)) & 0xff);
+        }
+        return len - 1;
+    }
+};
+
+struct hex_codec {
+    using size_type = std::ptrdiff_t;
+
+    static SPIO_CONSTEXPR size_type decoded_block_size() noexcept
+    {
+        return 1;
+    }
+    static SPIO_CONSTEXPR size_type encoded_block_size() noexcept
+    {
+        return 2;
+    }
+
+    static size_type encode_blocks(const byte* src, size_type n, byte* dst)
+    {
+        size_type i = 0;
+#if SPIO_HAS_AVX2
+        for (; i + 32 <= n; i += 32, dst += 64) {
+            const __m256i input =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i mask = _mm256_set1_epi8(0x0f);
+            const __m256i hi = detail::hex_encode_nibbles(
+                _mm256_and_si256(_mm256_srli_epi16(input, 4), mask));
+            const __m256i lo =
+                detail::hex_encode_nibbles(_mm256_and_si256(input, mask));
+            const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+            const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32),
+                                _mm256_permute2x128_si256(a, b, 0x31));
+        }
+#endif
+#if SPIO_HAS_SSE2
+        for (; i + 16 <= n; i += 16, dst += 32) {
+            const __m128i input =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i mask = _mm_set1_epi8(0x0f);
+            const __m128i hi = detail::hex_encode_nibbles(
+                _mm_and_si128(_mm_srli_epi16(input, 4), mask));
+            const __m128i lo =
+                detail::hex_encode_nibbles(_mm_and_si128(input, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                             _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16),
+                             _mm_unpackhi_epi8(hi, lo));
+        }
+#endif
+        const auto chars = "0123456789abcdef";
+        for (; i < n; ++i, dst += 2) {
+            const auto v = detail::byte_value(src[i]);
+            dst[0] = detail::char_byte(chars[v >> 4]);
+            dst[1] = detail::char_byte(chars[v & 0x0f]);
+        }
+        return i;
+    }
+    static size_type encode_final(const byte*, size_type n, byte*)
+    {
+        SPIO_UNUSED(n);
+        Expects(n == 0);
+        return 0;
+    }
+
+    static size_type decode_blocks(const byte* src,
+                                   size_type n,
+                                   byte* dst,
+                                   size_type& consumed)
+    {
+        size_type i = 0;
+        auto pos = dst;
+#if SPIO_HAS_AVX2
+        for (; i + 64 <= n; i += 64, pos += 32) {
+            __m256i a, b;
+            if (!detail::hex_decode_nibbles(
+                    _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(src + i)),
+                    a) ||
+                !detail::hex_decode_nibbles(
+                    _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(src + i + 32)),
+                    b)) {
+                break;
+            }
+            const __m256i packed = _mm256_packus_epi16(
+                detail::hex_decode_pack(a), detail::hex_decode_pack(b));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pos),
+                                _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+#endif
+#if SPIO_HAS_SSE2
+        for (; i + 32 <= n; i += 32, pos += 16) {
+            __m128i a, b;
+            if (!detail::hex_decode_nibbles(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)),
+                    a) ||
+                !detail::hex_decode_nibbles(
+                    _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(src + i + 16)),
+                    b)) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pos),
+                             _mm_packus_epi16(detail::hex_decode_pack(a),
+                                              detail::hex_decode_pack(b)));
+        }
+#endif
+        for (; i + 2 <= n; i += 2, ++pos) {
+            const auto hi = nibble(src[i]);
+            const auto lo = nibble(src[i + 1]);
+            if ((hi | lo) < 0) {
+                break;
+            }
+            *pos = static_cast<byte>(hi << 4 | lo);
+        }
+        consumed = i;
+        return pos - dst;
+    }
+    static size_type decode_final(const byte*, size_type, byte*)
+    {
+        // Every complete block is consumed by decode_blocks()
+        return -1;
+    }
+
+private:
+    static int nibble(byte b) noexcept
+    {
+        const auto c = detail::byte_value(b);
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+};
+
+namespace detail {
+    // Decodes data in place, keeping an incomplete trailing block
+    // until the next call
+    template <typename Codec>
+    class block_decoder {
+    public:
+        using size_type = std::ptrdiff_t;
+
+        // The caller is responsible for prepending carry() to data.
+        // Returns the number of bytes produced, or -1 on invalid input
+        size_type decode(byte* data, size_type n, bool last)
+        {
+            return decode(data, n, data, last);
+        }
+        // Like above, but writes the output to out
+        size_type decode(const byte* in, size_type n, byte* out, bool last)
+        {
+            const auto block = Codec::encoded_block_size();
+            m_carry_size = 0;
+            if (m_done) {
+                m_done = !last;
+                return n == 0 ? 0 : -1;
+            }
+
+            size_type consumed = 0;
+            const auto produced = Codec::decode_blocks(in, n, out, consumed);
+            const auto src = in + consumed;
+            const auto rest = n - consumed;
+            if (rest == 0) {
+                return produced;
+            }
+            if (rest < block && !last) {
+                std::copy(src, src + rest, m_carry.begin());
+                m_carry_size = rest;
+                return produced;
+            }
+            if (rest > block) {
+                return -1;
+            }
+
+            // Padded or otherwise partial last block,
+            // nothing may follow it
+            const auto r = Codec::decode_final(src, rest, out + produced);
+            if (r < 0) {
+                return -1;
+            }
+            m_done = !last;
+            return produced + r;
+        }
+
+        span<const byte> carry() const noexcept
+        {
+            return make_span(m_carry.data(), m_carry_size);
+        }
+        bool has_carry() const noexcept
+        {
+            return m_carry_size != 0;
+        }
+
+    private:
+        std::array<byte, 4> m_carry{};
+        size_type m_carry_size{0};
+        bool m_done{false};
+    };
+}  // namespace detail
+
+// Output filter encoding its input with Codec.
+// Incomplete blocks at the end of a write are kept until the next one:
+// call finish() before the last write to flush them.
+// spio::finish() and close() on a stream do that as well.
+template <typename Codec>
+class basic_encoding_output_filter : public output_filter {
+public:
+    using codec_type = Codec;
+
+    basic_encoding_output_filter() = default;
+    // The buffer is allocated from r, which must outlive the filter
+    explicit basic_encoding_output_filter(memory_resource* r)
+        : m_buf(aligned_allocator<byte>(r))
+    {
+    }
+
+    result write(buffer_type& data) override
+    {
+        const auto in_block = Codec::decoded_block_size();
+        const auto out_block = Codec::encoded_block_size();
+        const auto total = m_carry_size + static_cast<size_type>(data.size());
+        m_buf.resize(static_cast<std::size_t>((total + in_block - 1) /
+                                              in_block * out_block));
+
+        auto src = data.data();
+        const auto end = data.data() + data.size();
+        auto dst = m_buf.data();
+        if (m_carry_size != 0) {
+            while (m_carry_size < in_block && src != end) {
+                m_carry[static_cast<std::size_t>(m_carry_size++)] = *src++;
+            }
+            if (m_carry_size == in_block) {
+                dst += Codec::encode_blocks(m_carry.data(), in_block, dst) /
+                       in_block * out_block;
+                m_carry_size = 0;
+            }
+        }
+
+        const auto consumed = Codec::encode_blocks(src, end - src, dst);
+        src += consumed;
+        dst += consumed / in_block * out_block;
+        std::copy(src, end, m_carry.begin() + m_carry_size);
+        m_carry_size += end - src;
+
+        if (m_last) {
+            dst += Codec::encode_final(m_carry.data(), m_carry_size, dst);
+            m_carry_size = 0;
+            m_last = false;
+        }
+
+        m_buf.resize(static_cast<std::size_t>(dst - m_buf.data()));
+        detail::exchange_buffers(data, m_buf);
+        return static_cast<size_type>(data.size());
+    }
+    result write_final(buffer_type& data) override
+    {
+        finish();
+        return write(data);
+    }
+
+    // Treat the next write as the last one,
+    // flushing and padding the last block
+    void finish() noexcept
+    {
+        m_last = true;
+    }
+    bool has_pending() const noexcept
+    {
+        return m_carry_size != 0;
+    }
+
+private:
+    buffer_type m_buf{};
+    std::array<byte, 4> m_carry{};
+    size_type m_carry_size{0};
+    bool m_last{false};
+};
+
+// Output filter decoding its input with Codec
+template <typename Codec>
+class basic_decoding_output_filter : public output_filter {
+public:
+    using codec_type = Codec;
+
+    basic_decoding_output_filter() = default;
+    // The buffer is allocated from r, which must outlive the filter
+    explicit basic_decoding_output_filter(memory_resource* r)
+        : m_buf(aligned_allocator<byte>(r))
+    {
+    }
+
+    result write(buffer_type& data) override
+    {
+        const auto last = m_last;
+        m_last = false;
+        if (!m_decoder.has_carry()) {
+            const auto n = m_decoder.decode(
+                data.data(), static_cast<size_type>(data.size()), last);
+            if (n < 0) {
+                return make_result(0,
+                                   failure{invalid_input, "Invalid encoding"});
+            }
+            data.resize(static_cast<std::size_t>(n));
+            return n;
+        }
+
+        // The block carried over from the last write is completed in a
+        // small scratch buffer, and decoded with the rest of data to m_buf
+        const auto block = Codec::encoded_block_size();
+        const auto carry = m_decoder.carry();
+        std::array<byte, 4> scratch{};
+        std::copy(carry.begin(), carry.end(), scratch.begin());
+        const auto taken = std::min(static_cast<size_type>(data.size()),
+                                    block - carry.size());
+        std::copy(data.begin(), data.begin() + taken,
+                  scratch.begin() + carry.size());
+        const auto rest = static_cast<size_type>(data.size()) - taken;
+        m_buf.resize(static_cast<std::size_t>(
+            (rest / block + 2) * Codec::decoded_block_size()));
+
+        const auto first = m_decoder.decode(
+            scratch.data(), carry.size() + taken, m_buf.data(),
+            last && rest == 0);
+        // An incomplete block is carried again if there's nothing more
+        const auto second =
+            first < 0 || rest == 0
+                ? 0
+                : m_decoder.decode(data.data() + taken, rest,
+                                   m_buf.data() + first, last);
+        if (first < 0 || second < 0) {
+            return make_result(0, failure{invalid_input, "Invalid encoding"});
+        }
+        m_buf.resize(static_cast<std::size_t>(first + second));
+        detail::exchange_buffers(data, m_buf);
+        return static_cast<size_type>(data.size());
+    }
+    result write_final(buffer_type& data) override
+    {
+        finish();
+        return write(data);
+    }
+
+    // Treat the next write as the last one,
+    // allowing it to end in an unpadded partial block
+    void finish() noexcept
+    {
+        m_last = true;
+    }
+    bool has_pending() const noexcept
+    {
+        return m_decoder.has_carry();
+    }
+
+private:
+    detail::block_decoder<Codec> m_decoder{};
+    buffer_type m_buf{};
+    bool m_last{false};
+};
+
+// Input filter decoding its input with Codec.
+// The data is decoded in place, and the span shrunk to the decoded size.
+// An unpadded partial block is only accepted at the end of the input,
+// see read_final().
+template <typename Codec>
+class basic_decoding_input_filter : public input_filter {
+public:
+    using codec_type = Codec;
+
+    basic_decoding_input_filter() = default;
+    // Buffers are allocated from r, which must outlive the filter
+    explicit basic_decoding_input_filter(memory_resource* r)
+        : m_buf(aligned_allocator<byte>(r)),
+          m_pending(aligned_allocator<byte>(r))
+    {
+    }
+
+    result read(buffer_type& data) override
+    {
+        return _read(data, data.size(), false);
+    }
+    result read_final(buffer_type& data, size_type n) override
+    {
+        return _read(data, n, true);
+    }
+
+    bool has_pending() const noexcept
+    {
+        return !m_pending.empty() || m_decoder.has_carry();
+    }
+
+private:
+    // The first n bytes of data are input, and the decoded output can
+    // take up all of it
+    result _read(buffer_type& data, size_type n, bool last)
+    {
+        if (m_pending.empty() && !m_decoder.has_carry()) {
+            const auto produced = m_decoder.decode(data.data(), n, last);
+            if (produced < 0) {
+                return make_result(0,
+                                   failure{invalid_input, "Invalid encoding"});
+            }
+            data = data.first(produced);
+            return produced;
+        }
+
+        // Decoded output of the previous call that didn't fit, and
+        // the carried incomplete block, go before data
+        const auto carry = m_decoder.carry();
+        m_buf.assign(m_pending.begin(), m_pending.end());
+        m_buf.insert(m_buf.end(), carry.begin(), carry.end());
+        m_buf.insert(m_buf.end(), data.begin(), data.begin() + n);
+
+        const auto offset = static_cast<size_type>(m_pending.size());
+        const auto produced = m_decoder.decode(
+            m_buf.data() + offset,
+            static_cast<size_type>(m_buf.size()) - offset, last);
+        if (produced < 0) {
+            return make_result(0, failure{invalid_input, "Invalid encoding"});
+        }
+
+        const auto total = m_buf.begin() + offset + produced;
+        const auto len = std::min(offset + produced, data.size());
+        std::copy(m_buf.begin(), m_buf.begin() + len, data.begin());
+        m_pending.assign(m_buf.begin() + len, total);
+        data = data.first(len);
+        return len;
+    }
+
+    detail::block_decoder<Codec> m_decoder{};
+    byte_buffer m_buf{};
+    byte_buffer m_pending{};
+};
+
+using base64_encode_filter =
+    basic_encoding_output_filter<base64_codec<base64_alphabet>>;
+using base64url_encode_filter =
+    basic_encoding_output_filter<base64_codec<base64url_alphabet>>;
+using hex_encode_filter = basic_encoding_output_filter<hex_codec>;
+
+using base64_decode_filter =
+    basic_decoding_output_filter<base64_codec<base64_alphabet>>;
+using base64url_decode_filter =
+    basic_decoding_output_filter<base64_codec<base64url_alphabet>>;
+using hex_decode_filter = basic_decoding_output_filter<hex_codec>;
+
+using base64_decode_input_filter =
+    basic_decoding_input_filter<base64_codec<base64_alphabet>>;
+using base64url_decode_input_filter =
+    basic_decoding_input_filter<base64_codec<base64url_alphabet>>;
+using hex_decode_input_filter = basic_decoding_input_filter<hex_codec>;
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_CODEC_H
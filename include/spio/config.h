@@ -23,6 +23,7 @@
 #define SPIO_STD_11 201103L
 #define SPIO_STD_14 201402L
 #define SPIO_STD_17 201703L
+#define SPIO_STD_20 202002L
 
 #define SPIO_COMPILER(major, minor, patch) \
     ((major)*10000000 /* 10,000,000 */ + (minor)*10000 /* 10,000 */ + (patch))
@@ -101,6 +102,12 @@
 #define SPIO_POSIX 0
 #endif
 
+#ifdef __linux__
+#define SPIO_HAS_EPOLL 1
+#else
+#define SPIO_HAS_EPOLL 0
+#endif
+
 #ifdef _MSVC_LANG
 #define SPIO_MSVC_LANG _MSVC_LANG
 #else
@@ -204,6 +211,23 @@
 #define SPIO_HAS_DEDUCTION_GUIDES 0
 #endif
 
+// Detect C++20 coroutines
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && \
+    SPIO_HAS_INCLUDE(<coroutine>) &&                                     \
+    (__cplusplus >= SPIO_STD_20 || SPIO_MSVC_LANG >= SPIO_STD_20)
+#define SPIO_HAS_COROUTINES 1
+#else
+#define SPIO_HAS_COROUTINES 0
+#endif
+
+// Detect std::pmr
+#if (SPIO_HAS_INCLUDE(<memory_resource>) && __cplusplus >= SPIO_STD_17) || \
+    (SPIO_MSVC >= SPIO_COMPILER(19, 13, 0) && SPIO_MSVC_LANG >= SPIO_STD_17)
+#define SPIO_HAS_STD_PMR 1
+#else
+#define SPIO_HAS_STD_PMR 0
+#endif
+
 // Detect [[nodiscard]]
 #if (SPIO_HAS_CPP_ATTRIBUTE(nodiscard) && __cplusplus >= SPIO_STD_17) || \
     (SPIO_MSVC >= SPIO_COMPILER(19, 11, 0) &&                            \
@@ -310,6 +334,37 @@
 #define SPIO_UNLIKELY(x) (x)
 #endif
 
+// Detect SIMD instruction sets
+// Define SPIO_USE_SIMD to 0 to force the scalar code paths
+#ifndef SPIO_USE_SIMD
+#define SPIO_USE_SIMD 1
+#endif
+
+#if SPIO_USE_SIMD &&                                              \
+    (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SPIO_HAS_SSE2 1
+#else
+#define SPIO_HAS_SSE2 0
+#endif
+
+#if SPIO_USE_SIMD && (defined(__SSSE3__) || defined(__AVX2__))
+#define SPIO_HAS_SSSE3 1
+#else
+#define SPIO_HAS_SSSE3 0
+#endif
+
+#if SPIO_USE_SIMD && defined(__AVX2__)
+#define SPIO_HAS_AVX2 1
+#else
+#define SPIO_HAS_AVX2 0
+#endif
+
+// Collect I/O statistics in buffered sources and sinks, see stats.h
+#ifndef SPIO_ENABLE_STATS
+#define SPIO_ENABLE_STATS 0
+#endif
+
 // Min version:
 //
 // = default:
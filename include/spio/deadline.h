@@ -0,0 +1,83 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_DEADLINE_H
+#define SPIO_DEADLINE_H
+
+#include "config.h"
+
+#include <chrono>
+#include <system_error>
+#include "error.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+// Point in time after which an operation gives up.
+// A default-constructed deadline never expires.
+class deadline {
+public:
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    SPIO_CONSTEXPR deadline() noexcept = default;
+    SPIO_CONSTEXPR deadline(time_point t) noexcept
+        : m_time(t), m_infinite(false)
+    {
+    }
+    // Relative to now
+    template <typename Rep, typename Period>
+    deadline(std::chrono::duration<Rep, Period> d)
+        : deadline(clock::now() + std::chrono::duration_cast<duration>(d))
+    {
+    }
+
+    static SPIO_CONSTEXPR deadline never() noexcept
+    {
+        return {};
+    }
+
+    SPIO_CONSTEXPR bool infinite() const noexcept
+    {
+        return m_infinite;
+    }
+    SPIO_CONSTEXPR time_point when() const noexcept
+    {
+        return m_infinite ? time_point::max() : m_time;
+    }
+
+    bool expired() const
+    {
+        return !m_infinite && clock::now() >= m_time;
+    }
+
+private:
+    time_point m_time{};
+    bool m_infinite{true};
+};
+
+inline failure timed_out_error()
+{
+    return failure{std::make_error_code(std::errc::timed_out),
+                   "Deadline expired"};
+}
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_DEADLINE_H
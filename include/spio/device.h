@@ -171,6 +171,12 @@ using syncable_op = decltype(std::declval<Device>().sync());
 template <typename Device>
 using is_syncable = is_detected<syncable_op, Device>;
 
+// sync_data() makes written data durable, like fdatasync()
+template <typename Device>
+using data_syncable_op = decltype(std::declval<Device>().sync_data());
+template <typename Device>
+using is_data_syncable = is_detected<data_syncable_op, Device>;
+
 template <typename Device>
 using relative_seekable_op =
     decltype(std::declval<Device>().seek(std::declval<streampos>(),
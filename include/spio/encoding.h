@@ -0,0 +1,111 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_ENCODING_H
+#define SPIO_ENCODING_H
+
+#include "config.h"
+
+#include "device.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+struct ascii_tag {
+};
+struct utf8_tag {
+};
+struct utf16_tag {
+};
+struct utf32_tag {
+};
+
+template <typename CharT, typename Tag = ascii_tag, typename Enable = void>
+struct encoding;
+
+namespace detail {
+    // Positions are always expressed in code units,
+    // so seeking into the middle of a multi-unit sequence is possible
+    template <typename CharT>
+    struct code_unit_encoding {
+        using value_type = CharT;
+
+        static SPIO_CONSTEXPR streampos to_device(streampos pos) noexcept
+        {
+            return pos.operator streamoff() *
+                   static_cast<streamoff>(sizeof(value_type));
+        }
+        static SPIO_CONSTEXPR streampos from_device(streampos pos) noexcept
+        {
+            return pos.operator streamoff() /
+                   static_cast<streamoff>(sizeof(value_type));
+        }
+
+        static SPIO_CONSTEXPR streamoff to_device(streamoff off) noexcept
+        {
+            return off * static_cast<streamoff>(sizeof(value_type));
+        }
+        static SPIO_CONSTEXPR streamoff from_device(streamoff off) noexcept
+        {
+            return off / static_cast<streamoff>(sizeof(value_type));
+        }
+    };
+}  // namespace detail
+
+template <typename CharT>
+struct encoding<CharT, ascii_tag> : detail::code_unit_encoding<CharT> {
+    using tag_type = ascii_tag;
+
+    static SPIO_CONSTEXPR_DECL const int max_code_units = 1;
+};
+
+template <typename CharT>
+struct encoding<CharT,
+                utf8_tag,
+                typename std::enable_if<sizeof(CharT) == 1>::type>
+    : detail::code_unit_encoding<CharT> {
+    using tag_type = utf8_tag;
+
+    static SPIO_CONSTEXPR_DECL const int max_code_units = 4;
+};
+template <typename CharT>
+struct encoding<CharT,
+                utf16_tag,
+                typename std::enable_if<sizeof(CharT) == 2>::type>
+    : detail::code_unit_encoding<CharT> {
+    using tag_type = utf16_tag;
+
+    static SPIO_CONSTEXPR_DECL const int max_code_units = 2;
+};
+template <typename CharT>
+struct encoding<CharT,
+                utf32_tag,
+                typename std::enable_if<sizeof(CharT) == 4>::type>
+    : detail::code_unit_encoding<CharT> {
+    using tag_type = utf32_tag;
+
+    static SPIO_CONSTEXPR_DECL const int max_code_units = 1;
+};
+
+using utf8 = encoding<char, utf8_tag>;
+using utf16 = encoding<char16_t, utf16_tag>;
+using utf32 = encoding<char32_t, utf32_tag>;
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_ENCODING_H
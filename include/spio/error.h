@@ -44,7 +44,9 @@ enum error {
     scanner_error,
     unimplemented,
     unreachable,
-    undefined_error
+    undefined_error,
+    // Added after the others to keep their values
+    would_block
 };
 
 SPIO_END_NAMESPACE
@@ -96,6 +98,8 @@ struct error_category : public std::error_category {
                 return "Unreachable code";
             case undefined_error:
                 return "[undefined error]";
+            case would_block:
+                return "Operation would block";
         }
         assert(false);
         std::terminate();
@@ -0,0 +1,575 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_FD_DEVICE_H
+#define SPIO_FD_DEVICE_H
+
+#include "config.h"
+
+#if SPIO_POSIX
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+#include <vector>
+#include "device.h"
+#include "error.h"
+#include "fd_util.h"
+#include "result.h"
+#include "sink.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    inline failure fd_error()
+    {
+#if EAGAIN != EWOULDBLOCK
+        if (errno == EWOULDBLOCK) {
+            return failure{would_block};
+        }
+#endif
+        if (errno == EAGAIN) {
+            return failure{would_block};
+        }
+        return failure{SPIO_MAKE_ERRNO};
+    }
+
+    inline expected<void, failure> set_fd_flag(int fd,
+                                               int get,
+                                               int set,
+                                               int flag,
+                                               bool enable)
+    {
+        const auto flags = ::fcntl(fd, get);
+        if (flags == -1) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        const auto new_flags = enable ? (flags | flag) : (flags & ~flag);
+        if (new_flags != flags && ::fcntl(fd, set, new_flags) == -1) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+    }
+}  // namespace detail
+
+// Device over a POSIX file descriptor, meant for pipes and sockets.
+// If the descriptor is in non-blocking mode, operations that can't make
+// progress return the bytes transferred so far with a would_block error,
+// see is_would_block().
+//
+// Doesn't own the descriptor: close() closes it, the destructor doesn't.
+class fd_device {
+public:
+    SPIO_CONSTEXPR fd_device() = default;
+    explicit fd_device(int fd) noexcept : m_fd(fd), m_socket(_is_socket(fd))
+    {
+    }
+
+    SPIO_CONSTEXPR bool is_open() const noexcept
+    {
+        return m_fd != -1;
+    }
+    expected<void, failure> close() noexcept
+    {
+        Expects(is_open());
+        const auto fd = m_fd;
+        m_fd = -1;
+        if (::close(fd) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+    }
+
+    SPIO_CONSTEXPR int handle() const noexcept
+    {
+        return m_fd;
+    }
+
+    expected<void, failure> set_nonblocking(bool enable = true)
+    {
+        Expects(is_open());
+        return detail::set_fd_flag(m_fd, F_GETFL, F_SETFL, O_NONBLOCK,
+                                   enable);
+    }
+
+    expected<void, failure> sync_data()
+    {
+        Expects(is_open());
+        return detail::sync_fd_data(m_fd);
+    }
+
+    // Reads what's available, up to s.size() bytes
+    result read(span<byte> s, bool& eof)
+    {
+        Expects(is_open());
+
+        if (s.empty()) {
+            return 0;
+        }
+        while (true) {
+            const auto n =
+                ::read(m_fd, s.data(), static_cast<std::size_t>(s.size()));
+            if (n > 0) {
+                return n;
+            }
+            if (n == 0) {
+                eof = true;
+                return 0;
+            }
+            if (errno != EINTR) {
+                return make_result(0, detail::fd_error());
+            }
+        }
+    }
+
+    // Writes all of s, unless an error occurs or the descriptor is
+    // non-blocking and full
+    result write(span<const byte> s)
+    {
+        Expects(is_open());
+
+        streamsize written = 0;
+        while (written < s.size()) {
+            const auto n = _write_some(s.subspan(written));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return make_result(written, detail::fd_error());
+            }
+            written += n;
+        }
+        return written;
+    }
+
+private:
+    static bool _is_socket(int fd) noexcept
+    {
+        struct stat st;
+        return fd != -1 && ::fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+
+    streamsize _write_some(span<const byte> s) noexcept
+    {
+        const auto size = static_cast<std::size_t>(s.size());
+#ifdef MSG_NOSIGNAL
+        // Report EPIPE instead of raising SIGPIPE
+        if (m_socket) {
+            return ::send(m_fd, s.data(), size, MSG_NOSIGNAL);
+        }
+#endif
+        return ::write(m_fd, s.data(), size);
+    }
+
+    int m_fd{-1};
+    bool m_socket{false};
+};
+
+static_assert(is_sink<fd_device>::value, "");
+static_assert(is_source<fd_device>::value, "");
+
+// How fd_file_device::write_tail() writes a partial block in direct mode
+enum class direct_tail {
+    // Pad the block with zeros, and truncate the padding off when the
+    // device is synced or closed
+    pad,
+    // Write the partial block through the page cache
+    buffered
+};
+
+// fd_device over a regular file.
+// In direct mode (O_DIRECT) the page cache is bypassed, and writes must
+// be whole blocks at block-aligned offsets from block-aligned memory:
+// use a basic_buffered_writable with the same block size, and don't open
+// the file with O_APPEND.
+// With direct_tail::pad, the file can be longer than extent() until
+// sync_data(), close() or set_direct(false) truncates the padding.
+// The offset is tracked by the device: move it with seek(), or call
+// invalidate_offset() after moving it through handle().
+class fd_file_device : public fd_device {
+public:
+    SPIO_CONSTEXPR fd_file_device() = default;
+    explicit fd_file_device(int fd) noexcept : fd_device(fd) {}
+
+    expected<void, failure> close() noexcept
+    {
+        Expects(is_open());
+        auto r = _truncate_padding();
+        auto c = fd_device::close();
+        if (!r) {
+            return r;
+        }
+        return c;
+    }
+
+    expected<void, failure> sync_data()
+    {
+        Expects(is_open());
+        auto r = _truncate_padding();
+        if (!r) {
+            return r;
+        }
+        return fd_device::sync_data();
+    }
+
+    result read(span<byte> s, bool& eof)
+    {
+        auto r = fd_device::read(s, eof);
+        if (m_offset != -1) {
+            m_offset += r.value();
+        }
+        return r;
+    }
+
+    result write(span<const byte> s)
+    {
+        auto r = fd_device::write(s);
+        if (m_offset != -1) {
+            m_offset += r.value();
+        }
+        if (m_logical_size != -1 && r.value() > 0) {
+            const auto off = _offset();
+            if (off != -1 && off >= m_padded_end) {
+                // The padding has been overwritten
+                m_logical_size = -1;
+                m_padded_end = 0;
+            }
+            else if (off != -1) {
+                m_logical_size = std::max(m_logical_size, off);
+            }
+        }
+        return r;
+    }
+
+    expected<streampos, failure> seek(streampos pos, inout which = in | out)
+    {
+        SPIO_UNUSED(which);
+        return seek(streamoff(pos), seekdir::beg);
+    }
+    expected<streampos, failure> seek(streamoff off,
+                                      seekdir dir,
+                                      inout which = in | out)
+    {
+        SPIO_UNUSED(which);
+        Expects(is_open());
+
+        const auto origin = [&]() {
+            if (dir == seekdir::beg) {
+                return SEEK_SET;
+            }
+            if (dir == seekdir::cur) {
+                return SEEK_CUR;
+            }
+            return SEEK_END;
+        }();
+        const auto p = ::lseek(handle(), detail::int_cast<off_t>(off), origin);
+        if (p == -1) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        m_offset = static_cast<streamsize>(p);
+        return static_cast<streampos>(p);
+    }
+    // Call after the offset of handle() was moved by something else than
+    // the device, so that it's queried again when needed
+    void invalidate_offset() noexcept
+    {
+        m_offset = -1;
+    }
+
+    // Allocates the blocks in [offset, offset + len), so that writes there
+    // don't have to. With keep_size, the file size isn't changed.
+    expected<void, failure> preallocate(streampos offset,
+                                        streamsize len,
+                                        bool keep_size = true)
+    {
+        Expects(is_open());
+        Expects(len > 0);
+        return detail::preallocate_fd(handle(), offset, len, keep_size);
+    }
+
+    expected<streamsize, failure> truncate(streamsize newsize)
+    {
+        Expects(is_open());
+        if (::ftruncate(handle(), detail::int_cast<off_t>(newsize)) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        m_logical_size = -1;
+        m_padded_end = 0;
+        return newsize;
+    }
+    // Doesn't include the padding written by write_tail()
+    expected<streamsize, failure> extent() const
+    {
+        Expects(is_open());
+        if (m_logical_size != -1) {
+            return m_logical_size;
+        }
+        struct stat st;
+        if (::fstat(handle(), &st) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return detail::int_cast<streamsize>(st.st_size);
+    }
+
+    // block must be a multiple of the logical block size of the
+    // file system, usually 512 or 4096
+    expected<void, failure> set_direct(bool enable = true,
+                                       streamsize block = 4096,
+                                       direct_tail tail = direct_tail::pad)
+    {
+        Expects(is_open());
+        Expects(block > 0 && (block & (block - 1)) == 0);
+        if (!enable) {
+            auto t = _truncate_padding();
+            if (!t) {
+                return t;
+            }
+        }
+        auto r = _set_direct_flag(enable);
+        if (r) {
+            m_block = enable ? block : 0;
+            m_tail = tail;
+        }
+        return r;
+    }
+    // 0 if not in direct mode
+    SPIO_CONSTEXPR streamsize block_size() const noexcept
+    {
+        return m_block;
+    }
+    SPIO_CONSTEXPR direct_tail tail_mode() const noexcept
+    {
+        return m_tail;
+    }
+
+    // Writes s, the partial block at the end of the output, at the current
+    // offset without moving it, so that the whole block can be written
+    // over it later
+    result write_tail(span<const byte> s)
+    {
+        Expects(is_open());
+
+        const auto pos = _offset();
+        if (pos == -1) {
+            return make_result(0, failure{SPIO_MAKE_ERRNO});
+        }
+        if (m_block == 0) {
+            return _pwrite_all(s, pos);
+        }
+        if (m_tail == direct_tail::buffered) {
+            auto r = _set_direct_flag(false);
+            if (!r) {
+                return make_result(0, r.error());
+            }
+            auto ret = _pwrite_all(s, pos);
+            r = _set_direct_flag(true);
+            if (!ret.has_error() && !r) {
+                return make_result(ret.value(), r.error());
+            }
+            return ret;
+        }
+
+        auto size = extent();
+        if (!size) {
+            return make_result(0, size.error());
+        }
+        const auto padded = (s.size() + m_block - 1) / m_block * m_block;
+        std::vector<byte, aligned_allocator<byte>> block(
+            static_cast<std::size_t>(padded),
+            aligned_allocator<byte>(static_cast<std::size_t>(m_block)));
+        std::copy(s.begin(), s.end(), block.begin());
+        auto ret = _pwrite_all(make_span(block), pos);
+        if (ret.has_error()) {
+            return make_result(std::min(ret.value(), s.size()), ret.error());
+        }
+        // Don't cut off anything that was there before.
+        // Truncating now would also free the blocks preallocated past the
+        // end of the file, so it's deferred to sync_data() or close().
+        const auto end = std::max(size.value(), pos + s.size());
+        if (pos + padded > end) {
+            m_logical_size = end;
+            m_padded_end = std::max(m_padded_end, pos + padded);
+        }
+        return s.size();
+    }
+
+private:
+    // The current offset, queried from the descriptor only the first time
+    streamsize _offset()
+    {
+        if (m_offset == -1) {
+            const auto off = ::lseek(handle(), 0, SEEK_CUR);
+            if (off != -1) {
+                m_offset = static_cast<streamsize>(off);
+            }
+        }
+        return m_offset;
+    }
+
+    expected<void, failure> _truncate_padding()
+    {
+        if (m_logical_size == -1) {
+            return {};
+        }
+        auto r = truncate(m_logical_size);
+        if (!r) {
+            return make_unexpected(r.error());
+        }
+        return {};
+    }
+
+    expected<void, failure> _set_direct_flag(bool enable)
+    {
+#if defined(O_DIRECT)
+        return detail::set_fd_flag(handle(), F_GETFL, F_SETFL, O_DIRECT,
+                                   enable);
+#elif defined(F_NOCACHE)
+        if (::fcntl(handle(), F_NOCACHE, enable ? 1 : 0) == -1) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+#else
+        SPIO_UNUSED(enable);
+        return make_unexpected(
+            failure{unimplemented, "Direct I/O not supported"});
+#endif
+    }
+
+    result _pwrite_all(span<const byte> s, streamsize pos)
+    {
+        streamsize written = 0;
+        while (written < s.size()) {
+            const auto n = ::pwrite(
+                handle(), s.data() + written,
+                static_cast<std::size_t>(s.size() - written),
+                detail::int_cast<off_t>(pos + written));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return make_result(written, detail::fd_error());
+            }
+            written += n;
+        }
+        return written;
+    }
+
+    streamsize m_block{0};
+    direct_tail m_tail{direct_tail::pad};
+    // Size of the file without the padding of the last write_tail(),
+    // -1 if there's no padding to truncate
+    streamsize m_logical_size{-1};
+    streamsize m_padded_end{0};
+    // Offset of the descriptor, -1 if not known yet
+    streamsize m_offset{-1};
+};
+
+static_assert(is_sink<fd_file_device>::value, "");
+static_assert(has_write_tail<fd_file_device>::value, "");
+
+// Whether Device is backed by a POSIX file descriptor, returned by handle()
+template <typename Device>
+using fd_handle_op = decltype(std::declval<const Device&>().handle());
+template <typename Device>
+using is_fd_backed = std::is_same<detected_t<fd_handle_op, Device>, int>;
+
+namespace detail {
+    inline expected<std::pair<fd_device, fd_device>, failure> make_fd_pair(
+        int (&fds)[2])
+    {
+#ifndef __linux__
+        // Linux sets these atomically on creation
+        for (auto fd : fds) {
+            auto r = set_fd_flag(fd, F_GETFD, F_SETFD, FD_CLOEXEC, true);
+            if (r) {
+                r = set_fd_flag(fd, F_GETFL, F_SETFL, O_NONBLOCK, true);
+            }
+            if (!r) {
+                ::close(fds[0]);
+                ::close(fds[1]);
+                return make_unexpected(r.error());
+            }
+        }
+#endif
+        return std::make_pair(fd_device{fds[0]}, fd_device{fds[1]});
+    }
+}  // namespace detail
+
+// Creates a pipe, returning its read and write ends.
+// Both are non-blocking and close-on-exec.
+inline expected<std::pair<fd_device, fd_device>, failure> make_pipe()
+{
+    int fds[2];
+#ifdef __linux__
+    const auto ret = ::pipe2(fds, O_NONBLOCK | O_CLOEXEC);
+#else
+    const auto ret = ::pipe(fds);
+#endif
+    if (ret != 0) {
+        return make_unexpected(SPIO_MAKE_ERRNO);
+    }
+    return detail::make_fd_pair(fds);
+}
+
+// Creates a connected pair of local (AF_UNIX) stream sockets.
+// Both are non-blocking and close-on-exec.
+inline expected<std::pair<fd_device, fd_device>, failure> make_socket_pair()
+{
+    int fds[2];
+#ifdef __linux__
+    const auto ret = ::socketpair(
+        AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+#else
+    const auto ret = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+#endif
+    if (ret != 0) {
+        return make_unexpected(SPIO_MAKE_ERRNO);
+    }
+    return detail::make_fd_pair(fds);
+}
+
+// Opens a file with open(2), adding O_CLOEXEC.
+// For direct I/O, open it normally and use fd_file_device::set_direct().
+inline expected<fd_file_device, failure> open_fd_file(const char* path,
+                                                      int flags,
+                                                      mode_t mode = 0666)
+{
+    int fd;
+    do {
+        fd = ::open(path, flags | O_CLOEXEC, mode);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        return make_unexpected(SPIO_MAKE_ERRNO);
+    }
+    return fd_file_device{fd};
+}
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_POSIX
+
+#endif  // SPIO_FD_DEVICE_H
@@ -0,0 +1,106 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_FD_UTIL_H
+#define SPIO_FD_UTIL_H
+
+#include "config.h"
+
+#if SPIO_POSIX
+
+#include <cerrno>
+#include "device.h"
+#include "error.h"
+#include "third_party/expected.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    // Makes the data written to fd durable, skipping the metadata that
+    // isn't needed to read it back where possible
+    inline expected<void, failure> sync_fd_data(int fd)
+    {
+        int ret;
+        do {
+#if defined(__APPLE__)
+            // fsync() doesn't flush the drive cache
+            ret = ::fcntl(fd, F_FULLFSYNC);
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+            ret = ::fdatasync(fd);
+#else
+            ret = ::fsync(fd);
+#endif
+        } while (ret != 0 && errno == EINTR);
+        if (ret != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+    }
+
+    inline expected<void, failure> preallocate_fd(int fd,
+                                                  streampos offset,
+                                                  streamsize len,
+                                                  bool keep_size)
+    {
+        const auto off = int_cast<off_t>(static_cast<streamoff>(offset));
+#ifdef __linux__
+        int ret;
+        do {
+            ret = ::fallocate(fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, off,
+                              int_cast<off_t>(len));
+        } while (ret != 0 && errno == EINTR);
+        if (ret == 0) {
+            return {};
+        }
+        if (keep_size || errno != EOPNOTSUPP) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        // Not supported by the file system, let libc emulate it
+#else
+        if (keep_size) {
+            return make_unexpected(failure{
+                unimplemented, "Keep-size preallocation is Linux-only"});
+        }
+#endif
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+        const auto err = ::posix_fallocate(fd, off, int_cast<off_t>(len));
+        if (err != 0) {
+            return make_unexpected(
+                failure{std::error_code(err, std::generic_category())});
+        }
+        return {};
+#else
+        SPIO_UNUSED(fd);
+        SPIO_UNUSED(off);
+        SPIO_UNUSED(len);
+        return make_unexpected(
+            failure{unimplemented, "Preallocation not supported"});
+#endif
+    }
+}  // namespace detail
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_POSIX
+
+#endif  // SPIO_FD_UTIL_H
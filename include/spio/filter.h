@@ -23,6 +23,7 @@
 #include "nonstd/expected.hpp"
 #include "result.h"
 #include "third_party/gsl.h"
+#include "util.h"
 
 namespace spio {
 SPIO_BEGIN_NAMESPACE
@@ -42,14 +43,36 @@ protected:
 };
 
 struct output_filter : filter_base {
-    using buffer_type = std::vector<byte>;
+    using buffer_type = byte_buffer;
 
     virtual result write(buffer_type& data) = 0;
+
+    // Called instead of write() for the last data of the output,
+    // possibly empty, when the stream is finished.
+    // Filters holding back data output it here.
+    virtual result write_final(buffer_type& data)
+    {
+        return write(data);
+    }
 };
 struct byte_output_filter : filter_base {
     using buffer_type = void;
 
     virtual result put(byte data) = 0;
+
+    // Runs the filter over every byte in data.
+    // Override to process the whole span at once; the filter must not
+    // have seen the bytes from the returned count onward.
+    virtual result put_span(span<const byte> data)
+    {
+        for (size_type i = 0; i < data.size(); ++i) {
+            auto r = put(data[i]);
+            if (r.value() != 1 || r.has_error()) {
+                return result(i, r.inspect_error());
+            }
+        }
+        return data.size();
+    }
 };
 
 struct null_output_filter : output_filter {
@@ -64,17 +87,47 @@ struct null_byte_output_filter : byte_output_filter {
         SPIO_UNUSED(data);
         return 1;
     }
+    result put_span(span<const byte> data) override
+    {
+        return data.size();
+    }
 };
 
 struct input_filter : filter_base {
     using buffer_type = span<byte>;
 
     virtual result read(buffer_type& data) = 0;
+
+    // Called instead of read() once the input has ended.
+    // The first n bytes of data are the last of the input, and the rest
+    // of it is room for output held back by the filter.
+    // data is shrunk to the output.
+    virtual result read_final(buffer_type& data, size_type n)
+    {
+        data = data.first(n);
+        return read(data);
+    }
 };
 struct byte_input_filter : filter_base {
     using buffer_type = void;
 
     virtual result get(byte& data) = 0;
+
+    // Runs the filter over every byte in data.
+    // Override to process the whole span at once; the bytes from the
+    // returned count onward must be left as they were.
+    virtual result get_span(span<byte> data)
+    {
+        for (size_type i = 0; i < data.size(); ++i) {
+            const auto b = data[i];
+            auto r = get(data[i]);
+            if (r.value() != 1 || r.has_error()) {
+                data[i] = b;
+                return result(i, r.inspect_error());
+            }
+        }
+        return data.size();
+    }
 };
 
 struct null_input_filter : input_filter {
@@ -89,6 +142,10 @@ struct null_byte_input_filter : byte_input_filter {
         SPIO_UNUSED(data);
         return 1;
     }
+    result get_span(span<byte> data) override
+    {
+        return data.size();
+    }
 };
 
 template <typename Base>
@@ -178,6 +235,18 @@ public:
         }
         return static_cast<typename base::size_type>(buf.size());
     }
+    // Output of a filter's write_final() is the last data of the next one
+    result write_final(typename base::buffer_type& buf)
+    {
+        for (auto& f : base::filters()) {
+            auto r = f->write_final(buf);
+            if (r.value() < static_cast<typename base::size_type>(buf.size()) ||
+                r.has_error()) {
+                return r;
+            }
+        }
+        return static_cast<typename base::size_type>(buf.size());
+    }
 
     typename base::size_type output_size() const noexcept
     {
@@ -216,6 +285,22 @@ public:
         }
         return 1;
     }
+    // A single filter gets the whole span at once.
+    // With more, every byte goes through the whole chain before the next
+    // one, so that no filter sees bytes that a later one rejected.
+    result put_span(span<const byte> data)
+    {
+        if (base::size() == 1) {
+            return base::filters().front()->put_span(data);
+        }
+        for (std::ptrdiff_t i = 0; i < data.size(); ++i) {
+            auto r = put(data[i]);
+            if (r.value() == 0 || r.has_error()) {
+                return result(i, r.inspect_error());
+            }
+        }
+        return data.size();
+    }
 
     typename base::size_type output_size() const noexcept
     {
@@ -247,7 +332,8 @@ class source_filter_chain : public virtual basic_chain<input_filter> {
     };
 
 public:
-    result read(typename base::buffer_type buf)
+    // Filters may shrink buf, if they produce less data than they consume
+    result read(typename base::buffer_type& buf)
     {
         for (auto& f : base::filters()) {
             auto r = f->read(buf);
@@ -258,6 +344,24 @@ public:
         }
         return static_cast<typename base::size_type>(buf.size());
     }
+    // Like read(), but for the last n bytes of the input in buf:
+    // the filters may fill the rest of buf with what they've held back
+    result read_final(typename base::buffer_type& buf,
+                      typename base::size_type n)
+    {
+        const auto space = buf;
+        for (auto& f : base::filters()) {
+            buf = space;
+            auto r = f->read_final(buf, n);
+            if (r.value() < static_cast<typename base::size_type>(buf.size()) ||
+                r.has_error()) {
+                return r;
+            }
+            n = static_cast<typename base::size_type>(buf.size());
+        }
+        buf = space.first(n);
+        return n;
+    }
 
     typename base::size_type input_size() const noexcept
     {
@@ -286,16 +390,36 @@ class byte_source_filter_chain : public virtual basic_chain<byte_input_filter> {
     };
 
 public:
+    // A rejected byte is restored to the one that was read
     result get(byte& b)
     {
+        const auto original = b;
         for (auto& f : base::filters()) {
             auto r = f->get(b);
             if (r.value() == 0 || r.has_error()) {
+                b = original;
                 return r;
             }
         }
         return 1;
     }
+    // A single filter gets the whole span at once.
+    // With more, every byte goes through the whole chain before the next
+    // one, so that the bytes from the returned count onward are left as
+    // they were read.
+    result get_span(span<byte> data)
+    {
+        if (base::size() == 1) {
+            return base::filters().front()->get_span(data);
+        }
+        for (std::ptrdiff_t i = 0; i < data.size(); ++i) {
+            auto r = get(data[i]);
+            if (r.value() == 0 || r.has_error()) {
+                return result(i, r.inspect_error());
+            }
+        }
+        return data.size();
+    }
 
     typename base::size_type input_size() const noexcept
     {
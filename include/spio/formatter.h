@@ -49,17 +49,37 @@ struct basic_formatter {
     }
 };
 
+namespace detail {
+    template <typename Stream>
+    auto stream_resource(Stream& s, int) -> decltype(s.sink().resource())
+    {
+        return s.sink().resource();
+    }
+    template <typename Stream>
+    memory_resource* stream_resource(Stream&, long)
+    {
+        return new_delete_resource();
+    }
+
+    // The resource temporary buffers for s are allocated from:
+    // the one of its sink, if it has one
+    template <typename Stream>
+    memory_resource* stream_resource(Stream& s)
+    {
+        return stream_resource(s, 0);
+    }
+}  // namespace detail
+
 template <typename Stream, typename... Args>
 auto print(Stream& s,
            basic_string_view<typename Stream::char_type> f,
            const Args&... a)
-    -> decltype(write(std::declval<Stream&>(),
-                      std::declval<std::vector<byte>>()),
-                result())
+    -> typename std::enable_if<is_writable_stream<Stream>::value,
+                               result>::type
 {
-    std::vector<byte> buf;
+    byte_buffer buf{aligned_allocator<byte>(detail::stream_resource(s))};
     buf.reserve(f.size());
-    using iterator = memcpy_back_insert_iterator<std::vector<byte>,
+    using iterator = memcpy_back_insert_iterator<byte_buffer,
                                                  typename Stream::char_type>;
     get_formatter(s)(iterator(buf), f,
                      fmt::make_format_args<typename fmt::format_context_t<
@@ -70,23 +90,17 @@ template <typename Stream, typename... Args>
 auto print(Stream& s,
            basic_string_view<typename Stream::char_type> f,
            const Args&... a)
-    -> decltype(put(std::declval<Stream&>(), std::declval<byte>()), result())
+    -> typename std::enable_if<is_byte_writable_stream<Stream>::value &&
+                                   !is_writable_stream<Stream>::value,
+                               result>::type
 {
-    std::vector<byte> buf;
-    using iterator = memcpy_back_insert_iterator<std::vector<byte>,
+    byte_buffer buf{aligned_allocator<byte>(detail::stream_resource(s))};
+    using iterator = memcpy_back_insert_iterator<byte_buffer,
                                                  typename Stream::char_type>;
     get_formatter(s)(iterator(buf), f,
                      fmt::make_format_args<typename fmt::format_context_t<
                          iterator, typename Stream::char_type>::type>(a...));
-    auto r = result{0};
-    for (auto& ch : buf) {
-        auto tmp = put(s, ch);
-        if (tmp.value() != 1 || tmp.has_error()) {
-            return make_result(r.value(), tmp.error());
-        }
-        ++r.value();
-    }
-    return r;
+    return put(s, span<const byte>(buf));
 }
 template <typename Stream, typename... Args>
 result print_at(Stream& s,
@@ -94,8 +108,8 @@ result print_at(Stream& s,
                 basic_string_view<typename Stream::char_type> f,
                 const Args&... a)
 {
-    std::vector<byte> buf;
-    using iterator = memcpy_back_insert_iterator<std::vector<byte>,
+    byte_buffer buf{aligned_allocator<byte>(detail::stream_resource(s))};
+    using iterator = memcpy_back_insert_iterator<byte_buffer,
                                                  typename Stream::char_type>;
     get_formatter(s)(iterator(buf), f,
                      fmt::make_format_args<typename fmt::format_context_t<
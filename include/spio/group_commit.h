@@ -0,0 +1,268 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_GROUP_COMMIT_H
+#define SPIO_GROUP_COMMIT_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "device.h"
+#include "error.h"
+#include "result.h"
+#include "sink.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+#include "third_party/optional.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+struct group_commit_policy {
+    // Longest time a durable write waits for others to join its batch
+    std::chrono::microseconds interval{1000};
+    // Sync without waiting for the interval once this many bytes are
+    // waiting to be made durable
+    streamsize max_bytes{1 << 20};
+};
+
+// Sink batching the syncs of durable writes.
+// Instead of calling sync_data() on the Writable for every write that
+// must be durable, writers wait for a background thread doing one sync
+// per batch, and are all woken up when it's done.
+//
+// The Writable must support calling sync_data() concurrently with
+// write(), and must outlive the sink.
+// Errors from sync_data() are sticky: once a sync has failed,
+// nothing is reported durable anymore.
+template <typename Writable>
+class basic_group_commit_sink {
+public:
+    using writable_type = Writable;
+    // Position in the output, up to which a wait() makes it durable
+    using ticket_type = std::uint64_t;
+
+    static_assert(is_data_syncable<Writable>::value,
+                  "Writable must have sync_data()");
+
+    explicit basic_group_commit_sink(writable_type& w,
+                                     group_commit_policy p = {})
+        : m_writable(std::addressof(w)), m_policy(p)
+    {
+        Expects(p.max_bytes > 0);
+        m_thread = std::thread(&basic_group_commit_sink::_run, this);
+    }
+
+    basic_group_commit_sink(const basic_group_commit_sink&) = delete;
+    basic_group_commit_sink& operator=(const basic_group_commit_sink&) =
+        delete;
+    basic_group_commit_sink(basic_group_commit_sink&&) = delete;
+    basic_group_commit_sink& operator=(basic_group_commit_sink&&) = delete;
+
+    ~basic_group_commit_sink() noexcept
+    {
+        close();
+    }
+
+    // Writes data without waiting for it to be durable
+    result write(span<const byte> data)
+    {
+        ticket_type t{0};
+        return write(data, t);
+    }
+    // t is set to the ticket for data
+    result write(span<const byte> data, ticket_type& t)
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        if (!is_open()) {
+            return make_result(0, failure{invalid_operation,
+                                          "Sink has been closed"});
+        }
+        auto r = write_all(*m_writable, data);
+        m_written.store(m_written.load(std::memory_order_relaxed) +
+                            static_cast<ticket_type>(r.value()),
+                        std::memory_order_release);
+        t = m_written.load(std::memory_order_relaxed);
+        return r;
+    }
+
+    // Writes data, and blocks until it's durable
+    result write_durable(span<const byte> data)
+    {
+        ticket_type t{0};
+        auto r = write(data, t);
+        if (r.has_error()) {
+            return r;
+        }
+        auto w = wait(t);
+        if (!w) {
+            return make_result(0, w.error());
+        }
+        return r;
+    }
+
+    // Ticket for everything written so far
+    ticket_type mark() const noexcept
+    {
+        return m_written.load(std::memory_order_acquire);
+    }
+
+    // Blocks until everything up to t is durable
+    expected<void, failure> wait(ticket_type t)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (t > m_requested) {
+            m_requested = t;
+            if (!m_batch_open) {
+                m_batch_open = true;
+                m_batch_start = clock::now();
+            }
+            m_wake.notify_one();
+        }
+        m_done.wait(lock, [&] {
+            return m_durable >= t || m_error || m_stopped;
+        });
+        if (m_durable >= t) {
+            return {};
+        }
+        if (m_error) {
+            return make_unexpected(*m_error);
+        }
+        return make_unexpected(
+            failure{invalid_operation, "Sink has been closed"});
+    }
+
+    // Blocks until everything written so far is durable
+    expected<void, failure> commit()
+    {
+        return wait(mark());
+    }
+
+    // Number of sync_data() calls so far
+    std::uint64_t syncs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_syncs;
+    }
+
+    bool is_open() const noexcept
+    {
+        return m_open.load(std::memory_order_acquire);
+    }
+    // Makes everything written durable, and stops the sync thread
+    expected<void, failure> close()
+    {
+        {
+            std::lock_guard<std::mutex> write_lock(m_write_mutex);
+            if (!is_open()) {
+                return {};
+            }
+            m_open.store(false, std::memory_order_release);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requested = std::max(m_requested, mark());
+            m_closing = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_error) {
+            return make_unexpected(*m_error);
+        }
+        return {};
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    bool _batch_full() const noexcept
+    {
+        return m_requested - m_durable >=
+               static_cast<ticket_type>(m_policy.max_bytes);
+    }
+
+    void _run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [&] {
+                return m_closing || (m_requested > m_durable && !m_error);
+            });
+            if (m_error || m_requested <= m_durable) {
+                break;
+            }
+            // Give other writers a chance to join the batch
+            m_wake.wait_until(lock, m_batch_start + m_policy.interval,
+                              [&] { return m_closing || _batch_full(); });
+
+            // Everything up to target has been handed to the Writable
+            const auto target = m_written.load(std::memory_order_acquire);
+            lock.unlock();
+            auto r = m_writable->sync_data();
+            lock.lock();
+
+            ++m_syncs;
+            if (r) {
+                m_durable = std::max(m_durable, target);
+            }
+            else {
+                m_error = r.error();
+            }
+            // Writers that arrived during the sync start the next batch
+            m_batch_open = m_requested > m_durable;
+            m_batch_start = clock::now();
+            m_done.notify_all();
+        }
+        m_stopped = true;
+        m_done.notify_all();
+    }
+
+    writable_type* m_writable;
+    group_commit_policy m_policy;
+
+    std::mutex m_write_mutex{};
+    std::atomic<ticket_type> m_written{0};
+    std::atomic<bool> m_open{true};
+
+    mutable std::mutex m_mutex{};
+    std::condition_variable m_wake{};
+    std::condition_variable m_done{};
+    ticket_type m_requested{0};
+    ticket_type m_durable{0};
+    std::uint64_t m_syncs{0};
+    clock::time_point m_batch_start{};
+    bool m_batch_open{false};
+    bool m_closing{false};
+    bool m_stopped{false};
+    optional<failure> m_error{};
+
+    std::thread m_thread{};
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_GROUP_COMMIT_H
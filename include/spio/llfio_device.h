@@ -21,8 +21,10 @@
 #include "config.h"
 
 #include <chrono>
+#include "deadline.h"
 #include "device.h"
 #include "error.h"
+#include "fd_util.h"
 #include "third_party/llfio.h"
 #include "third_party/expected.h"
 #include "third_party/gsl.h"
@@ -31,13 +33,6 @@
 namespace spio {
 SPIO_BEGIN_NAMESPACE
 
-struct deadline {
-    bool steady;
-    union {
-        std::chrono::nanoseconds nsecs;
-    };
-};
-
 namespace detail {
     template <typename Handle>
     class llfio_device {
@@ -194,6 +189,20 @@ public:
         }
         return static_cast<streamsize>(ret.value());
     }
+
+#if SPIO_POSIX
+    // See fd_file_device::preallocate().
+    // For direct I/O, open the handle with llfio::file_handle::caching::none.
+    expected<void, failure> preallocate(streampos offset,
+                                        streamsize len,
+                                        bool keep_size = true)
+    {
+        Expects(is_open());
+        Expects(len > 0);
+        return detail::preallocate_fd(handle()->native_handle().fd, offset,
+                                      len, keep_size);
+    }
+#endif
 };
 
 SPIO_END_NAMESPACE
@@ -20,6 +20,9 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <memory>
+#include <utility>
 #include "device.h"
 #include "error.h"
 #include "result.h"
@@ -149,6 +152,183 @@ public:
     using base::span_type;
 };
 
+// Memory sink that grows as needed.
+// Data can be written with write(), or directly into the sink:
+// reserve(n) returns a contiguous region of at least n bytes, which can
+// be filled, for example by a formatter, and the bytes actually used are
+// then appended to the contents with commit().
+// Reallocating moves the contents, so spans returned by reserve(),
+// output() and contents() are invalidated by the next reserve() or write().
+template <typename Allocator = std::allocator<byte>>
+class basic_growable_memory_sink {
+    using traits = std::allocator_traits<Allocator>;
+    using propagate_on_move =
+        typename traits::propagate_on_container_move_assignment;
+
+public:
+    using allocator_type = Allocator;
+    using size_type = std::ptrdiff_t;
+
+    basic_growable_memory_sink() = default;
+    explicit basic_growable_memory_sink(size_type initial_capacity,
+                                        const Allocator& a = Allocator())
+        : m_alloc(a)
+    {
+        Expects(initial_capacity >= 0);
+        if (initial_capacity > 0) {
+            _reallocate(initial_capacity);
+        }
+    }
+    explicit basic_growable_memory_sink(const Allocator& a) : m_alloc(a) {}
+
+    basic_growable_memory_sink(const basic_growable_memory_sink&) = delete;
+    basic_growable_memory_sink& operator=(const basic_growable_memory_sink&) =
+        delete;
+    basic_growable_memory_sink(basic_growable_memory_sink&& o) noexcept
+        : m_alloc(std::move(o.m_alloc)),
+          m_data(o.m_data),
+          m_size(o.m_size),
+          m_capacity(o.m_capacity),
+          m_reserved(o.m_reserved)
+    {
+        o.m_data = nullptr;
+        o.m_size = o.m_capacity = o.m_reserved = 0;
+    }
+    // Takes the storage of o if the allocator propagates or compares equal,
+    // otherwise copies the contents of o into storage from our allocator
+    basic_growable_memory_sink& operator=(
+        basic_growable_memory_sink&& o) noexcept(propagate_on_move::value)
+    {
+        if (this != std::addressof(o)) {
+            _move_assign(o, propagate_on_move{});
+        }
+        return *this;
+    }
+    ~basic_growable_memory_sink() noexcept
+    {
+        _deallocate();
+    }
+
+    bool is_open() const noexcept
+    {
+        return true;
+    }
+    expected<void, failure> close() noexcept
+    {
+        return {};
+    }
+
+    // Returns a region of at least n bytes after the contents,
+    // growing the storage geometrically if needed
+    span<byte> reserve(size_type n)
+    {
+        Expects(n >= 0);
+        if (m_capacity - m_size < n) {
+            _reallocate(std::max(m_size + n, m_capacity * 2));
+        }
+        m_reserved = m_capacity - m_size;
+        return output();
+    }
+    // Appends the first n bytes of the region returned by reserve()
+    // to the contents
+    void commit(size_type n) noexcept
+    {
+        Expects(n >= 0 && n <= m_reserved);
+        m_size += n;
+        m_reserved = 0;
+    }
+
+    // The region returned by the last reserve(), empty after commit()
+    span<byte> output() noexcept
+    {
+        return {m_data + m_size, m_reserved};
+    }
+
+    result write(span<const byte> s)
+    {
+        auto region = reserve(s.size());
+        std::copy(s.begin(), s.end(), region.begin());
+        commit(s.size());
+        return s.size();
+    }
+
+    span<const byte> contents() const noexcept
+    {
+        return {m_data, m_size};
+    }
+    size_type size() const noexcept
+    {
+        return m_size;
+    }
+    size_type capacity() const noexcept
+    {
+        return m_capacity;
+    }
+    // Keeps the storage
+    void clear() noexcept
+    {
+        m_size = m_reserved = 0;
+    }
+
+    allocator_type get_allocator() const
+    {
+        return m_alloc;
+    }
+
+private:
+    void _move_assign(basic_growable_memory_sink& o, std::true_type) noexcept
+    {
+        _deallocate();
+        m_alloc = std::move(o.m_alloc);
+        _take(o);
+    }
+    void _move_assign(basic_growable_memory_sink& o, std::false_type)
+    {
+        if (m_alloc == o.m_alloc) {
+            _deallocate();
+            _take(o);
+            return;
+        }
+        // The storage of o can only be freed by its allocator
+        clear();
+        write(o.contents());
+        o.clear();
+    }
+    void _take(basic_growable_memory_sink& o) noexcept
+    {
+        m_data = o.m_data;
+        m_size = o.m_size;
+        m_capacity = o.m_capacity;
+        m_reserved = o.m_reserved;
+        o.m_data = nullptr;
+        o.m_size = o.m_capacity = o.m_reserved = 0;
+    }
+
+    void _reallocate(size_type cap)
+    {
+        auto p = traits::allocate(m_alloc, static_cast<std::size_t>(cap));
+        std::copy(m_data, m_data + m_size, p);
+        _deallocate();
+        m_data = p;
+        m_capacity = cap;
+    }
+    void _deallocate() noexcept
+    {
+        if (m_data) {
+            traits::deallocate(m_alloc, m_data,
+                               static_cast<std::size_t>(m_capacity));
+        }
+    }
+
+    allocator_type m_alloc{};
+    byte* m_data{nullptr};
+    size_type m_size{0};
+    size_type m_capacity{0};
+    size_type m_reserved{0};
+};
+
+using growable_memory_sink = basic_growable_memory_sink<>;
+
 SPIO_END_NAMESPACE
 }  // namespace spio
 
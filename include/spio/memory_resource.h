@@ -0,0 +1,233 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_MEMORY_RESOURCE_H
+#define SPIO_MEMORY_RESOURCE_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "third_party/gsl.h"
+
+#if SPIO_HAS_STD_PMR
+#include <memory_resource>
+#endif
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+#if SPIO_HAS_STD_PMR
+using memory_resource = std::pmr::memory_resource;
+using monotonic_buffer_resource = std::pmr::monotonic_buffer_resource;
+
+inline memory_resource* new_delete_resource() noexcept
+{
+    return std::pmr::new_delete_resource();
+}
+#else
+// Subset of std::pmr::memory_resource, for pre-C++17 standard libraries
+class memory_resource {
+public:
+    virtual ~memory_resource() = default;
+
+    void* allocate(std::size_t bytes,
+                   std::size_t alignment = alignof(std::max_align_t))
+    {
+        return do_allocate(bytes, alignment);
+    }
+    void deallocate(void* p,
+                    std::size_t bytes,
+                    std::size_t alignment = alignof(std::max_align_t))
+    {
+        do_deallocate(p, bytes, alignment);
+    }
+    bool is_equal(const memory_resource& o) const noexcept
+    {
+        return do_is_equal(o);
+    }
+
+private:
+    virtual void* do_allocate(std::size_t bytes, std::size_t alignment) = 0;
+    virtual void do_deallocate(void* p,
+                               std::size_t bytes,
+                               std::size_t alignment) = 0;
+    virtual bool do_is_equal(const memory_resource& o) const noexcept = 0;
+};
+
+inline bool operator==(const memory_resource& a,
+                       const memory_resource& b) noexcept
+{
+    return &a == &b || a.is_equal(b);
+}
+inline bool operator!=(const memory_resource& a,
+                       const memory_resource& b) noexcept
+{
+    return !(a == b);
+}
+
+namespace detail {
+    class new_delete_resource_impl : public memory_resource {
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            // The pointer to free is stored right before the aligned storage
+            const auto header = sizeof(void*);
+            auto p = static_cast<char*>(
+                ::operator new(bytes + header + alignment - 1));
+            const auto addr = reinterpret_cast<std::uintptr_t>(p + header);
+            const auto aligned =
+                p + header + ((alignment - addr % alignment) % alignment);
+            std::memcpy(aligned - header, &p, header);
+            return aligned;
+        }
+        void do_deallocate(void* ptr, std::size_t, std::size_t) override
+        {
+            void* p;
+            std::memcpy(&p, static_cast<char*>(ptr) - sizeof(void*),
+                        sizeof(void*));
+            ::operator delete(p);
+        }
+        bool do_is_equal(const memory_resource& o) const noexcept override
+        {
+            return this == &o;
+        }
+    };
+}  // namespace detail
+
+inline memory_resource* new_delete_resource() noexcept
+{
+    static detail::new_delete_resource_impl r;
+    return &r;
+}
+
+// Hands out memory from chunks that are only freed by release()
+// or the destructor, like std::pmr::monotonic_buffer_resource
+class monotonic_buffer_resource : public memory_resource {
+public:
+    monotonic_buffer_resource()
+        : monotonic_buffer_resource(new_delete_resource())
+    {
+    }
+    explicit monotonic_buffer_resource(memory_resource* upstream)
+        : m_upstream(upstream)
+    {
+    }
+    explicit monotonic_buffer_resource(
+        std::size_t initial_size,
+        memory_resource* upstream = new_delete_resource())
+        : m_upstream(upstream), m_next_size(initial_size)
+    {
+        Expects(initial_size > 0);
+    }
+    // Allocates from buffer until it runs out
+    monotonic_buffer_resource(
+        void* buffer,
+        std::size_t size,
+        memory_resource* upstream = new_delete_resource())
+        : m_upstream(upstream),
+          m_initial(static_cast<char*>(buffer)),
+          m_initial_size(size),
+          m_current(m_initial),
+          m_space(size),
+          m_next_size(std::max(size * 2, std::size_t{64}))
+    {
+    }
+
+    monotonic_buffer_resource(const monotonic_buffer_resource&) = delete;
+    monotonic_buffer_resource& operator=(const monotonic_buffer_resource&) =
+        delete;
+
+    ~monotonic_buffer_resource() override
+    {
+        release();
+    }
+
+    // Frees every chunk allocated from upstream at once
+    void release() noexcept
+    {
+        while (m_chunks) {
+            auto prev = m_chunks->prev;
+            m_upstream->deallocate(m_chunks, m_chunks->size,
+                                   alignof(std::max_align_t));
+            m_chunks = prev;
+        }
+        m_current = m_initial;
+        m_space = m_initial_size;
+    }
+
+    memory_resource* upstream_resource() const noexcept
+    {
+        return m_upstream;
+    }
+
+private:
+    struct alignas(std::max_align_t) chunk_header {
+        chunk_header* prev;
+        std::size_t size;
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        void* p = m_current;
+        if (!std::align(alignment, bytes, p, m_space)) {
+            _grow(bytes + alignment);
+            p = m_current;
+            std::align(alignment, bytes, p, m_space);
+        }
+        m_current = static_cast<char*>(p) + bytes;
+        m_space -= bytes;
+        return p;
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const memory_resource& o) const noexcept override
+    {
+        return this == &o;
+    }
+
+    void _grow(std::size_t min)
+    {
+        const auto size =
+            std::max(m_next_size, min + sizeof(chunk_header));
+        auto c = static_cast<chunk_header*>(
+            m_upstream->allocate(size, alignof(std::max_align_t)));
+        c->prev = m_chunks;
+        c->size = size;
+        m_chunks = c;
+        m_current = reinterpret_cast<char*>(c + 1);
+        m_space = size - sizeof(chunk_header);
+        m_next_size = size * 2;
+    }
+
+    memory_resource* m_upstream;
+    char* m_initial{nullptr};
+    std::size_t m_initial_size{0};
+    char* m_current{nullptr};
+    std::size_t m_space{0};
+    std::size_t m_next_size{1024};
+    chunk_header* m_chunks{nullptr};
+};
+#endif
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_MEMORY_RESOURCE_H
@@ -0,0 +1,168 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_NEWLINE_H
+#define SPIO_NEWLINE_H
+
+#include "config.h"
+
+#include <cstring>
+#include "filter.h"
+#include "result.h"
+#include "third_party/gsl.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    inline const byte* find_byte(const byte* first,
+                                 const byte* last,
+                                 char ch) noexcept
+    {
+        const auto p =
+            std::memchr(first, ch, static_cast<std::size_t>(last - first));
+        return p ? static_cast<const byte*>(p) : last;
+    }
+    inline byte* find_byte(byte* first, byte* last, char ch) noexcept
+    {
+        const auto p =
+            std::memchr(first, ch, static_cast<std::size_t>(last - first));
+        return p ? static_cast<byte*>(p) : last;
+    }
+}  // namespace detail
+
+// Input filter translating CRLF and CR line endings to LF.
+// Data without CRs is passed through untouched.
+//
+// A CR ending a read is translated right away, and an LF starting the
+// next one is dropped.
+class lf_input_filter : public input_filter {
+public:
+    result read(buffer_type& data) override
+    {
+        auto src = data.data();
+        const auto end = data.data() + data.size();
+        if (src == end) {
+            return 0;
+        }
+        if (m_after_cr) {
+            m_after_cr = false;
+            if (*src == static_cast<byte>('\n')) {
+                ++src;
+            }
+        }
+
+        auto cr = detail::find_byte(src, end, '\r');
+        if (cr == end && src == data.data()) {
+            return data.size();
+        }
+
+        auto dst = data.data();
+        while (true) {
+            const auto len = cr - src;
+            std::memmove(dst, src, static_cast<std::size_t>(len));
+            dst += len;
+            if (cr == end) {
+                break;
+            }
+
+            *dst++ = static_cast<byte>('\n');
+            src = cr + 1;
+            if (src == end) {
+                m_after_cr = true;
+                break;
+            }
+            if (*src == static_cast<byte>('\n')) {
+                ++src;
+            }
+            cr = detail::find_byte(src, end, '\r');
+        }
+
+        data = data.first(dst - data.data());
+        return data.size();
+    }
+
+private:
+    bool m_after_cr{false};
+};
+
+// Output filter translating LF line endings to CRLF.
+// LFs already preceded by a CR are left alone.
+class crlf_output_filter : public output_filter {
+public:
+    crlf_output_filter() = default;
+    // The buffer is allocated from r, which must outlive the filter
+    explicit crlf_output_filter(memory_resource* r)
+        : m_buf(aligned_allocator<byte>(r))
+    {
+    }
+
+    result write(buffer_type& data) override
+    {
+        if (data.empty()) {
+            return 0;
+        }
+
+        const auto first = data.data();
+        const auto end = data.data() + data.size();
+        std::size_t count = 0;
+        for (auto lf = detail::find_byte(first, end, '\n'); lf != end;
+             lf = detail::find_byte(lf + 1, end, '\n')) {
+            if (!preceded_by_cr(first, lf)) {
+                ++count;
+            }
+        }
+        if (count == 0) {
+            m_after_cr = data.back() == static_cast<byte>('\r');
+            return static_cast<size_type>(data.size());
+        }
+
+        m_buf.resize(data.size() + count);
+        auto dst = m_buf.data();
+        auto src = first;
+        for (auto lf = detail::find_byte(first, end, '\n'); lf != end;
+             lf = detail::find_byte(lf + 1, end, '\n')) {
+            if (preceded_by_cr(first, lf)) {
+                continue;
+            }
+            const auto len = static_cast<std::size_t>(lf - src);
+            std::memcpy(dst, src, len);
+            dst += len;
+            *dst++ = static_cast<byte>('\r');
+            src = lf;
+        }
+        std::memcpy(dst, src, static_cast<std::size_t>(end - src));
+
+        m_after_cr = data.back() == static_cast<byte>('\r');
+        detail::exchange_buffers(data, m_buf);
+        return static_cast<size_type>(data.size());
+    }
+
+private:
+    bool preceded_by_cr(const byte* first, const byte* lf) const noexcept
+    {
+        return lf == first ? m_after_cr : *(lf - 1) == static_cast<byte>('\r');
+    }
+
+    buffer_type m_buf{};
+    bool m_after_cr{false};
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_NEWLINE_H
@@ -0,0 +1,346 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_PIPELINE_H
+#define SPIO_PIPELINE_H
+
+#include "config.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include "error.h"
+#include "filter.h"
+#include "result.h"
+#include "sink.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+#include "third_party/optional.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    template <typename T>
+    class bounded_queue {
+    public:
+        using size_type = std::ptrdiff_t;
+
+        explicit bounded_queue(size_type capacity) : m_capacity(capacity)
+        {
+            Expects(capacity > 0);
+        }
+
+        // Blocks while the queue is full.
+        // Returns false if the queue has been closed.
+        bool push(T value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [&] {
+                return m_closed ||
+                       static_cast<size_type>(m_queue.size()) < m_capacity;
+            });
+            if (m_closed) {
+                return false;
+            }
+            m_queue.push_back(std::move(value));
+            lock.unlock();
+            m_not_empty.notify_one();
+            return true;
+        }
+        // Blocks while the queue is empty.
+        // Returns false if the queue has been closed and drained.
+        bool pop(T& value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock,
+                             [&] { return m_closed || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return false;
+            }
+            value = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+            m_not_full.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+            }
+            m_not_empty.notify_all();
+            m_not_full.notify_all();
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_not_empty;
+        std::condition_variable m_not_full;
+        std::deque<T> m_queue;
+        size_type m_capacity;
+        bool m_closed{false};
+    };
+}  // namespace detail
+
+// Runs the filters of a sink_filter_chain as a pipeline:
+// every filter gets its own thread, and the output is written to the
+// Writable on another one.
+// Chunks are passed between the stages through bounded queues,
+// so they reach the Writable in the order they were written.
+//
+// Only the stages run in parallel: a filter still runs on a single thread,
+// so a pipeline doesn't speed up a chain dominated by one heavy filter.
+// An exception thrown by a filter or the Writable is reported as an error,
+// like a failed write.
+//
+// The chain and the Writable must outlive the pipeline, and must not be
+// used by anything else while it's running.
+//
+// The chunks are allocated from the memory_resource given to the
+// constructor. They're grown and freed on the worker threads,
+// so the resource must be thread-safe, and outlive the pipeline.
+// The same goes for the resources the filters were created with.
+template <typename Writable>
+class basic_pipelined_sink {
+public:
+    using writable_type = Writable;
+    using size_type = std::ptrdiff_t;
+    using buffer_type = byte_buffer;
+
+    basic_pipelined_sink(sink_filter_chain& chain,
+                         writable_type& w,
+                         size_type queue_size = 4,
+                         memory_resource* r = new_delete_resource())
+        : m_writable(std::addressof(w)), m_alloc(r)
+    {
+        const auto stages = chain.filters().size() + 1;
+        m_queues.reserve(stages);
+        for (std::size_t i = 0; i < stages; ++i) {
+            m_queues.emplace_back(
+                make_unique<detail::bounded_queue<buffer_type>>(queue_size));
+        }
+
+        m_threads.reserve(stages);
+        for (std::size_t i = 0; i < chain.filters().size(); ++i) {
+            m_threads.emplace_back(&basic_pipelined_sink::_run_filter, this,
+                                   chain.filters()[i].get(),
+                                   m_queues[i].get(), m_queues[i + 1].get());
+        }
+        m_threads.emplace_back(&basic_pipelined_sink::_run_writer, this,
+                               m_queues.back().get());
+    }
+
+    basic_pipelined_sink(const basic_pipelined_sink&) = delete;
+    basic_pipelined_sink& operator=(const basic_pipelined_sink&) = delete;
+    basic_pipelined_sink(basic_pipelined_sink&&) = delete;
+    basic_pipelined_sink& operator=(basic_pipelined_sink&&) = delete;
+
+    ~basic_pipelined_sink() noexcept
+    {
+        close();
+    }
+
+    // Hands buf over to the first stage, blocking if its queue is full.
+    // buf is copied if it's not from the pipeline's resource.
+    // Errors from earlier writes are reported here.
+    result write(buffer_type buf)
+    {
+        auto err = _error();
+        if (err) {
+            return make_result(0, *err);
+        }
+        if (!is_open()) {
+            return make_result(0, failure{invalid_operation,
+                                          "Pipeline has been closed"});
+        }
+
+        if (buf.get_allocator() != m_alloc) {
+            return write(buffer_type(buf.begin(), buf.end(), m_alloc));
+        }
+        const auto n = static_cast<size_type>(buf.size());
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_submitted;
+        }
+        if (!m_queues.front()->push(std::move(buf))) {
+            _complete(nullopt);
+        }
+        return n;
+    }
+    result write(span<const byte> data)
+    {
+        return write(buffer_type(data.begin(), data.end(), m_alloc));
+    }
+
+    // Blocks until every chunk written so far has been written
+    // to the Writable
+    result flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_all_done.wait(lock, [&] { return m_completed == m_submitted; });
+        if (m_error) {
+            return make_result(0, *m_error);
+        }
+        return 0;
+    }
+
+    bool is_open() const noexcept
+    {
+        return m_open;
+    }
+    // Flushes the pipeline and stops the worker threads.
+    // The stages are stopped in order: each filter's write_final() output
+    // is passed on before the next stage is stopped.
+    expected<void, failure> close()
+    {
+        if (!m_open) {
+            return {};
+        }
+        flush();
+        for (std::size_t i = 0; i < m_queues.size(); ++i) {
+            m_queues[i]->close();
+            m_threads[i].join();
+        }
+        m_open = false;
+        auto r = flush();
+        if (r.has_error()) {
+            return make_unexpected(r.error());
+        }
+        return {};
+    }
+
+private:
+    void _run_filter(output_filter* filter,
+                     detail::bounded_queue<buffer_type>* from,
+                     detail::bounded_queue<buffer_type>* to)
+    {
+        buffer_type buf(m_alloc);
+        while (from->pop(buf)) {
+            if (_error()) {
+                _complete(nullopt);
+                continue;
+            }
+            auto r = _catching([&] { return filter->write(buf); });
+            if (r.has_error()) {
+                _complete(r.error());
+                continue;
+            }
+            if (!to->push(std::move(buf))) {
+                _complete(nullopt);
+            }
+        }
+
+        // Closed: what the filter has held back is the last chunk
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_submitted;
+        }
+        if (_error()) {
+            _complete(nullopt);
+            return;
+        }
+        buf.clear();
+        auto r = _catching([&] { return filter->write_final(buf); });
+        if (r.has_error() || buf.empty()) {
+            _complete(r.inspect_error());
+            return;
+        }
+        if (!to->push(std::move(buf))) {
+            _complete(nullopt);
+        }
+    }
+    void _run_writer(detail::bounded_queue<buffer_type>* from)
+    {
+        buffer_type buf(m_alloc);
+        while (from->pop(buf)) {
+            if (_error()) {
+                _complete(nullopt);
+                continue;
+            }
+            // A short write would lose the rest of the chunk
+            auto r = _catching(
+                [&] { return write_fully(*m_writable, make_span(buf)); });
+            _complete(r.inspect_error());
+        }
+    }
+
+    // An exception would otherwise escape the worker thread
+    // and terminate the program
+    template <typename F>
+    static result _catching(F&& f)
+    {
+        try {
+            return f();
+        }
+        catch (const failure& e) {
+            return make_result(0, e);
+        }
+        catch (const std::bad_alloc&) {
+            return make_result(0, failure{out_of_memory});
+        }
+        catch (const std::exception& e) {
+            return make_result(0, failure{undefined_error, e.what()});
+        }
+        catch (...) {
+            return make_result(0,
+                               failure{undefined_error, "Unknown exception"});
+        }
+    }
+
+    optional<failure> _error()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_error;
+    }
+    void _complete(optional<failure> err)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (err && !m_error) {
+                m_error = std::move(err);
+            }
+            ++m_completed;
+        }
+        m_all_done.notify_all();
+    }
+
+    writable_type* m_writable;
+    aligned_allocator<byte> m_alloc;
+    std::vector<std::unique_ptr<detail::bounded_queue<buffer_type>>>
+        m_queues{};
+    std::vector<std::thread> m_threads{};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_all_done{};
+    std::size_t m_submitted{0};
+    std::size_t m_completed{0};
+    optional<failure> m_error{};
+    bool m_open{true};
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_PIPELINE_H
@@ -0,0 +1,529 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_REACTOR_H
+#define SPIO_REACTOR_H
+
+#include "config.h"
+
+#if SPIO_HAS_EPOLL
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "async.h"
+#include "deadline.h"
+#include "error.h"
+#include "fd_device.h"
+#include "result.h"
+#include "sink.h"
+#include "source.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+enum class io_event { read, write };
+
+// Waits for file descriptors to become readable or writable with epoll,
+// and calls back whoever is waiting on them.
+//
+// Every wait is one-shot: its callback is called once from poll(), with
+// an empty error code when the descriptor is ready, std::errc::timed_out
+// if the deadline expires first, or std::errc::operation_canceled if the
+// wait is cancelled.
+// Waits must be cancelled before their descriptor is closed.
+class epoll_reactor {
+public:
+    using callback_type = std::function<void(std::error_code)>;
+    using clock = deadline::clock;
+
+    epoll_reactor() = default;
+
+    epoll_reactor(const epoll_reactor&) = delete;
+    epoll_reactor& operator=(const epoll_reactor&) = delete;
+    epoll_reactor(epoll_reactor&&) = delete;
+    epoll_reactor& operator=(epoll_reactor&&) = delete;
+
+    ~epoll_reactor() noexcept
+    {
+        if (is_open()) {
+            ::close(m_fd);
+        }
+    }
+
+    expected<void, failure> open()
+    {
+        Expects(!is_open());
+        m_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_fd == -1) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+    }
+    bool is_open() const noexcept
+    {
+        return m_fd != -1;
+    }
+    int handle() const noexcept
+    {
+        return m_fd;
+    }
+
+    // Calls cb once fd is ready for ev, or d has expired.
+    // There can be one wait per descriptor and event at a time.
+    expected<void, failure> wait(int fd,
+                                 io_event ev,
+                                 deadline d,
+                                 callback_type cb)
+    {
+        Expects(is_open());
+        Expects(cb);
+
+        auto& w = m_waiters[fd];
+        auto& slot = w.get(ev);
+        Expects(!slot.cb);
+
+        const auto old_events = w.events();
+        slot.cb = std::move(cb);
+        slot.until = d;
+        auto r = _update(fd, old_events, w.events());
+        if (!r) {
+            slot = waiter{};
+            if (w.events() == 0) {
+                m_waiters.erase(fd);
+            }
+            return r;
+        }
+        ++m_pending;
+        return {};
+    }
+
+    // Cancels every wait on fd
+    void cancel(int fd)
+    {
+        auto it = m_waiters.find(fd);
+        if (it == m_waiters.end()) {
+            return;
+        }
+        auto w = std::move(it->second);
+        m_waiters.erase(it);
+        // Fails harmlessly if fd has already been closed
+        ::epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+        const auto ec = std::make_error_code(std::errc::operation_canceled);
+        for (auto* slot : {&w.read, &w.write}) {
+            if (slot->cb) {
+                --m_pending;
+                slot->cb(ec);
+            }
+        }
+    }
+
+    // Number of waits that haven't been called back yet
+    std::size_t pending() const noexcept
+    {
+        return m_pending;
+    }
+
+    // Blocks until a descriptor is ready, a wait expires, or d expires,
+    // and calls back the waits that completed.
+    // Returns the number of callbacks called.
+    // If epoll fails, every wait is called back with the error.
+    expected<std::size_t, failure> poll(deadline d = {})
+    {
+        Expects(is_open());
+
+        std::array<epoll_event, 64> events;
+        int n;
+        do {
+            n = ::epoll_wait(m_fd, events.data(),
+                             static_cast<int>(events.size()),
+                             _timeout(_earliest(d)));
+        } while (n == -1 && errno == EINTR);
+        if (n == -1) {
+            const auto err = SPIO_MAKE_ERRNO;
+            _fail_all(err);
+            return make_unexpected(err);
+        }
+
+        // Collected first, since callbacks may start new waits
+        std::vector<completion> done;
+        for (int i = 0; i < n; ++i) {
+            const auto& e = events[static_cast<std::size_t>(i)];
+            auto it = m_waiters.find(e.data.fd);
+            if (it == m_waiters.end()) {
+                continue;
+            }
+            // Errors and hangups are reported by the next operation
+            const bool any = (e.events & (EPOLLERR | EPOLLHUP)) != 0;
+            auto& w = it->second;
+            const auto old_events = w.events();
+            if (w.read.cb && (any || (e.events & EPOLLIN) != 0)) {
+                done.push_back({std::move(w.read.cb), {}});
+                w.read = waiter{};
+            }
+            if (w.write.cb && (any || (e.events & EPOLLOUT) != 0)) {
+                done.push_back({std::move(w.write.cb), {}});
+                w.write = waiter{};
+            }
+            _settle(it, old_events);
+        }
+
+        const auto now = clock::now();
+        const auto timed_out = std::make_error_code(std::errc::timed_out);
+        for (auto it = m_waiters.begin(); it != m_waiters.end();) {
+            auto& w = it->second;
+            const auto old_events = w.events();
+            for (auto* slot : {&w.read, &w.write}) {
+                if (slot->cb && slot->until.when() <= now) {
+                    done.push_back({std::move(slot->cb), timed_out});
+                    *slot = waiter{};
+                }
+            }
+            it = _settle(it, old_events);
+        }
+
+        m_pending -= done.size();
+        for (auto& c : done) {
+            c.cb(c.ec);
+        }
+        return done.size();
+    }
+
+private:
+    struct waiter {
+        callback_type cb{};
+        deadline until{};
+    };
+    struct fd_waiters {
+        waiter& get(io_event ev) noexcept
+        {
+            return ev == io_event::read ? read : write;
+        }
+        std::uint32_t events() const noexcept
+        {
+            return (read.cb ? static_cast<std::uint32_t>(EPOLLIN) : 0u) |
+                   (write.cb ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+        }
+
+        waiter read{};
+        waiter write{};
+    };
+    struct completion {
+        callback_type cb;
+        std::error_code ec;
+    };
+    using map_type = std::unordered_map<int, fd_waiters>;
+
+    expected<void, failure> _update(int fd,
+                                    std::uint32_t old_events,
+                                    std::uint32_t new_events)
+    {
+        if (old_events == new_events) {
+            return {};
+        }
+        epoll_event e{};
+        e.events = new_events;
+        e.data.fd = fd;
+        const auto op = new_events == 0
+                            ? EPOLL_CTL_DEL
+                            : (old_events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+        if (::epoll_ctl(m_fd, op, fd, &e) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+    }
+    // Updates the interest of it->first after some of its waits completed,
+    // and forgets it if it has none left
+    map_type::iterator _settle(map_type::iterator it,
+                               std::uint32_t old_events)
+    {
+        const auto new_events = it->second.events();
+        // Failing to update only leads to spurious wakeups
+        _update(it->first, old_events, new_events);
+        if (new_events == 0) {
+            return m_waiters.erase(it);
+        }
+        return ++it;
+    }
+
+    deadline::time_point _earliest(deadline d) const
+    {
+        auto t = d.when();
+        for (const auto& entry : m_waiters) {
+            t = std::min({t, entry.second.read.until.when(),
+                          entry.second.write.until.when()});
+        }
+        return t;
+    }
+    static int _timeout(deadline::time_point t)
+    {
+        if (t == deadline::time_point::max()) {
+            return -1;
+        }
+        const auto now = clock::now();
+        if (t <= now) {
+            return 0;
+        }
+        // Rounded up, so that the deadline has passed once epoll returns
+        const auto left = t - now;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(left);
+        if (ms < left) {
+            ++ms;
+        }
+        return static_cast<int>(
+            std::min<std::chrono::milliseconds::rep>(ms.count(), INT_MAX));
+    }
+
+    void _fail_all(std::error_code ec)
+    {
+        std::vector<callback_type> cbs;
+        for (auto& entry : m_waiters) {
+            ::epoll_ctl(m_fd, EPOLL_CTL_DEL, entry.first, nullptr);
+            for (auto* slot : {&entry.second.read, &entry.second.write}) {
+                if (slot->cb) {
+                    cbs.push_back(std::move(slot->cb));
+                }
+            }
+        }
+        m_waiters.clear();
+        m_pending = 0;
+        for (auto& cb : cbs) {
+            cb(ec);
+        }
+    }
+
+    int m_fd{-1};
+    map_type m_waiters{};
+    std::size_t m_pending{0};
+};
+
+namespace detail {
+    // Calls op until it doesn't fail with would_block,
+    // waiting for fd to be ready for ev before every retry.
+    // done gets the bytes transferred by every call, and the last error.
+    template <typename Op, typename Done>
+    void _retry_when_ready(epoll_reactor& r,
+                           int fd,
+                           io_event ev,
+                           deadline d,
+                           Op op,
+                           Done done,
+                           streamsize total = 0)
+    {
+        auto res = op();
+        total += res.value();
+        if (!is_would_block(res)) {
+            res.value() = total;
+            done(std::move(res));
+            return;
+        }
+        auto w = r.wait(fd, ev, d, [&r, fd, ev, d, op, done,
+                                    total](std::error_code ec) mutable {
+            if (ec) {
+                done(make_result(total, failure{ec}));
+                return;
+            }
+            _retry_when_ready(r, fd, ev, d, op, done, total);
+        });
+        if (!w) {
+            done(make_result(total, w.error()));
+        }
+    }
+}  // namespace detail
+
+// Flushes the buffer of w, whose device is non-blocking,
+// resuming from r.poll() whenever the descriptor is writable again.
+// cb(result) is called once with the bytes written, and an error if the
+// flush failed, or d expired before it completed.
+// If the flush doesn't block, cb is called before this returns.
+// w must outlive the flush.
+template <typename Writable, typename Callback>
+void flush_when_ready(epoll_reactor& r,
+                      basic_buffered_writable<Writable>& w,
+                      deadline d,
+                      Callback cb)
+{
+    detail::_retry_when_ready(
+        r, w.get().handle(), io_event::write, d,
+        [&w] { return w.flush(); }, std::move(cb));
+}
+
+// Reads into data from the buffer of s, filling it from its non-blocking
+// device once the descriptor is readable, and resuming from r.poll().
+// cb(result, eof) is called once, as soon as anything has been read, the
+// end of the input has been reached, or an error occurred.
+// If the read doesn't block, cb is called before this returns.
+// s and data must outlive the read.
+template <typename Readable, typename Callback>
+void read_when_ready(epoll_reactor& r,
+                     basic_buffered_readable<Readable>& s,
+                     span<byte> data,
+                     deadline d,
+                     Callback cb)
+{
+    auto eof = std::make_shared<bool>(false);
+    detail::_retry_when_ready(
+        r, s.get().handle(), io_event::read, d,
+        [&s, data, eof]() -> result {
+            auto res = s.read(data, *eof);
+            // Bytes that were read are returned right away
+            if (res.value() != 0) {
+                return res.value();
+            }
+            return res;
+        },
+        [cb, eof](result res) mutable { cb(std::move(res), *eof); });
+}
+
+#if SPIO_HAS_COROUTINES
+
+// Non-blocking fd_device whose operations wait on an epoll_reactor
+// instead of failing with would_block.
+// The reactor must be attached to the run_loop, see run_loop::attach().
+class async_fd_device {
+public:
+    using device_type = fd_device;
+
+    async_fd_device(run_loop& l, epoll_reactor& r, device_type d)
+        : m_loop(std::addressof(l)),
+          m_reactor(std::addressof(r)),
+          m_device(std::move(d))
+    {
+    }
+
+    SPIO_CONSTEXPR14 device_type& device() noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR const device_type& device() const noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR run_loop& loop() const noexcept
+    {
+        return *m_loop;
+    }
+    SPIO_CONSTEXPR epoll_reactor& reactor() const noexcept
+    {
+        return *m_reactor;
+    }
+
+    bool is_open() const
+    {
+        return m_device.is_open();
+    }
+    // Cancels pending operations, and closes the descriptor
+    expected<void, failure> close()
+    {
+        m_reactor->cancel(m_device.handle());
+        return m_device.close();
+    }
+
+    task<result> async_write(span<const byte> s, deadline d = {})
+    {
+        streamsize written = 0;
+        while (true) {
+            auto r = m_device.write(s.subspan(written));
+            written += r.value();
+            if (!is_would_block(r)) {
+                if (r.has_error()) {
+                    co_return make_result(written, std::move(r).error());
+                }
+                co_return written;
+            }
+            auto ec = co_await ready_awaiter{this, io_event::write, d};
+            if (ec) {
+                co_return make_result(written, failure{ec});
+            }
+        }
+    }
+
+    task<result> async_read(span<byte> s, bool& eof, deadline d = {})
+    {
+        while (true) {
+            auto r = m_device.read(s, eof);
+            if (!is_would_block(r)) {
+                co_return r;
+            }
+            auto ec = co_await ready_awaiter{this, io_event::read, d};
+            if (ec) {
+                co_return make_result(0, failure{ec});
+            }
+        }
+    }
+
+private:
+    // Suspends until the reactor reports the descriptor ready,
+    // and resumes from the run_loop
+    struct ready_awaiter {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            auto r = self->m_reactor->wait(
+                self->m_device.handle(), event, until,
+                [this, h](std::error_code e) {
+                    ec = e;
+                    self->m_loop->post(h);
+                });
+            if (!r) {
+                ec = r.error().code();
+                return false;
+            }
+            return true;
+        }
+        std::error_code await_resume() const noexcept
+        {
+            return ec;
+        }
+
+        async_fd_device* self;
+        io_event event;
+        deadline until;
+        std::error_code ec{};
+    };
+
+    run_loop* m_loop;
+    epoll_reactor* m_reactor;
+    device_type m_device;
+};
+
+#endif  // SPIO_HAS_COROUTINES
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_HAS_EPOLL
+
+#endif  // SPIO_REACTOR_H
@@ -60,7 +60,7 @@ public:
     }
     SPIO_CONSTEXPR14 success_type&& value() && noexcept
     {
-        return m_ok;
+        return std::move(m_ok);
     }
 
     SPIO_CONSTEXPR bool has_error() const noexcept
@@ -119,6 +119,19 @@ inline result make_result(streamsize s, failure e) noexcept
     return result(s, std::move(e));
 }
 
+// Whether r stopped short because a non-blocking device couldn't make
+// progress. r.value() is still the number of bytes transferred before that.
+inline bool is_would_block(const result& r) noexcept
+{
+    if (!r.has_error()) {
+        return false;
+    }
+    const auto& c = r.error().code();
+    return c == would_block ||
+           c == std::errc::resource_unavailable_try_again ||
+           c == std::errc::operation_would_block;
+}
+
 SPIO_END_NAMESPACE
 }  // namespace spio
 
@@ -53,15 +53,39 @@ namespace detail {
 
         ring_base_posix(const ring_base_posix&) = delete;
         ring_base_posix& operator=(const ring_base_posix&) = delete;
-        ring_base_posix(ring_base_posix&&) noexcept = default;
-        ring_base_posix& operator=(ring_base_posix&&) noexcept = default;
+        // The mapping has a single owner
+        ring_base_posix(ring_base_posix&& o) noexcept
+            : m_ptr(o.m_ptr),
+              m_size(o.m_size),
+              m_head(o.m_head),
+              m_tail(o.m_tail),
+              m_empty(o.m_empty)
+        {
+            o.m_ptr = nullptr;
+            o.m_size = 0;
+        }
+        ring_base_posix& operator=(ring_base_posix&& o) noexcept
+        {
+            if (this != &o) {
+                _unmap();
+                m_ptr = o.m_ptr;
+                m_size = o.m_size;
+                m_head = o.m_head;
+                m_tail = o.m_tail;
+                m_empty = o.m_empty;
+                o.m_ptr = nullptr;
+                o.m_size = 0;
+            }
+            return *this;
+        }
 
         ~ring_base_posix() noexcept
         {
-            ::munmap(m_ptr - m_size, static_cast<std::size_t>(m_size * 3));
+            _unmap();
         }
 
-        expected<void, failure> init(size_type s) noexcept
+        // The mapping isn't allocated from a memory_resource
+        expected<void, failure> init(size_type s, memory_resource*) noexcept
         {
             auto rounded_size = round_up_power_of_two(s);
             auto page_size = ::sysconf(_SC_PAGESIZE);
@@ -130,7 +154,7 @@ namespace detail {
                 std::min(static_cast<size_type>(s.size()), free_space());
             std::copy(s.begin(), s.begin() + written, m_ptr + m_head);
             m_head += written;
-            if (m_size < m_head) {
+            if (m_size <= m_head) {
                 m_head &= (m_size - 1);
             }
             if (s.size() != 0) {
@@ -148,8 +172,8 @@ namespace detail {
             if (m_tail < 0) {
                 m_tail &= (m_size - 1);
             }
-            if (s.size() != 0) {
-                m_empty = true;
+            if (written != 0) {
+                m_empty = false;
             }
             return written;
         }
@@ -162,7 +186,7 @@ namespace detail {
             auto n = std::min(static_cast<size_type>(s.size()), in_use());
             std::copy(m_ptr + m_tail, m_ptr + m_tail + n, s.begin());
             m_tail += n;
-            if (m_size < m_tail) {
+            if (m_size <= m_tail) {
                 m_tail &= (m_size - 1);
             }
             if (m_head == m_tail) {
@@ -185,8 +209,12 @@ namespace detail {
 
         size_type in_use() const noexcept
         {
-            return m_tail <= m_head ? m_head - m_tail
-                                    : m_size - (m_tail - m_head);
+            if (m_head == m_tail) {
+                // Either empty or full
+                return m_empty ? 0 : m_size;
+            }
+            return m_tail < m_head ? m_head - m_tail
+                                   : m_size - (m_tail - m_head);
         }
         size_type free_space() const noexcept
         {
@@ -342,7 +370,13 @@ namespace detail {
         {
             m_head += off;
             m_head &= (m_size - 1);
-            m_empty = false;
+            // Moving back onto the tail empties the ring
+            if (off > 0) {
+                m_empty = false;
+            }
+            else if (off < 0 && m_head == m_tail) {
+                m_empty = true;
+            }
         }
         void move_tail(size_type off) noexcept
         {
@@ -353,6 +387,14 @@ namespace detail {
         }
 
     private:
+        void _unmap() noexcept
+        {
+            if (m_ptr) {
+                ::munmap(m_ptr - m_size,
+                         static_cast<std::size_t>(m_size * 3));
+            }
+        }
+
         value_type* m_ptr{};
         size_type m_size{};
         size_type m_head{0};
@@ -365,24 +407,29 @@ namespace detail {
     class ring_base_std {
     public:
         using value_type = byte;
-        using storage_type = std::unique_ptr<value_type[]>;
+        using storage_type = byte_buffer;
         using size_type = std::ptrdiff_t;
 
-        SPIO_CONSTEXPR ring_base_std() = default;
+        ring_base_std() = default;
 
-        expected<void, failure> init(size_type s)
+        expected<void, failure> init(size_type s, memory_resource* r)
         {
-            m_buf = storage_type(new value_type[static_cast<std::size_t>(s)]);
+            m_buf = storage_type(static_cast<std::size_t>(s),
+                                 aligned_allocator<byte>(r));
             m_size = s;
             return {};
         }
 
         size_type write(span<const byte> s)
         {
+            if (s.size() == 0 || free_space() == 0) {
+                return 0;
+            }
+            m_empty = false;
             if (m_head < m_tail) {
                 auto n =
                     std::min(static_cast<size_type>(s.size()), m_tail - m_head);
-                std::copy(s.begin(), s.begin() + n, m_buf.get() + m_head);
+                std::copy(s.begin(), s.begin() + n, m_buf.data() + m_head);
                 m_head += n;
                 if (m_head == m_size) {
                     m_head = 0;
@@ -391,7 +438,7 @@ namespace detail {
             }
             auto space_end = m_size - m_head;
             auto n = std::min(space_end, static_cast<size_type>(s.size()));
-            std::copy(s.begin(), s.begin() + n, m_buf.get() + m_head);
+            std::copy(s.begin(), s.begin() + n, m_buf.data() + m_head);
             s = s.subspan(n);
             m_head += n;
             if (m_head == m_size) {
@@ -401,14 +448,17 @@ namespace detail {
                 return n;
             }
 
-            return write(s);
+            return n + write(s);
         }
         size_type write_tail(span<const byte> s)
         {
             auto written = std::min(static_cast<size_type>(s.size()), m_tail);
             std::reverse_copy(s.rbegin(), s.rbegin() + written,
-                              m_buf.get() + m_tail - written);
+                              m_buf.data() + m_tail - written);
             m_tail -= written;
+            if (s.size() != 0) {
+                m_empty = false;
+            }
             s = s.first(s.size() - written);
             if (s.size() == 0) {
                 return written;
@@ -417,7 +467,7 @@ namespace detail {
             auto space =
                 std::min(static_cast<size_type>(s.size()), m_size - m_head - 1);
             std::reverse_copy(s.rbegin(), s.rbegin() + space,
-                              m_buf.get() + m_size - space);
+                              m_buf.data() + m_size - space);
             m_tail = m_size - space;
             return written + space;
         }
@@ -430,7 +480,7 @@ namespace detail {
             if (m_tail < m_head) {
                 auto n =
                     std::min(static_cast<size_type>(s.size()), m_head - m_tail);
-                std::copy(m_buf.get() + m_tail, m_buf.get() + m_tail + n,
+                std::copy(m_buf.data() + m_tail, m_buf.data() + m_tail + n,
                           s.begin());
                 m_tail += n;
                 if (m_tail == m_size) {
@@ -444,13 +494,16 @@ namespace detail {
 
             auto space_end = m_size - m_tail;
             auto n = std::min(space_end, static_cast<size_type>(s.size()));
-            std::copy(m_buf.get() + m_tail, m_buf.get() + m_tail + n,
+            std::copy(m_buf.data() + m_tail, m_buf.data() + m_tail + n,
                       s.begin());
             s = s.subspan(n);
             m_tail += n;
             if (m_tail == m_size) {
                 m_tail = 0;
             }
+            if (m_head == m_tail) {
+                m_empty = true;
+            }
             if (s.size() == 0) {
                 return n;
             }
@@ -461,7 +514,7 @@ namespace detail {
         span<const value_type> peek(size_type n) const noexcept
         {
             Expects(size() >= n);
-            return make_span(m_buf.get() + m_tail - n, n);
+            return make_span(m_buf.data() + m_tail - n, n);
         }
 
         void clear() noexcept
@@ -481,8 +534,12 @@ namespace detail {
 
         size_type in_use() const noexcept
         {
-            return m_tail <= m_head ? m_head - m_tail
-                                    : m_size - (m_tail - m_head);
+            if (m_head == m_tail) {
+                // Either empty or full
+                return m_empty ? 0 : m_size;
+            }
+            return m_tail < m_head ? m_head - m_tail
+                                   : m_size - (m_tail - m_head);
         }
         size_type free_space() const noexcept
         {
@@ -491,11 +548,11 @@ namespace detail {
 
         value_type* data() noexcept
         {
-            return m_buf.get();
+            return m_buf.data();
         }
         const value_type* data() const noexcept
         {
-            return m_buf.get();
+            return m_buf.data();
         }
 
         size_type head() const noexcept
@@ -653,12 +710,16 @@ namespace detail {
         {
             m_head += off;
             m_head &= (m_size - 1);
-            m_empty = false;
-            Ensures(m_head > m_tail);
+            if (off > 0) {
+                m_empty = false;
+            }
+            else if (off < 0 && m_head == m_tail) {
+                m_empty = true;
+            }
         }
         void move_tail(size_type off) noexcept
         {
-            Expects(m_tail + off <= m_head);
+            Expects(off <= in_use());
             m_tail += off;
             m_tail &= (m_size - 1);
             if (m_head == m_tail)
@@ -683,10 +744,11 @@ public:
     using value_type = T;
     using size_type = std::ptrdiff_t;
 
-    basic_ring(size_type n) : m_buf{}
+    basic_ring(size_type n, memory_resource* mr = new_delete_resource())
+        : m_buf{}, m_resource(mr)
     {
-        auto r =
-            m_buf.init(n * static_cast<std::ptrdiff_t>(sizeof(value_type)));
+        auto r = m_buf.init(
+            n * static_cast<std::ptrdiff_t>(sizeof(value_type)), mr);
         if (!r) {
             throw r.error();
         }
@@ -750,8 +812,14 @@ public:
                          size());
     }
 
+    memory_resource* resource() const noexcept
+    {
+        return m_resource;
+    }
+
 private:
     detail::ring_base m_buf;
+    memory_resource* m_resource;
 };
 template <>
 class basic_ring<byte> : public detail::ring_base {
@@ -761,9 +829,11 @@ public:
     using value_type = byte;
     using size_type = std::ptrdiff_t;
 
-    basic_ring(size_type n) : base{}
+    basic_ring(size_type n, memory_resource* mr = new_delete_resource())
+        : base{}, m_resource(mr)
     {
-        auto r = base::init(n * static_cast<size_type>(sizeof(value_type)));
+        auto r =
+            base::init(n * static_cast<size_type>(sizeof(value_type)), mr);
         if (!r) {
             throw r.error();
         }
@@ -777,6 +847,16 @@ public:
     {
         return make_span(data(), size());
     }
+
+    // The resource the buffer was allocated from,
+    // unless it's a memory mapping
+    memory_resource* resource() const noexcept
+    {
+        return m_resource;
+    }
+
+private:
+    memory_resource* m_resource;
 };
 
 using ring = basic_ring<byte>;
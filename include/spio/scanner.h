@@ -259,31 +259,42 @@ class basic_scan_stream_ref;
 template <typename Char>
 class basic_scan_stream_ref<Char, readable_tag> {
 public:
-    using ref_type = basic_stream_ref<Char, readable_tag>;
+    using ref_type =
+        basic_stream_ref<Char, make_tag<readable_tag, putbackable_span_tag>>;
     using char_type = typename ref_type::char_type;
 
-    basic_scan_stream_ref(ref_type ref) : m_ref(ref) {}
+    // Read characters are kept in a buffer allocated from r
+    basic_scan_stream_ref(ref_type ref,
+                          memory_resource* r = new_delete_resource())
+        : m_ref(ref), m_buf(aligned_allocator<char_type>(r))
+    {
+    }
 
     expected<char_type, failure> read_char()
     {
         // TODO: encoding
         char_type ch{};
-        auto ret = getchar(m_ref, ch);
+        auto ret = read(m_ref, as_writeable_bytes(make_span(&ch, 1)));
         if (ret.has_error()) {
             return make_unexpected(ret.error());
         }
+        if (ret.value() == 0) {
+            return make_unexpected(failure{end_of_file});
+        }
         m_buf.push_back(ch);
         return ch;
     }
     bool putback(char_type ch)
     {
         m_buf.pop_back();
-        return putback(as_bytes(make_span(&ch, 1)));
+        return ::spio::putback(m_ref, as_bytes(make_span(&ch, 1)));
     }
 
     bool putback_all()
     {
-        auto ret = putback(as_bytes(make_span(m_buf.data(), m_buf.size())));
+        const auto n = static_cast<std::ptrdiff_t>(m_buf.size());
+        auto ret =
+            ::spio::putback(m_ref, as_bytes(make_span(m_buf.data(), n)));
         if (ret) {
             m_buf.clear();
         }
@@ -292,33 +303,42 @@ public:
 
 private:
     ref_type m_ref;
-    std::vector<char_type> m_buf;
+    std::vector<char_type, aligned_allocator<char_type>> m_buf;
 };
 template <typename Char>
 class basic_scan_stream_ref<Char, byte_readable_tag> {
 public:
-    using ref_type = basic_stream_ref<Char, byte_readable_tag>;
+    using ref_type =
+        basic_stream_ref<Char,
+                         make_tag<byte_readable_tag, putbackable_byte_tag>>;
     using char_type = typename ref_type::char_type;
 
-    basic_scan_stream_ref(ref_type ref) : m_ref(ref) {}
+    // Read characters are kept in a buffer allocated from r
+    basic_scan_stream_ref(ref_type ref,
+                          memory_resource* r = new_delete_resource())
+        : m_ref(ref), m_buf(aligned_allocator<char_type>(r))
+    {
+    }
 
     expected<char_type, failure> read_char()
     {
         // TODO: encoding
         char_type ch{};
-        auto ret = getchar(m_ref, ch);
+        auto bytes = as_writeable_bytes(make_span(&ch, 1));
+        auto ret = get(m_ref, bytes);
         if (ret.has_error()) {
             return make_unexpected(ret.error());
         }
+        if (ret.value() != bytes.size()) {
+            return make_unexpected(failure{end_of_file});
+        }
         m_buf.push_back(ch);
         return ch;
     }
     bool putback(char_type ch)
     {
-        for (auto b : as_bytes(make_span(&ch, 1))) {
-            if (!putback(b)) {
-                return false;
-            }
+        if (!_putback(as_bytes(make_span(&ch, 1)))) {
+            return false;
         }
         m_buf.pop_back();
         return true;
@@ -326,19 +346,28 @@ public:
 
     bool putback_all()
     {
-        // FIXME
-        for (auto b : as_bytes(make_span(m_buf.data(), 1))) {
-            if (!putback(b)) {
-                return false;
-            }
+        const auto n = static_cast<std::ptrdiff_t>(m_buf.size());
+        if (!_putback(as_bytes(make_span(m_buf.data(), n)))) {
+            return false;
         }
         m_buf.clear();
         return true;
     }
 
 private:
+    // Last byte first, so that they're read again in order
+    bool _putback(span<const byte> data)
+    {
+        for (auto i = data.size(); i > 0; --i) {
+            if (!::spio::putback(m_ref, data[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     ref_type m_ref;
-    std::vector<char_type> m_buf;
+    std::vector<char_type, aligned_allocator<char_type>> m_buf;
 };
 template <typename Char>
 class basic_scan_stream_ref<Char, random_access_readable_tag> {
@@ -393,10 +422,12 @@ public:
     template <typename T>
     using scanner_impl_type = basic_scanner_impl<char_type, T>;
 
+    // Scanners allocate their buffers from mr
     basic_scan_context(ref_type r,
                        basic_string_view<char_type> f,
-                       basic_scan_locale<char_type> locale)
-        : m_ref(std::move(r)), m_parse_ctx(f), m_locale(locale)
+                       basic_scan_locale<char_type> locale,
+                       memory_resource* mr = new_delete_resource())
+        : m_ref(std::move(r)), m_parse_ctx(f), m_locale(locale), m_resource(mr)
     {
     }
 
@@ -415,10 +446,16 @@ public:
         return m_locale;
     }
 
+    memory_resource* resource() const noexcept
+    {
+        return m_resource;
+    }
+
 private:
     ref_type m_ref;
     parse_context_type m_parse_ctx;
     locale_type m_locale;
+    memory_resource* m_resource;
 };
 
 namespace detail {
@@ -466,13 +503,19 @@ struct basic_scanner_impl<CharT, span<CharT>>
         auto in_span = [](CharT ch, span<const CharT> s) {
             return std::find(s.begin(), s.end(), ch) != s.end();
         };
-        std::vector<CharT> buf(static_cast<size_t>(val.size()));
+        std::vector<CharT, aligned_allocator<CharT>> buf(
+            static_cast<size_t>(val.size()),
+            aligned_allocator<CharT>(ctx.resource()));
         auto it = buf.begin();
         for (; it != buf.end(); ++it) {
             auto ch = ctx.stream().read_char();
             if (!ch) {
-                for (auto i = buf.begin(); i != it - 1; ++i) {
-                    ctx.stream().putback(*i);
+                // The end of the input ends a non-empty value.
+                // On errors, basic_scan_args::visit() puts back
+                // everything that was read
+                if (it != buf.begin() &&
+                    ch.error().code() == end_of_file) {
+                    break;
                 }
                 return make_unexpected(ch.error());
             }
@@ -512,24 +555,27 @@ struct basic_scanner_impl<CharT, bool>
             return make_unexpected(
                 failure{scanner_error, "Invalid boolean value"});
         }
-        std::vector<CharT> buf(static_cast<size_t>(max_len));
+        std::vector<CharT, aligned_allocator<CharT>> buf(
+            static_cast<size_t>(max_len),
+            aligned_allocator<CharT>(ctx.resource()));
         auto it = buf.begin();
         for (; it != buf.end(); ++it) {
             auto ch = ctx.stream().read_char();
             if (!ch) {
-                for (auto i = buf.begin(); i != it - 1; ++i) {
-                    ctx.stream().putback(*i);
-                }
                 return make_unexpected(ch.error());
             }
             *it = ch.value();
 
-            if (std::equal(buf.begin(), it + 1,
+            // Only a whole match counts, "t" isn't "true"
+            const auto len = it + 1 - buf.begin();
+            if (len == ctx.locale().false_str.size() &&
+                std::equal(buf.begin(), it + 1,
                            ctx.locale().false_str.begin())) {
                 val = false;
                 return {};
             }
-            if (std::equal(buf.begin(), it + 1,
+            if (len == ctx.locale().true_str.size() &&
+                std::equal(buf.begin(), it + 1,
                            ctx.locale().true_str.begin())) {
                 val = true;
                 return {};
@@ -578,7 +624,9 @@ struct basic_scanner_impl<
     template <typename Context>
     expected<void, failure> scan(T& val, Context& ctx)
     {
-        std::vector<CharT> buf(static_cast<size_t>(max_digits<T>()) + 1);
+        std::vector<CharT, aligned_allocator<CharT>> buf(
+            static_cast<size_t>(max_digits<T>()) + 1,
+            aligned_allocator<CharT>(ctx.resource()));
 
         // Copied from span<CharT>
         auto in_span = [](CharT ch, span<const CharT> s) {
@@ -587,8 +635,12 @@ struct basic_scanner_impl<
         for (auto it = buf.begin(); it != buf.end(); ++it) {
             auto ch = ctx.stream().read_char();
             if (!ch) {
-                for (auto i = buf.begin(); i != it - 1; ++i) {
-                    ctx.stream().putback(*i);
+                // The end of the input ends a non-empty value.
+                // On errors, basic_scan_args::visit() puts back
+                // everything that was read
+                if (it != buf.begin() &&
+                    ch.error().code() == end_of_file) {
+                    break;
                 }
                 return make_unexpected(ch.error());
             }
@@ -672,8 +724,12 @@ struct basic_scanner_impl<
         for (auto it = buf.begin(); it != buf.end(); ++it) {
             auto tmp = ctx.stream().read_char();
             if (!tmp) {
-                for (auto i = buf.begin(); i != it - 1; ++i) {
-                    ctx.stream().putback(*i);
+                // The end of the input ends a non-empty value.
+                // On errors, basic_scan_args::visit() puts back
+                // everything that was read
+                if (it != buf.begin() &&
+                    tmp.error().code() == end_of_file) {
+                    break;
                 }
                 return make_unexpected(tmp.error());
             }
@@ -724,8 +780,8 @@ template <typename Stream, typename... Args>
 auto scan(Stream& s,
           basic_string_view<typename Stream::char_type> f,
           Args&... a)
-    -> decltype(read(std::declval<Stream&>(), std::declval<span<byte>>()),
-                expected<void, failure>())
+    -> typename std::enable_if<is_readable_stream<Stream>::value,
+                               expected<void, failure>>::type
 {
     using encoding_type = typename Stream::encoding_type;
     using ref_type = basic_scan_stream_ref<encoding_type, readable_tag>;
@@ -733,18 +789,20 @@ auto scan(Stream& s,
     using args_type = basic_scan_args<context_type>;
 
     auto r = typename ref_type::ref_type(s);
-    auto ref = ref_type(r);
-    auto ctx =
-        context_type(ref, f, classic_scan_locale<typename Stream::char_type>());
+    auto mr = detail::stream_resource(s);
+    auto ref = ref_type(r, mr);
+    auto ctx = context_type(
+        ref, f, classic_scan_locale<typename Stream::char_type>(), mr);
     auto args = make_scan_args<context_type>(a...);
-    return get_scanner(ref)(ctx, args_type(args.data()));
+    return get_scanner(r)(ctx, args_type(args.data()));
 }
 template <typename Stream, typename... Args>
 auto scan(Stream& s,
           basic_string_view<typename Stream::char_type> f,
           Args&... a)
-    -> decltype(get(std::declval<Stream&>(), std::declval<byte>()),
-                expected<void, failure>())
+    -> typename std::enable_if<is_byte_readable_stream<Stream>::value &&
+                                   !is_readable_stream<Stream>::value,
+                               expected<void, failure>>::type
 {
     using encoding_type = typename Stream::encoding_type;
     using ref_type = basic_scan_stream_ref<encoding_type, byte_readable_tag>;
@@ -752,9 +810,10 @@ auto scan(Stream& s,
     using args_type = basic_scan_args<context_type>;
 
     auto r = typename ref_type::ref_type(s);
-    auto ref = ref_type(r);
-    auto ctx =
-        context_type(ref, f, classic_scan_locale<typename Stream::char_type>());
+    auto mr = detail::stream_resource(s);
+    auto ref = ref_type(r, mr);
+    auto ctx = context_type(
+        ref, f, classic_scan_locale<typename Stream::char_type>(), mr);
     auto args = make_scan_args<context_type>(a...);
     return get_scanner(r)(ctx, args_type(args.data()));
 }
@@ -20,9 +20,12 @@
 
 #include "config.h"
 
+#include "adaptive_sizing.h"
+#include "buffer_pool.h"
 #include "device.h"
 #include "error.h"
 #include "result.h"
+#include "stats.h"
 #include "third_party/expected.h"
 #include "util.h"
 
@@ -36,7 +39,7 @@ SPIO_BEGIN_NAMESPACE
 template <typename Device>
 result write_all(Device& d, span<const byte> s)
 {
-    auto total_written = 0;
+    streamsize total_written = 0;
     for (auto i = 0; i < SPIO_WRITE_ALL_MAX_ATTEMPTS; ++i) {
         auto ret = d.write(s);
         total_written += ret.value();
@@ -52,6 +55,27 @@ result write_all(Device& d, span<const byte> s)
     return total_written;
 }
 
+// Calls write_all() until all of s is written.
+// A write that makes no progress is an error.
+template <typename Device>
+result write_fully(Device& d, span<const byte> s)
+{
+    streamsize total_written = 0;
+    while (!s.empty()) {
+        auto ret = write_all(d, s);
+        total_written += ret.value();
+        if (ret.has_error()) {
+            return make_result(total_written, ret.error());
+        }
+        if (ret.value() == 0) {
+            return make_result(total_written,
+                               failure{unknown_io_error, "Short write"});
+        }
+        s = s.subspan(ret.value());
+    }
+    return total_written;
+}
+
 template <typename Device>
 expected<span<typename Device::const_buffer_type>, failure> vwrite_all(
     span<typename Device::const_buffer_type> bufs,
@@ -107,20 +131,78 @@ namespace detail {
     };
 }  // namespace detail
 
+// Writable::write_tail(span<const byte>) writes the partial block at
+// the end of a block-aligned buffer without moving the write position,
+// see fd_file_device
+template <typename Writable>
+using write_tail_op = decltype(
+    std::declval<Writable&>().write_tail(std::declval<span<const byte>>()));
+template <typename Writable>
+using has_write_tail = is_detected<write_tail_op, Writable>;
+
+// With a block size, the buffer is aligned to it and only whole blocks
+// are written with write(), as direct I/O requires.
+// A partial block at the end is written with write_tail() when flushed,
+// and kept in the buffer until the rest of the block has been written.
+//
+// With a buffer_pool, the buffer is taken from the pool when data is
+// written, and given back when it's flushed, so idle sinks hold no memory.
+//
+// With set_adaptive_sizing(), the buffer is resized after flushes,
+// depending on how full it was, see adaptive_sizing.
 template <typename Writable>
 class basic_buffered_writable
-    : public detail::basic_buffered_sink_base<Writable> {
+    : public detail::basic_buffered_sink_base<Writable>,
+      public detail::with_io_stats {
     using base = detail::basic_buffered_sink_base<Writable>;
 
 public:
     using writable_type = typename base::sink_type;
-    using buffer_type = std::vector<byte>;
+    using buffer_type = byte_buffer;
     using size_type = std::ptrdiff_t;
 
+    // Unbuffered, not bound to a Writable
+    basic_buffered_writable() noexcept
+        : base(nullptr), m_buf{}, m_mode(buffer_mode::none)
+    {
+    }
+    // The buffer is allocated from r, which must outlive the sink
+    basic_buffered_writable(writable_type& w,
+                            buffer_mode m,
+                            size_type s = BUFSIZ,
+                            memory_resource* r = new_delete_resource())
+        : base(std::addressof(w)),
+          m_buf(_init_buffer(m, s, aligned_allocator<byte>(r))),
+          m_mode(m),
+          m_size(_use_buffering(m) ? s : 0)
+    {
+    }
+    // The pool must outlive the sink
     basic_buffered_writable(writable_type& w,
                             buffer_mode m,
-                            size_type s = BUFSIZ)
-        : base(std::addressof(w)), m_buf(_init_buffer(m, s)), m_mode(m)
+                            size_type s,
+                            buffer_pool& pool)
+        : base(std::addressof(w)),
+          m_buf(aligned_allocator<byte>(std::addressof(pool))),
+          m_mode(m),
+          m_size(_use_buffering(m) ? s : 0),
+          m_pooled(true)
+    {
+        Expects(s > 0);
+    }
+    // s is rounded up to a multiple of block
+    basic_buffered_writable(writable_type& w,
+                            buffer_mode m,
+                            size_type s,
+                            size_type block,
+                            memory_resource* r = new_delete_resource())
+        : base(std::addressof(w)),
+          m_buf(_init_buffer(m,
+                             _round_up(s, block),
+                             _block_allocator(block, r))),
+          m_mode(m),
+          m_block(block),
+          m_size(_use_buffering(m) ? _round_up(s, block) : 0)
     {
     }
 
@@ -133,6 +215,84 @@ public:
     {
         Expects(use_buffering());
 
+        if (m_pooled && m_buf.capacity() == 0) {
+            m_buf.reserve(static_cast<std::size_t>(m_size));
+        }
+        auto res = _write(s, flushed);
+        _release_if_empty();
+        return res;
+    }
+
+    result flush()
+    {
+        Expects(use_buffering());
+
+        auto res = _flush();
+        _release_if_empty();
+        return res;
+    }
+
+    SPIO_CONSTEXPR bool use_buffering() const noexcept
+    {
+        return _use_buffering(m_mode);
+    }
+
+    SPIO_CONSTEXPR size_type size() const noexcept
+    {
+        return m_size;
+    }
+    SPIO_CONSTEXPR size_type in_use() const noexcept
+    {
+        return static_cast<size_type>(m_buf.size());
+    }
+    SPIO_CONSTEXPR size_type free_space() const noexcept
+    {
+        return size() - in_use();
+    }
+    SPIO_CONSTEXPR bool empty() const noexcept
+    {
+        return in_use() == 0;
+    }
+    SPIO_CONSTEXPR bool full() const noexcept
+    {
+        return free_space() == 0;
+    }
+
+    // Contains the buffered data, with capacity for size() bytes,
+    // or none if a pooled buffer has been given back
+    SPIO_CONSTEXPR const buffer_type& buffer() const noexcept
+    {
+        return m_buf;
+    }
+    // The resource the buffer is allocated from
+    memory_resource* resource() const noexcept
+    {
+        return m_buf.get_allocator().resource();
+    }
+    SPIO_CONSTEXPR buffer_mode mode() const noexcept
+    {
+        return m_mode;
+    }
+    // 0 if not block-aligned
+    SPIO_CONSTEXPR size_type block_size() const noexcept
+    {
+        return m_block;
+    }
+
+    // Not available with a block size
+    void set_adaptive_sizing(adaptive_sizing a)
+    {
+        Expects(m_block == 0);
+        m_adapter = detail::size_adapter(a);
+    }
+    SPIO_CONSTEXPR bool adaptive() const noexcept
+    {
+        return m_adapter.enabled();
+    }
+
+private:
+    result _write(span<const byte> s, bool& flushed)
+    {
         if (m_mode == buffer_mode::full) {
             auto n = std::min(s.size(), free_space());
             write_to_buffer(s.first(n));
@@ -140,12 +300,13 @@ public:
             if (s.empty()) {
                 return n;
             }
-            auto res = flush();
+            auto res = _flush();
             flushed = true;
             if (res.has_error()) {
                 return {n, res.inspect_error()};
             }
-            return write(s, flushed);
+            auto rest = _write(s, flushed);
+            return {n + rest.value(), rest.inspect_error()};
         }
 
         // TODO: rewrite
@@ -156,11 +317,10 @@ public:
             }
         }
         auto first = i != -1 ? make_span(s.begin(), i + 1) : s;
-        auto n = std::min(first.size(), free_space());
-        std::copy(first.begin(), first.begin() + n, m_buf.begin() + m_next);
-        m_next += n;
+        auto n = write_to_buffer(
+            first.first(std::min(first.size(), free_space())));
         if (full() || i != -1) {
-            auto res = flush();
+            auto res = _flush();
             flushed = true;
             if (res.has_error()) {
                 return {n, res.inspect_error()};
@@ -171,68 +331,106 @@ public:
         if (s.empty()) {
             return n;
         }
-        return write(s, flushed);
+        auto rest = _write(s, flushed);
+        return {n + rest.value(), rest.inspect_error()};
     }
 
-    result flush()
+    result _flush()
     {
-        Expects(use_buffering());
-
-        auto res = base::get().write(make_span(m_buf.data(), in_use()));
-        if (SPIO_LIKELY(res.value() == in_use())) {
-            m_next = 0;
-            return res;
+        stats().flush();
+        if (m_block != 0) {
+            return _flush_blocks();
         }
-        if (res.value() == 0) {
-            return res;
+        const auto used = in_use();
+        auto res = _device_write(make_span(m_buf.data(), used));
+        _consume(res.value());
+        if (m_adapter.enabled() && empty()) {
+            _resize(m_adapter.observe(used, m_size));
         }
-        std::copy(m_buf.begin() + in_use() - res.value(),
-                  m_buf.begin() + in_use(), m_buf.begin());
-        m_next = res.value();
         return res;
     }
-
-    SPIO_CONSTEXPR bool use_buffering() const noexcept
+    // The buffer must be empty
+    void _resize(size_type n)
     {
-        return _use_buffering(m_mode);
+        if (n == m_size) {
+            return;
+        }
+        m_size = n;
+        // Released pooled buffers are taken again with the new size
+        if (m_buf.capacity() != 0) {
+            buffer_type buf(m_buf.get_allocator());
+            buf.reserve(static_cast<std::size_t>(n));
+            buf.swap(m_buf);
+        }
     }
-
-    SPIO_CONSTEXPR size_type size() const noexcept
+    void _release_if_empty() noexcept
     {
-        return static_cast<size_type>(m_buf.size());
+        if (m_pooled && empty() && m_buf.capacity() != 0) {
+            buffer_type(m_buf.get_allocator()).swap(m_buf);
+        }
     }
-    SPIO_CONSTEXPR size_type in_use() const noexcept
+
+    void _consume(size_type n) noexcept
     {
-        return m_next;
+        if (SPIO_LIKELY(n == in_use())) {
+            m_buf.clear();
+            return;
+        }
+        m_buf.erase(m_buf.begin(), m_buf.begin() + n);
     }
-    SPIO_CONSTEXPR size_type free_space() const noexcept
+
+    result _flush_blocks()
     {
-        return size() - in_use();
+        const auto blocks = in_use() - in_use() % m_block;
+        streamsize written = 0;
+        if (blocks != 0) {
+            auto res = _device_write(make_span(m_buf.data(), blocks));
+            _consume(res.value());
+            if (res.has_error()) {
+                return res;
+            }
+            written = res.value();
+        }
+        if (!empty()) {
+            auto res = _write_tail(has_write_tail<writable_type>{});
+            written += res.value();
+            if (res.has_error()) {
+                return make_result(written, res.error());
+            }
+        }
+        return written;
     }
-    SPIO_CONSTEXPR bool empty() const noexcept
+    result _write_tail(std::true_type)
     {
-        return in_use() == 0;
+        const auto tail = make_span(m_buf.data(), in_use());
+        const auto begin = stats().device_call_begin();
+        auto res = base::get().write_tail(tail);
+        stats().device_write(begin, tail.size(), res.value());
+        return res;
     }
-    SPIO_CONSTEXPR bool full() const noexcept
+    result _write_tail(std::false_type)
     {
-        return free_space() == 0;
+        // Can't be written again, so the following blocks won't be aligned
+        auto res = _device_write(make_span(m_buf.data(), in_use()));
+        _consume(res.value());
+        return res;
     }
 
-    SPIO_CONSTEXPR const buffer_type& buffer() const noexcept
-    {
-        return m_buf;
-    }
-    SPIO_CONSTEXPR buffer_mode mode() const noexcept
+    result _device_write(span<const byte> s)
     {
-        return m_mode;
+        const auto begin = stats().device_call_begin();
+        auto res = base::get().write(s);
+        stats().device_write(begin, s.size(), res.value());
+        return res;
     }
 
-private:
     size_type write_to_buffer(span<const byte> s) noexcept
     {
         Expects(free_space() >= s.size());
-        std::copy(s.begin(), s.end(), m_buf.begin() + m_next);
-        m_next += s.size();
+        // Within the capacity, so the buffer isn't reallocated
+        m_buf.insert(m_buf.end(), s.begin(), s.end());
+        stats().write(s.size());
+        stats().buffer_use(in_use());
         return s.size();
     }
 
@@ -242,17 +440,35 @@ private:
                     m) >>
                 2) == 0;
     }
-    static buffer_type _init_buffer(buffer_mode m, size_type s) noexcept
+    static buffer_type _init_buffer(buffer_mode m,
+                                    size_type s,
+                                    const aligned_allocator<byte>& a)
     {
+        buffer_type buf(a);
         if (_use_buffering(m)) {
-            return buffer_type(static_cast<std::size_t>(s));
+            buf.reserve(static_cast<std::size_t>(s));
         }
-        return {};
+        return buf;
+    }
+    static aligned_allocator<byte> _block_allocator(size_type block,
+                                                    memory_resource* r) noexcept
+    {
+        Expects(block > 0);
+        return aligned_allocator<byte>(static_cast<std::size_t>(block), r);
+    }
+    static size_type _round_up(size_type s, size_type block) noexcept
+    {
+        Expects(block > 0);
+        return std::max((s + block - 1) / block, size_type{1}) * block;
     }
 
+    // Holds the buffered data, with room for size() bytes reserved
     buffer_type m_buf;
-    size_type m_next{0};
     buffer_mode m_mode;
+    size_type m_block{0};
+    size_type m_size{0};
+    bool m_pooled{false};
+    detail::size_adapter m_adapter{};
 };
 
 SPIO_END_NAMESPACE
@@ -20,10 +20,14 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <vector>
+#include "adaptive_sizing.h"
 #include "device.h"
 #include "error.h"
 #include "result.h"
 #include "ring.h"
+#include "stats.h"
 #include "third_party/expected.h"
 #include "third_party/gsl.h"
 #include "util.h"
@@ -38,7 +42,7 @@ SPIO_BEGIN_NAMESPACE
 template <typename Readable>
 result read_all(Readable& d, span<byte> s, bool& eof)
 {
-    auto total_read = 0;
+    streamsize total_read = 0;
     for (auto i = 0; i < SPIO_READ_ALL_MAX_ATTEMPTS; ++i) {
         auto ret = d.read(s, eof);
         total_read += ret.value();
@@ -111,11 +115,38 @@ namespace detail {
         Expects((multiple & (multiple - 1)) == 0);
         return (n + multiple - 1) & -multiple;
     }
+
+    // Bytes put back in front of a source.
+    // They're returned by its next reads before anything else.
+    class putback_buffer {
+    public:
+        bool empty() const noexcept
+        {
+            return m_buf.empty();
+        }
+
+        void putback(span<const byte> s)
+        {
+            m_buf.insert(m_buf.begin(), s.begin(), s.end());
+        }
+        std::ptrdiff_t read(span<byte> s)
+        {
+            const auto n =
+                std::min(s.size(), static_cast<std::ptrdiff_t>(m_buf.size()));
+            std::copy(m_buf.begin(), m_buf.begin() + n, s.begin());
+            m_buf.erase(m_buf.begin(), m_buf.begin() + n);
+            return n;
+        }
+
+    private:
+        std::vector<byte> m_buf{};
+    };
 }  // namespace detail
 
 template <typename Readable>
 class basic_buffered_readable
-    : public detail::basic_buffered_source_base<Readable> {
+    : public detail::basic_buffered_source_base<Readable>,
+      public detail::with_io_stats {
     using base = detail::basic_buffered_source_base<Readable>;
 
 public:
@@ -125,11 +156,13 @@ public:
 
     static SPIO_CONSTEXPR_DECL const size_type buffer_size = BUFSIZ * 2;
 
+    // The buffer is allocated from mr, which must outlive the source
     basic_buffered_readable(readable_type& r,
                             size_type s = size_type(buffer_size),
-                            size_type rs = -1)
+                            size_type rs = -1,
+                            memory_resource* mr = new_delete_resource())
         : base(std::addressof(r)),
-          m_buffer(detail::round_up_power_of_two(s)),
+          m_buffer(detail::round_up_power_of_two(s), mr),
           m_read_size(rs)
     {
         if (m_read_size == -1) {
@@ -166,14 +199,49 @@ public:
         s = s.first(std::min(s.size(), in_use()));
         auto bytes_read = read_from_buffer(s);
         Ensures(bytes_read == s.size());
+        stats().read(bytes_read);
+        if (m_adapter.enabled() && in_use() == 0) {
+            _resize_buffer();
+        }
         return {bytes_read, r.inspect_error()};
     }
-    result putback(span<byte> s)
+    // Device reads that fill the whole read size double it, and reads
+    // returning less than a quarter of it shrink it, see adaptive_sizing.
+    // The buffer follows at twice the read size, but is only reallocated
+    // when it's empty.
+    // The bounds are rounded to powers of two.
+    void set_adaptive_sizing(adaptive_sizing a)
+    {
+        a.min_size = detail::round_up_power_of_two(a.min_size);
+        auto largest = detail::round_up_power_of_two(a.max_size);
+        if (largest > a.max_size) {
+            largest /= 2;
+        }
+        a.max_size = std::max(largest, a.min_size);
+        m_adapter = detail::size_adapter(a);
+        m_buffer_target = size();
+    }
+    SPIO_CONSTEXPR bool adaptive() const noexcept
+    {
+        return m_adapter.enabled();
+    }
+    SPIO_CONSTEXPR size_type read_size() const noexcept
+    {
+        return m_read_size;
+    }
+    // The resource the buffer is allocated from
+    memory_resource* resource() const noexcept
+    {
+        return m_buffer.resource();
+    }
+
+    result putback(span<const byte> s)
     {
 #if SPIO_GCC
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-overflow"
 #endif
+        stats().putback();
         if (s.size() > free_space()) {
             return make_result(m_buffer.write_tail(s.first(free_space())),
                                out_of_memory);
@@ -196,22 +264,39 @@ private:
         Expects(n <= free_space());
 
         size_type has_read = 0;
+        auto ret = result(0);
         auto buffer = m_buffer.direct_write(n);
         for (auto it = buffer.begin(); it != buffer.end(); ++it) {
+            const auto requested = (*it).size();
+            const auto begin = stats().device_call_begin();
             auto r = base::get().read(*it, eof);
+            stats().device_read(begin, requested, r.value(), eof);
             has_read += r.value();
-            if (r.has_error()) {
-                return {has_read, r.inspect_error()};
-            }
-            if (eof) {
+            // What was read before an error is kept, e.g. the bytes
+            // a non-blocking device returns with would_block
+            if (r.has_error() || eof) {
                 if (it != buffer.end()) {
                     ++it;  // can't use a ranged for because of this
                 }
+                ret = std::move(r);
                 break;
             }
         }
         m_buffer.move_head(-(n - has_read));
-        return has_read;
+        stats().buffer_use(in_use());
+        if (m_adapter.enabled() && n >= m_read_size && !ret.has_error()) {
+            m_read_size = m_adapter.observe(has_read, m_read_size);
+        }
+        ret.value() = has_read;
+        return ret;
+    }
+    void _resize_buffer()
+    {
+        const auto target = m_read_size * 2;
+        if (target != m_buffer_target) {
+            m_buffer = buffer_type(target, m_buffer.resource());
+            m_buffer_target = target;
+        }
     }
     size_type read_from_buffer(span<byte> s)
     {
@@ -221,6 +306,9 @@ private:
     buffer_type m_buffer;
     size_type m_read_size;
     bool m_eof{false};
+    detail::size_adapter m_adapter{};
+    // Size requested for m_buffer, which may have been rounded up
+    size_type m_buffer_target{0};
 };
 
 SPIO_END_NAMESPACE
@@ -20,11 +20,15 @@
 
 #include "config.h"
 
+#include "encoding.h"
+#include "memory_resource.h"
 #include "ring.h"
 #include "string_view.h"
 #include "util.h"
 
+#include "chunked_device.h"
 #include "container_device.h"
+#include "fd_device.h"
 #include "memory_device.h"
 #include "stdio_device.h"
 
@@ -35,13 +39,28 @@
 #include "sink.h"
 #include "source.h"
 
+#include "adaptive_sizing.h"
+#include "async.h"
+#include "buffer_pool.h"
+#include "codec.h"
+#include "deadline.h"
 #include "device_stream.h"
 #include "filter.h"
 #include "formatter.h"
+#include "group_commit.h"
+#include "newline.h"
+#include "pipeline.h"
+#include "reactor.h"
 #include "scanner.h"
+#include "stats.h"
 #include "stream.h"
 #include "stream_base.h"
 #include "stream_operations.h"
 #include "stream_ref.h"
+#include "synchronized.h"
+#include "thread_local_sink.h"
+#include "timed_device.h"
+#include "transcode.h"
+#include "transfer.h"
 
 #endif  // SPIO_SPIO_H
@@ -0,0 +1,264 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_STATS_H
+#define SPIO_STATS_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+// Counters of an io_stats at one point in time
+struct io_stats_snapshot {
+    // Bytes passed to and from the user of the buffer
+    std::uint64_t bytes_read{0};
+    std::uint64_t bytes_written{0};
+    // Calls to the device
+    std::uint64_t device_reads{0};
+    std::uint64_t device_writes{0};
+    // Device calls transferring less than requested,
+    // not counting reads stopped by the end of the file
+    std::uint64_t short_reads{0};
+    std::uint64_t short_writes{0};
+    std::uint64_t flushes{0};
+    std::uint64_t putbacks{0};
+    // Most bytes held in the buffer at once
+    std::uint64_t buffer_high_water{0};
+    // Time spent waiting for the device
+    std::chrono::nanoseconds device_time{0};
+
+    io_stats_snapshot& operator+=(const io_stats_snapshot& o) noexcept
+    {
+        bytes_read += o.bytes_read;
+        bytes_written += o.bytes_written;
+        device_reads += o.device_reads;
+        device_writes += o.device_writes;
+        short_reads += o.short_reads;
+        short_writes += o.short_writes;
+        flushes += o.flushes;
+        putbacks += o.putbacks;
+        buffer_high_water = std::max(buffer_high_water, o.buffer_high_water);
+        device_time += o.device_time;
+        return *this;
+    }
+};
+inline io_stats_snapshot operator+(io_stats_snapshot a,
+                                   const io_stats_snapshot& b) noexcept
+{
+    return a += b;
+}
+
+#if SPIO_ENABLE_STATS
+
+// I/O statistics of a buffered source or sink.
+// Only the thread using the buffer updates the counters, but snapshot()
+// can be called from any thread.
+class io_stats {
+public:
+    using clock = std::chrono::steady_clock;
+    using timestamp = clock::time_point;
+
+    io_stats() = default;
+    io_stats(const io_stats& o) noexcept
+    {
+        _store(o.snapshot());
+    }
+    io_stats& operator=(const io_stats& o) noexcept
+    {
+        _store(o.snapshot());
+        return *this;
+    }
+    ~io_stats() = default;
+
+    io_stats_snapshot snapshot() const noexcept
+    {
+        io_stats_snapshot s;
+        s.bytes_read = _load(m_bytes_read);
+        s.bytes_written = _load(m_bytes_written);
+        s.device_reads = _load(m_device_reads);
+        s.device_writes = _load(m_device_writes);
+        s.short_reads = _load(m_short_reads);
+        s.short_writes = _load(m_short_writes);
+        s.flushes = _load(m_flushes);
+        s.putbacks = _load(m_putbacks);
+        s.buffer_high_water = _load(m_buffer_high_water);
+        s.device_time = std::chrono::nanoseconds(
+            static_cast<std::chrono::nanoseconds::rep>(_load(m_device_time)));
+        return s;
+    }
+    void reset() noexcept
+    {
+        _store(io_stats_snapshot{});
+    }
+
+    // Pass the return value to device_read() or device_write()
+    timestamp device_call_begin() const noexcept
+    {
+        return clock::now();
+    }
+    void device_read(timestamp begin,
+                     std::ptrdiff_t requested,
+                     std::ptrdiff_t n,
+                     bool eof) noexcept
+    {
+        _add_time(begin);
+        _add(m_device_reads, 1);
+        if (n < requested && !eof) {
+            _add(m_short_reads, 1);
+        }
+    }
+    void device_write(timestamp begin,
+                      std::ptrdiff_t requested,
+                      std::ptrdiff_t n) noexcept
+    {
+        _add_time(begin);
+        _add(m_device_writes, 1);
+        if (n < requested) {
+            _add(m_short_writes, 1);
+        }
+    }
+
+    void read(std::ptrdiff_t n) noexcept
+    {
+        _add(m_bytes_read, static_cast<std::uint64_t>(n));
+    }
+    void write(std::ptrdiff_t n) noexcept
+    {
+        _add(m_bytes_written, static_cast<std::uint64_t>(n));
+    }
+    void flush() noexcept
+    {
+        _add(m_flushes, 1);
+    }
+    void putback() noexcept
+    {
+        _add(m_putbacks, 1);
+    }
+    void buffer_use(std::ptrdiff_t in_use) noexcept
+    {
+        const auto n = static_cast<std::uint64_t>(in_use);
+        if (n > _load(m_buffer_high_water)) {
+            m_buffer_high_water.store(n, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    using counter = std::atomic<std::uint64_t>;
+
+    static std::uint64_t _load(const counter& c) noexcept
+    {
+        return c.load(std::memory_order_relaxed);
+    }
+    // No read-modify-write needed with a single writer
+    static void _add(counter& c, std::uint64_t n) noexcept
+    {
+        c.store(_load(c) + n, std::memory_order_relaxed);
+    }
+    void _add_time(timestamp begin) noexcept
+    {
+        const auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - begin);
+        _add(m_device_time, static_cast<std::uint64_t>(d.count()));
+    }
+
+    void _store(const io_stats_snapshot& s) noexcept
+    {
+        const auto r = std::memory_order_relaxed;
+        m_bytes_read.store(s.bytes_read, r);
+        m_bytes_written.store(s.bytes_written, r);
+        m_device_reads.store(s.device_reads, r);
+        m_device_writes.store(s.device_writes, r);
+        m_short_reads.store(s.short_reads, r);
+        m_short_writes.store(s.short_writes, r);
+        m_flushes.store(s.flushes, r);
+        m_putbacks.store(s.putbacks, r);
+        m_buffer_high_water.store(s.buffer_high_water, r);
+        m_device_time.store(static_cast<std::uint64_t>(s.device_time.count()),
+                            r);
+    }
+
+    counter m_bytes_read{0};
+    counter m_bytes_written{0};
+    counter m_device_reads{0};
+    counter m_device_writes{0};
+    counter m_short_reads{0};
+    counter m_short_writes{0};
+    counter m_flushes{0};
+    counter m_putbacks{0};
+    counter m_buffer_high_water{0};
+    counter m_device_time{0};
+};
+
+#else
+
+// Statistics are disabled: define SPIO_ENABLE_STATS to 1 to collect them.
+// Every operation is a no-op, and the snapshot is always empty.
+class io_stats {
+public:
+    struct timestamp {
+    };
+
+    io_stats_snapshot snapshot() const noexcept
+    {
+        return {};
+    }
+    void reset() noexcept {}
+
+    SPIO_CONSTEXPR timestamp device_call_begin() const noexcept
+    {
+        return {};
+    }
+    void device_read(timestamp, std::ptrdiff_t, std::ptrdiff_t, bool) noexcept
+    {
+    }
+    void device_write(timestamp, std::ptrdiff_t, std::ptrdiff_t) noexcept {}
+
+    void read(std::ptrdiff_t) noexcept {}
+    void write(std::ptrdiff_t) noexcept {}
+    void flush() noexcept {}
+    void putback() noexcept {}
+    void buffer_use(std::ptrdiff_t) noexcept {}
+};
+
+#endif
+
+namespace detail {
+    // Base class giving a buffer its io_stats.
+    // Empty when statistics are disabled, so it takes no space.
+    class with_io_stats : private io_stats {
+    public:
+        io_stats& stats() noexcept
+        {
+            return *this;
+        }
+        const io_stats& stats() const noexcept
+        {
+            return *this;
+        }
+    };
+}  // namespace detail
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_STATS_H
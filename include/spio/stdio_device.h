@@ -20,14 +20,24 @@
 
 #include "config.h"
 
+#include <cerrno>
 #include <cstdio>
 #include "device.h"
 #include "error.h"
+#include "fd_util.h"
 #include "result.h"
 #include "third_party/expected.h"
 #include "third_party/gsl.h"
 #include "util.h"
 
+#if SPIO_POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+#elif SPIO_WINDOWS
+#include <io.h>
+#include <sys/stat.h>
+#endif
+
 namespace spio {
 SPIO_BEGIN_NAMESPACE
 
@@ -106,6 +116,25 @@ public:
         }
         return {};
     }
+    // Like sync(), but also makes the data durable
+    expected<void, failure> sync_data()
+    {
+        auto r = sync();
+        if (!r) {
+            return r;
+        }
+#if SPIO_POSIX
+        return detail::sync_fd_data(::fileno(m_handle));
+#elif SPIO_WINDOWS
+        if (::_commit(::_fileno(m_handle)) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return {};
+#else
+        return make_unexpected(
+            failure{unimplemented, "Durable sync not supported"});
+#endif
+    }
 
     expected<streampos, failure> seek(streampos pos, inout which = in | out)
     {
@@ -128,15 +157,117 @@ public:
             }
             return SEEK_END;
         }();
-        if (std::fseek(m_handle, static_cast<long>(off), origin) != 0) {
+        if (_seek(off, origin) != 0) {
             return make_unexpected(SPIO_MAKE_ERRNO);
         }
+        if (origin == SEEK_SET) {
+            return off;
+        }
 
-        auto p = std::ftell(m_handle);
+        const auto p = _tell();
         if (p == -1) {
             return make_unexpected(SPIO_MAKE_ERRNO);
         }
-        return p;
+        return static_cast<streamoff>(p);
+    }
+
+#if SPIO_POSIX
+    // Reads and writes at pos through the file descriptor, without moving
+    // the position of the FILE.
+    // Data buffered in the FILE isn't seen, so sync() after writing to it.
+    result read_at(span<byte> s, streampos pos, bool& eof)
+    {
+        Expects(is_open());
+
+        streamsize total = 0;
+        while (total < s.size()) {
+            const auto n = ::pread(
+                ::fileno(m_handle), s.data() + total,
+                static_cast<std::size_t>(s.size() - total),
+                detail::int_cast<off_t>(static_cast<streamoff>(pos) + total));
+            if (n == 0) {
+                eof = true;
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return make_result(total, SPIO_MAKE_ERRNO);
+            }
+            total += n;
+        }
+        return total;
+    }
+    result write_at(span<const byte> s, streampos pos)
+    {
+        Expects(is_open());
+
+        streamsize total = 0;
+        while (total < s.size()) {
+            const auto n = ::pwrite(
+                ::fileno(m_handle), s.data() + total,
+                static_cast<std::size_t>(s.size() - total),
+                detail::int_cast<off_t>(static_cast<streamoff>(pos) + total));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return make_result(total, SPIO_MAKE_ERRNO);
+            }
+            total += n;
+        }
+        return total;
+    }
+#endif
+
+    // Size of the file, not counting data buffered in the FILE
+    expected<streamsize, failure> extent() const
+    {
+        Expects(is_open());
+
+        auto h = const_cast<std::FILE*>(m_handle);
+#if SPIO_POSIX
+        struct stat st;
+        if (::fstat(::fileno(h), &st) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return detail::int_cast<streamsize>(st.st_size);
+#elif SPIO_WINDOWS
+        struct _stat64 st;
+        if (::_fstat64(::_fileno(h), &st) != 0) {
+            return make_unexpected(SPIO_MAKE_ERRNO);
+        }
+        return static_cast<streamsize>(st.st_size);
+#else
+        SPIO_UNUSED(h);
+        return make_unexpected(
+            failure{unimplemented, "File size not supported"});
+#endif
+    }
+
+private:
+    // Offsets beyond 2 GiB need these where long is 32 bits.
+    // On 32-bit POSIX systems, define _FILE_OFFSET_BITS=64 too.
+    int _seek(streamoff off, int origin)
+    {
+#if SPIO_WINDOWS
+        return ::_fseeki64(m_handle, static_cast<__int64>(off), origin);
+#elif SPIO_POSIX
+        return ::fseeko(m_handle, detail::int_cast<off_t>(off), origin);
+#else
+        return std::fseek(m_handle, static_cast<long>(off), origin);
+#endif
+    }
+    streamoff _tell()
+    {
+#if SPIO_WINDOWS
+        return static_cast<streamoff>(::_ftelli64(m_handle));
+#elif SPIO_POSIX
+        return detail::int_cast<streamoff>(::ftello(m_handle));
+#else
+        return static_cast<streamoff>(std::ftell(m_handle));
+#endif
     }
 
 protected:
@@ -151,9 +282,13 @@ public:
     using stdio_device::stdio_device;
 
     using stdio_device::close;
+    using stdio_device::extent;
     using stdio_device::get;
     using stdio_device::is_open;
     using stdio_device::putback;
+#if SPIO_POSIX
+    using stdio_device::read_at;
+#endif
     using stdio_device::seek;
 };
 
@@ -164,10 +299,15 @@ public:
     using stdio_device::stdio_device;
 
     using stdio_device::close;
+    using stdio_device::extent;
     using stdio_device::is_open;
     using stdio_device::seek;
     using stdio_device::sync;
+    using stdio_device::sync_data;
     using stdio_device::write;
+#if SPIO_POSIX
+    using stdio_device::write_at;
+#endif
 };
 
 static_assert(is_sink<stdio_sink>::value, "");
@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include "encoding.h"
 #include "filter.h"
 #include "formatter.h"
 #include "sink.h"
@@ -33,37 +34,6 @@ SPIO_BEGIN_NAMESPACE
 template <typename CharT>
 struct basic_scanner;
 
-struct ascii_tag {
-};
-
-template <typename CharT, typename Tag = ascii_tag, typename Enable = void>
-struct encoding;
-
-template <typename CharT>
-struct encoding<CharT, ascii_tag> {
-    using value_type = CharT;
-
-    static SPIO_CONSTEXPR streampos to_device(streampos pos) noexcept
-    {
-        return pos.operator streamoff() *
-               static_cast<streamoff>(sizeof(value_type));
-    }
-    static SPIO_CONSTEXPR streampos from_device(streampos pos) noexcept
-    {
-        return pos.operator streamoff() /
-               static_cast<streamoff>(sizeof(value_type));
-    }
-
-    static SPIO_CONSTEXPR streamoff to_device(streamoff off) noexcept
-    {
-        return off * static_cast<streamoff>(sizeof(value_type));
-    }
-    static SPIO_CONSTEXPR streamoff from_device(streamoff off) noexcept
-    {
-        return off / static_cast<streamoff>(sizeof(value_type));
-    }
-};
-
 namespace detail {
     template <typename Device>
     class guarded_buffered_writable : public basic_buffered_writable<Device> {
@@ -83,9 +53,11 @@ namespace detail {
         guarded_buffered_writable& operator=(
             guarded_buffered_writable&&) noexcept = default;
 
+        // Nothing is written to the device if the buffer is empty,
+        // so the device may already have been closed
         ~guarded_buffered_writable()
         {
-            if (base::use_buffering()) {
+            if (base::use_buffering() && !base::empty()) {
                 base::flush();
             }
         }
@@ -129,16 +101,14 @@ namespace detail {
 
         SPIO_CONSTEXPR14 sink_type& sink() noexcept
         {
-            Expects(m_sink.has_value());
-            return *m_sink;
+            return m_sink;
         }
         SPIO_CONSTEXPR14 const sink_type& sink() const noexcept
         {
-            Expects(m_sink.has_value());
-            return *m_sink;
+            return m_sink;
         }
 
-        SPIO_CONSTEXPR14 optional<sink_type>& sink_storage() noexcept
+        SPIO_CONSTEXPR14 sink_type& sink_storage() noexcept
         {
             return m_sink;
         }
@@ -149,7 +119,9 @@ namespace detail {
         }
 
     private:
-        optional<sink_type> m_sink;
+        // Default-constructed sinks are unbuffered,
+        // so writes go straight to the device
+        sink_type m_sink{};
     };
 
     template <typename Device, typename Encoding, typename Enable = void>
@@ -159,10 +131,19 @@ namespace detail {
 
         input_stream_base() = default;
 
+        // Bytes put back, returned as they are by the next reads
+        SPIO_CONSTEXPR14 putback_buffer& putback_storage() noexcept
+        {
+            return m_putback;
+        }
+
         SPIO_CONSTEXPR scanner_type scanner() const noexcept
         {
             return scanner_type{};
         }
+
+    private:
+        putback_buffer m_putback{};
     };
     template <typename Device, typename Encoding>
     class input_stream_base<
@@ -189,11 +170,22 @@ namespace detail {
             return *m_source;
         }
 
-        SPIO_CONSTEXPR14 optional<source_type> source_storage()
+        SPIO_CONSTEXPR14 optional<source_type>& source_storage() noexcept
+        {
+            return m_source;
+        }
+        SPIO_CONSTEXPR const optional<source_type>& source_storage() const
+            noexcept
         {
             return m_source;
         }
 
+        // Filtered bytes put back, returned as they are by the next reads
+        SPIO_CONSTEXPR14 putback_buffer& putback_storage() noexcept
+        {
+            return m_putback;
+        }
+
         SPIO_CONSTEXPR scanner_type scanner() const noexcept
         {
             return scanner_type{};
@@ -201,6 +193,7 @@ namespace detail {
 
     private:
         optional<source_type> m_source;
+        putback_buffer m_putback{};
     };
 }  // namespace detail
 
@@ -308,9 +301,15 @@ public:
     {
         return device().is_open();
     }
+    // Finishes the output first, see finish()
     virtual expected<void, failure> close()
     {
-        return device().close();
+        auto r = _finish(0);
+        auto c = device().close();
+        if (r.has_error()) {
+            return make_unexpected(r.error());
+        }
+        return c;
     }
 
     SPIO_CONSTEXPR14 chain_type& chain() noexcept
@@ -353,13 +352,38 @@ protected:
     }
 
 private:
+    template <typename S = stream>
+    auto _finish(int) -> decltype(finish(std::declval<S&>()))
+    {
+        return finish(static_cast<S&>(*this));
+    }
+    result _finish(long)
+    {
+        return 0;
+    }
+
     chain_type m_chain;
     device_type m_device;
     tied_type* m_tie{nullptr};
 };
 
+namespace detail {
+    // Counted in the statistics of the unbuffered sink
+    template <typename Stream, typename Buffer>
+    result _write_unbuffered(Stream& s, const Buffer& buf)
+    {
+        auto& st = s.sink().stats();
+        const auto size = static_cast<std::ptrdiff_t>(buf.size());
+        const auto begin = st.device_call_begin();
+        auto r = s.device().write(buf);
+        st.device_write(begin, size, r.value());
+        st.write(r.value());
+        return r;
+    }
+}  // namespace detail
+
 template <typename Stream>
-auto write(Stream& s, std::vector<byte> buf) ->
+auto write(Stream& s, byte_buffer buf) ->
     typename std::enable_if<is_writable_stream<Stream>::value, result>::type
 {
     auto sentry = typename Stream::output_sentry(s);
@@ -376,23 +400,45 @@ auto write(Stream& s, std::vector<byte> buf) ->
     if (s.sink().use_buffering()) {
         return s.sink().write(buf);
     }
-    return s.device().write(buf);
+    return detail::_write_unbuffered(s, buf);
+}
+template <typename Stream>
+auto write(Stream& s, std::vector<byte> buf) ->
+    typename std::enable_if<is_writable_stream<Stream>::value, result>::type
+{
+    if (!s.chain().output_empty()) {
+        // Filters work on byte_buffers
+        return write(s, byte_buffer(buf.begin(), buf.end(),
+                                    aligned_allocator<byte>(
+                                        detail::stream_resource(s))));
+    }
+    auto sentry = typename Stream::output_sentry(s);
+    if (!sentry) {
+        return make_result(0, sentry.error());
+    }
+    if (s.sink().use_buffering()) {
+        return s.sink().write(buf);
+    }
+    return detail::_write_unbuffered(s, buf);
 }
 template <typename Stream>
 result write(Stream& s, span<const byte> data)
 {
     if (!s.chain().output_empty()) {
-        std::vector<byte> buf(data.begin(), data.end());
-        return write(s, buf);
+        return write(s, byte_buffer(data.begin(), data.end(),
+                                    aligned_allocator<byte>(
+                                        detail::stream_resource(s))));
     }
     if (s.sink().use_buffering()) {
         return s.sink().write(data);
     }
-    return s.device().write(data);
+    return detail::_write_unbuffered(s, data);
 }
 
 template <typename Stream>
-result write_at(Stream& s, std::vector<byte> buf, streampos pos)
+auto write_at(Stream& s, byte_buffer buf, streampos pos) ->
+    typename std::enable_if<is_random_access_writable_stream<Stream>::value,
+                            result>::type
 {
     auto sentry = typename Stream::output_sentry(s);
     if (!sentry) {
@@ -408,10 +454,26 @@ result write_at(Stream& s, std::vector<byte> buf, streampos pos)
     return s.device().write_at(buf, Stream::encoding_type::to_device(pos));
 }
 template <typename Stream>
+result write_at(Stream& s, std::vector<byte> buf, streampos pos)
+{
+    return write_at(s, span<const byte>(buf), pos);
+}
+template <typename Stream>
 result write_at(Stream& s, span<const byte> data, streampos pos)
 {
-    std::vector<byte> buf(data.begin(), data.end());
-    return write_at(s, buf, pos);
+    if (s.chain().output_empty()) {
+        auto sentry = typename Stream::output_sentry(s);
+        if (!sentry) {
+            return make_result(0, sentry.error());
+        }
+        return s.device().write_at(data,
+                                   Stream::encoding_type::to_device(pos));
+    }
+    return write_at(s,
+                    byte_buffer(data.begin(), data.end(),
+                                aligned_allocator<byte>(
+                                    detail::stream_resource(s))),
+                    pos);
 }
 
 template <typename Stream>
@@ -431,6 +493,42 @@ auto put(Stream& s, byte data) ->
     }
     return s.device().put(data);
 }
+namespace detail {
+    template <typename Stream>
+    result _put_bytes(Stream& s, span<const byte> data)
+    {
+        for (std::ptrdiff_t i = 0; i < data.size(); ++i) {
+            auto r = s.device().put(data[i]);
+            if (r.value() != 1 || r.has_error()) {
+                return result(i, r.inspect_error());
+            }
+        }
+        return data.size();
+    }
+}  // namespace detail
+
+template <typename Stream>
+auto put(Stream& s, span<const byte> data) ->
+    typename std::enable_if<is_byte_writable_stream<Stream>::value,
+                            result>::type
+{
+    auto sentry = typename Stream::output_sentry(s);
+    if (!sentry) {
+        return make_result(0, sentry.error());
+    }
+    if (!s.chain().output_empty()) {
+        auto r = s.chain().put_span(data);
+        if (r.value() != data.size() || r.has_error()) {
+            // The bytes the filters accepted are still written
+            auto w = detail::_put_bytes(s, data.first(r.value()));
+            if (w.value() != r.value() || w.has_error()) {
+                return w;
+            }
+            return r;
+        }
+    }
+    return detail::_put_bytes(s, data);
+}
 
 template <typename Stream>
 typename Stream::formatter_type get_formatter(Stream& s)
@@ -447,12 +545,111 @@ result flush(Stream& s)
     }
     return s.sink().flush();
 }
+
+namespace detail {
+    template <typename Chain>
+    auto _write_final(Chain& c, byte_buffer& buf, int)
+        -> decltype(c.write_final(buf))
+    {
+        return c.write_final(buf);
+    }
+    template <typename Chain>
+    result _write_final(Chain&, byte_buffer&, long)
+    {
+        return 0;
+    }
+}  // namespace detail
+
+// Ends the output of s: the output filters write what they've held back,
+// like the padded last block of an encoding, and the sink is flushed.
+// Nothing should be written to s after this.
+// Returns the number of bytes the filters wrote.
+template <typename Stream>
+auto finish(Stream& s) ->
+    typename std::enable_if<is_writable_stream<Stream>::value, result>::type
+{
+    auto sentry = typename Stream::output_sentry(s);
+    if (!sentry) {
+        return make_result(0, sentry.error());
+    }
+    streamsize written = 0;
+    if (!s.chain().output_empty()) {
+        byte_buffer buf{aligned_allocator<byte>(detail::stream_resource(s))};
+        auto r = detail::_write_final(s.chain(), buf, 0);
+        if (r.has_error()) {
+            return make_result(0, r.error());
+        }
+        if (!buf.empty()) {
+            auto w = s.sink().use_buffering()
+                         ? s.sink().write(buf)
+                         : detail::_write_unbuffered(s, buf);
+            written = w.value();
+            if (w.has_error()) {
+                return w;
+            }
+        }
+    }
+    if (s.sink().use_buffering()) {
+        auto f = s.sink().flush();
+        if (f.has_error()) {
+            return make_result(written, f.error());
+        }
+    }
+    return written;
+}
+
 template <typename Stream>
 expected<void, failure> sync(Stream& s)
 {
     return s.device().sync();
 }
 
+namespace detail {
+    template <typename Stream>
+    auto _sink_stats(const Stream& s, int)
+        -> decltype(s.sink().stats().snapshot())
+    {
+        return s.sink().stats().snapshot();
+    }
+    template <typename Stream>
+    io_stats_snapshot _sink_stats(const Stream&, long)
+    {
+        return {};
+    }
+    template <typename Stream>
+    auto _source_stats(const Stream& s, int)
+        -> decltype(s.source_storage()->stats().snapshot())
+    {
+        if (!s.source_storage()) {
+            return {};
+        }
+        return s.source_storage()->stats().snapshot();
+    }
+    template <typename Stream>
+    io_stats_snapshot _source_stats(const Stream&, long)
+    {
+        return {};
+    }
+}  // namespace detail
+
+// Statistics of the buffers of a stream, combined.
+// Empty unless SPIO_ENABLE_STATS is defined to 1.
+template <typename Stream>
+io_stats_snapshot stream_stats(const Stream& s)
+{
+    return detail::_sink_stats(s, 0) + detail::_source_stats(s, 0);
+}
+
+namespace detail {
+    // Puts back bytes the filters haven't seen yet
+    template <typename Stream>
+    bool _putback_source(Stream& s, span<const byte> d)
+    {
+        s.clear_eof();
+        return !s.source().putback(d).has_error();
+    }
+}  // namespace detail
+
 template <typename Stream>
 result read(Stream& s, span<byte> data)
 {
@@ -460,27 +657,47 @@ result read(Stream& s, span<byte> data)
     if (!sentry) {
         return make_result(0, sentry.error());
     }
-    bool eof = false;
-    auto r = s.source().read(data, eof);
-    if (r.has_error()) {
-        putback(s, data.first(r.value()));
-        return make_result(0, r.error());
-    }
-    if (eof) {
-        s.set_eof();
+    if (!s.putback_storage().empty()) {
+        return s.putback_storage().read(data);
     }
-    if (!s.chain().input_empty()) {
-        data = data.first(r.value());
-        r = s.chain().read(data);
+    while (true) {
+        bool eof = false;
+        auto r = s.source().read(data, eof);
         if (r.has_error()) {
-            putback(s, data);
+            detail::_putback_source(s, data.first(r.value()));
             return make_result(0, r.error());
         }
-        if (r.value() < data.size()) {
-            putback(s, data.subspan(r.value()));
+        if (eof) {
+            s.set_eof();
         }
+        if (!s.chain().input_empty() && eof) {
+            // Let the filters release what they've held back
+            auto buf = data;
+            r = s.chain().read_final(buf, r.value());
+            if (r.has_error()) {
+                detail::_putback_source(s, buf);
+                return make_result(0, r.error());
+            }
+        }
+        else if (!s.chain().input_empty()) {
+            const auto n = r.value();
+            auto buf = data.first(n);
+            r = s.chain().read(buf);
+            if (r.has_error()) {
+                detail::_putback_source(s, buf);
+                return make_result(0, r.error());
+            }
+            if (r.value() < buf.size()) {
+                detail::_putback_source(s, buf.subspan(r.value()));
+            }
+            // The filters consumed the input without producing anything,
+            // e.g. a CRLF split between reads: 0 would look like EOF
+            else if (n != 0 && buf.empty()) {
+                continue;
+            }
+        }
+        return r;
     }
-    return r;
 }
 
 namespace detail {
@@ -490,13 +707,42 @@ namespace detail {
                             std::declval<span<byte>>()),
                     bool())
     {
-        return putback(s, data);
+        return _putback_source(s, data);
     }
     template <typename Stream>
     auto _read_at_putback(Stream&, span<byte>) -> bool
     {
         return {};
     }
+
+    template <typename Stream>
+    auto _read_at_filter(Stream& s, span<byte> data, int)
+        -> decltype(s.chain().read(data), result(0))
+    {
+        if (s.chain().input_empty()) {
+            return data.size();
+        }
+        auto r = s.chain().read(data);
+        if (r.has_error()) {
+            _read_at_putback(s, data);
+            return make_result(0, r.error());
+        }
+        if (r.value() < data.size()) {
+            _read_at_putback(s, data.subspan(r.value()));
+        }
+        return r;
+    }
+    // Nothing is put back into a byte stream:
+    // reading at a position doesn't move it
+    template <typename Stream>
+    auto _read_at_filter(Stream& s, span<byte> data, long)
+        -> decltype(s.chain().get_span(data), result(0))
+    {
+        if (s.chain().input_empty()) {
+            return data.size();
+        }
+        return s.chain().get_span(data);
+    }
 }  // namespace detail
 
 template <typename Stream>
@@ -516,18 +762,7 @@ result read_at(Stream& s, span<byte> data, streampos pos)
     if (eof) {
         s.set_eof();
     }
-    if (!s.chain().input_empty()) {
-        data = data.first(r.value());
-        r = s.chain().read(data);
-        if (r.has_error()) {
-            detail::_read_at_putback(s, data);
-            return make_result(0, r.error());
-        }
-        if (r.value() < data.size()) {
-            detail::_read_at_putback(s, data.subspan(r.value()));
-        }
-    }
-    return r;
+    return detail::_read_at_filter(s, data.first(r.value()), 0);
 }
 
 template <typename Stream>
@@ -559,6 +794,80 @@ result get(Stream& s, byte& data)
     }
     return r;
 }
+namespace detail {
+    template <typename Stream>
+    auto _putback_byte(Stream& s, byte b, int)
+        -> decltype(putback(s, b), bool())
+    {
+        return putback(s, b);
+    }
+    template <typename Stream>
+    bool _putback_byte(Stream&, byte, long)
+    {
+        return false;
+    }
+
+    // Puts back data a byte at a time, last one first, so that it's read
+    // again in the same order.
+    // Returns the number of bytes put back, counted from the end of data.
+    template <typename Stream>
+    std::ptrdiff_t _putback_bytes(Stream& s, span<const byte> data)
+    {
+        std::ptrdiff_t n = 0;
+        for (; n < data.size(); ++n) {
+            if (!_putback_byte(s, data[data.size() - n - 1], 0)) {
+                break;
+            }
+        }
+        return n;
+    }
+}  // namespace detail
+
+template <typename Stream>
+auto get(Stream& s, span<byte> data) ->
+    typename std::enable_if<is_byte_readable_stream<Stream>::value,
+                            result>::type
+{
+    auto sentry = typename Stream::input_sentry(s);
+    if (!sentry) {
+        return make_result(0, sentry.error());
+    }
+    std::ptrdiff_t n = 0;
+    bool eof = false;
+    auto ret = result(0);
+    for (; n < data.size() && !eof; ++n) {
+        auto r = s.device().get(data[n], eof);
+        if (r.has_error()) {
+            if (r.value() == 1) {
+                detail::_putback_byte(s, data[n], 0);
+            }
+            ret = make_result(0, r.error());
+            break;
+        }
+        if (r.value() != 1) {
+            break;
+        }
+    }
+    if (eof) {
+        s.set_eof();
+    }
+    if (s.chain().input_empty()) {
+        ret.value() = n;
+        return ret;
+    }
+
+    // Run the filters over what was read even if the device failed,
+    // and put back what they didn't accept
+    auto r = s.chain().get_span(data.first(n));
+    if (r.value() < n) {
+        detail::_putback_bytes(s, data.subspan(r.value(), n - r.value()));
+    }
+    if (r.has_error()) {
+        return r;
+    }
+    ret.value() = r.value();
+    return ret;
+}
 
 template <typename Stream>
 typename Stream::scanner_type get_scanner(Stream& s)
@@ -568,7 +877,7 @@ typename Stream::scanner_type get_scanner(Stream& s)
 
 template <typename Stream>
 auto putback(Stream& s, span<const byte> d) ->
-    typename std::enable_if<is_readable<Stream>::value, bool>::type
+    typename std::enable_if<is_readable_stream<Stream>::value, bool>::type
 {
     s.clear_eof();
     auto sentry = typename Stream::input_sentry(s);
@@ -576,12 +885,18 @@ auto putback(Stream& s, span<const byte> d) ->
         s.set_bad();
         return false;
     }
-    return s.source().putback(d);
+    if (!s.chain().input_empty()) {
+        // Already filtered: running the filters over d again could
+        // change it, or make stateful ones lose it
+        s.putback_storage().putback(d);
+        return true;
+    }
+    return !s.source().putback(d).has_error();
 }
 template <typename Stream>
 auto putback(Stream& s, byte d) ->
-    typename std::enable_if<is_byte_readable<Stream>::value &&
-                                !is_readable<Stream>::value,
+    typename std::enable_if<is_byte_readable_stream<Stream>::value &&
+                                !is_readable_stream<Stream>::value,
                             bool>::type
 {
     s.clear_eof();
@@ -20,7 +20,6 @@
 
 #include "config.h"
 
-#include <vector>
 #include "device.h"
 
 namespace spio {
@@ -37,11 +36,11 @@ public:
 
     bool bad() const noexcept
     {
-        return m_flags[0];
+        return m_bad;
     }
     bool eof() const noexcept
     {
-        return m_flags[1];
+        return m_eof;
     }
     virtual operator bool() const noexcept
     {
@@ -54,32 +53,28 @@ public:
 
     void set_bad()
     {
-        m_flags[0] = true;
+        m_bad = true;
     }
     void clear_bad()
     {
-        m_flags[0] = false;
+        m_bad = false;
     }
 
     void set_eof()
     {
-        m_flags[1] = true;
+        m_eof = true;
     }
     void clear_eof()
     {
-        m_flags[1] = false;
+        m_eof = false;
     }
 
 protected:
     stream_base() = default;
 
 private:
-    static std::vector<bool> _flags_init()
-    {
-        return {false, false};
-    }
-
-    std::vector<bool> m_flags{_flags_init()};  // Intentional vector<bool>
+    bool m_bad{false};
+    bool m_eof{false};
 };
 
 struct any_tag {
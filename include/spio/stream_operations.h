@@ -75,25 +75,21 @@ auto getchar(Stream& s, typename Stream::char_type& ch) ->
                                 !is_readable_stream<Stream>::value,
                             result>::type
 {
-    auto res = result(0);
     typename Stream::char_type tmp;
-    for (auto& b : as_writeable_bytes(make_span(tmp, 1))) {
-        auto r = get(s, b);
-        if (r.error() || r.value() != 1) {
-            res.value() += r.value();
-            if (res.value() > 0) {
-                if (putback(s, tmp.first(res.value()))) {
-                    res.value() = 0;
-                }
-            }
-            res.value() = Stream::encoding_type::from_device(res.value());
-            return make_result(res.value(), r.error());
+    auto bytes = as_writeable_bytes(make_span(std::addressof(tmp), 1));
+    auto r = get(s, bytes);
+    if (r.value() == bytes.size()) {
+        ch = tmp;
+    }
+    else if (r.value() > 0) {
+        // Don't lose the bytes of a partially read character
+        const auto first = bytes.first(r.value());
+        if (detail::_putback_bytes(s, first) == first.size()) {
+            r.value() = 0;
         }
-        ++res.value();
     }
-    ch = tmp;
-    res.value() = Stream::encoding_type::from_device(res.value());
-    return res;
+    r.value() = Stream::encoding_type::from_device(r.value());
+    return r;
 }
 template <typename Stream>
 result getchar_at(Stream& s, typename Stream::char_type& ch, streampos pos)
@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include <new>
 #include "stream.h"
 
 namespace spio {
@@ -52,6 +53,7 @@ namespace detail {
         virtual result write_at(std::vector<byte> buf, streampos pos) = 0;
         virtual result write_at(span<const byte> buf, streampos pos) = 0;
         virtual result put(byte data) = 0;
+        virtual result put(span<const byte> data) = 0;
 
         virtual result flush() = 0;
         virtual expected<void, failure> sync() = 0;
@@ -61,6 +63,7 @@ namespace detail {
         virtual result read(span<byte> buf) = 0;
         virtual result read_at(span<byte> buf, streampos pos) = 0;
         virtual result get(byte& data) = 0;
+        virtual result get(span<byte> data) = 0;
 
         virtual basic_scanner<Encoding> scanner() = 0;
 
@@ -74,6 +77,10 @@ namespace detail {
                                                   inout which = in | out) = 0;
         virtual expected<streampos, failure> tell(inout which = in | out) = 0;
 
+        // Copy-constructs *this into storage, which must be large enough
+        virtual erased_stream_storage_base* copy_to(
+            void* storage) const noexcept = 0;
+
         virtual ~erased_stream_storage_base() = default;
     };
     template <typename Stream>
@@ -84,6 +91,12 @@ namespace detail {
 
         erased_stream_storage(Stream& s) : m_stream(s) {}
 
+        erased_stream_storage_base<typename Stream::encoding_type>* copy_to(
+            void* storage) const noexcept override
+        {
+            return ::new (storage) erased_stream_storage(*this);
+        }
+
         Stream& get_stream()
         {
             return m_stream;
@@ -152,6 +165,10 @@ namespace detail {
         {
             return _put(data);
         }
+        result put(span<const byte> data) override
+        {
+            return _put(data);
+        }
 
         result flush() override
         {
@@ -179,6 +196,10 @@ namespace detail {
         {
             return _get(data);
         }
+        result get(span<byte> data) override
+        {
+            return _get(data);
+        }
 
         basic_scanner<typename Stream::encoding_type> scanner() override
         {
@@ -279,6 +300,20 @@ namespace detail {
         {
             SPIO_UNREACHABLE;
         }
+        template <typename S = Stream>
+        auto _put(span<const byte> data) ->
+            typename std::enable_if<is_byte_writable_stream<S>::value,
+                                    result>::type
+        {
+            return ::spio::put(m_stream, data);
+        }
+        template <typename S = Stream>
+        [[noreturn]] auto _put(span<const byte>) ->
+            typename std::enable_if<!is_byte_writable_stream<S>::value,
+                                    result>::type
+        {
+            SPIO_UNREACHABLE;
+        }
 
         template <typename S = Stream>
         auto _flush() ->
@@ -365,6 +400,20 @@ namespace detail {
         {
             SPIO_UNREACHABLE;
         }
+        template <typename S = Stream>
+        auto _get(span<byte> d) ->
+            typename std::enable_if<is_byte_readable_stream<S>::value,
+                                    result>::type
+        {
+            return ::spio::get(m_stream, d);
+        }
+        template <typename S = Stream>
+        [[noreturn]] auto _get(span<byte>) ->
+            typename std::enable_if<!is_byte_readable_stream<S>::value,
+                                    result>::type
+        {
+            SPIO_UNREACHABLE;
+        }
 
         template <typename S = Stream>
         auto _scanner() -> typename std::enable_if<
@@ -457,20 +506,61 @@ namespace detail {
         template <typename Device, typename Chain>
         using stream_type = stream<Device, Char, Chain>;
 
+        // Every erased_stream_storage is a vtable pointer and a reference,
+        // so it's stored inline instead of on the heap
+        struct storage_layout {
+            virtual ~storage_layout() = default;
+            void* stream;
+        };
+        using storage_type =
+            typename std::aligned_storage<sizeof(storage_layout),
+                                          alignof(storage_layout)>::type;
+
     public:
         using base = erased_stream_storage_base<Char>;
-        using pointer = std::shared_ptr<base>;
 
         basic_erased_stream() = default;
-        basic_erased_stream(pointer p) : m_ptr(std::move(p)) {}
 
         template <
             typename Device,
             typename Chain,
             typename T = erased_stream_storage<stream_type<Device, Chain>>>
         basic_erased_stream(stream_type<Device, Chain>& s)
-            : m_ptr(std::make_shared<T>(s))
         {
+            _construct<T>(s);
+        }
+
+        basic_erased_stream(const basic_erased_stream& o)
+        {
+            _copy(o);
+        }
+        basic_erased_stream& operator=(const basic_erased_stream& o)
+        {
+            if (this != &o) {
+                _destroy();
+                _copy(o);
+            }
+            return *this;
+        }
+        // Leaves o empty
+        basic_erased_stream(basic_erased_stream&& o) noexcept
+        {
+            _copy(o);
+            o._destroy();
+        }
+        basic_erased_stream& operator=(basic_erased_stream&& o) noexcept
+        {
+            if (this != &o) {
+                _destroy();
+                _copy(o);
+                o._destroy();
+            }
+            return *this;
+        }
+
+        ~basic_erased_stream() noexcept
+        {
+            _destroy();
         }
 
         template <
@@ -479,12 +569,13 @@ namespace detail {
             typename T = erased_stream_storage<stream_type<Device, Chain>>>
         void set(stream_type<Device, Chain>& s)
         {
-            m_ptr = std::make_shared<T>(s);
+            _destroy();
+            _construct<T>(s);
         }
 
         bool valid() const
         {
-            return m_ptr.operator bool();
+            return m_ptr != nullptr;
         }
         explicit operator bool() const
         {
@@ -511,15 +602,38 @@ namespace detail {
 
         base* operator->()
         {
-            return m_ptr.get();
+            return m_ptr;
         }
         const base* operator->() const
         {
-            return m_ptr.get();
+            return m_ptr;
         }
 
     private:
-        pointer m_ptr;
+        template <typename T, typename Stream>
+        void _construct(Stream& s)
+        {
+            static_assert(sizeof(T) <= sizeof(storage_type) &&
+                              alignof(T) <= alignof(storage_type),
+                          "Erased stream storage doesn't fit inline");
+            m_ptr = ::new (static_cast<void*>(&m_storage)) T(s);
+        }
+        void _copy(const basic_erased_stream& o) noexcept
+        {
+            if (o.m_ptr) {
+                m_ptr = o.m_ptr->copy_to(&m_storage);
+            }
+        }
+        void _destroy() noexcept
+        {
+            if (m_ptr) {
+                m_ptr->~base();
+                m_ptr = nullptr;
+            }
+        }
+
+        storage_type m_storage{};
+        base* m_ptr{nullptr};
     };
 }  // namespace detail
 
@@ -720,6 +834,14 @@ auto put(basic_stream_ref<Encoding, Properties> s, byte data) ->
 {
     return s->put(data);
 }
+template <typename Encoding, typename Properties>
+auto put(basic_stream_ref<Encoding, Properties> s, span<const byte> data) ->
+    typename std::enable_if<
+        detail::has_tag<Properties, byte_writable_tag>::value,
+        result>::type
+{
+    return s->put(data);
+}
 
 template <typename Encoding, typename Properties>
 basic_formatter<Encoding> get_formatter(
@@ -770,6 +892,14 @@ auto get(basic_stream_ref<Encoding, Properties> s, byte& data) ->
 {
     return s->get(data);
 }
+template <typename Encoding, typename Properties>
+auto get(basic_stream_ref<Encoding, Properties> s, span<byte> data) ->
+    typename std::enable_if<
+        detail::has_tag<Properties, byte_readable_tag>::value,
+        result>::type
+{
+    return s->get(data);
+}
 
 template <typename Encoding, typename Properties>
 basic_scanner<Encoding> get_scanner(basic_stream_ref<Encoding, Properties> s)
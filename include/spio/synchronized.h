@@ -0,0 +1,257 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_SYNCHRONIZED_H
+#define SPIO_SYNCHRONIZED_H
+
+#include "config.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "formatter.h"
+#include "result.h"
+#include "stream.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+#if SPIO_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    class spinlock {
+    public:
+        spinlock() = default;
+
+        spinlock(const spinlock&) = delete;
+        spinlock& operator=(const spinlock&) = delete;
+
+        void lock() noexcept
+        {
+            while (m_locked.exchange(true, std::memory_order_acquire)) {
+                // Spin on a plain load to keep the cache line shared
+                while (m_locked.load(std::memory_order_relaxed)) {
+                    _relax();
+                }
+            }
+        }
+        bool try_lock() noexcept
+        {
+            return !m_locked.load(std::memory_order_relaxed) &&
+                   !m_locked.exchange(true, std::memory_order_acquire);
+        }
+        void unlock() noexcept
+        {
+            m_locked.store(false, std::memory_order_release);
+        }
+
+    private:
+        static void _relax() noexcept
+        {
+#if SPIO_HAS_SSE2
+            _mm_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        std::atomic<bool> m_locked{false};
+    };
+
+    // Per-thread buffers for formatting records.
+    // They're reused between records, so they only allocate when they grow.
+    // Every nesting level gets its own one, since formatting an argument
+    // may print to another synchronized_stream.
+    class record_buffer {
+    public:
+        record_buffer() : m_stack(_stack())
+        {
+            if (m_stack.depth == m_stack.buffers.size()) {
+                m_stack.buffers.emplace_back();
+            }
+            m_buf = std::addressof(m_stack.buffers[m_stack.depth++]);
+            m_buf->clear();
+        }
+
+        record_buffer(const record_buffer&) = delete;
+        record_buffer& operator=(const record_buffer&) = delete;
+
+        ~record_buffer() noexcept
+        {
+            --m_stack.depth;
+        }
+
+        std::vector<byte>& get() noexcept
+        {
+            return *m_buf;
+        }
+
+    private:
+        struct stack {
+            // Elements of a deque stay put when it grows
+            std::deque<std::vector<byte>> buffers{};
+            std::size_t depth{0};
+        };
+        static stack& _stack()
+        {
+            static thread_local stack s;
+            return s;
+        }
+
+        stack& m_stack;
+        std::vector<byte>* m_buf{nullptr};
+    };
+}  // namespace detail
+
+// Locks a std::mutex for the whole operation, formatting included
+struct mutex_policy {
+    using lock_type = std::mutex;
+    static SPIO_CONSTEXPR_DECL const bool buffer_records = false;
+};
+// Like mutex_policy, but busy-waits instead of sleeping.
+// Only worth it when the records are short.
+struct spinlock_policy {
+    using lock_type = detail::spinlock;
+    static SPIO_CONSTEXPR_DECL const bool buffer_records = false;
+};
+// Formats into a per-thread buffer without holding the lock,
+// and only locks to write the finished record
+struct thread_buffer_policy {
+    using lock_type = std::mutex;
+    static SPIO_CONSTEXPR_DECL const bool buffer_records = true;
+};
+
+// Makes every write() and print() on a stream atomic with respect to
+// other threads going through the same synchronized_stream.
+// The stream must outlive it, and must not be used directly while
+// other threads may be using it.
+template <typename Stream, typename Policy = mutex_policy>
+class synchronized_stream {
+public:
+    using stream_type = Stream;
+    using policy_type = Policy;
+    using lock_type = typename Policy::lock_type;
+    using encoding_type = typename Stream::encoding_type;
+    using char_type = typename Stream::char_type;
+
+    explicit synchronized_stream(stream_type& s) : m_stream(std::addressof(s))
+    {
+    }
+
+    synchronized_stream(const synchronized_stream&) = delete;
+    synchronized_stream& operator=(const synchronized_stream&) = delete;
+
+    result write(span<const byte> data)
+    {
+        std::lock_guard<lock_type> lock(m_lock);
+        return ::spio::write(*m_stream, data);
+    }
+    result write(std::vector<byte> buf)
+    {
+        std::lock_guard<lock_type> lock(m_lock);
+        return ::spio::write(*m_stream, std::move(buf));
+    }
+
+    template <typename... Args>
+    result print(basic_string_view<char_type> f, const Args&... a)
+    {
+        return _print(std::integral_constant<bool, Policy::buffer_records>{},
+                      f, a...);
+    }
+
+    result flush()
+    {
+        std::lock_guard<lock_type> lock(m_lock);
+        return ::spio::flush(*m_stream);
+    }
+
+    // Calls fn(stream) while holding the lock,
+    // for operations spanning multiple calls
+    template <typename F>
+    auto apply(F&& fn) -> decltype(fn(std::declval<stream_type&>()))
+    {
+        std::lock_guard<lock_type> lock(m_lock);
+        return fn(*m_stream);
+    }
+
+    SPIO_CONSTEXPR14 stream_type& get_unsynchronized() noexcept
+    {
+        return *m_stream;
+    }
+    SPIO_CONSTEXPR const stream_type& get_unsynchronized() const noexcept
+    {
+        return *m_stream;
+    }
+
+private:
+    template <typename... Args>
+    result _print(std::false_type,
+                  basic_string_view<char_type> f,
+                  const Args&... a)
+    {
+        std::lock_guard<lock_type> lock(m_lock);
+        return ::spio::print(*m_stream, f, a...);
+    }
+    template <typename... Args>
+    result _print(std::true_type,
+                  basic_string_view<char_type> f,
+                  const Args&... a)
+    {
+        detail::record_buffer rb;
+        auto& buf = rb.get();
+
+        using iterator = memcpy_back_insert_iterator<std::vector<byte>,
+                                                     char_type>;
+        get_formatter(*m_stream)(
+            iterator(buf), f,
+            fmt::make_format_args<
+                typename fmt::format_context_t<iterator, char_type>::type>(
+                a...));
+
+        std::lock_guard<lock_type> lock(m_lock);
+        return _write_record(span<const byte>(buf));
+    }
+
+    template <typename S = Stream>
+    auto _write_record(span<const byte> data) ->
+        typename std::enable_if<is_writable_stream<S>::value, result>::type
+    {
+        return ::spio::write(*m_stream, data);
+    }
+    template <typename S = Stream>
+    auto _write_record(span<const byte> data) ->
+        typename std::enable_if<is_byte_writable_stream<S>::value &&
+                                    !is_writable_stream<S>::value,
+                                result>::type
+    {
+        return ::spio::put(*m_stream, data);
+    }
+
+    stream_type* m_stream;
+    lock_type m_lock{};
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_SYNCHRONIZED_H
@@ -0,0 +1,387 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_THREAD_LOCAL_SINK_H
+#define SPIO_THREAD_LOCAL_SINK_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "error.h"
+#include "result.h"
+#include "sink.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+enum class record_framing {
+    // Records are written as-is
+    none,
+    // Every record is preceded by a header containing a sequence number,
+    // see merge_framed_records()
+    sequence
+};
+
+namespace detail {
+    // Header: 8-byte sequence number, 4-byte record size,
+    // both little endian
+    SPIO_CONSTEXPR_DECL const std::ptrdiff_t framed_header_size = 12;
+
+    inline void encode_framed_header(byte* dst,
+                                     std::uint64_t seq,
+                                     std::uint32_t size) noexcept
+    {
+        for (int i = 0; i < 8; ++i) {
+            *dst++ = static_cast<byte>((seq >> (i * 8)) & 0xff);
+        }
+        for (int i = 0; i < 4; ++i) {
+            *dst++ = static_cast<byte>((size >> (i * 8)) & 0xff);
+        }
+    }
+    inline void decode_framed_header(const byte* src,
+                                     std::uint64_t& seq,
+                                     std::uint32_t& size) noexcept
+    {
+        seq = 0;
+        for (int i = 0; i < 8; ++i) {
+            seq |= static_cast<std::uint64_t>(*src++) << (i * 8);
+        }
+        size = 0;
+        for (int i = 0; i < 4; ++i) {
+            size |= static_cast<std::uint32_t>(*src++) << (i * 8);
+        }
+    }
+
+    // Distinguishes sinks in the per-thread cache,
+    // even if one is created at the address of a destroyed one
+    inline std::uint64_t next_sink_generation() noexcept
+    {
+        static std::atomic<std::uint64_t> generation{0};
+        return ++generation;
+    }
+}  // namespace detail
+
+// Sink giving every writing thread its own buffer.
+// Writes only touch the buffer of the calling thread, and full buffers
+// are written to the Writable under a lock, so the threads only contend
+// when a buffer is handed over.
+//
+// Records written by a single thread keep their order, but buffers from
+// different threads are interleaved in the order they fill up.
+// With record_framing::sequence, merge_framed_records() can restore the
+// order in which the records were written.
+//
+// The Writable must outlive the sink.
+template <typename Writable>
+class basic_thread_local_sink {
+public:
+    using writable_type = Writable;
+    using size_type = std::ptrdiff_t;
+
+    basic_thread_local_sink(writable_type& w,
+                            size_type buffer_size = BUFSIZ,
+                            record_framing f = record_framing::none)
+        : m_writable(std::addressof(w)),
+          m_buffer_size(buffer_size),
+          m_framing(f),
+          m_generation(detail::next_sink_generation())
+    {
+        Expects(buffer_size > 0);
+    }
+
+    basic_thread_local_sink(const basic_thread_local_sink&) = delete;
+    basic_thread_local_sink& operator=(const basic_thread_local_sink&) =
+        delete;
+    basic_thread_local_sink(basic_thread_local_sink&&) = delete;
+    basic_thread_local_sink& operator=(basic_thread_local_sink&&) = delete;
+
+    ~basic_thread_local_sink() noexcept
+    {
+        flush();
+    }
+
+    // Writes data as a single record
+    result write(span<const byte> data)
+    {
+        auto& buf = _local_buffer();
+        std::lock_guard<std::mutex> lock(buf.lock);
+
+        const auto record_size = data.size() + _header_size();
+        if (buf.in_use() + record_size > m_buffer_size) {
+            auto r = _flush_buffer(buf);
+            if (r.has_error()) {
+                return make_result(0, r.error());
+            }
+        }
+
+        if (record_size > m_buffer_size) {
+            // Too large to be buffered
+            std::array<byte, detail::framed_header_size> header;
+            std::lock_guard<std::mutex> write_lock(m_write_mutex);
+            if (m_framing == record_framing::sequence) {
+                _encode_header(header.data(), data.size());
+                // A partial header would corrupt the framing
+                auto r = write_fully(*m_writable, make_span(header));
+                if (r.has_error()) {
+                    return make_result(0, r.error());
+                }
+            }
+            return write_fully(*m_writable, data);
+        }
+
+        const auto pos = buf.data.size();
+        buf.data.resize(pos + static_cast<std::size_t>(record_size));
+        auto dst = buf.data.data() + pos;
+        if (m_framing == record_framing::sequence) {
+            _encode_header(dst, data.size());
+            dst += detail::framed_header_size;
+        }
+        std::copy(data.begin(), data.end(), dst);
+        return data.size();
+    }
+    result write(const std::vector<byte>& buf)
+    {
+        return write(make_span(buf));
+    }
+
+    // Writes the buffers of every thread to the Writable.
+    // The buffers of threads that have exited are removed.
+    result flush()
+    {
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        streamsize total = 0;
+        for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+            auto& buf = *it->second;
+            // Read first: the thread may write more before exiting
+            const auto exited = buf.exited.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> buf_lock(buf.lock);
+                auto r = _flush_buffer(buf);
+                total += r.value();
+                if (r.has_error()) {
+                    return make_result(total, r.error());
+                }
+            }
+            if (exited) {
+                it = m_buffers.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        return total;
+    }
+
+    // Number of threads with a buffer in this sink
+    size_type thread_count()
+    {
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        return static_cast<size_type>(m_buffers.size());
+    }
+
+    SPIO_CONSTEXPR size_type buffer_size() const noexcept
+    {
+        return m_buffer_size;
+    }
+    SPIO_CONSTEXPR record_framing framing() const noexcept
+    {
+        return m_framing;
+    }
+
+private:
+    struct thread_buffer {
+        size_type in_use() const noexcept
+        {
+            return static_cast<size_type>(data.size());
+        }
+
+        std::vector<byte> data{};
+        // Held while the buffer is written to the Writable,
+        // so a thread waiting for it blocks instead of spinning
+        std::mutex lock{};
+        // Set when the thread writing to the buffer exits
+        std::atomic<bool> exited{false};
+    };
+
+    // Marks the buffers of a thread when it exits.
+    // A buffer outlives its thread until it has been flushed.
+    struct exit_marker {
+        ~exit_marker()
+        {
+            for (auto& b : buffers) {
+                if (auto buf = b.lock()) {
+                    buf->exited.store(true, std::memory_order_release);
+                }
+            }
+        }
+
+        std::vector<std::weak_ptr<thread_buffer>> buffers{};
+    };
+
+    thread_buffer& _local_buffer()
+    {
+        struct cache_entry {
+            std::uint64_t generation{0};
+            thread_buffer* buffer{nullptr};
+        };
+        // Shared by every sink of this type,
+        // so switching between sinks goes through the registry
+        static thread_local cache_entry cache;
+        if (SPIO_LIKELY(cache.generation == m_generation)) {
+            return *cache.buffer;
+        }
+
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        _remove_exited();
+        // The id of an exited thread may be reused by a new one
+        const auto id = std::this_thread::get_id();
+        auto it = std::find_if(
+            m_buffers.begin(), m_buffers.end(), [&](const buffer_entry& e) {
+                return e.first == id &&
+                       !e.second->exited.load(std::memory_order_acquire);
+            });
+        if (it == m_buffers.end()) {
+            auto buf = std::make_shared<thread_buffer>();
+            buf->data.reserve(static_cast<std::size_t>(m_buffer_size));
+
+            static thread_local exit_marker marker;
+            marker.buffers.erase(
+                std::remove_if(marker.buffers.begin(), marker.buffers.end(),
+                               [](const std::weak_ptr<thread_buffer>& b) {
+                                   return b.expired();
+                               }),
+                marker.buffers.end());
+            marker.buffers.push_back(buf);
+
+            m_buffers.emplace_back(id, std::move(buf));
+            it = m_buffers.end() - 1;
+        }
+        cache.generation = m_generation;
+        cache.buffer = it->second.get();
+        return *cache.buffer;
+    }
+
+    // Flushes and removes the buffers of exited threads.
+    // Buffers that fail to flush are kept, flush() reports the error.
+    // m_registry_mutex must be locked.
+    void _remove_exited()
+    {
+        m_buffers.erase(
+            std::remove_if(m_buffers.begin(), m_buffers.end(),
+                           [&](const buffer_entry& e) {
+                               auto& buf = *e.second;
+                               if (!buf.exited.load(
+                                       std::memory_order_acquire)) {
+                                   return false;
+                               }
+                               std::lock_guard<std::mutex> lock(buf.lock);
+                               return !_flush_buffer(buf).has_error();
+                           }),
+            m_buffers.end());
+    }
+
+    // buf must be locked
+    result _flush_buffer(thread_buffer& buf)
+    {
+        if (buf.data.empty()) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        auto r = write_fully(*m_writable, make_span(buf.data));
+        buf.data.erase(buf.data.begin(), buf.data.begin() + r.value());
+        return r;
+    }
+
+    size_type _header_size() const noexcept
+    {
+        return m_framing == record_framing::sequence
+                   ? detail::framed_header_size
+                   : 0;
+    }
+    void _encode_header(byte* dst, size_type size) noexcept
+    {
+        detail::encode_framed_header(
+            dst, m_sequence.fetch_add(1, std::memory_order_relaxed),
+            static_cast<std::uint32_t>(size));
+    }
+
+    using buffer_entry =
+        std::pair<std::thread::id, std::shared_ptr<thread_buffer>>;
+
+    writable_type* m_writable;
+    size_type m_buffer_size;
+    record_framing m_framing;
+    std::uint64_t m_generation;
+    std::atomic<std::uint64_t> m_sequence{0};
+
+    std::mutex m_registry_mutex{};
+    std::vector<buffer_entry> m_buffers{};
+    std::mutex m_write_mutex{};
+};
+
+// Restores the order of the records in the output of a
+// basic_thread_local_sink using record_framing::sequence.
+// The records are appended to dest without their headers.
+// Returns the number of records.
+inline result merge_framed_records(span<const byte> data,
+                                   std::vector<byte>& dest)
+{
+    struct record {
+        std::uint64_t seq;
+        span<const byte> data;
+    };
+    std::vector<record> records;
+    while (!data.empty()) {
+        if (data.size() < detail::framed_header_size) {
+            return make_result(static_cast<streamsize>(records.size()),
+                               failure{invalid_input, "Truncated header"});
+        }
+        std::uint64_t seq;
+        std::uint32_t size;
+        detail::decode_framed_header(data.data(), seq, size);
+        data = data.subspan(detail::framed_header_size);
+        if (data.size() < static_cast<std::ptrdiff_t>(size)) {
+            return make_result(static_cast<streamsize>(records.size()),
+                               failure{invalid_input, "Truncated record"});
+        }
+        records.push_back({seq, data.first(size)});
+        data = data.subspan(size);
+    }
+
+    std::sort(records.begin(), records.end(),
+              [](const record& a, const record& b) { return a.seq < b.seq; });
+    for (auto& r : records) {
+        dest.insert(dest.end(), r.data.begin(), r.data.end());
+    }
+    return static_cast<streamsize>(records.size());
+}
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_THREAD_LOCAL_SINK_H
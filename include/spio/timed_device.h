@@ -0,0 +1,346 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_TIMED_DEVICE_H
+#define SPIO_TIMED_DEVICE_H
+
+#include "config.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "device.h"
+#include "error.h"
+#include "result.h"
+#include "util.h"
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    // Index of the highest set bit, v must be nonzero
+    inline int highest_bit(std::uint64_t v) noexcept
+    {
+#if SPIO_HAS_BUILTIN(__builtin_clzll) || SPIO_GCC_COMPAT
+        return 63 - __builtin_clzll(v);
+#else
+        int n = 0;
+        while (v >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+}  // namespace detail
+
+struct latency_summary {
+    std::uint64_t count{0};
+    std::chrono::nanoseconds p50{0};
+    std::chrono::nanoseconds p99{0};
+    std::chrono::nanoseconds p999{0};
+    std::chrono::nanoseconds max{0};
+};
+
+// Log-linear histogram of latencies, like an HDR histogram:
+// values are kept with a relative error below 1/32, up to 2^40 ns
+// (about 18 minutes). Longer latencies are recorded as the maximum.
+// Recording is lock-free, and can be done from any number of threads.
+class latency_histogram {
+public:
+    using duration = std::chrono::nanoseconds;
+
+    latency_histogram() = default;
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    void record(duration d) noexcept
+    {
+        const auto v = d.count() < 0 ? std::uint64_t{0}
+                                     : static_cast<std::uint64_t>(d.count());
+        const auto r = std::memory_order_relaxed;
+        m_buckets[_index(v)].fetch_add(1, r);
+        m_count.fetch_add(1, r);
+        m_sum.fetch_add(v, r);
+        auto max = m_max.load(r);
+        while (v > max && !m_max.compare_exchange_weak(max, v, r)) {
+        }
+    }
+
+    std::uint64_t count() const noexcept
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+    duration max() const noexcept
+    {
+        return _to_duration(m_max.load(std::memory_order_relaxed));
+    }
+    duration mean() const noexcept
+    {
+        const auto n = count();
+        if (n == 0) {
+            return duration{0};
+        }
+        return _to_duration(m_sum.load(std::memory_order_relaxed) / n);
+    }
+
+    // Smallest latency at least p percent of the recorded ones
+    // are below or equal to, 0 <= p <= 100
+    duration percentile(double p) const noexcept
+    {
+        Expects(p >= 0 && p <= 100);
+        const auto n = count();
+        if (n == 0) {
+            return duration{0};
+        }
+        // Rounded like HdrHistogram does
+        auto target =
+            static_cast<std::uint64_t>(p / 100 * static_cast<double>(n) + 0.5);
+        if (target == 0) {
+            target = 1;
+        }
+        const auto max = m_max.load(std::memory_order_relaxed);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return _to_duration(std::min(_highest_in_bucket(i), max));
+            }
+        }
+        return _to_duration(max);
+    }
+
+    latency_summary summary() const noexcept
+    {
+        latency_summary s;
+        s.count = count();
+        s.p50 = percentile(50);
+        s.p99 = percentile(99);
+        s.p999 = percentile(99.9);
+        s.max = max();
+        return s;
+    }
+
+    // Not atomic with respect to concurrent record() calls
+    void reset() noexcept
+    {
+        const auto r = std::memory_order_relaxed;
+        for (auto& b : m_buckets) {
+            b.store(0, r);
+        }
+        m_count.store(0, r);
+        m_sum.store(0, r);
+        m_max.store(0, r);
+    }
+
+private:
+    // Values below sub_bucket_count are exact, above that every power of
+    // two is split into sub_bucket_count / 2 buckets
+    static SPIO_CONSTEXPR_DECL const int sub_bucket_bits = 6;
+    static SPIO_CONSTEXPR_DECL const std::uint64_t sub_bucket_count =
+        std::uint64_t{1} << sub_bucket_bits;
+    static SPIO_CONSTEXPR_DECL const std::uint64_t sub_bucket_half =
+        sub_bucket_count / 2;
+    static SPIO_CONSTEXPR_DECL const int max_bits = 40;
+    static SPIO_CONSTEXPR_DECL const std::size_t bucket_count =
+        detail::int_cast<std::size_t>(
+            sub_bucket_count +
+            (max_bits - sub_bucket_bits) * sub_bucket_half);
+
+    static std::size_t _index(std::uint64_t v) noexcept
+    {
+        const auto limit = (std::uint64_t{1} << max_bits) - 1;
+        if (v > limit) {
+            v = limit;
+        }
+        if (v < sub_bucket_count) {
+            return detail::int_cast<std::size_t>(v);
+        }
+        const auto shift = detail::highest_bit(v) - (sub_bucket_bits - 1);
+        return detail::int_cast<std::size_t>(
+            sub_bucket_count +
+            static_cast<std::uint64_t>(shift - 1) * sub_bucket_half +
+            ((v >> shift) - sub_bucket_half));
+    }
+    static std::uint64_t _highest_in_bucket(std::size_t i) noexcept
+    {
+        if (i < sub_bucket_count) {
+            return i;
+        }
+        const auto r = i - sub_bucket_count;
+        const auto shift = r / sub_bucket_half + 1;
+        const auto sub = r % sub_bucket_half + sub_bucket_half;
+        return ((sub + 1) << shift) - 1;
+    }
+    static duration _to_duration(std::uint64_t v) noexcept
+    {
+        return duration(static_cast<duration::rep>(v));
+    }
+
+    std::array<std::atomic<std::uint64_t>, bucket_count> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_sum{0};
+    std::atomic<std::uint64_t> m_max{0};
+};
+
+enum class device_op { read, write, read_at, write_at, sync, seek };
+
+// A latency_histogram for every device_op
+class device_latencies {
+public:
+    device_latencies() = default;
+
+    latency_histogram& operator[](device_op op) noexcept
+    {
+        return m_ops[static_cast<std::size_t>(op)];
+    }
+    const latency_histogram& operator[](device_op op) const noexcept
+    {
+        return m_ops[static_cast<std::size_t>(op)];
+    }
+
+    void reset() noexcept
+    {
+        for (auto& h : m_ops) {
+            h.reset();
+        }
+    }
+
+private:
+    std::array<latency_histogram, 6> m_ops{};
+};
+
+// Records the latency of every write, read, read_at, write_at, sync,
+// sync_data and seek of a Device, which it owns.
+// sync_data() is recorded as device_op::sync.
+// The device_latencies must outlive it, and can be shared between
+// devices.
+template <typename Device>
+class basic_timed_device {
+public:
+    using device_type = Device;
+    using clock = std::chrono::steady_clock;
+
+    basic_timed_device(device_latencies& l, device_type d)
+        : m_latencies(std::addressof(l)), m_device(std::move(d))
+    {
+    }
+
+    SPIO_CONSTEXPR14 device_type& device() noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR const device_type& device() const noexcept
+    {
+        return m_device;
+    }
+    SPIO_CONSTEXPR device_latencies& latencies() const noexcept
+    {
+        return *m_latencies;
+    }
+
+    bool is_open() const
+    {
+        return m_device.is_open();
+    }
+    expected<void, failure> close()
+    {
+        return m_device.close();
+    }
+
+    template <typename D = Device>
+    auto write(span<const byte> s)
+        -> decltype(std::declval<D&>().write(s))
+    {
+        const auto begin = clock::now();
+        auto r = m_device.write(s);
+        _record(device_op::write, begin);
+        return r;
+    }
+    template <typename D = Device>
+    auto write_at(span<const byte> s, streampos pos)
+        -> decltype(std::declval<D&>().write_at(s, pos))
+    {
+        const auto begin = clock::now();
+        auto r = m_device.write_at(s, pos);
+        _record(device_op::write_at, begin);
+        return r;
+    }
+
+    template <typename D = Device>
+    auto read(span<byte> s, bool& eof)
+        -> decltype(std::declval<D&>().read(s, eof))
+    {
+        const auto begin = clock::now();
+        auto r = m_device.read(s, eof);
+        _record(device_op::read, begin);
+        return r;
+    }
+    template <typename D = Device>
+    auto read_at(span<byte> s, streampos pos, bool& eof)
+        -> decltype(std::declval<D&>().read_at(s, pos, eof))
+    {
+        const auto begin = clock::now();
+        auto r = m_device.read_at(s, pos, eof);
+        _record(device_op::read_at, begin);
+        return r;
+    }
+
+    template <typename D = Device>
+    auto sync() -> decltype(std::declval<D&>().sync())
+    {
+        const auto begin = clock::now();
+        auto r = m_device.sync();
+        _record(device_op::sync, begin);
+        return r;
+    }
+    template <typename D = Device>
+    auto sync_data() -> decltype(std::declval<D&>().sync_data())
+    {
+        const auto begin = clock::now();
+        auto r = m_device.sync_data();
+        _record(device_op::sync, begin);
+        return r;
+    }
+
+    template <typename... Args, typename D = Device>
+    auto seek(Args&&... a)
+        -> decltype(std::declval<D&>().seek(std::forward<Args>(a)...))
+    {
+        const auto begin = clock::now();
+        auto r = m_device.seek(std::forward<Args>(a)...);
+        _record(device_op::seek, begin);
+        return r;
+    }
+
+private:
+    void _record(device_op op, clock::time_point begin) noexcept
+    {
+        (*m_latencies)[op].record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - begin));
+    }
+
+    device_latencies* m_latencies;
+    device_type m_device;
+};
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_TIMED_DEVICE_H
@@ -0,0 +1,878 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_TRANSCODE_H
+#define SPIO_TRANSCODE_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include "device.h"
+#include "encoding.h"
+#include "error.h"
+#include "filter.h"
+#include "result.h"
+#include "third_party/expected.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+#if SPIO_HAS_SSE2
+#include <emmintrin.h>
+#endif
+#if SPIO_HAS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+    template <typename T>
+    T load_unit(const byte* p) noexcept
+    {
+        T v;
+        std::memcpy(std::addressof(v), p, sizeof(T));
+        return v;
+    }
+    template <typename T>
+    void store_unit(byte* p, T v) noexcept
+    {
+        std::memcpy(p, std::addressof(v), sizeof(T));
+    }
+
+    enum class transcode_status { done, incomplete, output_full, invalid };
+
+    struct transcode_result {
+        std::ptrdiff_t consumed;
+        std::ptrdiff_t produced;
+        transcode_status status;
+    };
+
+    inline bool is_valid_code_point(char32_t cp) noexcept
+    {
+        return cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF);
+    }
+
+    template <typename Tag>
+    struct unicode_traits;
+
+    template <>
+    struct unicode_traits<utf8_tag> {
+        using unit_type = std::uint8_t;
+
+        static transcode_status decode(const byte* p,
+                                       std::ptrdiff_t n,
+                                       char32_t& cp,
+                                       std::ptrdiff_t& len) noexcept
+        {
+            const auto lead = to_uchar(p[0]);
+            if (lead < 0x80) {
+                cp = lead;
+                len = 1;
+                return transcode_status::done;
+            }
+
+            std::ptrdiff_t extra = 0;
+            char32_t min = 0;
+            if ((lead & 0xE0) == 0xC0) {
+                extra = 1;
+                cp = lead & 0x1Fu;
+                min = 0x80;
+            }
+            else if ((lead & 0xF0) == 0xE0) {
+                extra = 2;
+                cp = lead & 0x0Fu;
+                min = 0x800;
+            }
+            else if ((lead & 0xF8) == 0xF0) {
+                extra = 3;
+                cp = lead & 0x07u;
+                min = 0x10000;
+            }
+            else {
+                return transcode_status::invalid;
+            }
+
+            const auto avail = std::min(n - 1, extra);
+            for (std::ptrdiff_t i = 1; i <= avail; ++i) {
+                const auto b = to_uchar(p[i]);
+                if ((b & 0xC0) != 0x80) {
+                    return transcode_status::invalid;
+                }
+                cp = (cp << 6) | (b & 0x3Fu);
+            }
+            if (avail < extra) {
+                return transcode_status::incomplete;
+            }
+            if (cp < min || !is_valid_code_point(cp)) {
+                return transcode_status::invalid;
+            }
+            len = extra + 1;
+            return transcode_status::done;
+        }
+
+        static std::ptrdiff_t encode(char32_t cp,
+                                     byte* p,
+                                     std::ptrdiff_t n) noexcept
+        {
+            if (cp < 0x80) {
+                if (n < 1) {
+                    return 0;
+                }
+                p[0] = to_byte(cp);
+                return 1;
+            }
+            if (cp < 0x800) {
+                if (n < 2) {
+                    return 0;
+                }
+                p[0] = to_byte(0xC0 | (cp >> 6));
+                p[1] = to_byte(0x80 | (cp & 0x3F));
+                return 2;
+            }
+            if (cp < 0x10000) {
+                if (n < 3) {
+                    return 0;
+                }
+                p[0] = to_byte(0xE0 | (cp >> 12));
+                p[1] = to_byte(0x80 | ((cp >> 6) & 0x3F));
+                p[2] = to_byte(0x80 | (cp & 0x3F));
+                return 3;
+            }
+            if (n < 4) {
+                return 0;
+            }
+            p[0] = to_byte(0xF0 | (cp >> 18));
+            p[1] = to_byte(0x80 | ((cp >> 12) & 0x3F));
+            p[2] = to_byte(0x80 | ((cp >> 6) & 0x3F));
+            p[3] = to_byte(0x80 | (cp & 0x3F));
+            return 4;
+        }
+    };
+
+    template <>
+    struct unicode_traits<utf16_tag> {
+        using unit_type = std::uint16_t;
+
+        static transcode_status decode(const byte* p,
+                                       std::ptrdiff_t n,
+                                       char32_t& cp,
+                                       std::ptrdiff_t& len) noexcept
+        {
+            if (n < 2) {
+                return transcode_status::incomplete;
+            }
+            const auto lead = load_unit<unit_type>(p);
+            if (lead < 0xD800 || lead > 0xDFFF) {
+                cp = lead;
+                len = 2;
+                return transcode_status::done;
+            }
+            if (lead > 0xDBFF) {
+                return transcode_status::invalid;
+            }
+            if (n < 4) {
+                return transcode_status::incomplete;
+            }
+            const auto trail = load_unit<unit_type>(p + 2);
+            if (trail < 0xDC00 || trail > 0xDFFF) {
+                return transcode_status::invalid;
+            }
+            cp = 0x10000 + ((static_cast<char32_t>(lead) - 0xD800) << 10) +
+                 (static_cast<char32_t>(trail) - 0xDC00);
+            len = 4;
+            return transcode_status::done;
+        }
+
+        static std::ptrdiff_t encode(char32_t cp,
+                                     byte* p,
+                                     std::ptrdiff_t n) noexcept
+        {
+            if (cp < 0x10000) {
+                if (n < 2) {
+                    return 0;
+                }
+                store_unit(p, static_cast<unit_type>(cp));
+                return 2;
+            }
+            if (n < 4) {
+                return 0;
+            }
+            cp -= 0x10000;
+            store_unit(p, static_cast<unit_type>(0xD800 + (cp >> 10)));
+            store_unit(p + 2, static_cast<unit_type>(0xDC00 + (cp & 0x3FF)));
+            return 4;
+        }
+    };
+
+    template <>
+    struct unicode_traits<utf32_tag> {
+        using unit_type = std::uint32_t;
+
+        static transcode_status decode(const byte* p,
+                                       std::ptrdiff_t n,
+                                       char32_t& cp,
+                                       std::ptrdiff_t& len) noexcept
+        {
+            if (n < 4) {
+                return transcode_status::incomplete;
+            }
+            cp = load_unit<unit_type>(p);
+            if (!is_valid_code_point(cp)) {
+                return transcode_status::invalid;
+            }
+            len = 4;
+            return transcode_status::done;
+        }
+
+        static std::ptrdiff_t encode(char32_t cp,
+                                     byte* p,
+                                     std::ptrdiff_t n) noexcept
+        {
+            if (n < 4) {
+                return 0;
+            }
+            store_unit(p, static_cast<unit_type>(cp));
+            return 4;
+        }
+    };
+
+    // Copies the leading run of ASCII code units from src to dst,
+    // returns the number of code units copied.
+    template <typename FromTag, typename ToTag>
+    std::ptrdiff_t ascii_run_scalar(const byte* src,
+                                    byte* dst,
+                                    std::ptrdiff_t n) noexcept
+    {
+        using from_unit = typename unicode_traits<FromTag>::unit_type;
+        using to_unit = typename unicode_traits<ToTag>::unit_type;
+
+        const auto from_size = static_cast<std::ptrdiff_t>(sizeof(from_unit));
+        const auto to_size = static_cast<std::ptrdiff_t>(sizeof(to_unit));
+
+        std::ptrdiff_t i = 0;
+        for (; i < n; ++i) {
+            const auto u = load_unit<from_unit>(src + i * from_size);
+            if (u >= 0x80) {
+                break;
+            }
+            store_unit(dst + i * to_size, static_cast<to_unit>(u));
+        }
+        return i;
+    }
+
+    template <typename FromTag, typename ToTag>
+    struct ascii_run {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            return ascii_run_scalar<FromTag, ToTag>(src, dst, n);
+        }
+    };
+
+#if SPIO_HAS_SSE2
+    // SSE2 implies x86, so code units are little-endian:
+    // widening and narrowing is done by interleaving with or dropping zeroes.
+    // The AVX2 loops handle 32 code units at a time,
+    // the SSE2 loops the rest they can.
+#if SPIO_HAS_AVX2
+    // Lanes of an AVX2 pack in the order they were packed
+    inline __m256i ascii_fix_pack(__m256i v) noexcept
+    {
+        return _mm256_permute4x64_epi64(v, 0xD8);
+    }
+#endif
+
+    template <>
+    struct ascii_run<utf8_tag, utf16_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            for (; i + 32 <= n; i += 32) {
+                const auto v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src + i));
+                if (_mm256_movemask_epi8(v) != 0) {
+                    break;
+                }
+                auto out = reinterpret_cast<__m256i*>(dst + i * 2);
+                _mm256_storeu_si256(
+                    out, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+                _mm256_storeu_si256(
+                    out + 1,
+                    _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+            }
+#endif
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= n; i += 16) {
+                const auto v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i));
+                if (_mm_movemask_epi8(v) != 0) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                                 _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2 + 16),
+                                 _mm_unpackhi_epi8(v, zero));
+            }
+            return i + ascii_run_scalar<utf8_tag, utf16_tag>(
+                           src + i, dst + i * 2, n - i);
+        }
+    };
+    template <>
+    struct ascii_run<utf8_tag, utf32_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            for (; i + 32 <= n; i += 32) {
+                const auto v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src + i));
+                if (_mm256_movemask_epi8(v) != 0) {
+                    break;
+                }
+                const auto lo = _mm256_castsi256_si128(v);
+                const auto hi = _mm256_extracti128_si256(v, 1);
+                auto out = reinterpret_cast<__m256i*>(dst + i * 4);
+                _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(lo));
+                _mm256_storeu_si256(
+                    out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+                _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(hi));
+                _mm256_storeu_si256(
+                    out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+            }
+#endif
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= n; i += 16) {
+                const auto v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i));
+                if (_mm_movemask_epi8(v) != 0) {
+                    break;
+                }
+                const auto lo = _mm_unpacklo_epi8(v, zero);
+                const auto hi = _mm_unpackhi_epi8(v, zero);
+                auto out = reinterpret_cast<__m128i*>(dst + i * 4);
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+            }
+            return i + ascii_run_scalar<utf8_tag, utf32_tag>(
+                           src + i, dst + i * 4, n - i);
+        }
+    };
+    template <>
+    struct ascii_run<utf16_tag, utf8_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            const auto mask256 = _mm256_set1_epi16(static_cast<short>(0xFF80));
+            for (; i + 32 <= n; i += 32) {
+                auto in = reinterpret_cast<const __m256i*>(src + i * 2);
+                const auto v0 = _mm256_loadu_si256(in);
+                const auto v1 = _mm256_loadu_si256(in + 1);
+                if (!_mm256_testz_si256(_mm256_or_si256(v0, v1), mask256)) {
+                    break;
+                }
+                _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(dst + i),
+                    ascii_fix_pack(_mm256_packus_epi16(v0, v1)));
+            }
+#endif
+            const auto mask = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= n; i += 16) {
+                const auto v0 = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i * 2));
+                const auto v1 = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i * 2 + 16));
+                const auto high = _mm_or_si128(_mm_and_si128(v0, mask),
+                                               _mm_and_si128(v1, mask));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) !=
+                    0xFFFF) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                                 _mm_packus_epi16(v0, v1));
+            }
+            return i + ascii_run_scalar<utf16_tag, utf8_tag>(
+                           src + i * 2, dst + i, n - i);
+        }
+    };
+    template <>
+    struct ascii_run<utf16_tag, utf32_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            const auto mask256 = _mm256_set1_epi16(static_cast<short>(0xFF80));
+            for (; i + 32 <= n; i += 32) {
+                auto in = reinterpret_cast<const __m256i*>(src + i * 2);
+                const auto v0 = _mm256_loadu_si256(in);
+                const auto v1 = _mm256_loadu_si256(in + 1);
+                if (!_mm256_testz_si256(_mm256_or_si256(v0, v1), mask256)) {
+                    break;
+                }
+                auto out = reinterpret_cast<__m256i*>(dst + i * 4);
+                _mm256_storeu_si256(
+                    out, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v0)));
+                _mm256_storeu_si256(
+                    out + 1,
+                    _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v0, 1)));
+                _mm256_storeu_si256(
+                    out + 2, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v1)));
+                _mm256_storeu_si256(
+                    out + 3,
+                    _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v1, 1)));
+            }
+#endif
+            const auto mask = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const auto zero = _mm_setzero_si128();
+            for (; i + 8 <= n; i += 8) {
+                const auto v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i * 2));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask),
+                                                      zero)) != 0xFFFF) {
+                    break;
+                }
+                auto out = reinterpret_cast<__m128i*>(dst + i * 4);
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(v, zero));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(v, zero));
+            }
+            return i + ascii_run_scalar<utf16_tag, utf32_tag>(
+                           src + i * 2, dst + i * 4, n - i);
+        }
+    };
+    template <>
+    struct ascii_run<utf32_tag, utf8_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            const auto mask256 =
+                _mm256_set1_epi32(static_cast<int>(0xFFFFFF80));
+            for (; i + 32 <= n; i += 32) {
+                auto in = reinterpret_cast<const __m256i*>(src + i * 4);
+                const auto v0 = _mm256_loadu_si256(in);
+                const auto v1 = _mm256_loadu_si256(in + 1);
+                const auto v2 = _mm256_loadu_si256(in + 2);
+                const auto v3 = _mm256_loadu_si256(in + 3);
+                const auto all = _mm256_or_si256(_mm256_or_si256(v0, v1),
+                                                 _mm256_or_si256(v2, v3));
+                if (!_mm256_testz_si256(all, mask256)) {
+                    break;
+                }
+                const auto lo = ascii_fix_pack(_mm256_packs_epi32(v0, v1));
+                const auto hi = ascii_fix_pack(_mm256_packs_epi32(v2, v3));
+                _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(dst + i),
+                    ascii_fix_pack(_mm256_packus_epi16(lo, hi)));
+            }
+#endif
+            const auto mask = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= n; i += 16) {
+                auto in = reinterpret_cast<const __m128i*>(src + i * 4);
+                const auto v0 = _mm_loadu_si128(in);
+                const auto v1 = _mm_loadu_si128(in + 1);
+                const auto v2 = _mm_loadu_si128(in + 2);
+                const auto v3 = _mm_loadu_si128(in + 3);
+                const auto all =
+                    _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, mask),
+                                                      zero)) != 0xFFFF) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                                 _mm_packus_epi16(_mm_packs_epi32(v0, v1),
+                                                  _mm_packs_epi32(v2, v3)));
+            }
+            return i + ascii_run_scalar<utf32_tag, utf8_tag>(
+                           src + i * 4, dst + i, n - i);
+        }
+    };
+    template <>
+    struct ascii_run<utf32_tag, utf16_tag> {
+        static std::ptrdiff_t copy(const byte* src,
+                                   byte* dst,
+                                   std::ptrdiff_t n) noexcept
+        {
+            std::ptrdiff_t i = 0;
+#if SPIO_HAS_AVX2
+            const auto mask256 =
+                _mm256_set1_epi32(static_cast<int>(0xFFFFFF80));
+            for (; i + 32 <= n; i += 32) {
+                auto in = reinterpret_cast<const __m256i*>(src + i * 4);
+                const auto v0 = _mm256_loadu_si256(in);
+                const auto v1 = _mm256_loadu_si256(in + 1);
+                const auto v2 = _mm256_loadu_si256(in + 2);
+                const auto v3 = _mm256_loadu_si256(in + 3);
+                const auto all = _mm256_or_si256(_mm256_or_si256(v0, v1),
+                                                 _mm256_or_si256(v2, v3));
+                if (!_mm256_testz_si256(all, mask256)) {
+                    break;
+                }
+                auto out = reinterpret_cast<__m256i*>(dst + i * 2);
+                _mm256_storeu_si256(
+                    out, ascii_fix_pack(_mm256_packs_epi32(v0, v1)));
+                _mm256_storeu_si256(
+                    out + 1, ascii_fix_pack(_mm256_packs_epi32(v2, v3)));
+            }
+#endif
+            const auto mask = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+            const auto zero = _mm_setzero_si128();
+            for (; i + 8 <= n; i += 8) {
+                auto in = reinterpret_cast<const __m128i*>(src + i * 4);
+                const auto v0 = _mm_loadu_si128(in);
+                const auto v1 = _mm_loadu_si128(in + 1);
+                const auto high = _mm_and_si128(_mm_or_si128(v0, v1), mask);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xFFFF) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                                 _mm_packs_epi32(v0, v1));
+            }
+            return i + ascii_run_scalar<utf32_tag, utf16_tag>(
+                           src + i * 4, dst + i * 2, n - i);
+        }
+    };
+#endif
+
+    template <typename From, typename To>
+    transcode_result transcode(span<const byte> in, span<byte> out) noexcept
+    {
+        using from_traits = unicode_traits<typename From::tag_type>;
+        using to_traits = unicode_traits<typename To::tag_type>;
+        using ascii = ascii_run<typename From::tag_type, typename To::tag_type>;
+        const auto from_size =
+            static_cast<std::ptrdiff_t>(sizeof(typename From::value_type));
+        const auto to_size =
+            static_cast<std::ptrdiff_t>(sizeof(typename To::value_type));
+
+        auto src = in.data();
+        const auto src_end = in.data() + in.size();
+        auto dst = out.data();
+        const auto dst_end = out.data() + out.size();
+        const auto make = [&](transcode_status s) {
+            return transcode_result{src - in.data(), dst - out.data(), s};
+        };
+
+        while (src != src_end) {
+            const auto n = std::min((src_end - src) / from_size,
+                                    (dst_end - dst) / to_size);
+            const auto copied = ascii::copy(src, dst, n);
+            src += copied * from_size;
+            dst += copied * to_size;
+            if (src == src_end) {
+                break;
+            }
+
+            char32_t cp{};
+            std::ptrdiff_t len = 0;
+            const auto s = from_traits::decode(src, src_end - src, cp, len);
+            if (s != transcode_status::done) {
+                return make(s);
+            }
+            const auto written = to_traits::encode(cp, dst, dst_end - dst);
+            if (written == 0) {
+                return make(transcode_status::output_full);
+            }
+            src += len;
+            dst += written;
+        }
+        return make(transcode_status::done);
+    }
+}  // namespace detail
+
+// Output filter converting code units of encoding From to encoding To.
+// Incomplete sequences at the end of a write are kept until the next one.
+template <typename From, typename To>
+class basic_transcoding_output_filter : public output_filter {
+public:
+    using from_encoding_type = From;
+    using to_encoding_type = To;
+
+    basic_transcoding_output_filter() = default;
+    // The buffer is allocated from r, which must outlive the filter
+    explicit basic_transcoding_output_filter(memory_resource* r)
+        : m_buf(aligned_allocator<byte>(r))
+    {
+    }
+
+    result write(buffer_type& data) override
+    {
+        const auto units = (static_cast<std::size_t>(m_carry_size) +
+                            data.size()) /
+                           sizeof(typename From::value_type);
+        m_buf.resize(units * static_cast<std::size_t>(To::max_code_units) *
+                     sizeof(typename To::value_type));
+        auto dest = make_span(m_buf);
+
+        // The sequence carried over from the last write is completed
+        // in a small scratch buffer, and the rest is read from data
+        size_type offset = 0;
+        size_type produced = 0;
+        if (m_carry_size != 0) {
+            std::array<byte, 2 * max_sequence_size> scratch{};
+            std::copy(m_carry.begin(), m_carry.begin() + m_carry_size,
+                      scratch.begin());
+            const auto taken = std::min(
+                static_cast<size_type>(data.size()),
+                static_cast<size_type>(scratch.size()) - m_carry_size);
+            std::copy(data.begin(), data.begin() + taken,
+                      scratch.begin() + m_carry_size);
+
+            auto r = detail::transcode<From, To>(
+                make_span(scratch.data(), m_carry_size + taken), dest);
+            if (r.status == detail::transcode_status::invalid ||
+                (r.consumed < m_carry_size &&
+                 taken != static_cast<size_type>(data.size()))) {
+                m_carry_size = 0;
+                return make_result(
+                    0, failure{invalid_input, "Invalid code unit sequence"});
+            }
+            if (r.consumed < m_carry_size) {
+                // Still incomplete, all of data is in scratch
+                _carry(make_span(scratch.data() + r.consumed,
+                                 m_carry_size + taken - r.consumed));
+                data.clear();
+                return 0;
+            }
+            offset = r.consumed - m_carry_size;
+            produced = r.produced;
+        }
+
+        auto r = detail::transcode<From, To>(
+            make_span(data).subspan(offset), dest.subspan(produced));
+        if (r.status == detail::transcode_status::invalid) {
+            m_carry_size = 0;
+            return make_result(
+                0, failure{invalid_input, "Invalid code unit sequence"});
+        }
+        Expects(r.status != detail::transcode_status::output_full);
+
+        _carry(make_span(data).subspan(offset + r.consumed));
+        m_buf.resize(static_cast<std::size_t>(produced + r.produced));
+        detail::exchange_buffers(data, m_buf);
+        return static_cast<size_type>(data.size());
+    }
+
+    bool has_pending() const noexcept
+    {
+        return m_carry_size != 0;
+    }
+
+private:
+    // Longest sequence of code units encoding a single code point,
+    // in bytes
+    static SPIO_CONSTEXPR_DECL const size_type max_sequence_size = 4;
+
+    void _carry(span<const byte> rest) noexcept
+    {
+        Expects(rest.size() < max_sequence_size);
+        std::copy(rest.begin(), rest.end(), m_carry.begin());
+        m_carry_size = rest.size();
+    }
+
+    buffer_type m_buf{};
+    std::array<byte, max_sequence_size> m_carry{};
+    size_type m_carry_size{0};
+};
+
+// Readable device adapter converting the contents of an underlying
+// Readable from encoding From to encoding To.
+//
+// An input_filter can only modify its span in place, which is not enough
+// for conversions that grow the data (e.g. UTF-8 to UTF-16),
+// so input transcoding is done on the device level instead.
+template <typename Readable, typename From, typename To>
+class basic_transcoding_readable {
+public:
+    using readable_type = Readable;
+    using from_encoding_type = From;
+    using to_encoding_type = To;
+    using size_type = std::ptrdiff_t;
+
+    // The buffer is allocated from mr, which must outlive the readable
+    basic_transcoding_readable(readable_type& r,
+                               size_type s = BUFSIZ,
+                               memory_resource* mr = new_delete_resource())
+        : m_readable(std::addressof(r)),
+          m_buf(static_cast<std::size_t>(s), aligned_allocator<byte>(mr))
+    {
+        Expects(s >= 4);
+    }
+
+    SPIO_CONSTEXPR14 readable_type& get() noexcept
+    {
+        return *m_readable;
+    }
+    SPIO_CONSTEXPR const readable_type& get() const noexcept
+    {
+        return *m_readable;
+    }
+
+    bool is_open() const
+    {
+        return m_readable->is_open();
+    }
+    expected<void, failure> close()
+    {
+        return m_readable->close();
+    }
+
+    result read(span<byte> s, bool& eof)
+    {
+        Expects(is_open());
+
+        size_type produced = drain_pending(s);
+        auto need_input = m_in_use == 0 && produced == 0;
+        while (true) {
+            if (need_input && !m_eof) {
+                auto r = fill();
+                if (r.has_error()) {
+                    return {produced, r.inspect_error()};
+                }
+                if (r.value() == 0 && !m_eof) {
+                    break;
+                }
+            }
+
+            auto t = detail::transcode<From, To>(
+                make_span(m_buf.data(), m_in_use), s.subspan(produced));
+            consume(t.consumed);
+            produced += t.produced;
+
+            if (t.status == detail::transcode_status::invalid) {
+                return make_result(
+                    produced,
+                    failure{invalid_input, "Invalid code unit sequence"});
+            }
+            if (t.status == detail::transcode_status::output_full) {
+                if (produced == 0) {
+                    // Not even one code point fits in s:
+                    // keep it and return what fits
+                    t = detail::transcode<From, To>(
+                        make_span(m_buf.data(), m_in_use),
+                        make_span(m_pending));
+                    consume(t.consumed);
+                    m_pending_end = t.produced;
+                    produced = drain_pending(s);
+                }
+                break;
+            }
+            if (t.status == detail::transcode_status::incomplete && m_eof) {
+                return make_result(
+                    produced,
+                    failure{invalid_input, "Truncated code unit sequence"});
+            }
+            if (produced != 0 || m_eof) {
+                break;
+            }
+            need_input = true;
+        }
+
+        if (m_eof && m_in_use == 0 && m_pending_begin == m_pending_end) {
+            eof = true;
+        }
+        return produced;
+    }
+
+private:
+    size_type drain_pending(span<byte> s) noexcept
+    {
+        const auto n = std::min(s.size(), m_pending_end - m_pending_begin);
+        std::copy(m_pending.begin() + m_pending_begin,
+                  m_pending.begin() + m_pending_begin + n, s.begin());
+        m_pending_begin += n;
+        if (m_pending_begin == m_pending_end) {
+            m_pending_begin = m_pending_end = 0;
+        }
+        return n;
+    }
+
+    result fill()
+    {
+        auto r = m_readable->read(
+            make_span(m_buf.data() + m_in_use,
+                      static_cast<size_type>(m_buf.size()) - m_in_use),
+            m_eof);
+        m_in_use += r.value();
+        return r;
+    }
+    void consume(size_type n) noexcept
+    {
+        std::memmove(m_buf.data(), m_buf.data() + n,
+                     static_cast<std::size_t>(m_in_use - n));
+        m_in_use -= n;
+    }
+
+    readable_type* m_readable;
+    byte_buffer m_buf;
+    size_type m_in_use{0};
+    // Output of a code point that didn't fit in the span given to read()
+    std::array<byte, 4> m_pending{};
+    size_type m_pending_begin{0};
+    size_type m_pending_end{0};
+    bool m_eof{false};
+};
+
+using utf8_to_utf16_filter = basic_transcoding_output_filter<utf8, utf16>;
+using utf8_to_utf32_filter = basic_transcoding_output_filter<utf8, utf32>;
+using utf16_to_utf8_filter = basic_transcoding_output_filter<utf16, utf8>;
+using utf16_to_utf32_filter = basic_transcoding_output_filter<utf16, utf32>;
+using utf32_to_utf8_filter = basic_transcoding_output_filter<utf32, utf8>;
+using utf32_to_utf16_filter = basic_transcoding_output_filter<utf32, utf16>;
+
+template <typename Readable>
+using utf8_to_utf16_readable =
+    basic_transcoding_readable<Readable, utf8, utf16>;
+template <typename Readable>
+using utf8_to_utf32_readable =
+    basic_transcoding_readable<Readable, utf8, utf32>;
+template <typename Readable>
+using utf16_to_utf8_readable =
+    basic_transcoding_readable<Readable, utf16, utf8>;
+template <typename Readable>
+using utf16_to_utf32_readable =
+    basic_transcoding_readable<Readable, utf16, utf32>;
+template <typename Readable>
+using utf32_to_utf8_readable =
+    basic_transcoding_readable<Readable, utf32, utf8>;
+template <typename Readable>
+using utf32_to_utf16_readable =
+    basic_transcoding_readable<Readable, utf32, utf16>;
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_TRANSCODE_H
@@ -0,0 +1,394 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_TRANSFER_H
+#define SPIO_TRANSFER_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <limits>
+#include <vector>
+#include "error.h"
+#include "fd_device.h"
+#include "result.h"
+#include "stream.h"
+#include "third_party/gsl.h"
+#include "util.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace spio {
+SPIO_BEGIN_NAMESPACE
+
+namespace detail {
+#ifdef __linux__
+    // Moves data between two descriptors without copying it to user space.
+    // The method is picked based on the kinds of the descriptors:
+    // copy_file_range() between regular files, sendfile() from a regular
+    // file, splice() if either one is a pipe, and splice() through an
+    // intermediate pipe otherwise. Methods the kernel or the filesystem
+    // turn out not to support are skipped.
+    class fd_transfer {
+    public:
+        enum class method {
+            copy_file_range,
+            sendfile,
+            splice,
+            splice_pipe,
+            none
+        };
+
+        fd_transfer(int in_fd, int out_fd) noexcept
+            : m_in(in_fd), m_out(out_fd), m_method(_pick(in_fd, out_fd))
+        {
+        }
+
+        fd_transfer(const fd_transfer&) = delete;
+        fd_transfer& operator=(const fd_transfer&) = delete;
+        fd_transfer(fd_transfer&&) = delete;
+        fd_transfer& operator=(fd_transfer&&) = delete;
+
+        ~fd_transfer() noexcept
+        {
+            if (m_pipe[0] != -1) {
+                ::close(m_pipe[0]);
+                ::close(m_pipe[1]);
+            }
+        }
+
+        method current_method() const noexcept
+        {
+            return m_method;
+        }
+
+        // Moves up to n bytes, and returns how many reached the output.
+        // Fails with unimplemented once no method works for these
+        // descriptors, without having moved anything.
+        result copy(streamsize n, bool& eof)
+        {
+            Expects(n > 0);
+            n = std::min(n, max_chunk);
+            while (m_method != method::none) {
+                auto r = _copy(n, eof);
+                if (r.has_error() && r.value() == 0 &&
+                    _unsupported(r.error().code().value())) {
+                    m_method = _fallback(m_method);
+                    continue;
+                }
+                return r;
+            }
+            return make_result(0, failure{unimplemented,
+                                          "No zero-copy transfer available"});
+        }
+
+    private:
+        static SPIO_CONSTEXPR_DECL const streamsize max_chunk = 1 << 30;
+
+        static method _pick(int in_fd, int out_fd) noexcept
+        {
+            struct stat in_st, out_st;
+            if (::fstat(in_fd, &in_st) != 0 || ::fstat(out_fd, &out_st) != 0) {
+                return method::none;
+            }
+            if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+                return method::copy_file_range;
+            }
+            if (S_ISREG(in_st.st_mode)) {
+                return method::sendfile;
+            }
+            if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+                return method::splice;
+            }
+            return method::splice_pipe;
+        }
+        static method _fallback(method m) noexcept
+        {
+            // Either end may be a pipe or socket for sendfile() and
+            // splice() through a pipe, so they're what's left to try
+            if (m == method::copy_file_range) {
+                return method::sendfile;
+            }
+            if (m == method::sendfile || m == method::splice) {
+                return method::splice_pipe;
+            }
+            return method::none;
+        }
+        bool _unsupported(int err) const noexcept
+        {
+            return err == EINVAL || err == ENOSYS || err == EXDEV ||
+                   err == EOPNOTSUPP ||
+                   // O_APPEND output, for copy_file_range()
+                   (err == EBADF && m_method == method::copy_file_range);
+        }
+
+        result _copy(streamsize n, bool& eof)
+        {
+            if (m_method == method::splice_pipe) {
+                return _splice_pipe(n, eof);
+            }
+
+            const auto len = static_cast<std::size_t>(n);
+            ssize_t ret = -1;
+            if (m_method == method::copy_file_range) {
+#ifdef SYS_copy_file_range
+                ret = ::syscall(SYS_copy_file_range, m_in, nullptr, m_out,
+                                nullptr, len, 0u);
+#else
+                errno = ENOSYS;
+#endif
+            }
+            else if (m_method == method::sendfile) {
+                ret = ::sendfile(m_out, m_in, nullptr, len);
+            }
+            else {
+                ret = ::splice(m_in, nullptr, m_out, nullptr, len,
+                               SPLICE_F_MOVE);
+            }
+            if (ret < 0) {
+                return make_result(0, fd_error());
+            }
+            if (ret == 0) {
+                eof = true;
+            }
+            return int_cast<streamsize>(ret);
+        }
+
+        result _splice_pipe(streamsize n, bool& eof)
+        {
+            if (m_pipe[0] == -1 && ::pipe2(m_pipe, O_CLOEXEC) != 0) {
+                return make_result(0, failure{SPIO_MAKE_ERRNO});
+            }
+            auto pending = ::splice(m_in, nullptr, m_pipe[1], nullptr,
+                                    static_cast<std::size_t>(n), SPLICE_F_MOVE);
+            if (pending < 0) {
+                return make_result(0, fd_error());
+            }
+            if (pending == 0) {
+                eof = true;
+                return 0;
+            }
+
+            // Whatever was taken from the input has to reach the output,
+            // so wait for it even if it's non-blocking
+            streamsize written = 0;
+            while (pending != 0) {
+                const auto ret =
+                    ::splice(m_pipe[0], nullptr, m_out, nullptr,
+                             static_cast<std::size_t>(pending), SPLICE_F_MOVE);
+                if (ret >= 0) {
+                    written += ret;
+                    pending -= ret;
+                    continue;
+                }
+                if (errno == EAGAIN) {
+                    pollfd p{m_out, POLLOUT, 0};
+                    if (::poll(&p, 1, -1) >= 0 || errno == EINTR) {
+                        continue;
+                    }
+                }
+                else if (errno == EINTR) {
+                    continue;
+                }
+                return make_result(written, failure{SPIO_MAKE_ERRNO});
+            }
+            return written;
+        }
+
+        int m_in;
+        int m_out;
+        method m_method;
+        int m_pipe[2]{-1, -1};
+    };
+#endif  // __linux__
+
+    template <typename InStream, typename OutStream>
+    result transfer_buffered(InStream& src,
+                             OutStream& dst,
+                             streamsize n,
+                             streamsize chunk_size)
+    {
+        std::vector<byte> buf(static_cast<std::size_t>(chunk_size));
+        streamsize total = 0;
+        while (n < 0 || total < n) {
+            auto chunk = make_span(buf);
+            if (n >= 0) {
+                chunk = chunk.first(std::min(chunk.size(), n - total));
+            }
+            auto r = read(src, chunk);
+            if (r.value() == 0) {
+                if (r.has_error()) {
+                    return make_result(total, r.error());
+                }
+                break;
+            }
+            chunk = chunk.first(r.value());
+            auto w = write(dst, chunk);
+            total += w.value();
+            if (w.has_error() || w.value() < chunk.size()) {
+                // Not lost, the next read gets it again
+                putback(src, chunk.subspan(w.value()));
+                return make_result(total, w.has_error()
+                                              ? w.error()
+                                              : failure{unknown_io_error});
+            }
+            if (r.has_error()) {
+                return make_result(total, r.error());
+            }
+            if (src.eof()) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    // Devices caching their offset have to forget it after the kernel
+    // has moved it
+    template <typename Device>
+    auto invalidate_offset(Device& d, int) -> decltype(d.invalidate_offset())
+    {
+        d.invalidate_offset();
+    }
+    template <typename Device>
+    void invalidate_offset(Device&, long)
+    {
+    }
+
+    template <typename InStream, typename OutStream>
+    result transfer_fd(InStream&, OutStream&, streamsize, std::false_type)
+    {
+        return make_result(0, failure{unimplemented});
+    }
+    template <typename InStream, typename OutStream>
+    result transfer_fd(InStream& src,
+                       OutStream& dst,
+                       streamsize n,
+                       std::true_type)
+    {
+#ifdef __linux__
+        if (!src.chain().input_empty() || !dst.chain().output_empty()) {
+            return make_result(0, failure{unimplemented});
+        }
+        // Data buffered in the streams has to go out first:
+        // what's in the source goes through the sink of dst,
+        // which is then flushed before the kernel writes to the descriptor
+        streamsize total = 0;
+        auto& source = src.source_storage();
+        if (source && source->in_use() != 0) {
+            const auto buffered =
+                n < 0 ? source->in_use() : std::min(n, source->in_use());
+            auto r = transfer_buffered(src, dst, buffered, buffered);
+            total += r.value();
+            if (r.has_error()) {
+                return r;
+            }
+        }
+        if (dst.sink().use_buffering()) {
+            auto f = flush(dst);
+            if (f.has_error()) {
+                return make_result(total, f.error());
+            }
+        }
+
+        fd_transfer t(src.device().handle(), dst.device().handle());
+        result ret = 0;
+        while (n < 0 || total < n) {
+            bool eof = false;
+            auto r = t.copy(n < 0 ? std::numeric_limits<streamsize>::max()
+                                  : n - total,
+                            eof);
+            total += r.value();
+            if (eof) {
+                src.set_eof();
+                break;
+            }
+            if (r.has_error()) {
+                ret = make_result(0, r.error());
+                break;
+            }
+        }
+        invalidate_offset(src.device(), 0);
+        invalidate_offset(dst.device(), 0);
+        ret.value() = total;
+        return ret;
+#else
+        SPIO_UNUSED(src);
+        SPIO_UNUSED(dst);
+        SPIO_UNUSED(n);
+        return make_result(0, failure{unimplemented});
+#endif
+    }
+}  // namespace detail
+
+// Copies n bytes from src to dst, or everything until the end of src if
+// n is negative. Returns the number of bytes written to dst.
+//
+// If both streams are backed by file descriptors and have no filters,
+// the data is moved inside the kernel (copy_file_range(), sendfile() or
+// splice()) where available. Otherwise it's read into a buffer and
+// written from there.
+template <typename InStream, typename OutStream>
+auto transfer(InStream& src, OutStream& dst, streamsize n = -1) ->
+    typename std::enable_if<is_readable_stream<InStream>::value &&
+                                is_writable_stream<OutStream>::value,
+                            result>::type
+{
+    auto in_sentry = typename InStream::input_sentry(src);
+    if (!in_sentry) {
+        return make_result(0, in_sentry.error());
+    }
+    auto out_sentry = typename OutStream::output_sentry(dst);
+    if (!out_sentry) {
+        return make_result(0, out_sentry.error());
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    using fd_backed =
+        std::integral_constant<bool,
+                               is_fd_backed<typename InStream::device_type>::
+                                       value &&
+                                   is_fd_backed<typename OutStream::
+                                                    device_type>::value>;
+    auto r = detail::transfer_fd(src, dst, n, fd_backed{});
+    if (!r.has_error() || r.error().code() != unimplemented) {
+        return r;
+    }
+
+    // Carry on from where the fast path gave up
+    auto& source = src.source_storage();
+    const auto chunk_size =
+        source ? source->size() : static_cast<streamsize>(BUFSIZ) * 2;
+    auto b = detail::transfer_buffered(src, dst, n < 0 ? n : n - r.value(),
+                                       chunk_size);
+    return result(r.value() + b.value(), b.inspect_error());
+}
+
+SPIO_END_NAMESPACE
+}  // namespace spio
+
+#endif  // SPIO_TRANSFER_H
@@ -20,8 +20,14 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <memory>
+#include <type_traits>
+#include <vector>
+#include "memory_resource.h"
 #include "third_party/gsl.h"
 
 namespace spio {
@@ -142,6 +148,118 @@ namespace detail {
         return 1 << (32 - __builtin_clz(n - 1));
     }
 #endif
+
+    // static_cast<To>(v), for types like off_t and streamoff that are the
+    // same type on some platforms but not on others.
+    // Where they're the same, v is returned as is: a cast would be useless.
+    template <typename To, typename From>
+    SPIO_CONSTEXPR auto int_cast(From v) noexcept ->
+        typename std::enable_if<std::is_same<To, From>::value, To>::type
+    {
+        return v;
+    }
+    template <typename To, typename From>
+    SPIO_CONSTEXPR auto int_cast(From v) noexcept ->
+        typename std::enable_if<!std::is_same<To, From>::value, To>::type
+    {
+        return static_cast<To>(v);
+    }
+}  // namespace detail
+
+// Allocator returning storage aligned to an alignment chosen at run time,
+// like the block size of a device opened for direct I/O.
+// The alignment must be a power of two.
+// Storage comes from a memory_resource, new_delete_resource() by default.
+//
+// Like std::pmr::polymorphic_allocator, the allocator doesn't propagate
+// on assignment: a container keeps its resource when assigned to.
+// A copy of a container uses the same resource as the original.
+template <typename T>
+class aligned_allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::false_type;
+    using propagate_on_container_swap = std::false_type;
+
+    aligned_allocator() noexcept = default;
+    explicit aligned_allocator(
+        std::size_t alignment,
+        memory_resource* r = new_delete_resource()) noexcept
+        : m_alignment(alignment), m_resource(r)
+    {
+        Expects(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        Expects(r != nullptr);
+    }
+    explicit aligned_allocator(memory_resource* r) noexcept : m_resource(r)
+    {
+        Expects(r != nullptr);
+    }
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U>& o) noexcept
+        : m_alignment(o.alignment()), m_resource(o.resource())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(
+            m_resource->allocate(n * sizeof(T), _alignment()));
+    }
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        m_resource->deallocate(ptr, n * sizeof(T), _alignment());
+    }
+
+    SPIO_CONSTEXPR std::size_t alignment() const noexcept
+    {
+        return m_alignment;
+    }
+    SPIO_CONSTEXPR memory_resource* resource() const noexcept
+    {
+        return m_resource;
+    }
+
+private:
+    std::size_t _alignment() const noexcept
+    {
+        return std::max(m_alignment, alignof(T));
+    }
+
+    std::size_t m_alignment{alignof(std::max_align_t)};
+    memory_resource* m_resource{new_delete_resource()};
+};
+
+template <typename T, typename U>
+bool operator==(const aligned_allocator<T>& a,
+                const aligned_allocator<U>& b) noexcept
+{
+    return a.alignment() == b.alignment() &&
+           *a.resource() == *b.resource();
+}
+template <typename T, typename U>
+bool operator!=(const aligned_allocator<T>& a,
+                const aligned_allocator<U>& b) noexcept
+{
+    return !(a == b);
+}
+
+// Buffer type used by streams, sinks and filters
+using byte_buffer = std::vector<byte, aligned_allocator<byte>>;
+
+namespace detail {
+    // Gives to the contents of from,
+    // leaving from with unspecified contents.
+    // Buffers from different resources can't be swapped,
+    // so the contents are copied instead.
+    inline void exchange_buffers(byte_buffer& to, byte_buffer& from)
+    {
+        if (to.get_allocator() == from.get_allocator()) {
+            to.swap(from);
+            return;
+        }
+        to.assign(from.begin(), from.end());
+    }
 }  // namespace detail
 
 template <typename Container, typename Element, typename = int>
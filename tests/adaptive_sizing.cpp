@@ -0,0 +1,131 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+TEST_CASE("adaptive buffered writable")
+{
+    using writable_type = spio::basic_buffered_writable<spio::vector_sink>;
+    std::vector<spio::byte> out;
+    spio::vector_sink sink(out);
+    writable_type w(sink, spio::buffer_mode::full, 1024);
+    w.set_adaptive_sizing({256, 8192, 4});
+    CHECK(w.adaptive());
+
+    SUBCASE("bulk writes grow the buffer")
+    {
+        const std::vector<spio::byte> data(100000, spio::to_byte(0x61));
+        CHECK(w.write(data).value() == 100000);
+        CHECK(w.size() == 8192);
+        CHECK(w.buffer().capacity() == 8192);
+        CHECK(w.flush().has_error() == false);
+        CHECK(out.size() == 100000);
+    }
+
+    SUBCASE("small flushes shrink the buffer")
+    {
+        const std::vector<spio::byte> data(10, spio::to_byte(0x61));
+        for (int i = 0; i < 3; ++i) {
+            w.write(data);
+            w.flush();
+        }
+        CHECK(w.size() == 1024);
+        w.write(data);
+        w.flush();
+        CHECK(w.size() == 512);
+        for (int i = 0; i < 100; ++i) {
+            w.write(data);
+            w.flush();
+        }
+        CHECK(w.size() == 256);
+        CHECK(w.buffer().capacity() == 256);
+        CHECK(out.size() == 104 * 10);
+    }
+
+    SUBCASE("half-full flushes keep the size")
+    {
+        const std::vector<spio::byte> data(500, spio::to_byte(0x61));
+        for (int i = 0; i < 20; ++i) {
+            w.write(data);
+            w.flush();
+        }
+        CHECK(w.size() == 1024);
+    }
+}
+
+TEST_CASE("adaptive pooled writable")
+{
+    using writable_type = spio::basic_buffered_writable<spio::vector_sink>;
+    spio::buffer_pool pool;
+    std::vector<spio::byte> out;
+    spio::vector_sink sink(out);
+    writable_type w(sink, spio::buffer_mode::full, 1024, pool);
+    w.set_adaptive_sizing({256, 4096, 1});
+
+    const std::vector<spio::byte> data(10, spio::to_byte(0x61));
+    w.write(data);
+    w.flush();
+    CHECK(w.size() == 512);
+    CHECK(w.buffer().capacity() == 0);
+    w.write(data);
+    CHECK(w.buffer().capacity() == 512);
+}
+
+TEST_CASE("adaptive buffered readable")
+{
+    using readable_type = spio::basic_buffered_readable<spio::vector_source>;
+
+    SUBCASE("bulk reads grow the read size")
+    {
+        std::vector<spio::byte> in(1 << 20, spio::to_byte(0x61));
+        spio::vector_source source(in);
+        spio::monotonic_buffer_resource arena;
+        readable_type r(source, 4096, -1, &arena);
+        r.set_adaptive_sizing({1024, 65536, 4});
+        CHECK(r.read_size() == 2048);
+
+        std::vector<spio::byte> buf(4096);
+        bool eof = false;
+        spio::streamsize total = 0;
+        while (!eof) {
+            auto res = r.read(buf, eof);
+            total += res.value();
+            if (res.has_error()) {
+                break;
+            }
+        }
+        CHECK(total == static_cast<spio::streamsize>(in.size()));
+        CHECK(r.read_size() == 65536);
+        CHECK(r.size() >= 131072);
+        // Reallocated from the same resource
+        CHECK(r.resource() == &arena);
+    }
+
+    SUBCASE("short reads shrink the read size")
+    {
+        std::vector<spio::byte> in(100, spio::to_byte(0x61));
+        spio::vector_source source(in);
+        readable_type r(source, 4096);
+        r.set_adaptive_sizing({1024, 65536, 1});
+
+        std::vector<spio::byte> buf(10);
+        bool eof = false;
+        CHECK(r.read(buf, eof).value() == 10);
+        CHECK(r.read_size() == 1024);
+    }
+}
@@ -0,0 +1,407 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+#if SPIO_HAS_COROUTINES
+
+static spio::task<int> add_later(spio::run_loop& loop, int a, int b)
+{
+    co_await loop.schedule();
+    co_return a + b;
+}
+static spio::task<int> sum(spio::run_loop& loop)
+{
+    auto a = co_await add_later(loop, 1, 2);
+    auto b = co_await add_later(loop, a, 3);
+    co_return b;
+}
+static spio::task<void> throws(spio::run_loop& loop)
+{
+    co_await loop.schedule();
+    throw std::runtime_error("error");
+}
+
+TEST_CASE("task")
+{
+    spio::run_loop loop;
+    CHECK(spio::sync_wait(loop, sum(loop)) == 6);
+    CHECK_THROWS_AS(spio::sync_wait(loop, throws(loop)), std::runtime_error);
+    CHECK(loop.empty());
+}
+
+TEST_CASE("run_loop timers")
+{
+    spio::run_loop loop;
+    std::vector<int> order;
+    auto sleeper = [&](int ms) -> spio::task<void> {
+        co_await loop.sleep_for(std::chrono::milliseconds(ms));
+        order.push_back(ms);
+    };
+    loop.spawn(sleeper(30));
+    loop.spawn(sleeper(10));
+    loop.spawn(sleeper(20));
+    loop.run();
+    CHECK(order == std::vector<int>{10, 20, 30});
+}
+
+using async_vector_device = spio::basic_async_device<spio::vector_device>;
+using async_vector_stream = spio::stream<async_vector_device,
+                                         spio::encoding<char>,
+                                         spio::memory_iostream_chain>;
+
+TEST_CASE("async_write and async_read")
+{
+    spio::run_loop loop;
+    std::vector<spio::byte> container;
+    async_vector_stream s(
+        async_vector_device(loop, spio::vector_device(container)),
+        async_vector_stream::input_base{}, async_vector_stream::output_base{},
+        async_vector_stream::chain_type{});
+
+    // Interleaved writers, each writing whole records
+    auto writer = [&](std::string str) -> spio::task<void> {
+        for (int i = 0; i < 3; ++i) {
+            auto r = co_await spio::async_write(s, to_span(str));
+            CHECK(!r.has_error());
+            CHECK(r.value() == static_cast<std::ptrdiff_t>(str.size()));
+        }
+    };
+    loop.spawn(writer("a"));
+    loop.spawn(writer("b"));
+    loop.run();
+    CHECK(to_string(container) == "ababab");
+
+    async_vector_stream input(
+        async_vector_device(loop, spio::vector_device(container)),
+        async_vector_stream::input_base{}, async_vector_stream::output_base{},
+        async_vector_stream::chain_type{});
+    std::array<spio::byte, 4> buf{};
+    auto r =
+        spio::sync_wait(loop, spio::async_read(input, spio::make_span(buf)));
+    CHECK(!r.has_error());
+    CHECK(r.value() == 4);
+    CHECK(std::memcmp(buf.data(), "abab", 4) == 0);
+    r = spio::sync_wait(loop, spio::async_read(input, spio::make_span(buf)));
+    CHECK(!r.has_error());
+    CHECK(r.value() == 2);
+    CHECK(input.eof());
+}
+
+TEST_CASE("async_write_at and async_read_at")
+{
+    using async_memory_device = spio::basic_async_device<spio::memory_device>;
+    using stream_type = spio::stream<async_memory_device, spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    std::vector<spio::byte> container(12);
+    stream_type s(async_memory_device(loop, spio::memory_device(container)),
+                  stream_type::input_base{}, stream_type::output_base{},
+                  stream_type::chain_type{});
+
+    auto r = spio::sync_wait(
+        loop, spio::async_write_at(s, to_span("world!"), 6));
+    CHECK(!r.has_error());
+    r = spio::sync_wait(loop, spio::async_write_at(s, to_span("Hello "), 0));
+    CHECK(!r.has_error());
+    CHECK(to_string(container) == "Hello world!");
+
+    std::array<spio::byte, 5> buf{};
+    r = spio::sync_wait(loop, spio::async_read_at(s, spio::make_span(buf), 6));
+    CHECK(!r.has_error());
+    CHECK(r.value() == 5);
+    CHECK(std::memcmp(buf.data(), "world", 5) == 0);
+}
+
+TEST_CASE("async deadline")
+{
+    spio::run_loop loop;
+    std::vector<spio::byte> container;
+    async_vector_stream s(
+        async_vector_device(loop, spio::vector_device(container)),
+        async_vector_stream::input_base{}, async_vector_stream::output_base{},
+        async_vector_stream::chain_type{});
+
+    auto r = spio::sync_wait(
+        loop, spio::async_write(s, to_span("late"),
+                                spio::deadline::clock::now() -
+                                    std::chrono::seconds(1)));
+    CHECK(r.has_error());
+    CHECK(r.error().code() == std::errc::timed_out);
+    CHECK(container.empty());
+
+    r = spio::sync_wait(loop, spio::async_write(s, to_span("on time"),
+                                                std::chrono::seconds(10)));
+    CHECK(!r.has_error());
+    CHECK(to_string(container) == "on time");
+}
+
+TEST_CASE("async_print and async_scan")
+{
+    spio::run_loop loop;
+    std::vector<spio::byte> container;
+    async_vector_stream s(
+        async_vector_device(loop, spio::vector_device(container)),
+        async_vector_stream::input_base{}, async_vector_stream::output_base{},
+        async_vector_stream::chain_type{});
+
+    auto r = spio::sync_wait(loop, spio::async_print(s, "{}\n{}\n", 42, 7));
+    CHECK(!r.has_error());
+    CHECK(to_string(container) == "42\n7\n");
+
+    async_vector_stream input(
+        async_vector_device(loop, spio::vector_device(container)),
+        async_vector_stream::input_base{}, async_vector_stream::output_base{},
+        async_vector_stream::chain_type{});
+    // Only the first line is consumed by the first scan
+    int a{}, b{};
+    auto e = spio::sync_wait(loop, spio::async_scan(input, "{}", a));
+    CHECK(e.operator bool());
+    CHECK(a == 42);
+    auto e2 = spio::sync_wait(loop, spio::async_scan(input, "{}", b));
+    CHECK(e2.operator bool());
+    CHECK(b == 7);
+
+    auto e3 = spio::sync_wait(loop, spio::async_scan(input, "{}", b));
+    CHECK(!e3);
+}
+
+// Counts the reads that reach the device
+struct counting_async_device : async_vector_device {
+    using async_vector_device::async_vector_device;
+
+    spio::task<spio::result> async_read(spio::span<spio::byte> s,
+                                        bool& eof,
+                                        spio::deadline d = {})
+    {
+        ++reads;
+        co_return co_await async_vector_device::async_read(s, eof, d);
+    }
+
+    int reads{0};
+};
+
+TEST_CASE("async_scan reads in chunks")
+{
+    using stream_type = spio::stream<counting_async_device,
+                                     spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    const std::string str = "1 2 3\n4\n";
+    std::vector<spio::byte> container(to_span(str).begin(),
+                                      to_span(str).end());
+    stream_type input(
+        counting_async_device(loop, spio::vector_device(container)),
+        stream_type::input_base{}, stream_type::output_base{},
+        stream_type::chain_type{});
+
+    int a{}, b{}, c{};
+    auto e = spio::sync_wait(loop, spio::async_scan(input, "{}{}{}", a, b, c));
+    CHECK(e.operator bool());
+    CHECK(a == 1);
+    CHECK(b == 2);
+    CHECK(c == 3);
+    CHECK(input.device().reads == 1);
+
+    // The rest of the chunk was put back
+    std::array<spio::byte, 8> buf{};
+    auto r =
+        spio::sync_wait(loop, spio::async_read(input, spio::make_span(buf)));
+    CHECK(!r.has_error());
+    REQUIRE(r.value() == 2);
+    CHECK(std::memcmp(buf.data(), "4\n", 2) == 0);
+}
+
+// Never has anything to read, but never reaches the end either
+struct stalled_async_device {
+    bool is_open() const
+    {
+        return true;
+    }
+    spio::expected<void, spio::failure> close()
+    {
+        return {};
+    }
+
+    spio::task<spio::result> async_read(spio::span<spio::byte>,
+                                        bool&,
+                                        spio::deadline = {})
+    {
+        co_return 0;
+    }
+};
+
+TEST_CASE("async_scan without input")
+{
+    using stream_type =
+        spio::stream<stalled_async_device, spio::encoding<char>,
+                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    stream_type input(stalled_async_device{}, stream_type::input_base{},
+                      stream_type::output_base{}, stream_type::chain_type{});
+
+    int a{};
+    auto e = spio::sync_wait(loop, spio::async_scan(input, "{}", a));
+    REQUIRE(!e);
+    CHECK(e.error().code() == spio::would_block);
+}
+
+// Readable both synchronously and asynchronously
+struct dual_async_device : async_vector_device {
+    using async_vector_device::async_vector_device;
+
+    spio::result read(spio::span<spio::byte> s, bool& eof)
+    {
+        return device().read(s, eof);
+    }
+};
+
+TEST_CASE("async_read after buffered reads")
+{
+    using stream_type = spio::stream<dual_async_device, spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    const std::string str = "abcdef";
+    std::vector<spio::byte> container(to_span(str).begin(),
+                                      to_span(str).end());
+    stream_type input(dual_async_device(loop, spio::vector_device(container)),
+                      stream_type::input_base{}, stream_type::output_base{},
+                      stream_type::chain_type{});
+    input.source_storage() =
+        stream_type::input_base::source_type(input.device());
+
+    // Buffers all of the input
+    std::array<spio::byte, 2> first{};
+    auto r = spio::read(input, spio::make_span(first));
+    CHECK(r.value() == 2);
+
+    std::array<spio::byte, 8> buf{};
+    r = spio::sync_wait(loop, spio::async_read(input, spio::make_span(buf)));
+    CHECK(!r.has_error());
+    REQUIRE(r.value() == 4);
+    CHECK(std::memcmp(buf.data(), "cdef", 4) == 0);
+}
+
+TEST_CASE("async_scan after buffered reads")
+{
+    using stream_type = spio::stream<dual_async_device, spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    // Longer than a chunk of async_scan() after the newline
+    std::string rest;
+    for (int i = 0; i < 600; ++i) {
+        rest.push_back(static_cast<char>('a' + i % 26));
+    }
+    const std::string str = "a1\n" + rest;
+    std::vector<spio::byte> container(to_span(str).begin(),
+                                      to_span(str).end());
+    stream_type input(dual_async_device(loop, spio::vector_device(container)),
+                      stream_type::input_base{}, stream_type::output_base{},
+                      stream_type::chain_type{});
+    input.source_storage() =
+        stream_type::input_base::source_type(input.device());
+
+    // Buffers all of the input
+    spio::byte first{};
+    CHECK(spio::read(input, spio::make_span(&first, 1)).value() == 1);
+
+    int a{};
+    auto e = spio::sync_wait(loop, spio::async_scan(input, "{}", a));
+    CHECK(e.operator bool());
+    CHECK(a == 1);
+
+    // What followed the newline comes back before the rest of the source
+    std::string out;
+    while (out.size() < rest.size()) {
+        std::array<spio::byte, 100> buf{};
+        auto r = spio::sync_wait(loop,
+                                 spio::async_read(input, spio::make_span(buf)));
+        REQUIRE(!r.has_error());
+        REQUIRE(r.value() != 0);
+        out += to_string(spio::make_span(buf).first(r.value()));
+    }
+    CHECK(out == rest);
+}
+
+#if SPIO_HAS_EPOLL
+
+TEST_CASE("async_fd_device")
+{
+    using stream_type =
+        spio::stream<spio::async_fd_device, spio::encoding<char>,
+                     spio::memory_iostream_chain>;
+
+    spio::run_loop loop;
+    spio::epoll_reactor reactor;
+    REQUIRE(reactor.open().has_value());
+    loop.attach(reactor);
+
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    stream_type rd(spio::async_fd_device(loop, reactor, p->first),
+                   stream_type::input_base{}, stream_type::output_base{},
+                   stream_type::chain_type{});
+    stream_type wr(spio::async_fd_device(loop, reactor, p->second),
+                   stream_type::input_base{}, stream_type::output_base{},
+                   stream_type::chain_type{});
+
+    // Nothing to read yet
+    std::array<spio::byte, 4096> buf{};
+    auto r = spio::sync_wait(
+        loop, spio::async_read(rd, spio::make_span(buf),
+                               std::chrono::milliseconds(10)));
+    CHECK(r.has_error());
+    CHECK(r.error().code() == std::errc::timed_out);
+
+    // More than fits in the pipe, so the writer has to wait for the reader
+    std::string data(1 << 20, 'x');
+    std::string received;
+    auto reader = [&]() -> spio::task<void> {
+        while (!rd.eof()) {
+            auto res = co_await spio::async_read(rd, spio::make_span(buf));
+            received.append(reinterpret_cast<const char*>(buf.data()),
+                            static_cast<std::size_t>(res.value()));
+            if (res.has_error()) {
+                break;
+            }
+        }
+    };
+    auto writer = [&]() -> spio::task<void> {
+        co_await loop.sleep_for(std::chrono::milliseconds(5));
+        auto res = co_await spio::async_write(wr, to_span(data));
+        CHECK(!res.has_error());
+        CHECK(res.value() == static_cast<std::ptrdiff_t>(data.size()));
+        CHECK(wr.device().close().has_value());
+    };
+    loop.spawn(reader());
+    loop.spawn(writer());
+    loop.run();
+    CHECK(received == data);
+    CHECK(loop.empty());
+    CHECK(rd.device().close().has_value());
+}
+
+#endif
+
+#endif
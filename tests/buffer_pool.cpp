@@ -0,0 +1,187 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include <thread>
+#include "doctest.h"
+
+TEST_CASE("buffer_pool")
+{
+    spio::buffer_pool pool(4096, 1);
+    CHECK(pool.max_buffer_size() == 4096);
+
+    SUBCASE("reuse")
+    {
+        auto a = pool.allocate(100);
+        CHECK(pool.allocated_bytes() == 256);
+        pool.deallocate(a, 100);
+        auto b = pool.allocate(200);
+        CHECK(a == b);
+        CHECK(pool.allocated_bytes() == 256);
+        pool.deallocate(b, 200);
+    }
+
+    SUBCASE("shared lists")
+    {
+        auto a = pool.allocate(1000);
+        auto b = pool.allocate(1000);
+        CHECK(pool.allocated_bytes() == 2048);
+        pool.deallocate(a, 1000);
+        // The thread cache holds one buffer
+        pool.deallocate(b, 1000);
+        CHECK(pool.shared_bytes() == 1024);
+        pool.trim();
+        CHECK(pool.shared_bytes() == 0);
+        CHECK(pool.allocated_bytes() == 1024);
+    }
+
+    SUBCASE("large")
+    {
+        auto a = pool.allocate(10000);
+        CHECK(pool.allocated_bytes() == 0);
+        pool.deallocate(a, 10000);
+    }
+
+    SUBCASE("threads")
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&pool]() {
+                std::vector<void*> bufs;
+                for (int i = 0; i < 1000; ++i) {
+                    bufs.push_back(pool.allocate(512));
+                    if (i % 3 == 0) {
+                        for (auto p : bufs) {
+                            pool.deallocate(p, 512);
+                        }
+                        bufs.clear();
+                    }
+                }
+                for (auto p : bufs) {
+                    pool.deallocate(p, 512);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        CHECK(pool.allocated_bytes() <= 4 * 3 * 512);
+    }
+
+    SUBCASE("exited threads")
+    {
+        std::thread([&pool]() {
+            // Left in the thread cache
+            pool.deallocate(pool.allocate(1000), 1000);
+        }).join();
+        CHECK(pool.allocated_bytes() == 1024);
+        pool.trim();
+        CHECK(pool.allocated_bytes() == 0);
+
+        std::thread([&pool]() {
+            pool.deallocate(pool.allocate(1000), 1000);
+        }).join();
+        // Taken back from the cache of the exited thread
+        auto a = pool.allocate(1000);
+        CHECK(pool.allocated_bytes() == 1024);
+        pool.deallocate(a, 1000);
+    }
+}
+
+TEST_CASE("buffer_pool thread caches")
+{
+    // Every pool has a cache of its own in the thread
+    spio::buffer_pool a(4096, 1);
+    spio::buffer_pool b(4096, 1);
+    void* last_a = nullptr;
+    void* last_b = nullptr;
+    for (int i = 0; i < 4; ++i) {
+        auto pa = a.allocate(100);
+        auto pb = b.allocate(100);
+        if (i != 0) {
+            CHECK(pa == last_a);
+            CHECK(pb == last_b);
+        }
+        a.deallocate(pa, 100);
+        b.deallocate(pb, 100);
+        last_a = pa;
+        last_b = pb;
+    }
+    CHECK(a.allocated_bytes() == 256);
+    CHECK(b.allocated_bytes() == 256);
+}
+
+TEST_CASE("pooled buffered writable")
+{
+    using writable_type = spio::basic_buffered_writable<spio::vector_sink>;
+    spio::buffer_pool pool;
+    const std::vector<spio::byte> data(100, spio::to_byte(0x61));
+
+    SUBCASE("buffer held while in use")
+    {
+        std::vector<spio::byte> out;
+        spio::vector_sink sink(out);
+        writable_type w(sink, spio::buffer_mode::full, 1024, pool);
+        CHECK(w.size() == 1024);
+        CHECK(w.buffer().capacity() == 0);
+
+        CHECK(w.write(data).value() == 100);
+        CHECK(w.buffer().capacity() == 1024);
+        CHECK(out.empty());
+
+        CHECK(w.flush().value() == 100);
+        CHECK(w.buffer().capacity() == 0);
+        CHECK(out.size() == 100);
+
+        // Larger than the buffer
+        std::vector<spio::byte> big(3000, spio::to_byte(0x62));
+        CHECK(w.write(big).value() == 3000);
+        CHECK(out.size() == 100 + 3072 - 1024);
+        CHECK(w.in_use() == 3000 - 2048);
+        CHECK(w.flush().value() == 3000 - 2048);
+        CHECK(out.size() == 3100);
+    }
+
+    SUBCASE("memory scales with active writers")
+    {
+        std::vector<std::vector<spio::byte>> outs(100);
+        std::vector<spio::vector_sink> sinks;
+        std::vector<writable_type> writers;
+        sinks.reserve(outs.size());
+        writers.reserve(outs.size());
+        for (auto& o : outs) {
+            sinks.emplace_back(o);
+            writers.emplace_back(sinks.back(), spio::buffer_mode::line,
+                                 BUFSIZ, pool);
+        }
+        for (auto& w : writers) {
+            CHECK(w.write(data).value() == 100);
+            CHECK(w.flush().value() == 100);
+        }
+        CHECK(pool.allocated_bytes() == BUFSIZ);
+
+        writers[0].write(data);
+        writers[1].write(data);
+        CHECK(pool.allocated_bytes() == 2 * BUFSIZ);
+
+        // Newlines flush in line mode
+        const auto line = spio::as_bytes(spio::make_span("line\n", 5));
+        CHECK(writers[0].write(line).value() == 5);
+        CHECK(writers[0].buffer().capacity() == 0);
+        CHECK(outs[0].size() == 205);
+    }
+}
@@ -0,0 +1,192 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+namespace {
+std::vector<spio::byte> make_data(std::ptrdiff_t n)
+{
+    std::vector<spio::byte> data(static_cast<std::size_t>(n));
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<spio::byte>(i % 251);
+    }
+    return data;
+}
+}  // namespace
+
+TEST_CASE("chunked_buffer")
+{
+    spio::chunked_buffer buf(16, 64);
+    CHECK(buf.empty());
+    CHECK(buf.chunk_count() == 0);
+    CHECK(buf.linearize().empty());
+
+    const auto data = make_data(300);
+
+    SUBCASE("append without moving")
+    {
+        buf.append(spio::make_span(data).first(10));
+        REQUIRE(buf.chunk_count() == 1);
+        const auto first = buf.buffers().front().data();
+
+        for (std::ptrdiff_t i = 10; i < 300; i += 10) {
+            buf.append(spio::make_span(data).subspan(i, 10));
+        }
+        CHECK(buf.size() == 300);
+        CHECK(buf.buffers().front().data() == first);
+        // 16 + 32 + 64 + 64 + 64 + 64
+        CHECK(buf.chunk_count() == 6);
+
+        std::vector<spio::byte> joined;
+        for (auto& s : buf.buffers()) {
+            joined.insert(joined.end(), s.begin(), s.end());
+        }
+        CHECK(joined == data);
+    }
+
+    SUBCASE("large append")
+    {
+        buf.append(spio::make_span(data).first(4));
+        buf.append(data);
+        CHECK(buf.size() == 304);
+        CHECK(buf.chunk_count() == 2);
+    }
+
+    SUBCASE("copy_to")
+    {
+        buf.append(data);
+        std::vector<spio::byte> out(100);
+        CHECK(buf.copy_to(out, 40) == 100);
+        CHECK(std::equal(out.begin(), out.end(), data.begin() + 40));
+        CHECK(buf.copy_to(out, 250) == 50);
+        CHECK(std::equal(out.begin(), out.begin() + 50, data.begin() + 250));
+        CHECK(buf.copy_to(out, 300) == 0);
+    }
+
+    SUBCASE("linearize")
+    {
+        buf.append(data);
+        auto s = buf.linearize();
+        CHECK(buf.chunk_count() == 1);
+        CHECK(s.size() == 300);
+        CHECK(std::equal(s.begin(), s.end(), data.begin()));
+
+        buf.append(spio::make_span(data).first(5));
+        CHECK(buf.size() == 305);
+        CHECK(buf.chunk_count() == 2);
+    }
+
+    SUBCASE("clear")
+    {
+        buf.append(data);
+        buf.clear();
+        CHECK(buf.empty());
+        CHECK(buf.chunk_count() == 1);
+        CHECK(buf.buffers().empty());
+
+        buf.append(spio::make_span(data).first(16));
+        CHECK(buf.chunk_count() == 1);
+        CHECK(buf.size() == 16);
+    }
+}
+
+TEST_CASE("chunked_device")
+{
+    spio::chunked_buffer buf(8, 32);
+    const auto data = make_data(100);
+
+    SUBCASE("write and read")
+    {
+        spio::chunked_sink sink(buf);
+        CHECK(sink.write(spio::make_span(data).first(50)).value() == 50);
+        CHECK(sink.write(spio::make_span(data).subspan(50)).value() == 50);
+        CHECK(buf.size() == 100);
+
+        spio::chunked_source source(buf);
+        auto extent = source.extent();
+        CHECK(extent.value() == 100);
+        std::vector<spio::byte> out(60);
+        bool eof = false;
+        CHECK(source.read(out, eof).value() == 60);
+        CHECK(!eof);
+        CHECK(std::equal(out.begin(), out.end(), data.begin()));
+        CHECK(source.read(out, eof).value() == 40);
+        CHECK(eof);
+        CHECK(std::equal(out.begin(), out.begin() + 40, data.begin() + 60));
+
+        auto r = source.read(out, eof);
+        CHECK(r.value() == 0);
+        CHECK(r.error().code() == spio::end_of_file);
+
+        eof = false;
+        CHECK(source.read_at(spio::make_span(out).first(10), 90, eof).value() ==
+              10);
+        CHECK(eof);
+        CHECK(source.read_at(out, 100, eof).error().code() ==
+              spio::out_of_range);
+    }
+
+    SUBCASE("write_chunks")
+    {
+        buf.append(data);
+        std::vector<spio::byte> dest;
+        spio::vector_sink sink(dest);
+        CHECK(spio::write_chunks(sink, buf).value() == 100);
+        CHECK(dest == data);
+    }
+
+    SUBCASE("write_chunks short write")
+    {
+        // Accepts at most 12 bytes per call
+        struct limited_sink {
+            spio::result write(spio::span<const spio::byte> s)
+            {
+                const auto n = std::min(s.size(), std::ptrdiff_t{12});
+                dest.insert(dest.end(), s.begin(), s.begin() + n);
+                return n;
+            }
+
+            std::vector<spio::byte> dest;
+        };
+        for (std::ptrdiff_t i = 0; i < 100; i += 10) {
+            buf.append(spio::make_span(data).subspan(i, 10));
+        }
+        REQUIRE(buf.buffers().size() > 2);
+        const auto first = buf.buffers()[0].size();
+        REQUIRE(first <= 12);
+        REQUIRE(buf.buffers()[1].size() > 12);
+        limited_sink sink{};
+        CHECK(spio::write_chunks(sink, buf).value() == first + 12);
+        CHECK(sink.dest.size() == static_cast<std::size_t>(first + 12));
+        CHECK(std::equal(sink.dest.begin(), sink.dest.end(), data.begin()));
+    }
+
+    SUBCASE("stream")
+    {
+        spio::chunked_sink sink{buf};
+        using stream_type =
+            spio::stream<spio::chunked_sink, spio::encoding<char>,
+                         spio::sink_filter_chain>;
+        stream_type s(sink, stream_type::input_base{},
+                      stream_type::output_base{}, stream_type::chain_type{});
+        auto r = spio::write(s, spio::make_span(data));
+        CHECK(!r.has_error());
+        CHECK(r.value() == 100);
+        CHECK(buf.size() == 100);
+    }
+}
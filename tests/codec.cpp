@@ -0,0 +1,284 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+// Writes data in chunks of the given size through filter
+template <typename Filter>
+static spio::byte_buffer filter_chunked(Filter& filter,
+                                        const spio::byte_buffer& in,
+                                        std::size_t chunk)
+{
+    spio::byte_buffer out;
+    for (std::size_t i = 0; i < in.size(); i += chunk) {
+        const auto end = std::min(in.size(), i + chunk);
+        spio::byte_buffer buf(in.begin() + static_cast<long>(i),
+                              in.begin() + static_cast<long>(end));
+        if (end == in.size()) {
+            filter.finish();
+        }
+        auto r = filter.write(buf);
+        REQUIRE(!r.has_error());
+        out.insert(out.end(), buf.begin(), buf.end());
+    }
+    return out;
+}
+
+TEST_CASE("base64 filter")
+{
+    // RFC 4648 test vectors
+    const std::vector<std::pair<std::string, std::string>> vectors = {
+        {"", ""},
+        {"f", "Zg=="},
+        {"fo", "Zm8="},
+        {"foo", "Zm9v"},
+        {"foob", "Zm9vYg=="},
+        {"fooba", "Zm9vYmE="},
+        {"foobar", "Zm9vYmFy"}};
+
+    SUBCASE("encode")
+    {
+        for (const auto& v : vectors) {
+            spio::base64_encode_filter filter;
+            auto buf = to_bytes(v.first);
+            filter.finish();
+            auto r = filter.write(buf);
+            CHECK(!r.has_error());
+            CHECK(buf == to_bytes(v.second));
+            CHECK(!filter.has_pending());
+        }
+    }
+    SUBCASE("decode")
+    {
+        for (const auto& v : vectors) {
+            spio::base64_decode_filter filter;
+            auto buf = to_bytes(v.second);
+            auto r = filter.write(buf);
+            CHECK(!r.has_error());
+            CHECK(buf == to_bytes(v.first));
+            CHECK(!filter.has_pending());
+        }
+    }
+    SUBCASE("url-safe")
+    {
+        const auto data = to_bytes("\xfb\xff\xbf?");
+        spio::base64url_encode_filter enc;
+        auto buf = data;
+        enc.finish();
+        enc.write(buf);
+        CHECK(buf == to_bytes("-_-_Pw"));
+
+        spio::base64url_decode_filter dec;
+        dec.finish();
+        auto r = dec.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == data);
+    }
+    SUBCASE("roundtrip")
+    {
+        // Long enough to go through the vectorized paths
+        const auto data = make_data<spio::byte_buffer>(1000);
+        for (std::size_t chunk : {1u, 2u, 5u, 13u, 64u, 1000u}) {
+            spio::base64_encode_filter enc;
+            auto encoded = filter_chunked(enc, data, chunk);
+            CHECK(encoded.size() == 1336);
+
+            spio::base64_decode_filter dec;
+            auto decoded = filter_chunked(dec, encoded, chunk);
+            CHECK(decoded == data);
+        }
+    }
+    SUBCASE("carried block before a long chunk")
+    {
+        // The vectorized decoding of the chunk mustn't write past the
+        // decoded size of the filter's buffer
+        const auto data = make_data<spio::byte_buffer>(300);
+        for (std::size_t n = 30; n <= data.size(); n += 3) {
+            const spio::byte_buffer in(data.begin(),
+                                       data.begin() + static_cast<long>(n));
+            spio::base64_encode_filter enc;
+            enc.finish();
+            auto encoded = in;
+            REQUIRE(!enc.write(encoded).has_error());
+
+            for (std::size_t carry = 1; carry < 4; ++carry) {
+                spio::base64_decode_filter dec;
+                spio::byte_buffer head(
+                    encoded.begin(),
+                    encoded.begin() + static_cast<long>(carry));
+                REQUIRE(!dec.write(head).has_error());
+                CHECK(head.empty());
+                spio::byte_buffer tail(
+                    encoded.begin() + static_cast<long>(carry), encoded.end());
+                dec.finish();
+                REQUIRE(!dec.write(tail).has_error());
+                CHECK(tail == in);
+            }
+        }
+    }
+    SUBCASE("invalid")
+    {
+        spio::base64_decode_filter filter;
+        auto buf = to_bytes("Zm9v*mFy");
+        CHECK(filter.write(buf).has_error());
+
+        spio::base64_decode_filter padded;
+        buf = to_bytes("Zg==Zm9v");
+        CHECK(padded.write(buf).has_error());
+    }
+}
+
+TEST_CASE("hex filter")
+{
+    SUBCASE("encode")
+    {
+        spio::hex_encode_filter filter;
+        auto buf = to_bytes("\x01\xab\xff spio");
+        auto r = filter.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes("01abff207370696f"));
+    }
+    SUBCASE("decode")
+    {
+        spio::hex_decode_filter filter;
+        auto buf = to_bytes("01ABff2");
+        auto r = filter.write(buf);
+        CHECK(!r.has_error());
+        CHECK(filter.has_pending());
+        buf = to_bytes("07370696f");
+        r = filter.write(buf);
+        CHECK(!r.has_error());
+        CHECK(!filter.has_pending());
+        CHECK(buf == to_bytes(" spio"));
+    }
+    SUBCASE("roundtrip")
+    {
+        const auto data = make_data<spio::byte_buffer>(1000);
+        for (std::size_t chunk : {1u, 3u, 33u, 1000u}) {
+            spio::hex_encode_filter enc;
+            auto encoded = filter_chunked(enc, data, chunk);
+            CHECK(encoded.size() == 2000);
+
+            spio::hex_decode_filter dec;
+            auto decoded = filter_chunked(dec, encoded, chunk);
+            CHECK(decoded == data);
+        }
+    }
+    SUBCASE("invalid")
+    {
+        spio::hex_decode_filter filter;
+        auto buf = to_bytes("0g");
+        CHECK(filter.write(buf).has_error());
+    }
+}
+
+TEST_CASE("decoding input filter")
+{
+    const auto data = make_data<spio::byte_buffer>(1000);
+    spio::byte_buffer encoded = data;
+    {
+        spio::base64_encode_filter enc;
+        enc.finish();
+        enc.write(encoded);
+    }
+
+    for (std::ptrdiff_t chunk : {1, 3, 7, 64, 2000}) {
+        spio::source_filter_chain chain;
+        chain.push<spio::base64_decode_input_filter>();
+
+        spio::byte_buffer decoded;
+        spio::byte_buffer buf(static_cast<std::size_t>(chunk));
+        for (std::size_t i = 0; i < encoded.size();
+             i += static_cast<std::size_t>(chunk)) {
+            auto s = spio::make_span(buf);
+            const auto n = std::min(static_cast<std::size_t>(chunk),
+                                    encoded.size() - i);
+            s = s.first(static_cast<std::ptrdiff_t>(n));
+            std::copy(encoded.begin() + static_cast<long>(i),
+                      encoded.begin() + static_cast<long>(i + n), s.begin());
+
+            auto r = chain.read(s);
+            REQUIRE(!r.has_error());
+            CHECK(r.value() == s.size());
+            decoded.insert(decoded.end(), s.begin(), s.end());
+        }
+        CHECK(decoded == data);
+    }
+}
+
+TEST_CASE("decoding input filter unpadded end")
+{
+    using stream_type = spio::stream<spio::vector_device, spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    const std::string str{"QUJDRA"};
+    for (std::ptrdiff_t chunk : {1, 4, 64}) {
+        std::vector<spio::byte> encoded(str.size());
+        std::memcpy(encoded.data(), str.data(), str.size());
+        stream_type in(spio::vector_device(encoded), stream_type::input_base{},
+                       stream_type::output_base{}, stream_type::chain_type{});
+        in.source_storage() =
+            stream_type::input_base::source_type(in.device());
+        static_cast<spio::source_filter_chain&>(in.chain())
+            .push<spio::base64url_decode_input_filter>();
+
+        std::string decoded;
+        std::vector<spio::byte> buf(static_cast<std::size_t>(chunk));
+        while (decoded.size() < 8) {
+            auto r = spio::read(in, spio::make_span(buf));
+            REQUIRE(!r.has_error());
+            if (r.value() == 0 && in.eof()) {
+                break;
+            }
+            decoded.append(reinterpret_cast<const char*>(buf.data()),
+                           static_cast<std::size_t>(r.value()));
+        }
+        CHECK(decoded == "ABCD");
+    }
+}
+
+TEST_CASE("encoding filter at the end of a stream")
+{
+    using stream_type = spio::stream<spio::vector_sink, spio::encoding<char>,
+                                     spio::sink_filter_chain>;
+    std::vector<spio::byte> out;
+    spio::vector_sink sink(out);
+    stream_type s(sink, stream_type::input_base{},
+                  stream_type::sink_type(sink, spio::buffer_mode::full),
+                  stream_type::chain_type{});
+    s.chain().push<spio::base64_encode_filter>();
+
+    // Ends in the middle of a block
+    const auto data = to_bytes("Hello");
+    CHECK(spio::write(s, spio::make_span(data)).value() == 4);
+    CHECK(spio::flush(s).value() == 4);
+    CHECK(out.size() == 4);
+
+    SUBCASE("finish")
+    {
+        CHECK(spio::finish(s).value() == 4);
+    }
+    SUBCASE("close")
+    {
+        CHECK(s.close());
+    }
+    const auto expected = to_bytes("SGVsbG8=");
+    CHECK(std::equal(out.begin(), out.end(), expected.begin(),
+                     expected.end()));
+}
@@ -0,0 +1,209 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_TESTS_COUNTING_NEW_H
+#define SPIO_TESTS_COUNTING_NEW_H
+
+// Replaces every global operator new and delete with ones that count
+// the allocations made by the program.
+// Include this in exactly one translation unit of an executable.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace counting_new {
+inline std::atomic<std::uint64_t>& count() noexcept
+{
+    static std::atomic<std::uint64_t> n{0};
+    return n;
+}
+inline std::atomic<std::uint64_t>& bytes() noexcept
+{
+    static std::atomic<std::uint64_t> n{0};
+    return n;
+}
+
+// Number of allocations made so far
+inline std::uint64_t allocations() noexcept
+{
+    return count().load(std::memory_order_relaxed);
+}
+// Number of bytes requested so far
+inline std::uint64_t allocated_bytes() noexcept
+{
+    return bytes().load(std::memory_order_relaxed);
+}
+
+namespace detail {
+    inline void* alloc(std::size_t n) noexcept
+    {
+        count().fetch_add(1, std::memory_order_relaxed);
+        bytes().fetch_add(n, std::memory_order_relaxed);
+        return std::malloc(n == 0 ? 1 : n);
+    }
+// p comes from alloc(), but once operator delete is inlined, GCC only
+// sees it coming from operator new
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+    inline void dealloc(void* p) noexcept
+    {
+        std::free(p);
+    }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef __cpp_aligned_new
+    inline void* alloc(std::size_t n, std::align_val_t a) noexcept
+    {
+        count().fetch_add(1, std::memory_order_relaxed);
+        bytes().fetch_add(n, std::memory_order_relaxed);
+        const auto alignment = static_cast<std::size_t>(a);
+        if (n == 0) {
+            n = 1;
+        }
+#ifdef _WIN32
+        return _aligned_malloc(n, alignment);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, n) != 0) {
+            return nullptr;
+        }
+        return p;
+#endif
+    }
+    inline void dealloc(void* p, std::align_val_t) noexcept
+    {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+#endif
+}  // namespace detail
+}  // namespace counting_new
+
+void* operator new(std::size_t n)
+{
+    if (auto p = counting_new::detail::alloc(n)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t n)
+{
+    return ::operator new(n);
+}
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept
+{
+    return counting_new::detail::alloc(n);
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept
+{
+    return counting_new::detail::alloc(n);
+}
+void operator delete(void* p) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+void operator delete[](void* p) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, std::size_t) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+void operator delete[](void* p, std::size_t) noexcept
+{
+    counting_new::detail::dealloc(p);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t n, std::align_val_t a)
+{
+    if (auto p = counting_new::detail::alloc(n, a)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t n, std::align_val_t a)
+{
+    return ::operator new(n, a);
+}
+void* operator new(std::size_t n,
+                   std::align_val_t a,
+                   const std::nothrow_t&) noexcept
+{
+    return counting_new::detail::alloc(n, a);
+}
+void* operator new[](std::size_t n,
+                     std::align_val_t a,
+                     const std::nothrow_t&) noexcept
+{
+    return counting_new::detail::alloc(n, a);
+}
+void operator delete(void* p, std::align_val_t a) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+void operator delete[](void* p, std::align_val_t a) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+void operator delete(void* p,
+                     std::align_val_t a,
+                     const std::nothrow_t&) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+void operator delete[](void* p,
+                       std::align_val_t a,
+                       const std::nothrow_t&) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept
+{
+    counting_new::detail::dealloc(p, a);
+}
+#endif
+
+#endif  // SPIO_TESTS_COUNTING_NEW_H
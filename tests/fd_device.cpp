@@ -0,0 +1,394 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include <functional>
+#include "doctest.h"
+#include "test_util.h"
+
+#if SPIO_POSIX
+
+TEST_CASE("fd_device pipe")
+{
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    auto& rd = p->first;
+    auto& wr = p->second;
+
+    std::array<spio::byte, 16> buf{};
+    bool eof = false;
+    auto r = rd.read(spio::make_span(buf), eof);
+    CHECK(spio::is_would_block(r));
+    CHECK(r.value() == 0);
+    CHECK(!eof);
+
+    r = wr.write(to_span("hello"));
+    CHECK(!r.has_error());
+    CHECK(r.value() == 5);
+    r = rd.read(spio::make_span(buf), eof);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 5);
+    CHECK(std::memcmp(buf.data(), "hello", 5) == 0);
+
+    CHECK(wr.close().has_value());
+    r = rd.read(spio::make_span(buf), eof);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 0);
+    CHECK(eof);
+    CHECK(rd.close().has_value());
+}
+
+TEST_CASE("fd_device partial write")
+{
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    auto& rd = p->first;
+    auto& wr = p->second;
+
+    // Larger than the pipe buffer
+    std::vector<spio::byte> data(4 << 20, static_cast<spio::byte>(0x2a));
+    auto r = wr.write(spio::make_span(data));
+    CHECK(spio::is_would_block(r));
+    CHECK(r.value() > 0);
+    CHECK(r.value() < static_cast<std::ptrdiff_t>(data.size()));
+
+    // Draining the pipe makes room for the rest
+    std::vector<spio::byte> buf(data.size());
+    std::ptrdiff_t total = 0;
+    bool eof = false;
+    while (true) {
+        auto rr = rd.read(spio::make_span(buf).subspan(total), eof);
+        total += rr.value();
+        if (rr.has_error()) {
+            CHECK(spio::is_would_block(rr));
+            break;
+        }
+    }
+    CHECK(total == r.value());
+    r = wr.write(spio::make_span(data).subspan(total));
+    CHECK(r.value() > 0);
+
+    CHECK(rd.close().has_value());
+    CHECK(wr.close().has_value());
+}
+
+TEST_CASE("fd_device socket pair")
+{
+    auto p = spio::make_socket_pair();
+    REQUIRE(p.has_value());
+    auto& a = p->first;
+    auto& b = p->second;
+
+    std::array<spio::byte, 16> buf{};
+    bool eof = false;
+    CHECK(!a.write(to_span("ping")).has_error());
+    auto r = b.read(spio::make_span(buf), eof);
+    CHECK(r.value() == 4);
+    CHECK(!b.write(to_span("pong")).has_error());
+    r = a.read(spio::make_span(buf), eof);
+    CHECK(r.value() == 4);
+    CHECK(std::memcmp(buf.data(), "pong", 4) == 0);
+
+    // No SIGPIPE when the peer is gone
+    CHECK(b.close().has_value());
+    r = a.write(to_span("lost"));
+    CHECK(r.has_error());
+    CHECK(r.error().code() == std::errc::broken_pipe);
+    CHECK(a.close().has_value());
+}
+
+static spio::fd_file_device open_temp_file()
+{
+    char path[] = "/tmp/spio-fd-file-XXXXXX";
+    auto fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::close(fd);
+    auto f = spio::open_fd_file(path, O_RDWR | O_TRUNC);
+    ::unlink(path);
+    REQUIRE(f.has_value());
+    return *f;
+}
+static std::vector<spio::byte> read_file(const spio::fd_file_device& f)
+{
+    auto size = f.extent();
+    REQUIRE(size.has_value());
+    std::vector<spio::byte> buf(static_cast<std::size_t>(*size));
+    auto n = ::pread(f.handle(), buf.data(), buf.size(), 0);
+    CHECK(n == static_cast<ssize_t>(buf.size()));
+    return buf;
+}
+TEST_CASE("fd_file_device preallocate")
+{
+    auto f = open_temp_file();
+
+    auto r = f.preallocate(0, 1 << 20);
+    if (!r.has_value() &&
+        r.error().code() == std::errc::operation_not_supported) {
+        CHECK(f.close().has_value());
+        return;
+    }
+    CHECK(r.has_value());
+    CHECK(*f.extent() == 0);
+
+    CHECK(f.preallocate(0, 8192, false).has_value());
+    CHECK(*f.extent() == 8192);
+    CHECK(f.truncate(100).has_value());
+    CHECK(*f.extent() == 100);
+    CHECK(f.close().has_value());
+}
+
+TEST_CASE("fd_file_device block-aligned writes")
+{
+    auto f = open_temp_file();
+    const auto data = make_data(1100);
+
+    {
+        spio::basic_buffered_writable<spio::fd_file_device> buf(
+            f, spio::buffer_mode::full, 1000, 512);
+        CHECK(buf.size() == 1024);
+        CHECK(buf.block_size() == 512);
+        CHECK(reinterpret_cast<std::uintptr_t>(buf.buffer().data()) % 512 ==
+              0);
+
+        CHECK(buf.write(spio::make_span(data).first(700)).value() == 700);
+        auto r = buf.flush();
+        CHECK(!r.has_error());
+        CHECK(r.value() == 700);
+        // The partial block stays buffered, without moving the offset
+        CHECK(buf.in_use() == 700 - 512);
+        CHECK(::lseek(f.handle(), 0, SEEK_CUR) == 512);
+        CHECK(read_file(f) == std::vector<spio::byte>(data.begin(),
+                                                      data.begin() + 700));
+
+        CHECK(buf.write(spio::make_span(data).subspan(700)).value() == 400);
+        r = buf.flush();
+        CHECK(!r.has_error());
+        CHECK(::lseek(f.handle(), 0, SEEK_CUR) == 1024);
+        CHECK(read_file(f) == data);
+    }
+    CHECK(f.close().has_value());
+}
+
+TEST_CASE("fd_file_device direct")
+{
+    for (auto tail : {spio::direct_tail::pad, spio::direct_tail::buffered}) {
+        auto f = open_temp_file();
+        if (!f.set_direct(true, 4096, tail).has_value()) {
+            // Not supported by the file system
+            CHECK(f.close().has_value());
+            return;
+        }
+        CHECK(f.block_size() == 4096);
+        CHECK(f.tail_mode() == tail);
+
+        const auto data = make_data(10000);
+        {
+            spio::basic_buffered_writable<spio::fd_file_device> buf(
+                f, spio::buffer_mode::full, 8192, f.block_size());
+            auto r = buf.write(spio::make_span(data));
+            if (r.has_error()) {
+                // Direct writes rejected by the file system
+                CHECK(r.error().code() == std::errc::invalid_argument);
+                CHECK(f.close().has_value());
+                return;
+            }
+            CHECK(r.value() == 10000);
+            r = buf.flush();
+            CHECK(!r.has_error());
+            CHECK(*f.extent() == 10000);
+        }
+        CHECK(f.set_direct(false).has_value());
+        CHECK(f.block_size() == 0);
+        CHECK(read_file(f) == data);
+        CHECK(f.close().has_value());
+    }
+}
+
+TEST_CASE("fd_file_device padded tail keeps preallocation")
+{
+    auto f = open_temp_file();
+    if (!f.set_direct(true, 4096, spio::direct_tail::pad).has_value() ||
+        !f.preallocate(0, 1 << 20).has_value()) {
+        // Not supported by the file system
+        CHECK(f.close().has_value());
+        return;
+    }
+    auto blocks = [&] {
+        struct stat st;
+        REQUIRE(::fstat(f.handle(), &st) == 0);
+        return st.st_blocks;
+    };
+    const auto preallocated = blocks();
+
+    const auto data = make_data(100);
+    auto r = f.write_tail(spio::make_span(data));
+    if (r.has_error()) {
+        // Direct writes rejected by the file system
+        CHECK(f.close().has_value());
+        return;
+    }
+    CHECK(r.value() == 100);
+    CHECK(*f.extent() == 100);
+    CHECK(blocks() == preallocated);
+
+    CHECK(f.sync_data().has_value());
+    CHECK(*f.extent() == 100);
+    CHECK(f.set_direct(false).has_value());
+    CHECK(read_file(f) == data);
+    CHECK(f.close().has_value());
+}
+
+TEST_CASE("fd_file_device seek")
+{
+    auto f = open_temp_file();
+    const auto data = make_data(300);
+
+    CHECK(f.write(spio::make_span(data).first(200)).value() == 200);
+    CHECK(f.write_tail(spio::make_span(data).subspan(200)).value() == 100);
+    CHECK(*f.seek(0, spio::seekdir::cur) == 200);
+    CHECK(::lseek(f.handle(), 0, SEEK_CUR) == 200);
+    CHECK(*f.extent() == 300);
+
+    CHECK(*f.seek(50) == 50);
+    CHECK(f.write(spio::make_span(data).first(10)).value() == 10);
+    CHECK(*f.seek(-10, spio::seekdir::cur) == 50);
+    std::vector<spio::byte> buf(10);
+    bool eof = false;
+    CHECK(f.read(spio::make_span(buf), eof).value() == 10);
+    CHECK(buf == std::vector<spio::byte>(data.begin(), data.begin() + 10));
+    CHECK(*f.seek(0, spio::seekdir::cur) == 60);
+    CHECK(*f.seek(0, spio::seekdir::end) == *f.extent());
+    CHECK(f.close().has_value());
+}
+
+#endif
+
+#if SPIO_HAS_EPOLL
+
+TEST_CASE("epoll_reactor")
+{
+    spio::epoll_reactor reactor;
+    REQUIRE(reactor.open().has_value());
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    auto& rd = p->first;
+    auto& wr = p->second;
+
+    int calls = 0;
+    std::error_code ec{};
+    auto cb = [&](std::error_code e) {
+        ++calls;
+        ec = e;
+    };
+
+    // Nothing to read
+    REQUIRE(reactor
+                .wait(rd.handle(), spio::io_event::read,
+                      std::chrono::milliseconds(10), cb)
+                .has_value());
+    CHECK(reactor.pending() == 1);
+    while (reactor.pending() != 0) {
+        CHECK(reactor.poll().has_value());
+    }
+    CHECK(calls == 1);
+    CHECK(ec == std::errc::timed_out);
+
+    // An empty pipe is writable right away
+    REQUIRE(
+        reactor.wait(wr.handle(), spio::io_event::write, {}, cb).has_value());
+    auto n = reactor.poll();
+    CHECK(n.has_value());
+    CHECK(*n == 1);
+    CHECK(calls == 2);
+    CHECK(!ec);
+
+    REQUIRE(
+        reactor.wait(rd.handle(), spio::io_event::read, {}, cb).has_value());
+    n = reactor.poll(spio::deadline::clock::now());
+    CHECK(*n == 0);
+    CHECK(!wr.write(to_span("x")).has_error());
+    n = reactor.poll();
+    CHECK(*n == 1);
+    CHECK(calls == 3);
+    CHECK(!ec);
+
+    REQUIRE(reactor
+                .wait(wr.handle(), spio::io_event::write,
+                      std::chrono::seconds(10), cb)
+                .has_value());
+    reactor.cancel(wr.handle());
+    CHECK(calls == 4);
+    CHECK(ec == std::errc::operation_canceled);
+    CHECK(reactor.pending() == 0);
+
+    CHECK(rd.close().has_value());
+    CHECK(wr.close().has_value());
+}
+
+TEST_CASE("buffered fd devices on epoll_reactor")
+{
+    spio::epoll_reactor reactor;
+    REQUIRE(reactor.open().has_value());
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    auto& rd = p->first;
+    auto& wr = p->second;
+
+    // More than fits in the pipe
+    const auto data = make_data(1 << 20);
+    spio::basic_buffered_writable<spio::fd_device> sink(
+        wr, spio::buffer_mode::full, 2 << 20);
+    CHECK(!sink.write(spio::make_span(data)).has_error());
+
+    bool flushed = false;
+    spio::result flush_result{0};
+    spio::flush_when_ready(reactor, sink, {}, [&](spio::result r) {
+        flushed = true;
+        flush_result = std::move(r);
+    });
+    CHECK(!flushed);
+
+    spio::basic_buffered_readable<spio::fd_device> source(rd);
+    std::vector<spio::byte> received;
+    std::array<spio::byte, 4096> buf{};
+    std::function<void()> read_more = [&] {
+        spio::read_when_ready(
+            reactor, source, spio::make_span(buf), {},
+            [&](spio::result r, bool eof) {
+                CHECK(!r.has_error());
+                received.insert(received.end(), buf.begin(),
+                                buf.begin() + r.value());
+                if (!eof && received.size() < data.size()) {
+                    read_more();
+                }
+            });
+    };
+    read_more();
+
+    while (reactor.pending() != 0) {
+        REQUIRE(reactor.poll().has_value());
+    }
+    CHECK(flushed);
+    CHECK(!flush_result.has_error());
+    CHECK(flush_result.value() == static_cast<std::ptrdiff_t>(data.size()));
+    CHECK(received == data);
+
+    CHECK(rd.close().has_value());
+    CHECK(wr.close().has_value());
+}
+
+#endif
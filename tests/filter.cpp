@@ -46,7 +46,7 @@ TEST_CASE("sink_filter")
 
     auto str = "Hello world!";
     auto len = std::strlen(str);
-    std::vector<spio::byte> buffer(
+    spio::byte_buffer buffer(
         reinterpret_cast<const spio::byte*>(str),
         reinterpret_cast<const spio::byte*>(str) + len);
 
@@ -117,3 +117,207 @@ TEST_CASE("source_filter")
         ++i;
     }
 }
+
+struct counting_byte_input_filter : spio::byte_input_filter {
+    spio::result get(spio::byte& data) override
+    {
+        SPIO_UNUSED(data);
+        ++bytes;
+        return 1;
+    }
+    spio::result get_span(spio::span<spio::byte> data) override
+    {
+        ++spans;
+        bytes += data.size();
+        return data.size();
+    }
+
+    std::ptrdiff_t bytes{0};
+    int spans{0};
+};
+struct uppercase_byte_input_filter : spio::byte_input_filter {
+    spio::result get(spio::byte& data) override
+    {
+        const auto ch = static_cast<char>(data);
+        if (ch >= 'a' && ch <= 'z') {
+            data = static_cast<spio::byte>(ch - 'a' + 'A');
+        }
+        return 1;
+    }
+};
+
+TEST_CASE("byte_source_filter span")
+{
+    spio::byte_source_filter_chain chain;
+    auto& counter = chain.push<counting_byte_input_filter>();
+
+    std::string str = "Hello world!";
+    auto s = spio::as_writeable_bytes(
+        spio::make_span(&str[0], static_cast<std::ptrdiff_t>(str.size())));
+    auto r = chain.get_span(s);
+    CHECK(r.value() == s.size());
+    CHECK(!r.has_error());
+    CHECK(counter.spans == 1);
+    CHECK(counter.bytes == s.size());
+
+    // With more than one filter, the chain goes a byte at a time
+    chain.push<uppercase_byte_input_filter>();
+    r = chain.get_span(s);
+    CHECK(r.value() == s.size());
+    CHECK(!r.has_error());
+    CHECK(str == "HELLO WORLD!");
+    CHECK(counter.spans == 1);
+    CHECK(counter.bytes == 2 * s.size());
+}
+
+TEST_CASE("byte_source_filter getchar")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("abc", f);
+    std::rewind(f);
+
+    spio::stdio_handle_instream in(f);
+    auto& counter = in.chain().push<counting_byte_input_filter>();
+
+    char ch{};
+    for (auto expected : {'a', 'b', 'c'}) {
+        auto r = spio::getchar(in, ch);
+        CHECK(r.value() == 1);
+        CHECK(ch == expected);
+    }
+    CHECK(counter.spans == 3);
+    CHECK(counter.bytes == 3);
+    std::fclose(f);
+}
+
+TEST_CASE("byte_source_filter getchar partial")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("abc", f);
+    std::rewind(f);
+
+    spio::basic_stdio_handle_instream<spio::encoding<char16_t>> in(f);
+    in.chain().push<counting_byte_input_filter>();
+
+    char16_t ch{};
+    auto r = spio::getchar(in, ch);
+    CHECK(r.value() == 1);
+    r = spio::getchar(in, ch);
+    CHECK(r.value() == 0);
+
+    // The odd byte was put back
+    std::array<spio::byte, 1> buf{};
+    r = spio::get(in, spio::make_span(buf));
+    CHECK(r.value() == 1);
+    CHECK(buf[0] == spio::to_byte('c'));
+    std::fclose(f);
+}
+
+struct rejecting_byte_input_filter : spio::byte_input_filter {
+    rejecting_byte_input_filter() = default;
+    rejecting_byte_input_filter(char r) : rejected(r) {}
+
+    spio::result get(spio::byte& data) override
+    {
+        if (data == spio::to_byte(rejected)) {
+            return spio::make_result(
+                0, spio::failure{spio::invalid_input, "Rejected"});
+        }
+        return 1;
+    }
+
+    char rejected{'!'};
+};
+
+TEST_CASE("byte_source_filter get span putback")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("ab!", f);
+    std::rewind(f);
+
+    spio::stdio_handle_instream in(f);
+    in.chain().push<rejecting_byte_input_filter>();
+
+    std::array<spio::byte, 3> buf{};
+    auto r = spio::get(in, spio::make_span(buf));
+    CHECK(r.has_error());
+    CHECK(r.value() == 2);
+    // The rejected byte is read again
+    CHECK(std::fgetc(f) == '!');
+    std::fclose(f);
+}
+
+struct rejecting_byte_output_filter : spio::byte_output_filter {
+    spio::result put(spio::byte data) override
+    {
+        if (data == spio::to_byte('!')) {
+            return spio::make_result(
+                0, spio::failure{spio::invalid_input, "Rejected"});
+        }
+        return 1;
+    }
+};
+
+// Writes bytes one by one, like a character device
+struct byte_vector_sink {
+    bool is_open() const
+    {
+        return true;
+    }
+    spio::expected<void, spio::failure> close()
+    {
+        return {};
+    }
+    spio::result put(spio::byte b)
+    {
+        data.push_back(b);
+        return 1;
+    }
+
+    std::vector<spio::byte> data;
+};
+
+TEST_CASE("byte_sink_filter put span partial")
+{
+    using stream_type = spio::stream<byte_vector_sink, spio::encoding<char>,
+                                     spio::byte_sink_filter_chain>;
+    stream_type out(byte_vector_sink{}, stream_type::input_base{},
+                    stream_type::output_base{}, stream_type::chain_type{});
+    out.chain().push<rejecting_byte_output_filter>();
+
+    const std::string str = "ab!c";
+    auto r = spio::put(
+        out, spio::as_bytes(spio::make_span(
+                 str.data(), static_cast<std::ptrdiff_t>(str.size()))));
+    CHECK(r.has_error());
+    CHECK(r.value() == 2);
+    // The accepted bytes were written
+    const auto& data = out.device().data;
+    CHECK(std::string(reinterpret_cast<const char*>(data.data()),
+                      data.size()) == "ab");
+}
+
+TEST_CASE("byte_source_filter chain putback")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("abc", f);
+    std::rewind(f);
+
+    spio::stdio_handle_instream in(f);
+    in.chain().push<uppercase_byte_input_filter>();
+    in.chain().push<rejecting_byte_input_filter>('C');
+
+    std::array<spio::byte, 3> buf{};
+    auto r = spio::get(in, spio::make_span(buf));
+    CHECK(r.has_error());
+    CHECK(r.value() == 2);
+    CHECK(buf[0] == spio::to_byte('A'));
+    CHECK(buf[1] == spio::to_byte('B'));
+    // The byte is put back as it was read, not as the first filter left it
+    CHECK(std::fgetc(f) == 'c');
+    std::fclose(f);
+}
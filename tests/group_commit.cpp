@@ -0,0 +1,157 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Writable keeping track of what has been made durable
+    struct durable_sink {
+        spio::result write(spio::span<const spio::byte> s)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            data.insert(data.end(), s.begin(), s.end());
+            return s.size();
+        }
+        spio::expected<void, spio::failure> sync_data()
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            std::lock_guard<std::mutex> lock(mutex);
+            ++syncs;
+            if (fail) {
+                return spio::make_unexpected(
+                    spio::failure{spio::unknown_io_error, "Sync failed"});
+            }
+            durable = data.size();
+            return {};
+        }
+
+        std::mutex mutex;
+        std::vector<spio::byte> data;
+        std::size_t durable{0};
+        int syncs{0};
+        bool fail{false};
+    };
+}  // namespace
+
+TEST_CASE("group_commit batching")
+{
+    durable_sink d;
+    spio::group_commit_policy p;
+    p.interval = std::chrono::milliseconds(2);
+    spio::basic_group_commit_sink<durable_sink> sink(d, p);
+
+    const int thread_count = 8;
+    const int records = 50;
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < records; ++j) {
+                spio::basic_group_commit_sink<durable_sink>::ticket_type t;
+                auto r = sink.write(to_span("record\n"), t);
+                if (r.has_error() || !sink.wait(t).has_value()) {
+                    ++failures;
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(d.mutex);
+                if (d.durable < t) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    CHECK(failures == 0);
+
+    CHECK(d.data.size() ==
+          static_cast<std::size_t>(thread_count * records * 7));
+    CHECK(sink.syncs() == static_cast<std::uint64_t>(d.syncs));
+    // Fewer syncs than durable writes
+    CHECK(sink.syncs() < static_cast<std::uint64_t>(thread_count * records));
+    CHECK(sink.close().has_value());
+}
+
+TEST_CASE("group_commit max_bytes")
+{
+    durable_sink d;
+    spio::group_commit_policy p;
+    p.interval = std::chrono::seconds(60);
+    p.max_bytes = 4;
+    spio::basic_group_commit_sink<durable_sink> sink(d, p);
+
+    // Doesn't wait for the interval
+    CHECK(!sink.write_durable(to_span("hello")).has_error());
+    CHECK(d.durable == 5);
+    CHECK(sink.syncs() == 1);
+
+    // Nothing to make durable
+    CHECK(sink.commit().has_value());
+    CHECK(sink.syncs() == 1);
+
+    // Everything is made durable when closing
+    CHECK(!sink.write(to_span("abc")).has_error());
+    CHECK(sink.close().has_value());
+    CHECK(d.durable == 8);
+    CHECK(sink.commit().has_value());
+    CHECK(!sink.is_open());
+    CHECK(sink.write(to_span("x")).has_error());
+}
+
+TEST_CASE("group_commit error")
+{
+    durable_sink d;
+    d.fail = true;
+    spio::group_commit_policy p;
+    p.interval = std::chrono::microseconds(100);
+    spio::basic_group_commit_sink<durable_sink> sink(d, p);
+
+    auto r = sink.write_durable(to_span("hello"));
+    CHECK(r.has_error());
+    CHECK(r.error().code() == spio::unknown_io_error);
+    // Sticky
+    CHECK(!sink.commit().has_value());
+    CHECK(!sink.close().has_value());
+}
+
+#if SPIO_POSIX
+TEST_CASE("group_commit fd_file_device")
+{
+    char path[] = "/tmp/spio-group-commit-XXXXXX";
+    auto fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::unlink(path);
+    spio::fd_file_device f(fd);
+    {
+        spio::basic_group_commit_sink<spio::fd_file_device> sink(f);
+        CHECK(!sink.write_durable(to_span("hello\n")).has_error());
+        CHECK(sink.syncs() == 1);
+    }
+    CHECK(*f.extent() == 6);
+    CHECK(f.close().has_value());
+}
+#endif
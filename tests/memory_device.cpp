@@ -0,0 +1,130 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+TEST_CASE("growable_memory_sink")
+{
+    spio::growable_memory_sink sink;
+    CHECK(sink.size() == 0);
+    CHECK(sink.capacity() == 0);
+    CHECK(sink.contents().empty());
+
+    SUBCASE("reserve and commit")
+    {
+        auto out = sink.reserve(16);
+        REQUIRE(out.size() >= 16);
+        CHECK(sink.output().data() == out.data());
+        auto r = fmt::format_to_n(reinterpret_cast<char*>(out.data()),
+                                  static_cast<std::size_t>(out.size()),
+                                  "{} {}", 42, "foo");
+        sink.commit(static_cast<std::ptrdiff_t>(r.size));
+        CHECK(sink.output().empty());
+        CHECK(sink.size() == 6);
+
+        auto c = sink.contents();
+        CHECK(std::string(reinterpret_cast<const char*>(c.data()),
+                          static_cast<std::size_t>(c.size())) == "42 foo");
+    }
+
+    SUBCASE("geometric growth")
+    {
+        std::vector<spio::byte> data(100, static_cast<spio::byte>('a'));
+        int reallocations = 0;
+        auto cap = sink.capacity();
+        for (int i = 0; i < 1000; ++i) {
+            CHECK(sink.write(data).value() == 100);
+            if (sink.capacity() != cap) {
+                ++reallocations;
+                cap = sink.capacity();
+            }
+        }
+        CHECK(sink.size() == 100 * 1000);
+        CHECK(reallocations < 20);
+
+        sink.clear();
+        CHECK(sink.size() == 0);
+        CHECK(sink.capacity() == cap);
+    }
+
+    SUBCASE("move")
+    {
+        sink.write(std::vector<spio::byte>(10));
+        auto moved = std::move(sink);
+        CHECK(moved.size() == 10);
+
+        spio::growable_memory_sink assigned(4);
+        assigned = std::move(moved);
+        CHECK(assigned.size() == 10);
+        CHECK(moved.size() == 0);
+    }
+}
+
+TEST_CASE("growable_memory_sink allocator")
+{
+    spio::basic_growable_memory_sink<spio::aligned_allocator<spio::byte>> sink(
+        10, spio::aligned_allocator<spio::byte>(64));
+    CHECK(sink.capacity() == 10);
+    auto out = sink.reserve(100);
+    CHECK(reinterpret_cast<std::uintptr_t>(out.data()) % 64 == 0);
+    CHECK(sink.capacity() >= 100);
+}
+
+#if SPIO_HAS_STD_PMR
+TEST_CASE("growable_memory_sink pmr move")
+{
+    using sink_type = spio::basic_growable_memory_sink<
+        std::pmr::polymorphic_allocator<spio::byte>>;
+    std::vector<spio::byte> data(100, static_cast<spio::byte>('a'));
+    std::pmr::monotonic_buffer_resource a, b;
+
+    SUBCASE("equal")
+    {
+        sink_type src(16, &a), dst(&a);
+        src.write(data);
+        const auto p = src.contents().data();
+        dst = std::move(src);
+        CHECK(dst.contents().data() == p);
+        CHECK(dst.size() == 100);
+        CHECK(src.size() == 0);
+    }
+    SUBCASE("unequal")
+    {
+        sink_type src(16, &a), dst(&b);
+        src.write(data);
+        dst = std::move(src);
+        CHECK(dst.get_allocator().resource() == &b);
+        CHECK(dst.size() == 100);
+        CHECK(std::equal(data.begin(), data.end(), dst.contents().begin()));
+        CHECK(src.get_allocator().resource() == &a);
+    }
+}
+#endif
+
+TEST_CASE("growable_memory_sink stream")
+{
+    using stream_type = spio::stream<spio::growable_memory_sink,
+                                     spio::encoding<char>,
+                                     spio::sink_filter_chain>;
+    stream_type s(spio::growable_memory_sink{}, stream_type::input_base{},
+                  stream_type::output_base{}, stream_type::chain_type{});
+    std::vector<spio::byte> data(12, static_cast<spio::byte>('a'));
+    auto r = spio::write(s, spio::make_span(data));
+    CHECK(!r.has_error());
+    CHECK(s.device().size() == 12);
+}
@@ -0,0 +1,140 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+namespace {
+class counting_resource : public spio::memory_resource {
+public:
+    int allocations{0};
+    int live{0};
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        ++allocations;
+        ++live;
+        return m_arena.allocate(bytes, alignment);
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override
+    {
+        --live;
+    }
+    bool do_is_equal(const spio::memory_resource& o) const noexcept override
+    {
+        return this == &o;
+    }
+
+    spio::monotonic_buffer_resource m_arena{};
+};
+}  // namespace
+
+TEST_CASE("monotonic_buffer_resource")
+{
+    spio::monotonic_buffer_resource arena(64);
+    auto a = arena.allocate(10, 1);
+    auto b = arena.allocate(100, 64);
+    CHECK(a != b);
+    CHECK(reinterpret_cast<std::uintptr_t>(b) % 64 == 0);
+    std::memset(a, 0, 10);
+    std::memset(b, 0, 100);
+    arena.deallocate(b, 100, 64);
+    arena.release();
+}
+
+TEST_CASE("io resources")
+{
+    counting_resource r;
+
+    SUBCASE("default")
+    {
+        spio::byte_buffer buf(16);
+        CHECK(buf.get_allocator().resource() == spio::new_delete_resource());
+        spio::ring ring(64);
+        CHECK(ring.resource() == spio::new_delete_resource());
+    }
+
+    SUBCASE("buffers")
+    {
+        std::vector<spio::byte> out;
+        spio::vector_sink sink(out);
+        spio::vector_source source(out);
+        {
+            spio::basic_buffered_writable<spio::vector_sink> buffered(
+                sink, spio::buffer_mode::full, 64, &r);
+            CHECK(buffered.resource() == &r);
+            CHECK(r.allocations == 1);
+
+            spio::basic_buffered_writable<spio::vector_sink> aligned(
+                sink, spio::buffer_mode::full, 64, 32, &r);
+            CHECK(aligned.resource() == &r);
+            CHECK(aligned.buffer().get_allocator().alignment() == 32);
+
+            spio::basic_buffered_readable<spio::vector_source> readable(
+                source, 64, -1, &r);
+            CHECK(readable.resource() == &r);
+            CHECK(r.live >= 2);
+        }
+        CHECK(r.live == 0);
+    }
+
+    SUBCASE("copies")
+    {
+        spio::byte_buffer buf(10, spio::aligned_allocator<spio::byte>(&r));
+        const auto copy = buf;
+        CHECK(copy.get_allocator().resource() == &r);
+        CHECK(r.allocations == 2);
+
+        // Assignment keeps the resource of the target
+        spio::byte_buffer other(10);
+        other = buf;
+        CHECK(other.get_allocator().resource() ==
+              spio::new_delete_resource());
+        CHECK(r.allocations == 2);
+    }
+
+    SUBCASE("filters")
+    {
+        using stream_type =
+            spio::stream<spio::vector_sink, spio::encoding<char>,
+                         spio::sink_filter_chain>;
+        std::vector<spio::byte> out;
+        spio::vector_sink sink(out);
+        const std::vector<spio::byte> data(8, spio::to_byte(0xab));
+        {
+            stream_type s(sink, stream_type::input_base{},
+                          stream_type::sink_type(
+                              sink, spio::buffer_mode::full, 64, &r),
+                          stream_type::chain_type{});
+            s.chain().push<spio::hex_encode_filter>(&r);
+            CHECK(spio::write(s, spio::make_span(data)).value() == 16);
+            CHECK(spio::print(s, "{}", 42).value() == 4);
+        }
+        CHECK(r.allocations > 0);
+        CHECK(r.live == 0);
+        CHECK(out.size() == 20);
+    }
+
+    SUBCASE("explicit resource")
+    {
+        spio::byte_buffer buf(10, spio::aligned_allocator<spio::byte>(&r));
+        CHECK(r.allocations == 1);
+        CHECK(spio::aligned_allocator<spio::byte>(&r) !=
+              spio::aligned_allocator<spio::byte>());
+    }
+}
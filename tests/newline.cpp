@@ -0,0 +1,158 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+TEST_CASE("lf_input_filter")
+{
+    spio::lf_input_filter filter;
+
+    SUBCASE("pass-through")
+    {
+        auto buf = to_bytes("foo\nbar\n");
+        auto s = spio::make_span(buf);
+        auto r = filter.read(s);
+        CHECK(r.value() == 8);
+        CHECK(to_string(s) == "foo\nbar\n");
+    }
+    SUBCASE("mixed")
+    {
+        auto buf = to_bytes("a\r\nb\rc\nd\r\r\n");
+        auto s = spio::make_span(buf);
+        auto r = filter.read(s);
+        CHECK(r.value() == s.size());
+        CHECK(to_string(s) == "a\nb\nc\nd\n\n");
+    }
+    SUBCASE("split")
+    {
+        auto first = to_bytes("a\r");
+        auto second = to_bytes("\nb\r");
+        auto third = to_bytes("c");
+
+        auto s = spio::make_span(first);
+        filter.read(s);
+        CHECK(to_string(s) == "a\n");
+        s = spio::make_span(second);
+        filter.read(s);
+        CHECK(to_string(s) == "b\n");
+        s = spio::make_span(third);
+        filter.read(s);
+        CHECK(to_string(s) == "c");
+    }
+}
+
+TEST_CASE("lf_input_filter stream")
+{
+    using stream_type = spio::stream<spio::vector_source, spio::encoding<char>,
+                                     spio::source_filter_chain>;
+
+    const std::string str{"12\r\n34"};
+    std::vector<spio::byte> data(str.size());
+    std::memcpy(data.data(), str.data(), str.size());
+    stream_type in(spio::vector_source(data), stream_type::input_base{},
+                   stream_type::output_base{}, stream_type::chain_type{});
+    in.source_storage() = stream_type::input_base::source_type(in.device());
+    in.chain().push<spio::lf_input_filter>();
+
+    SUBCASE("scan")
+    {
+        int a{}, b{};
+        CHECK(spio::scan(in, "{}", a).has_value());
+        CHECK(spio::scan(in, "{}", b).has_value());
+        CHECK(a == 12);
+        CHECK(b == 34);
+    }
+    SUBCASE("byte-wise read")
+    {
+        // The LF after the CR is dropped without an empty read
+        std::string out;
+        spio::byte b{};
+        while (true) {
+            auto r = spio::read(in, spio::make_span(&b, 1));
+            CHECK(!r.has_error());
+            if (r.value() == 0) {
+                break;
+            }
+            out.push_back(static_cast<char>(b));
+        }
+        CHECK(in.eof());
+        CHECK(out == "12\n34");
+    }
+}
+
+TEST_CASE("lf_input_filter stream putback")
+{
+    using stream_type = spio::stream<spio::vector_source, spio::encoding<char>,
+                                     spio::source_filter_chain>;
+
+    auto data = to_bytes("ab\rcd");
+    std::vector<spio::byte> vec(data.begin(), data.end());
+    stream_type in(spio::vector_source(vec), stream_type::input_base{},
+                   stream_type::output_base{}, stream_type::chain_type{});
+    in.source_storage() = stream_type::input_base::source_type(in.device());
+    in.chain().push<spio::lf_input_filter>();
+
+    // The CR ends the read: the filter drops an LF starting the next one,
+    // which the newline put back mustn't be mistaken for
+    std::array<spio::byte, 3> buf{};
+    CHECK(spio::read(in, spio::make_span(buf)).value() == 3);
+    CHECK(to_string(buf) == "ab\n");
+    CHECK(spio::putback(in, spio::make_span(buf).subspan(2)));
+
+    std::array<spio::byte, 8> rest{};
+    std::string out;
+    while (true) {
+        auto r = spio::read(in, spio::make_span(rest));
+        CHECK(!r.has_error());
+        if (r.value() == 0) {
+            break;
+        }
+        out += to_string(spio::make_span(rest).first(r.value()));
+    }
+    CHECK(out == "\ncd");
+}
+
+TEST_CASE("crlf_output_filter")
+{
+    spio::crlf_output_filter filter;
+
+    SUBCASE("pass-through")
+    {
+        auto buf = to_bytes("foo bar");
+        auto r = filter.write(buf);
+        CHECK(r.value() == 7);
+        CHECK(buf == to_bytes("foo bar"));
+    }
+    SUBCASE("translate")
+    {
+        auto buf = to_bytes("\na\nb\r\nc\n");
+        auto r = filter.write(buf);
+        CHECK(r.value() == static_cast<std::ptrdiff_t>(buf.size()));
+        CHECK(buf == to_bytes("\r\na\r\nb\r\nc\r\n"));
+    }
+    SUBCASE("split")
+    {
+        auto first = to_bytes("a\r");
+        auto second = to_bytes("\nb\n");
+        filter.write(first);
+        filter.write(second);
+        CHECK(first == to_bytes("a\r"));
+        CHECK(second == to_bytes("\nb\r\n"));
+    }
+}
@@ -0,0 +1,265 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include "doctest.h"
+#include "test_util.h"
+
+struct xor_output_filter : spio::output_filter {
+    spio::result write(buffer_type& data) override
+    {
+        for (auto& b : data) {
+            b = static_cast<spio::byte>(static_cast<unsigned char>(b) ^ 0x5a);
+        }
+        return static_cast<size_type>(data.size());
+    }
+};
+struct failing_output_filter : spio::output_filter {
+    spio::result write(buffer_type& data) override
+    {
+        SPIO_UNUSED(data);
+        return spio::make_result(0, spio::failure{spio::invalid_input});
+    }
+};
+
+struct throwing_output_filter : spio::output_filter {
+    spio::result write(buffer_type& data) override
+    {
+        SPIO_UNUSED(data);
+        throw std::runtime_error("Filter failed");
+    }
+};
+
+static spio::byte_buffer make_chunk(int i)
+{
+    spio::byte_buffer chunk(static_cast<std::size_t>(i % 97 + 1));
+    for (auto& b : chunk) {
+        b = static_cast<spio::byte>(i & 0xff);
+    }
+    return chunk;
+}
+
+TEST_CASE("pipelined sink")
+{
+    spio::sink_filter_chain chain;
+    chain.push<xor_output_filter>();
+    chain.push<spio::hex_encode_filter>();
+
+    // Same filters run sequentially
+    spio::sink_filter_chain expected_chain;
+    expected_chain.push<xor_output_filter>();
+    expected_chain.push<spio::hex_encode_filter>();
+    std::vector<spio::byte> expected;
+
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    {
+        spio::basic_pipelined_sink<spio::vector_sink> pipeline(chain, sink,
+                                                               2);
+        for (int i = 0; i < 1000; ++i) {
+            auto chunk = make_chunk(i);
+            auto r = pipeline.write(chunk);
+            CHECK(!r.has_error());
+            CHECK(r.value() == static_cast<std::ptrdiff_t>(chunk.size()));
+
+            expected_chain.write(chunk);
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+
+            if (i == 500) {
+                CHECK(!pipeline.flush().has_error());
+                CHECK(container.size() == expected.size());
+            }
+        }
+        CHECK(pipeline.close().has_value());
+        CHECK(!pipeline.is_open());
+    }
+    CHECK(container == expected);
+}
+
+TEST_CASE("pipelined sink error")
+{
+    spio::sink_filter_chain chain;
+    chain.push<failing_output_filter>();
+
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    spio::basic_pipelined_sink<spio::vector_sink> pipeline(chain, sink);
+
+    CHECK(!pipeline.write(make_chunk(1)).has_error());
+    CHECK(pipeline.flush().has_error());
+    CHECK(pipeline.write(make_chunk(2)).has_error());
+    CHECK(container.empty());
+}
+
+TEST_CASE("pipelined sink exceptions")
+{
+    spio::sink_filter_chain chain;
+    chain.push<throwing_output_filter>();
+
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    spio::basic_pipelined_sink<spio::vector_sink> pipeline(chain, sink);
+
+    CHECK(!pipeline.write(make_chunk(1)).has_error());
+    auto r = pipeline.flush();
+    REQUIRE(r.has_error());
+    CHECK(r.error().code() == spio::undefined_error);
+    CHECK(container.empty());
+
+    auto c = pipeline.close();
+    CHECK(!c.has_value());
+    CHECK(!pipeline.is_open());
+}
+
+TEST_CASE("pipelined sink final blocks")
+{
+    spio::sink_filter_chain chain;
+    chain.push<spio::base64_encode_filter>();
+    chain.push<spio::hex_encode_filter>();
+
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    spio::basic_pipelined_sink<spio::vector_sink> pipeline(chain, sink);
+
+    // Not a whole block: held back by the encoder until the pipeline closes
+    CHECK(!pipeline.write(to_span("A")).has_error());
+    CHECK(!pipeline.flush().has_error());
+    CHECK(container.empty());
+
+    CHECK(pipeline.close().has_value());
+    CHECK(to_string(container) == "51513d3d");  // "QQ=="
+}
+
+TEST_CASE("pipelined sink is a device")
+{
+    using pipeline_type = spio::basic_pipelined_sink<spio::vector_sink>;
+    CHECK(spio::is_device<pipeline_type>::value);
+    CHECK(spio::is_writable<pipeline_type>::value);
+}
+
+// Accepts at most 3 bytes per call, none once stuck
+struct trickling_writable {
+    spio::result write(spio::span<const spio::byte> s)
+    {
+        const auto n = stuck ? 0 : std::min(s.size(), std::ptrdiff_t{3});
+        data.insert(data.end(), s.begin(), s.begin() + n);
+        return n;
+    }
+
+    std::vector<spio::byte> data;
+    bool stuck{false};
+};
+
+TEST_CASE("pipelined sink short writes")
+{
+    spio::sink_filter_chain chain;
+    chain.push<xor_output_filter>();
+    trickling_writable sink;
+    spio::basic_pipelined_sink<trickling_writable> pipeline(chain, sink);
+
+    SUBCASE("trickling")
+    {
+        auto chunk = make_chunk(9);
+        CHECK(pipeline.write(chunk).value() == 10);
+        CHECK(!pipeline.flush().has_error());
+        REQUIRE(sink.data.size() == 10);
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+            CHECK(static_cast<unsigned char>(sink.data[i]) ==
+                  (static_cast<unsigned char>(chunk[i]) ^ 0x5a));
+        }
+    }
+    SUBCASE("stuck")
+    {
+        sink.stuck = true;
+        CHECK(!pipeline.write(make_chunk(9)).has_error());
+        CHECK(pipeline.flush().has_error());
+    }
+}
+
+// Counts the calls made from threads other than the one that created it
+class owner_thread_resource : public spio::memory_resource {
+public:
+    std::atomic<int> foreign{0};
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        _check();
+        return m_arena.allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+        override
+    {
+        _check();
+        m_arena.deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const spio::memory_resource& o) const noexcept override
+    {
+        return this == &o;
+    }
+
+    void _check()
+    {
+        if (std::this_thread::get_id() != m_owner) {
+            ++foreign;
+        }
+    }
+
+    std::thread::id m_owner{std::this_thread::get_id()};
+    spio::monotonic_buffer_resource m_arena{};
+};
+
+TEST_CASE("pipelined sink chunks from another resource")
+{
+    spio::sink_filter_chain chain;
+    chain.push<xor_output_filter>();
+    chain.push<spio::hex_encode_filter>();
+
+    spio::sink_filter_chain expected_chain;
+    expected_chain.push<xor_output_filter>();
+    expected_chain.push<spio::hex_encode_filter>();
+    std::vector<spio::byte> expected;
+
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    owner_thread_resource arena;
+    {
+        spio::basic_pipelined_sink<spio::vector_sink> pipeline(chain, sink,
+                                                               2);
+        for (int i = 0; i < 2000; ++i) {
+            const auto data = make_chunk(i);
+            spio::byte_buffer chunk(
+                data.begin(), data.end(),
+                spio::aligned_allocator<spio::byte>(&arena));
+            if (i % 2 == 0) {
+                CHECK(!pipeline.write(chunk).has_error());
+            }
+            else {
+                CHECK(!pipeline.write(spio::make_span(chunk)).has_error());
+            }
+
+            expected_chain.write(chunk);
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+        }
+        CHECK(pipeline.close().has_value());
+    }
+    CHECK(arena.foreign == 0);
+    CHECK(container == expected);
+}
@@ -134,4 +134,52 @@ TEST_CASE("ring")
             CHECK(r.empty());
         }
     }
+
+    SUBCASE("wrap at the end")
+    {
+        spio::ring r(1024);
+        std::vector<spio::byte> buf(static_cast<std::size_t>(r.size()),
+                                    spio::byte{'a'});
+        auto s = spio::make_span(buf);
+        for (int i = 0; i < 2; ++i) {
+            CHECK(r.write(s) == r.size());
+            CHECK(r.in_use() == r.size());
+            CHECK(r.read(s) == r.size());
+            CHECK(r.empty());
+            CHECK(r.free_space() == r.size());
+        }
+    }
+
+    SUBCASE("move head back")
+    {
+        spio::ring r(1024);
+        for (auto n : {r.size() / 2, r.size()}) {
+            // Reserve n bytes, but fill none of them
+            for (auto s : r.direct_write(n)) {
+                (void)s;
+            }
+            CHECK(r.in_use() == n);
+            r.move_head(-n);
+            CHECK(r.empty());
+            CHECK(r.in_use() == 0);
+        }
+    }
+    SUBCASE("move head back across the end")
+    {
+        spio::ring r(1024);
+        std::vector<spio::byte> buf(static_cast<std::size_t>(r.size() / 2),
+                                    spio::byte{'a'});
+        auto s = spio::make_span(buf);
+        CHECK(r.write(s) == s.size());
+        CHECK(r.read(s) == s.size());
+
+        // The head wraps past the end, and is moved back before the tail
+        for (auto part : r.direct_write(r.size())) {
+            (void)part;
+        }
+        r.move_head(-r.size() / 4);
+        CHECK(r.in_use() == r.size() * 3 / 4);
+        r.move_tail(r.size() / 2);
+        CHECK(r.in_use() == r.size() / 4);
+    }
 }
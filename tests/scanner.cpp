@@ -17,6 +17,7 @@
 
 #include <spio/spio.h>
 #include "doctest.h"
+#include "test_util.h"
 
 TEST_CASE("scanner")
 {
@@ -95,3 +96,120 @@ TEST_CASE("scanner double")
     }
     CHECK(val == doctest::Approx(3.14159));
 }
+
+TEST_CASE("scanner sequential")
+{
+    using stream_type = spio::stream<spio::vector_source, spio::encoding<char>,
+                                     spio::source_filter_chain>;
+
+    const std::string str{"-420 3.5 false abc"};
+    const auto bytes = to_span(str);
+    std::vector<spio::byte> data(bytes.begin(), bytes.end());
+    stream_type in(spio::vector_source(data), stream_type::input_base{},
+                   stream_type::output_base{}, stream_type::chain_type{});
+    in.source_storage() = stream_type::input_base::source_type(in.device());
+
+    int i{};
+    double d{};
+    bool b{true};
+    char sep{};
+    std::array<char, 3> arr{};
+    auto sp = spio::span<char>(arr);
+    // Integers consume the whitespace after them
+    CHECK(spio::scan(in, "{}", i).has_value());
+    CHECK(spio::scan(in, "{}{}", d, sep).has_value());
+    CHECK(spio::scan(in, "{}{}", b, sep).has_value());
+    CHECK(spio::scan(in, "{}", sp).has_value());
+    CHECK(i == -420);
+    CHECK(d == doctest::Approx(3.5));
+    CHECK(!b);
+    CHECK(std::string(arr.data(), arr.size()) == "abc");
+
+    auto ret = spio::scan(in, "{}", i);
+    REQUIRE(!ret);
+    CHECK(ret.error().code() == spio::end_of_file);
+}
+
+TEST_CASE("scanner sequential stdio")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("12 true", f);
+    std::rewind(f);
+
+    spio::stdio_handle_instream in(f);
+    int i{};
+    bool b{};
+    CHECK(spio::scan(in, "{}", i).has_value());
+    CHECK(spio::scan(in, "{}", b).has_value());
+    CHECK(i == 12);
+    CHECK(b);
+    std::fclose(f);
+}
+
+using vector_instream = spio::stream<spio::vector_source,
+                                     spio::encoding<char>,
+                                     spio::source_filter_chain>;
+
+// Scans a whole new stream reading str
+template <typename... Args>
+static spio::expected<void, spio::failure> scan_string(const std::string& str,
+                                                       const char* f,
+                                                       Args&... a)
+{
+    const auto bytes = to_span(str);
+    std::vector<spio::byte> data(bytes.begin(), bytes.end());
+    vector_instream in(spio::vector_source(data), vector_instream::input_base{},
+                       vector_instream::output_base{},
+                       vector_instream::chain_type{});
+    in.source_storage() = vector_instream::input_base::source_type(in.device());
+    return spio::scan(in, f, a...);
+}
+
+TEST_CASE("scanner end of input")
+{
+    SUBCASE("int")
+    {
+        int i{};
+        CHECK(scan_string("42", "{}", i).has_value());
+        CHECK(i == 42);
+    }
+    SUBCASE("double")
+    {
+        double d{};
+        CHECK(scan_string("2.5", "{}", d).has_value());
+        CHECK(d == doctest::Approx(2.5));
+    }
+    SUBCASE("char span")
+    {
+        std::array<char, 3> arr{};
+        auto s = spio::span<char>(arr);
+        CHECK(scan_string("ab", "{}", s).has_value());
+        CHECK(arr[0] == 'a');
+        CHECK(arr[1] == 'b');
+    }
+    SUBCASE("empty")
+    {
+        int i{};
+        auto ret = scan_string("", "{}", i);
+        REQUIRE(!ret);
+        CHECK(ret.error().code() == spio::end_of_file);
+    }
+}
+
+TEST_CASE("scanner bool whole match")
+{
+    bool b{};
+    CHECK(scan_string("true", "{}", b).has_value());
+    CHECK(b);
+    CHECK(scan_string("false", "{}", b).has_value());
+    CHECK(!b);
+
+    // A prefix of "true" isn't true
+    auto ret = scan_string("t", "{}", b);
+    REQUIRE(!ret);
+    CHECK(ret.error().code() == spio::end_of_file);
+    ret = scan_string("tulip", "{}", b);
+    REQUIRE(!ret);
+    CHECK(ret.error().code() == spio::scanner_error);
+}
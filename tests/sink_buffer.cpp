@@ -128,4 +128,32 @@ TEST_CASE("sink_buffer")
         CHECK(!ret.has_error());
         CHECK(buf.empty());
     }
+
+    SUBCASE("block-aligned buffering")
+    {
+        spio::basic_buffered_writable<spio::vector_sink> buf(
+            sink, spio::buffer_mode::full, 100, 64);
+        CHECK(buf.size() == 128);
+        CHECK(buf.block_size() == 64);
+        CHECK(reinterpret_cast<std::uintptr_t>(buf.buffer().data()) % 64 ==
+              0);
+
+        std::vector<char> write(200);
+        fill_random(write.begin(), write.end());
+        auto ret = buf.write(spio::as_bytes(spio::make_span(
+            write.data(), static_cast<std::ptrdiff_t>(write.size()))));
+        CHECK(!ret.has_error());
+        CHECK(ret.value() == 200);
+        CHECK(container.size() == 128);
+        CHECK(buf.in_use() == 72);
+
+        // No write_tail(), so the partial block is written normally
+        ret = buf.flush();
+        CHECK(!ret.has_error());
+        CHECK(ret.value() == 72);
+        CHECK(buf.empty());
+        CHECK(container.size() == write.size());
+        CHECK_EQ(std::memcmp(container.data(), write.data(), container.size()),
+                 0);
+    }
 }
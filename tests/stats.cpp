@@ -0,0 +1,106 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_ENABLE_STATS
+#define SPIO_ENABLE_STATS 1
+#endif
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+namespace {
+    std::vector<spio::byte> make_bytes(std::size_t n)
+    {
+        std::vector<spio::byte> v(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            v[i] = static_cast<spio::byte>('a' + i % 26);
+        }
+        return v;
+    }
+}  // namespace
+
+TEST_CASE("buffered_writable stats")
+{
+    std::vector<spio::byte> out;
+    spio::vector_sink sink(out);
+    spio::basic_buffered_writable<spio::vector_sink> buf(
+        sink, spio::buffer_mode::full, 16);
+    const auto data = make_bytes(20);
+
+    CHECK(buf.write(spio::make_span(data).first(10)).value() == 10);
+    CHECK(buf.write(spio::make_span(data).subspan(10)).value() == 10);
+    CHECK(buf.flush().value() == 4);
+
+    auto s = buf.stats().snapshot();
+    CHECK(s.bytes_written == 20);
+    CHECK(s.device_writes == 2);
+    CHECK(s.short_writes == 0);
+    CHECK(s.flushes == 2);
+    CHECK(s.buffer_high_water == 16);
+    CHECK(s.bytes_read == 0);
+    CHECK(out == data);
+
+    buf.stats().reset();
+    CHECK(buf.stats().snapshot().device_writes == 0);
+}
+
+TEST_CASE("buffered_readable stats")
+{
+    auto data = make_bytes(100);
+    spio::vector_source source(data);
+    spio::basic_buffered_readable<spio::vector_source> buf(source, 4096);
+
+    std::vector<spio::byte> read(10);
+    bool eof = false;
+    CHECK(buf.read(spio::make_span(read), eof).value() == 10);
+    CHECK(buf.putback(spio::make_span(read).first(5)).value() == 5);
+    read.resize(200);
+    CHECK(buf.read(spio::make_span(read), eof).value() == 95);
+    CHECK(eof);
+
+    auto s = buf.stats().snapshot();
+    CHECK(s.bytes_read == 105);
+    CHECK(s.device_reads == 1);
+    // Stopped by the end of the file
+    CHECK(s.short_reads == 0);
+    CHECK(s.putbacks == 1);
+    CHECK(s.buffer_high_water == 100);
+    CHECK(s.bytes_written == 0);
+}
+
+TEST_CASE("stream_stats")
+{
+    using stream_type = spio::stream<spio::vector_sink, spio::encoding<char>,
+                                     spio::sink_filter_chain>;
+    std::vector<spio::byte> out;
+    spio::vector_sink sink(out);
+    stream_type s(sink, stream_type::input_base{}, stream_type::output_base{},
+                  stream_type::chain_type{});
+    const auto data = make_bytes(8);
+
+    // Unbuffered writes go straight to the device
+    s.sink_storage() = stream_type::sink_type(sink, spio::buffer_mode::none);
+    CHECK(spio::write(s, spio::make_span(data)).value() == 8);
+    auto st = spio::stream_stats(s);
+    CHECK(st.bytes_written == 8);
+    CHECK(st.device_writes == 1);
+    CHECK(st.flushes == 0);
+
+    spio::io_stats_snapshot sum = st + st;
+    CHECK(sum.bytes_written == 16);
+    CHECK(sum.buffer_high_water == st.buffer_high_water);
+}
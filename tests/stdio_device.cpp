@@ -18,3 +18,121 @@
 #include "doctest.h"
 #include <spio/spio.h>
 
+
+#include <cstring>
+
+TEST_CASE("stdio_device seek and extent")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    spio::stdio_device d(f);
+
+    const char str[] = "Hello world";
+    auto data = spio::as_bytes(spio::make_span(str, 11));
+    CHECK(d.write(data).value() == 11);
+    CHECK(d.sync().has_value());
+    CHECK(*d.extent() == 11);
+
+    auto p = d.seek(6, spio::seekdir::beg);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == 6);
+    p = d.seek(-1, spio::seekdir::end);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == 10);
+    p = d.seek(-2, spio::seekdir::cur);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == 8);
+
+    // Past what a 32-bit long can represent
+    const auto big = spio::streamoff{5} << 30;
+    p = d.seek(big, spio::seekdir::beg);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == big);
+    CHECK(d.write(data.first(1)).value() == 1);
+    CHECK(d.sync().has_value());
+    CHECK(*d.extent() == big + 1);
+    p = d.seek(0, spio::seekdir::cur);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == big + 1);
+
+    std::fclose(f);
+}
+
+#if SPIO_POSIX
+TEST_CASE("stdio_device read_at and write_at")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    spio::stdio_device d(f);
+
+    const char str[] = "Hello world";
+    auto data = spio::as_bytes(spio::make_span(str, 11));
+    CHECK(d.write_at(data, 0).value() == 11);
+    CHECK(d.write_at(data.first(5), 20).value() == 5);
+    CHECK(*d.extent() == 25);
+
+    // The position of the FILE isn't moved
+    auto p = d.seek(0, spio::seekdir::cur);
+    REQUIRE(p.has_value());
+    CHECK(static_cast<spio::streamoff>(*p) == 0);
+
+    char buf[8] = {};
+    bool eof = false;
+    auto r = d.read_at(spio::as_writeable_bytes(spio::make_span(buf, 5)), 6,
+                       eof);
+    CHECK(r.value() == 5);
+    CHECK(!eof);
+    CHECK(std::memcmp(buf, "world", 5) == 0);
+
+    r = d.read_at(spio::as_writeable_bytes(spio::make_span(buf, 8)), 20,
+                  eof);
+    CHECK(r.value() == 5);
+    CHECK(eof);
+    CHECK(std::memcmp(buf, "Hello", 5) == 0);
+
+    std::fclose(f);
+}
+
+TEST_CASE("stdio_instream scan_at")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("123 456", f);
+    std::fflush(f);
+
+    spio::basic_stdio_handle_instream<spio::encoding<char>> s(f);
+    int a{}, b{};
+    CHECK(spio::scan_at(s, 4, "{}", b).has_value());
+    CHECK(spio::scan_at(s, 0, "{}", a).has_value());
+    CHECK(a == 123);
+    CHECK(b == 456);
+
+    std::fclose(f);
+}
+
+struct increment_byte_input_filter : spio::byte_input_filter {
+    spio::result get(spio::byte& data) override
+    {
+        data = static_cast<spio::byte>(static_cast<unsigned char>(data) + 1);
+        return 1;
+    }
+};
+
+TEST_CASE("stdio_instream read_at filtered")
+{
+    auto f = std::tmpfile();
+    REQUIRE(f);
+    std::fputs("abcd", f);
+    std::fflush(f);
+
+    spio::stdio_handle_instream s(f);
+    s.chain().push<increment_byte_input_filter>();
+    std::array<spio::byte, 2> buf{};
+    auto r = spio::read_at(s, spio::make_span(buf), 1);
+    CHECK(r.value() == 2);
+    CHECK(buf[0] == spio::to_byte('c'));
+    CHECK(buf[1] == spio::to_byte('d'));
+
+    std::fclose(f);
+}
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "counting_new.h"
+#include "doctest.h"
+
+TEST_CASE("stream flags")
+{
+    spio::memory_outstream s;
+    CHECK(s);
+    CHECK(!s.bad());
+    CHECK(!s.eof());
+
+    s.set_eof();
+    CHECK(s.eof());
+    CHECK(s);
+    s.set_bad();
+    CHECK(s.bad());
+    CHECK(!s);
+
+    s.clear_bad();
+    s.clear_eof();
+    CHECK(s);
+    CHECK(!s.eof());
+}
+
+TEST_CASE("stream allocations")
+{
+    const char str[] = "Hello world!";
+    const auto data = spio::as_bytes(spio::make_span(str, 12));
+
+    SUBCASE("memory_outstream")
+    {
+        std::vector<spio::byte> buf(12);
+        const auto before = counting_new::allocations();
+        {
+            spio::memory_outstream s(buf);
+            auto r = spio::write_at(s, data, 0);
+            CHECK(!r.has_error());
+            CHECK(r.value() == 12);
+        }
+        CHECK(counting_new::allocations() == before);
+        CHECK(std::memcmp(buf.data(), str, 12) == 0);
+    }
+    SUBCASE("unbuffered writable")
+    {
+        std::vector<spio::byte> buf;
+        buf.reserve(12);
+        spio::vector_sink sink{buf};
+        using stream_type =
+            spio::stream<spio::vector_sink, spio::encoding<char>,
+                         spio::sink_filter_chain>;
+        const auto before = counting_new::allocations();
+        {
+            stream_type s(sink, stream_type::input_base{},
+                          stream_type::output_base{},
+                          stream_type::chain_type{});
+            CHECK(!s.sink().use_buffering());
+            auto r = spio::write(s, data);
+            CHECK(!r.has_error());
+            CHECK(r.value() == 12);
+        }
+        CHECK(counting_new::allocations() == before);
+        CHECK(buf.size() == 12);
+    }
+}
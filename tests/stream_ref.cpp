@@ -16,6 +16,9 @@
 //     https://github.com/eliaskosunen/spio
 
 #include <spio/spio.h>
+#include <type_traits>
+#include <utility>
+#include "counting_new.h"
 #include "doctest.h"
 
 TEST_CASE("stream_ref")
@@ -35,3 +38,67 @@ TEST_CASE("stream_ref")
     CHECK_EQ(
         std::memcmp(str, stream.device().output().data() + 12, strlen(str)), 0);
 }
+
+TEST_CASE("stream_ref copy")
+{
+    std::vector<spio::byte> buf(24);
+    spio::memory_outstream stream(buf);
+    using ref_type = spio::basic_stream_ref<spio::encoding<char>,
+                                            spio::random_access_writable_tag>;
+    ref_type ref(stream);
+    ref_type copy(ref);
+    ref_type assigned{};
+    assigned = copy;
+
+    const auto str = "Hello";
+    auto ret = spio::write_at(
+        assigned, spio::as_bytes(spio::make_span(str, strlen(str))), 0);
+    CHECK(!ret.has_error());
+    CHECK_EQ(std::memcmp(str, stream.device().output().data(), strlen(str)), 0);
+    ret = spio::write_at(
+        ref, spio::as_bytes(spio::make_span(str, strlen(str))), 5);
+    CHECK(!ret.has_error());
+    CHECK_EQ(
+        std::memcmp(str, stream.device().output().data() + 5, strlen(str)), 0);
+}
+
+TEST_CASE("stream_ref move")
+{
+    std::vector<spio::byte> buf(24);
+    spio::memory_outstream stream(buf);
+    using ref_type = spio::basic_stream_ref<spio::encoding<char>,
+                                            spio::random_access_writable_tag>;
+    static_assert(std::is_nothrow_move_constructible<ref_type>::value, "");
+    static_assert(std::is_nothrow_move_assignable<ref_type>::value, "");
+
+    ref_type ref(stream);
+    ref_type moved(std::move(ref));
+    ref_type assigned{};
+    assigned = std::move(moved);
+
+    const auto str = "Hello";
+    auto ret = spio::write_at(
+        assigned, spio::as_bytes(spio::make_span(str, strlen(str))), 0);
+    CHECK(!ret.has_error());
+    CHECK_EQ(std::memcmp(str, stream.device().output().data(), strlen(str)), 0);
+}
+
+TEST_CASE("stream_ref allocations")
+{
+    std::vector<spio::byte> buf(24);
+    spio::memory_outstream stream(buf);
+    using ref_type = spio::basic_stream_ref<spio::encoding<char>,
+                                            spio::random_access_writable_tag>;
+
+    const auto before = counting_new::allocations();
+    {
+        ref_type ref(stream);
+        ref_type copy(ref);
+        ref_type assigned{};
+        assigned = copy;
+        ref_type moved(std::move(copy));
+        assigned = std::move(moved);
+        ref.reset(stream);
+    }
+    CHECK(counting_new::allocations() == before);
+}
@@ -0,0 +1,229 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include "doctest.h"
+
+using stream_type = spio::
+    stream<spio::vector_sink, spio::encoding<char>, spio::sink_filter_chain>;
+
+static const int thread_count = 4;
+static const int record_count = 500;
+
+// Every line has to be a complete record: "<thread> <record>"
+static void check_records(const std::vector<spio::byte>& container)
+{
+    std::string str(reinterpret_cast<const char*>(container.data()),
+                    container.size());
+    std::istringstream ss(str);
+    std::vector<int> next(thread_count, 0);
+    std::string line;
+    int lines = 0;
+    while (std::getline(ss, line)) {
+        std::istringstream ls(line);
+        int t = -1, i = -1;
+        std::string rest;
+        ls >> t >> i;
+        CHECK(ls);
+        CHECK(!(ls >> rest));
+        REQUIRE(t >= 0);
+        REQUIRE(t < thread_count);
+        // Records of a single thread stay in order
+        CHECK(i == next[static_cast<std::size_t>(t)]++);
+        ++lines;
+    }
+    CHECK(lines == thread_count * record_count);
+}
+
+template <typename Policy, typename Write>
+static void run_threads(Write w)
+{
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    stream_type s(sink, stream_type::input_base{}, stream_type::output_base{},
+                  stream_type::chain_type{});
+    spio::synchronized_stream<stream_type, Policy> sync(s);
+
+    // Assertions aren't thread-safe, so errors are counted instead
+    std::atomic<int> errors{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&sync, &w, &errors, t] {
+            for (int i = 0; i < record_count; ++i) {
+                if (w(sync, t, i).has_error()) {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK(errors == 0);
+    check_records(container);
+}
+
+struct write_record {
+    template <typename Sync>
+    spio::result operator()(Sync& sync, int t, int i) const
+    {
+        const auto str = std::to_string(t) + ' ' + std::to_string(i) + '\n';
+        return sync.write(spio::as_bytes(spio::make_span(
+            str.data(), static_cast<std::ptrdiff_t>(str.size()))));
+    }
+};
+struct print_record {
+    template <typename Sync>
+    spio::result operator()(Sync& sync, int t, int i) const
+    {
+        return sync.print("{} {}\n", t, i);
+    }
+};
+
+TEST_CASE("synchronized_stream write")
+{
+    SUBCASE("mutex")
+    {
+        run_threads<spio::mutex_policy>(write_record{});
+    }
+    SUBCASE("spinlock")
+    {
+        run_threads<spio::spinlock_policy>(write_record{});
+    }
+    SUBCASE("thread_buffer")
+    {
+        run_threads<spio::thread_buffer_policy>(write_record{});
+    }
+}
+
+TEST_CASE("synchronized_stream print")
+{
+    SUBCASE("mutex")
+    {
+        run_threads<spio::mutex_policy>(print_record{});
+    }
+    SUBCASE("spinlock")
+    {
+        run_threads<spio::spinlock_policy>(print_record{});
+    }
+    SUBCASE("thread_buffer")
+    {
+        run_threads<spio::thread_buffer_policy>(print_record{});
+    }
+}
+
+// Prints to another stream while being formatted
+struct nested_record {
+    spio::synchronized_stream<stream_type, spio::thread_buffer_policy>* inner;
+};
+namespace fmt {
+template <>
+struct formatter<nested_record> {
+    template <typename ParseContext>
+    auto parse(ParseContext& ctx) -> decltype(ctx.begin())
+    {
+        return ctx.begin();
+    }
+    template <typename FormatContext>
+    auto format(const nested_record& r, FormatContext& ctx)
+        -> decltype(ctx.out())
+    {
+        if (r.inner) {
+            r.inner->print("{} {}\n", 2, nested_record{nullptr});
+        }
+        return format_to(ctx.out(), "{}", r.inner ? "outer" : "leaf");
+    }
+};
+}  // namespace fmt
+
+TEST_CASE("synchronized_stream nested print")
+{
+    std::vector<spio::byte> outer_container, inner_container;
+    spio::vector_sink outer_sink(outer_container), inner_sink(inner_container);
+    stream_type outer_stream(outer_sink, stream_type::input_base{},
+                             stream_type::output_base{},
+                             stream_type::chain_type{});
+    stream_type inner_stream(inner_sink, stream_type::input_base{},
+                             stream_type::output_base{},
+                             stream_type::chain_type{});
+    spio::synchronized_stream<stream_type, spio::thread_buffer_policy> outer(
+        outer_stream);
+    spio::synchronized_stream<stream_type, spio::thread_buffer_policy> inner(
+        inner_stream);
+
+    CHECK(!outer.print("{} {}\n", 1, nested_record{&inner}).has_error());
+    const auto to_string = [](const std::vector<spio::byte>& c) {
+        return std::string(reinterpret_cast<const char*>(c.data()), c.size());
+    };
+    CHECK(to_string(outer_container) == "1 outer\n");
+    CHECK(to_string(inner_container) == "2 leaf\n");
+}
+
+// Only byte-writable: has put() but no write()
+struct byte_vector_sink {
+    bool is_open() const
+    {
+        return true;
+    }
+    spio::expected<void, spio::failure> close()
+    {
+        return {};
+    }
+    spio::result put(spio::byte b)
+    {
+        data.push_back(b);
+        return 1;
+    }
+
+    std::vector<spio::byte> data;
+};
+
+template <typename Policy>
+static void check_byte_print()
+{
+    using byte_stream_type =
+        spio::stream<byte_vector_sink, spio::encoding<char>,
+                     spio::byte_sink_filter_chain>;
+    byte_stream_type s(byte_vector_sink{}, byte_stream_type::input_base{},
+                       byte_stream_type::output_base{},
+                       byte_stream_type::chain_type{});
+    spio::synchronized_stream<byte_stream_type, Policy> sync(s);
+
+    CHECK(!sync.print("{} {}\n", 0, 1).has_error());
+    const auto& data = s.device().data;
+    CHECK(std::string(reinterpret_cast<const char*>(data.data()),
+                      data.size()) == "0 1\n");
+}
+
+TEST_CASE("synchronized_stream byte-writable print")
+{
+    SUBCASE("mutex")
+    {
+        check_byte_print<spio::mutex_policy>();
+    }
+    SUBCASE("spinlock")
+    {
+        check_byte_print<spio::spinlock_policy>();
+    }
+    SUBCASE("thread_buffer")
+    {
+        check_byte_print<spio::thread_buffer_policy>();
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#ifndef SPIO_TESTS_TEST_UTIL_H
+#define SPIO_TESTS_TEST_UTIL_H
+
+// Helpers shared by the tests
+
+#include <spio/spio.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The bytes of str, without the terminating null
+inline spio::span<const spio::byte> to_span(const char* str)
+{
+    return spio::as_bytes(spio::make_span(
+        str, static_cast<std::ptrdiff_t>(std::strlen(str))));
+}
+// str must outlive the span
+inline spio::span<const spio::byte> to_span(const std::string& str)
+{
+    return spio::as_bytes(spio::make_span(
+        str.data(), static_cast<std::ptrdiff_t>(str.size())));
+}
+
+inline spio::byte_buffer to_bytes(const std::string& str)
+{
+    auto s = to_span(str);
+    return spio::byte_buffer(s.begin(), s.end());
+}
+template <typename CharT>
+spio::byte_buffer to_bytes(const std::basic_string<CharT>& str)
+{
+    auto s = spio::as_bytes(
+        spio::make_span(str.data(), static_cast<std::ptrdiff_t>(str.size())));
+    return spio::byte_buffer(s.begin(), s.end());
+}
+
+inline std::string to_string(spio::span<const spio::byte> s)
+{
+    return std::string(reinterpret_cast<const char*>(s.data()),
+                       static_cast<std::size_t>(s.size()));
+}
+
+// n pseudo-random bytes, the same every time
+template <typename Buffer = std::vector<spio::byte>>
+Buffer make_data(std::size_t n)
+{
+    Buffer data(n);
+    unsigned v = 1;
+    for (auto& b : data) {
+        v = v * 1103515245u + 12345u;
+        b = static_cast<spio::byte>((v >> 16) & 0xff);
+    }
+    return data;
+}
+
+#endif  // SPIO_TESTS_TEST_UTIL_H
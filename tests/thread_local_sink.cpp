@@ -0,0 +1,176 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include <atomic>
+#include <thread>
+#include "doctest.h"
+
+static const int thread_count = 4;
+static const int record_count = 1000;
+
+// Record i of thread t is i % 13 + 1 bytes of value t
+static std::vector<spio::byte> make_record(int t, int i)
+{
+    return std::vector<spio::byte>(static_cast<std::size_t>(i % 13 + 1),
+                                   static_cast<spio::byte>(t));
+}
+
+static int write_records(spio::basic_thread_local_sink<spio::vector_sink>& s)
+{
+    std::atomic<int> errors{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&s, &errors, t] {
+            for (int i = 0; i < record_count; ++i) {
+                auto rec = make_record(t, i);
+                auto r = s.write(rec);
+                if (r.has_error() ||
+                    r.value() != static_cast<std::ptrdiff_t>(rec.size())) {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return errors;
+}
+
+TEST_CASE("thread_local_sink")
+{
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    {
+        spio::basic_thread_local_sink<spio::vector_sink> s(sink, 64);
+        CHECK(write_records(s) == 0);
+        CHECK(!s.flush().has_error());
+    }
+
+    // Nothing was lost or duplicated
+    std::vector<std::size_t> counts(thread_count, 0);
+    for (auto b : container) {
+        const auto t = static_cast<std::size_t>(b);
+        REQUIRE(t < counts.size());
+        ++counts[t];
+    }
+    std::size_t expected = 0;
+    for (int i = 0; i < record_count; ++i) {
+        expected += make_record(0, i).size();
+    }
+    for (auto c : counts) {
+        CHECK(c == expected);
+    }
+}
+
+TEST_CASE("thread_local_sink framed")
+{
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    {
+        // Small enough for some records to bypass the buffer
+        spio::basic_thread_local_sink<spio::vector_sink> s(
+            sink, 20, spio::record_framing::sequence);
+        CHECK(write_records(s) == 0);
+    }
+
+    std::vector<spio::byte> merged;
+    auto r = spio::merge_framed_records(container, merged);
+    CHECK(!r.has_error());
+    CHECK(r.value() == thread_count * record_count);
+
+    // In sequence order, the records of every thread are in order
+    std::vector<int> next(thread_count, 0);
+    auto it = merged.begin();
+    while (it != merged.end()) {
+        const auto t = static_cast<int>(*it);
+        REQUIRE(t < thread_count);
+        auto& i = next[static_cast<std::size_t>(t)];
+        const auto rec = make_record(t, i);
+        REQUIRE(merged.end() - it >=
+                static_cast<std::ptrdiff_t>(rec.size()));
+        CHECK(std::equal(rec.begin(), rec.end(), it));
+        it += static_cast<std::ptrdiff_t>(rec.size());
+        ++i;
+    }
+    for (auto n : next) {
+        CHECK(n == record_count);
+    }
+
+    SUBCASE("truncated")
+    {
+        container.pop_back();
+        merged.clear();
+        CHECK(spio::merge_framed_records(container, merged).has_error());
+    }
+}
+
+// Accepts at most 3 bytes per call
+struct trickling_sink {
+    spio::result write(spio::span<const spio::byte> s)
+    {
+        const auto n = std::min(s.size(), std::ptrdiff_t{3});
+        data.insert(data.end(), s.begin(), s.begin() + n);
+        return n;
+    }
+
+    std::vector<spio::byte> data;
+};
+
+TEST_CASE("thread_local_sink short writes")
+{
+    trickling_sink sink;
+    {
+        spio::basic_thread_local_sink<trickling_sink> s(
+            sink, 20, spio::record_framing::sequence);
+        for (int i = 0; i < 100; ++i) {
+            // Some bypass the buffer
+            auto rec = make_record(0, i);
+            CHECK(s.write(rec).value() ==
+                  static_cast<std::ptrdiff_t>(rec.size()));
+        }
+        CHECK(!s.flush().has_error());
+    }
+
+    std::vector<spio::byte> merged;
+    auto r = spio::merge_framed_records(sink.data, merged);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 100);
+}
+
+TEST_CASE("thread_local_sink exited threads")
+{
+    std::vector<spio::byte> container;
+    spio::vector_sink sink(container);
+    spio::basic_thread_local_sink<spio::vector_sink> s(sink, 64);
+
+    for (int round = 0; round < 3; ++round) {
+        CHECK(write_records(s) == 0);
+        // Buffers of exited threads are flushed and removed
+        // when another thread starts writing
+        CHECK(s.thread_count() <= thread_count);
+    }
+    CHECK(!s.flush().has_error());
+    CHECK(s.thread_count() == 0);
+
+    std::size_t expected = 0;
+    for (int i = 0; i < record_count; ++i) {
+        expected += make_record(0, i).size();
+    }
+    CHECK(container.size() == 3 * thread_count * expected);
+}
@@ -0,0 +1,116 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+
+using std::chrono::nanoseconds;
+
+TEST_CASE("latency_histogram")
+{
+    spio::latency_histogram h;
+    CHECK(h.count() == 0);
+    CHECK(h.percentile(50) == nanoseconds{0});
+
+    SUBCASE("exact small values")
+    {
+        for (int i = 1; i <= 10; ++i) {
+            h.record(nanoseconds{i});
+        }
+        CHECK(h.count() == 10);
+        CHECK(h.percentile(50) == nanoseconds{5});
+        CHECK(h.percentile(100) == nanoseconds{10});
+        CHECK(h.max() == nanoseconds{10});
+        CHECK(h.mean() == nanoseconds{5});
+    }
+
+    SUBCASE("relative error")
+    {
+        // 1 us to 1 ms
+        for (std::int64_t i = 1; i <= 1000; ++i) {
+            h.record(nanoseconds{i * 1000});
+        }
+        auto within = [](nanoseconds actual, std::int64_t expected) {
+            const auto diff = actual.count() - expected;
+            return (diff < 0 ? -diff : diff) * 32 <= expected;
+        };
+        CHECK(within(h.percentile(50), 500 * 1000));
+        CHECK(within(h.percentile(99), 990 * 1000));
+        CHECK(within(h.percentile(99.9), 999 * 1000));
+        CHECK(h.percentile(100) == nanoseconds{1000 * 1000});
+
+        auto s = h.summary();
+        CHECK(s.count == 1000);
+        CHECK(s.p50 == h.percentile(50));
+        CHECK(s.max == h.max());
+    }
+
+    SUBCASE("tail")
+    {
+        // Small enough to be recorded exactly
+        for (int i = 0; i < 999; ++i) {
+            h.record(nanoseconds{50});
+        }
+        h.record(std::chrono::seconds{1});
+        CHECK(h.percentile(99) == nanoseconds{50});
+        CHECK(h.percentile(99.9) == nanoseconds{50});
+        CHECK(h.percentile(100) == std::chrono::seconds{1});
+    }
+
+    SUBCASE("reset")
+    {
+        h.record(nanoseconds{100});
+        h.reset();
+        CHECK(h.count() == 0);
+        CHECK(h.max() == nanoseconds{0});
+    }
+}
+
+TEST_CASE("timed_device")
+{
+    spio::device_latencies l;
+    std::vector<spio::byte> buf;
+    spio::basic_timed_device<spio::vector_device> d(l,
+                                                    spio::vector_device(buf));
+    CHECK(d.is_open());
+
+    const char str[] = "Hello";
+    auto data = spio::as_bytes(spio::make_span(str, 5));
+    CHECK(d.write(data).value() == 5);
+    CHECK(d.write(data).value() == 5);
+    CHECK(buf.size() == 10);
+    CHECK(l[spio::device_op::write].count() == 2);
+    CHECK(l[spio::device_op::read].count() == 0);
+
+    // Latencies can be shared between devices
+    spio::basic_timed_device<spio::vector_source> src(
+        l, spio::vector_source(buf));
+    std::vector<spio::byte> read(5);
+    bool eof = false;
+    CHECK(src.read(spio::make_span(read), eof).value() == 5);
+    CHECK(l[spio::device_op::read].count() == 1);
+    CHECK(std::equal(read.begin(), read.end(), data.begin()));
+
+    // Operations the device doesn't support aren't available
+    using timed = spio::basic_timed_device<spio::vector_sink>;
+    CHECK(spio::is_writable<timed>::value);
+    CHECK(!spio::is_readable<timed>::value);
+    CHECK(!spio::is_random_access_writable<timed>::value);
+
+    l.reset();
+    CHECK(l[spio::device_op::write].count() == 0);
+}
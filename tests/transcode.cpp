@@ -0,0 +1,178 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+TEST_CASE("transcode output filter")
+{
+    // Long enough to go through the vectorized ASCII paths
+    const std::string utf8 =
+        "Hello world, this is plain ASCII! "
+        "Long enough for more than one AVX2 block. "
+        "\xc3\xa4\xc3\xb6 \xe2\x82\xac \xf0\x9f\x98\x80 end";
+    const std::u16string utf16 =
+        u"Hello world, this is plain ASCII! "
+        u"Long enough for more than one AVX2 block. "
+        u"äö € \U0001F600 end";
+    const std::u32string utf32 =
+        U"Hello world, this is plain ASCII! "
+        U"Long enough for more than one AVX2 block. "
+        U"äö € \U0001F600 end";
+
+    SUBCASE("utf8 to utf16")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf8_to_utf16_filter>();
+        auto buf = to_bytes(utf8);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf16));
+    }
+    SUBCASE("utf16 to utf8")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf16_to_utf8_filter>();
+        auto buf = to_bytes(utf16);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf8));
+    }
+    SUBCASE("utf8 to utf32")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf8_to_utf32_filter>();
+        auto buf = to_bytes(utf8);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf32));
+    }
+    SUBCASE("utf32 to utf16")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf32_to_utf16_filter>();
+        auto buf = to_bytes(utf32);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf16));
+    }
+    SUBCASE("utf16 to utf32")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf16_to_utf32_filter>();
+        auto buf = to_bytes(utf16);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf32));
+    }
+    SUBCASE("utf32 to utf8")
+    {
+        spio::sink_filter_chain chain;
+        chain.push<spio::utf32_to_utf8_filter>();
+        auto buf = to_bytes(utf32);
+        auto r = chain.write(buf);
+        CHECK(!r.has_error());
+        CHECK(buf == to_bytes(utf8));
+    }
+    SUBCASE("split sequence")
+    {
+        spio::utf8_to_utf16_filter filter;
+        auto all = to_bytes(utf8);
+        // Split in the middle of the 4-byte sequence
+        const auto split = static_cast<std::ptrdiff_t>(utf8.find('\xf0') + 2);
+        spio::byte_buffer first(all.begin(), all.begin() + split);
+        spio::byte_buffer second(all.begin() + split, all.end());
+
+        auto r = filter.write(first);
+        CHECK(!r.has_error());
+        CHECK(filter.has_pending());
+        r = filter.write(second);
+        CHECK(!r.has_error());
+        CHECK(!filter.has_pending());
+
+        first.insert(first.end(), second.begin(), second.end());
+        CHECK(first == to_bytes(utf16));
+    }
+    SUBCASE("byte by byte")
+    {
+        spio::utf16_to_utf8_filter filter;
+        const auto all = to_bytes(utf16);
+        spio::byte_buffer out;
+        for (auto b : all) {
+            spio::byte_buffer buf{b};
+            auto r = filter.write(buf);
+            CHECK(!r.has_error());
+            out.insert(out.end(), buf.begin(), buf.end());
+        }
+        CHECK(!filter.has_pending());
+        CHECK(out == to_bytes(utf8));
+    }
+    SUBCASE("invalid")
+    {
+        spio::utf8_to_utf16_filter filter;
+        spio::byte_buffer buf{spio::to_byte(0x61), spio::to_byte(0xff)};
+        auto r = filter.write(buf);
+        CHECK(r.has_error());
+    }
+}
+
+TEST_CASE("transcoding readable")
+{
+    std::string str = "Hello \xe2\x82\xac world \xf0\x9f\x98\x80!";
+    auto bytes = to_bytes(str);
+    std::vector<spio::byte> container(bytes.begin(), bytes.end());
+    spio::vector_source source(container);
+    spio::utf8_to_utf16_readable<spio::vector_source> readable(source, 8);
+
+    std::u16string result;
+    bool eof = false;
+    while (!eof) {
+        std::array<char16_t, 3> buf{};
+        auto r = readable.read(spio::as_writeable_bytes(spio::make_span(buf)),
+                               eof);
+        CHECK(!r.has_error());
+        CHECK(r.value() % 2 == 0);
+        result.append(buf.data(), static_cast<std::size_t>(r.value() / 2));
+    }
+    CHECK(result == u"Hello € world \U0001F600!");
+}
+
+TEST_CASE("transcoding readable small reads")
+{
+    // Every character needs a surrogate pair in UTF-16
+    std::string str = "\xf0\x9f\x98\x80\xf0\x9f\x98\x81";
+    auto bytes = to_bytes(str);
+    std::vector<spio::byte> container(bytes.begin(), bytes.end());
+    spio::vector_source source(container);
+    spio::utf8_to_utf16_readable<spio::vector_source> readable(source);
+
+    std::u16string result;
+    bool eof = false;
+    for (int i = 0; i < 8 && !eof; ++i) {
+        char16_t ch{};
+        auto r = readable.read(
+            spio::as_writeable_bytes(spio::make_span(&ch, 1)), eof);
+        CHECK(!r.has_error());
+        if (r.value() != 0) {
+            CHECK(r.value() == 2);
+            result.push_back(ch);
+        }
+    }
+    CHECK(eof);
+    CHECK(result == u"\U0001F600\U0001F601");
+}
@@ -0,0 +1,243 @@
+// Copyright 2017-2018 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of spio:
+//     https://github.com/eliaskosunen/spio
+
+#include <spio/spio.h>
+#include "doctest.h"
+#include "test_util.h"
+
+TEST_CASE("transfer buffered")
+{
+    using stream_type = spio::stream<spio::vector_device, spio::encoding<char>,
+                                     spio::memory_iostream_chain>;
+
+    auto data = make_data(100000);
+    std::vector<spio::byte> dest;
+    stream_type src(spio::vector_device(data), stream_type::input_base{},
+                    stream_type::output_base{}, stream_type::chain_type{});
+    src.source_storage() = stream_type::input_base::source_type(src.device());
+    stream_type dst(spio::vector_device(dest), stream_type::input_base{},
+                    stream_type::output_base{}, stream_type::chain_type{});
+
+    auto r = spio::transfer(src, dst, 1000);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 1000);
+    CHECK(!src.eof());
+
+    r = spio::transfer(src, dst);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 99000);
+    CHECK(src.eof());
+    CHECK(dest == data);
+}
+
+#if SPIO_POSIX
+
+using fd_stream = spio::stream<spio::fd_device, spio::encoding<char>,
+                               spio::memory_iostream_chain>;
+
+// The buffered source refers to the device inside the stream,
+// so the stream can't be moved
+static std::unique_ptr<fd_stream> make_fd_stream(spio::fd_device d)
+{
+    auto s = spio::make_unique<fd_stream>(d, fd_stream::input_base{},
+                                          fd_stream::output_base{},
+                                          fd_stream::chain_type{});
+    s->source_storage() = fd_stream::input_base::source_type(s->device());
+    return s;
+}
+
+static spio::fd_device make_temp_file(const std::vector<spio::byte>& data)
+{
+    char path[] = "/tmp/spio-transfer-XXXXXX";
+    auto fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::unlink(path);
+    spio::fd_device d(fd);
+    CHECK(!d.write(spio::make_span(data)).has_error());
+    ::lseek(fd, 0, SEEK_SET);
+    return d;
+}
+static std::vector<spio::byte> read_fd(int fd, std::size_t n)
+{
+    std::vector<spio::byte> buf(n);
+    std::size_t total = 0;
+    while (total < n) {
+        auto ret = ::pread(fd, buf.data() + total, n - total,
+                           static_cast<off_t>(total));
+        if (ret <= 0) {
+            break;
+        }
+        total += static_cast<std::size_t>(ret);
+    }
+    buf.resize(total);
+    return buf;
+}
+
+TEST_CASE("transfer file to file")
+{
+    auto data = make_data(1 << 20);
+    auto src = make_fd_stream(make_temp_file(data));
+    auto dst = make_fd_stream(make_temp_file({}));
+
+    // Buffered in src, so it has to be written before the rest
+    std::array<spio::byte, 10> head{};
+    CHECK(spio::read(*src, spio::make_span(head)).value() == 10);
+    CHECK(!dst->device().write(spio::make_span(head)).has_error());
+
+    auto r = spio::transfer(*src, *dst);
+    CHECK(!r.has_error());
+    CHECK(r.value() == static_cast<std::ptrdiff_t>(data.size() - 10));
+    CHECK(src->eof());
+    CHECK(read_fd(dst->device().handle(), data.size() + 1) == data);
+
+    CHECK(src->device().close().has_value());
+    CHECK(dst->device().close().has_value());
+}
+
+TEST_CASE("transfer to a buffered stream")
+{
+    auto data = make_data(1 << 20);
+    auto src = make_fd_stream(make_temp_file(data));
+    auto dst = make_fd_stream(make_temp_file({}));
+    dst->sink_storage() = fd_stream::output_base::sink_type(
+        dst->device(), spio::buffer_mode::full);
+
+    // Both end up in the sink of dst before the rest is copied
+    std::array<spio::byte, 10> head{};
+    CHECK(spio::read(*src, spio::make_span(head)).value() == 10);
+    CHECK(!spio::write(*dst, spio::make_span(head)).has_error());
+    CHECK(dst->sink().in_use() == 10);
+
+    auto r = spio::transfer(*src, *dst);
+    CHECK(!r.has_error());
+    CHECK(r.value() == static_cast<std::ptrdiff_t>(data.size() - 10));
+    CHECK(dst->sink().in_use() == 0);
+    CHECK(read_fd(dst->device().handle(), data.size() + 1) == data);
+
+    CHECK(src->device().close().has_value());
+    CHECK(dst->device().close().has_value());
+}
+
+TEST_CASE("transfer between file devices")
+{
+    using file_stream =
+        spio::stream<spio::fd_file_device, spio::encoding<char>,
+                     spio::memory_iostream_chain>;
+    auto data = make_data(2000);
+    file_stream src(spio::fd_file_device(make_temp_file(data).handle()),
+                    file_stream::input_base{}, file_stream::output_base{},
+                    file_stream::chain_type{});
+    file_stream dst(spio::fd_file_device(make_temp_file({}).handle()),
+                    file_stream::input_base{}, file_stream::output_base{},
+                    file_stream::chain_type{});
+    // Both devices know their offset before the kernel moves it
+    CHECK(*src.device().seek(0) == 0);
+    CHECK(*dst.device().seek(0) == 0);
+
+    auto r = spio::transfer(src, dst, 1000);
+    CHECK(!r.has_error());
+    CHECK(r.value() == 1000);
+    CHECK(*src.device().seek(0, spio::seekdir::cur) == 1000);
+    CHECK(*dst.device().seek(0, spio::seekdir::cur) == 1000);
+
+    const auto tail = to_span("tail");
+    CHECK(dst.device().write(tail).value() == 4);
+    auto expected = std::vector<spio::byte>(data.begin(), data.begin() + 1000);
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    CHECK(read_fd(dst.device().handle(), 2000) == expected);
+
+    CHECK(src.device().close().has_value());
+    CHECK(dst.device().close().has_value());
+}
+
+#ifdef __linux__
+
+TEST_CASE("transfer through pipes and sockets")
+{
+    auto data = make_data(50000);
+
+    // File to pipe (sendfile)
+    auto file = make_fd_stream(make_temp_file(data));
+    auto p = spio::make_pipe();
+    REQUIRE(p.has_value());
+    auto pipe_out = make_fd_stream(p->second);
+    auto r = spio::transfer(*file, *pipe_out);
+    CHECK(!r.has_error());
+    CHECK(r.value() == static_cast<std::ptrdiff_t>(data.size()));
+    CHECK(pipe_out->device().close().has_value());
+
+    // Pipe to socket (splice)
+    auto s = spio::make_socket_pair();
+    REQUIRE(s.has_value());
+    auto pipe_in = make_fd_stream(p->first);
+    auto sock_out = make_fd_stream(s->first);
+    r = spio::transfer(*pipe_in, *sock_out);
+    CHECK(!r.has_error());
+    CHECK(r.value() == static_cast<std::ptrdiff_t>(data.size()));
+    CHECK(pipe_in->eof());
+    CHECK(sock_out->device().close().has_value());
+
+    // Socket to socket (splice through a pipe)
+    auto s2 = spio::make_socket_pair();
+    REQUIRE(s2.has_value());
+    auto sock_in = make_fd_stream(s->second);
+    auto sock_out2 = make_fd_stream(s2->first);
+    r = spio::transfer(*sock_in, *sock_out2);
+    CHECK(!r.has_error());
+    CHECK(r.value() == static_cast<std::ptrdiff_t>(data.size()));
+    CHECK(sock_in->eof());
+
+    std::vector<spio::byte> received(data.size());
+    bool eof = false;
+    auto n = spio::read_all(s2->second, spio::make_span(received), eof);
+    CHECK(n.value() == static_cast<std::ptrdiff_t>(data.size()));
+    CHECK(received == data);
+
+    CHECK(file->device().close().has_value());
+    CHECK(sock_in->device().close().has_value());
+    CHECK(sock_out2->device().close().has_value());
+    CHECK(s2->second.close().has_value());
+}
+
+TEST_CASE("fd_transfer method")
+{
+    auto file = make_temp_file({});
+    auto p = spio::make_pipe();
+    auto s = spio::make_socket_pair();
+    REQUIRE(p.has_value());
+    REQUIRE(s.has_value());
+
+    using method = spio::detail::fd_transfer::method;
+    auto pick = [](const spio::fd_device& a, const spio::fd_device& b) {
+        return spio::detail::fd_transfer(a.handle(), b.handle())
+            .current_method();
+    };
+    CHECK(pick(file, file) == method::copy_file_range);
+    CHECK(pick(file, s->first) == method::sendfile);
+    CHECK(pick(p->first, s->first) == method::splice);
+    CHECK(pick(s->first, s->second) == method::splice_pipe);
+
+    CHECK(file.close().has_value());
+    CHECK(p->first.close().has_value());
+    CHECK(p->second.close().has_value());
+    CHECK(s->first.close().has_value());
+    CHECK(s->second.close().has_value());
+}
+
+#endif
+
+#endif